@@ -173,6 +173,12 @@ typedef enum libvlc_media_parse_flag_t
      * when the input is asking for credentials.
      */
     libvlc_media_do_interact    = 0x08,
+    /**
+     * Decode the whole audio track to measure its loudness (EBU R 128), and
+     * store it as ReplayGain meta data, unless the media already has some.
+     * This can take a while: the media is decoded as fast as possible.
+     */
+    libvlc_media_parse_loudness = 0x10,
 } libvlc_media_parse_flag_t;
 
 /**
@@ -520,6 +526,26 @@ LIBVLC_API libvlc_state_t libvlc_media_get_state(
 LIBVLC_API bool libvlc_media_get_stats(libvlc_media_t *p_md,
                                        libvlc_media_stats_t *p_stats);
 
+/**
+ * Get the current rendering statistics of the video output of the media
+ *
+ * These are not part of libvlc_media_stats_t, which is allocated by the
+ * caller and whose layout cannot change.
+ *
+ * \param p_md: media descriptor object
+ * \param pi_render_time: average time spent rendering a picture,
+ *                        in microseconds [OUT]
+ * \param pi_display_slack: average margin left before the display deadline
+ *                          of a picture, in microseconds, negative when late
+ *                          [OUT]
+ * \retval true statistics are available
+ * \retval false otherwise
+ * \version LibVLC 4.0.0 and later.
+ */
+LIBVLC_API bool libvlc_media_get_render_stats(libvlc_media_t *p_md,
+                                              int64_t *pi_render_time,
+                                              int64_t *pi_display_slack);
+
 /* The following method uses libvlc_media_list_t, however, media_list usage is optionnal
  * and this is here for convenience */
 #define VLC_FORWARD_DECLARE_OBJECT(a) struct a
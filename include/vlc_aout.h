@@ -397,6 +397,23 @@ VLC_API char *aout_DeviceGet (audio_output_t *);
 VLC_API int aout_DeviceSet (audio_output_t *, const char *);
 VLC_API int aout_DevicesList (audio_output_t *, char ***, char ***);
 
+/**
+ * Report the time when a sample will be played.
+ *
+ * This is an alternative to audio_output::time_get for plugins that render
+ * from a (real-time) callback. It does not lock nor block, so it can be called
+ * from such a callback; the report is applied on the next play.
+ * It must not be called from several threads concurrently.
+ *
+ * \param system_ts system time when the sample will be played
+ * \param pts timestamp of the sample
+ */
+static inline void aout_TimingReport(audio_output_t *aout, vlc_tick_t system_ts,
+                                     vlc_tick_t pts)
+{
+    aout->events->timing_report(aout, system_ts, pts);
+}
+
 /**
  * Report change of configured audio volume to the core and UI.
  */
@@ -231,6 +231,36 @@ static inline block_t *block_Duplicate( const block_t *p_block )
     return p_dup;
 }
 
+/**
+ * Shares a block.
+ *
+ * Creates a block with the same properties and payload as another one,
+ * without copying the payload. The payload is reference-counted, and freed
+ * along with the last block referring to it. This is much cheaper than
+ * block_Duplicate() to hand the same data over to several consumers.
+ *
+ * The payload of shared blocks is read-only: block_TryRealloc() and
+ * block_Realloc() copy it rather than expand it in place (except that one
+ * of the blocks may prepend data in the spare room in front of it), and it
+ * must not be written to. Use block_Unshare() to get a writeable block.
+ *
+ * @param pp_block pointer to the block to share; if the block was not shared
+ * yet, it is replaced by an equivalent shared block, unless memory is short.
+ * The block must not be part of a chain.
+ * @return the new block on success, NULL on error.
+ */
+VLC_API block_t *block_Share(block_t **pp_block) VLC_USED;
+
+/**
+ * Gets a writeable block.
+ *
+ * @return the block itself if its payload is not shared, a block owning the
+ * payload without copying it if no other block refers to it anymore, or a
+ * copy of the block otherwise (the block is then released).
+ * NULL on memory error (the block is released).
+ */
+VLC_API block_t *block_Unshare(block_t *) VLC_USED;
+
 /**
  * Wraps heap in a block.
  *
@@ -49,6 +49,7 @@ struct filter_video_callbacks
 
 struct filter_audio_callbacks
 {
+    block_t *(*buffer_new)(filter_t *, size_t);
     struct
     {
         void (*on_changed)(filter_t *,
@@ -270,6 +271,25 @@ static inline picture_t *filter_NewPicture( filter_t *p_filter )
     return pic;
 }
 
+/**
+ * This function will return a new audio buffer usable by p_filter as an
+ * output buffer. You have to release it using block_Release or by returning
+ * it to the caller as a ops->filter_audio return value.
+ * Provided for convenience.
+ *
+ * \param p_filter filter_t object
+ * \param i_size buffer size in bytes
+ * \return new block on success or NULL on failure
+ */
+static inline block_t *filter_NewAudioBuffer( filter_t *p_filter,
+                                              size_t i_size )
+{
+    if ( p_filter->owner.audio != NULL
+      && p_filter->owner.audio->buffer_new != NULL )
+        return p_filter->owner.audio->buffer_new( p_filter, i_size );
+    return block_Alloc( i_size );
+}
+
 /**
  * Flush a filter
  *
@@ -469,6 +469,7 @@ typedef enum input_item_meta_request_option_t
     META_REQUEST_OPTION_FETCH_NETWORK = 0x08,
     META_REQUEST_OPTION_FETCH_ANY     = 0x0C,
     META_REQUEST_OPTION_DO_INTERACT   = 0x10,
+    META_REQUEST_OPTION_PARSE_LOUDNESS = 0x20,
 } input_item_meta_request_option_t;
 
 /* status of the on_preparse_ended() callback */
@@ -525,6 +526,8 @@ struct input_stats_t
     int64_t i_displayed_pictures;
     int64_t i_late_pictures;
     int64_t i_lost_pictures;
+    int64_t i_render_time; /**< Average rendering duration (us) */
+    int64_t i_display_slack; /**< Average margin before display (us) */
 
     /* Aout */
     int64_t i_played_abuffers;
@@ -813,6 +813,31 @@ bool libvlc_media_get_stats(libvlc_media_t *p_md,
     return true;
 }
 
+bool libvlc_media_get_render_stats(libvlc_media_t *p_md,
+                                   int64_t *pi_render_time,
+                                   int64_t *pi_display_slack)
+{
+    input_item_t *item = p_md->p_input_item;
+
+    if( !p_md->p_input_item )
+        return false;
+
+    vlc_mutex_lock( &item->lock );
+
+    input_stats_t *p_itm_stats = p_md->p_input_item->p_stats;
+    if( p_itm_stats == NULL )
+    {
+        vlc_mutex_unlock( &item->lock );
+        return false;
+    }
+
+    *pi_render_time = p_itm_stats->i_render_time;
+    *pi_display_slack = p_itm_stats->i_display_slack;
+
+    vlc_mutex_unlock( &item->lock );
+    return true;
+}
+
 // Get event manager from a media descriptor object
 libvlc_event_manager_t *
 libvlc_media_event_manager( libvlc_media_t * p_md )
@@ -875,6 +900,8 @@ static int media_parse(libvlc_media_t *media, bool b_async,
             parse_scope |= META_REQUEST_OPTION_FETCH_NETWORK;
         if (parse_flag & libvlc_media_do_interact)
             parse_scope |= META_REQUEST_OPTION_DO_INTERACT;
+        if (parse_flag & libvlc_media_parse_loudness)
+            parse_scope |= META_REQUEST_OPTION_PARSE_LOUDNESS;
 
         /* Note: we cannot keep parsed_lock when calling libvlc_MetadataRequest
          * because it might also be used to submit the state synchronously
@@ -57,14 +57,53 @@
 
 #define SOUT_CFG_PREFIX "sout-file-"
 
+typedef struct
+{
+    int fd;
+
+    /* Write-behind, only for regular files */
+    bool async;
+    vlc_thread_t thread;
+    vlc_mutex_t lock;
+    vlc_cond_t wait_data;  /* signaled when there is something to write */
+    vlc_cond_t wait_space; /* signaled when something has been written */
+    block_t *queue;
+    block_t **queue_last;
+    size_t queue_size;     /* including the chain being written */
+    size_t queue_max;
+    bool writing;
+    bool error;
+    bool closing;
+
+    /* Owned by the writer thread, unless the queue is drained */
+    off_t offset;
+    off_t size;
+    off_t allocated;
+    size_t prealloc;
+    uint64_t unsynced;
+    uint64_t sync_interval;
+#ifdef O_DIRECT
+    uint8_t *direct_buf;   /* O_DIRECT needs aligned buffers and offsets */
+    size_t direct_len;
+    size_t direct_align;
+    size_t direct_size;
+#endif
+} sout_access_out_sys_t;
+
+static void Drain( sout_access_out_t * );
+
 /*****************************************************************************
  * Read: standard read on a file descriptor.
  *****************************************************************************/
 static ssize_t Read( sout_access_out_t *p_access, block_t *p_buffer )
 {
-    int *fdp = p_access->p_sys, fd = *fdp;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    int fd = p_sys->fd;
     ssize_t val;
 
+    if (p_sys->async)
+        Drain(p_access);
+
     do
         val = read(fd, p_buffer->p_buffer, p_buffer->i_buffer);
     while (val == -1 && errno == EINTR);
@@ -76,7 +115,8 @@ static ssize_t Read( sout_access_out_t *p_access, block_t *p_buffer )
  *****************************************************************************/
 static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 {
-    int *fdp = p_access->p_sys, fd = *fdp;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    int fd = p_sys->fd;
     size_t i_write = 0;
 
     while( p_buffer )
@@ -109,7 +149,8 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
 
 static ssize_t WritePipe(sout_access_out_t *access, block_t *block)
 {
-    int *fdp = access->p_sys, fd = *fdp;
+    sout_access_out_sys_t *sys = access->p_sys;
+    int fd = sys->fd;
     ssize_t total = 0;
 
     while (block != NULL)
@@ -148,7 +189,8 @@ static ssize_t WritePipe(sout_access_out_t *access, block_t *block)
 #ifdef S_ISSOCK
 static ssize_t Send(sout_access_out_t *access, block_t *block)
 {
-    int *fdp = access->p_sys, fd = *fdp;
+    sout_access_out_sys_t *sys = access->p_sys;
+    int fd = sys->fd;
     size_t total = 0;
 
     while (block != NULL)
@@ -182,14 +224,310 @@ static ssize_t Send(sout_access_out_t *access, block_t *block)
 }
 #endif
 
+/*****************************************************************************
+ * Write-behind: the blocks are queued for a thread writing them, so that a
+ * slow disk does not stall the stream output.
+ *****************************************************************************/
+static void Preallocate(sout_access_out_t *access, size_t len)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+    sout_access_out_sys_t *sys = access->p_sys;
+
+    if (sys->prealloc == 0 || sys->offset + (off_t)len <= sys->allocated)
+        return;
+
+    /* Allocate whole extents ahead, to limit fragmentation when many
+     * files grow at the same time, without changing the file size */
+    off_t end = sys->offset + len + sys->prealloc;
+    end -= end % sys->prealloc;
+    if (sys->allocated < sys->offset)
+        sys->allocated = sys->offset;
+
+    if (fallocate(sys->fd, FALLOC_FL_KEEP_SIZE, sys->allocated,
+                  end - sys->allocated))
+    {
+        msg_Dbg(access, "cannot preallocate: %s", vlc_strerror_c(errno));
+        sys->prealloc = 0;
+        return;
+    }
+    sys->allocated = end;
+#else
+    VLC_UNUSED(access); VLC_UNUSED(len);
+#endif
+}
+
+#ifdef O_DIRECT
+static ssize_t WriteDirectBuffer(sout_access_out_t *access, size_t len)
+{
+    sout_access_out_sys_t *sys = access->p_sys;
+    size_t done = 0;
+
+    while (done < len)
+    {
+        ssize_t val = write(sys->fd, sys->direct_buf + done, len - done);
+        if (val <= 0)
+        {
+            if (errno == EINTR)
+                continue;
+            msg_Err(access, "cannot write: %s", vlc_strerror_c(errno));
+            return -1;
+        }
+        done += val;
+    }
+    return done;
+}
+
+static ssize_t WriteDirect(sout_access_out_t *access, block_t *block)
+{
+    sout_access_out_sys_t *sys = access->p_sys;
+    ssize_t total = 0;
+
+    while (block != NULL)
+    {
+        size_t copy = __MIN(block->i_buffer, sys->direct_size - sys->direct_len);
+
+        memcpy(sys->direct_buf + sys->direct_len, block->p_buffer, copy);
+        sys->direct_len += copy;
+        block->p_buffer += copy;
+        block->i_buffer -= copy;
+        total += copy;
+
+        if (sys->direct_len == sys->direct_size)
+        {
+            if (WriteDirectBuffer(access, sys->direct_size) < 0)
+            {
+                block_ChainRelease(block);
+                return -1;
+            }
+            sys->direct_len = 0;
+        }
+
+        if (block->i_buffer == 0)
+        {
+            block_t *next = block->p_next;
+            block_Release(block);
+            block = next;
+        }
+    }
+    return total;
+}
+
+/* Writes the last partial buffer, and leaves the direct I/O mode, as the file
+ * position may not be aligned anymore */
+static int LeaveDirect(sout_access_out_t *access)
+{
+    sout_access_out_sys_t *sys = access->p_sys;
+    int ret = 0;
+
+    if (sys->direct_len > 0)
+    {
+        size_t len = sys->direct_len + sys->direct_align - 1;
+        len -= len % sys->direct_align;
+        memset(sys->direct_buf + sys->direct_len, 0, len - sys->direct_len);
+
+        if (WriteDirectBuffer(access, len) < 0
+         || ftruncate(sys->fd, sys->size)
+         || lseek(sys->fd, sys->offset, SEEK_SET) == -1)
+            ret = -1;
+        sys->direct_len = 0;
+    }
+
+    fcntl(sys->fd, F_SETFL, fcntl(sys->fd, F_GETFL) & ~O_DIRECT);
+    aligned_free(sys->direct_buf);
+    sys->direct_buf = NULL;
+    return ret;
+}
+#endif
+
+static void *WriteThread(void *data)
+{
+    sout_access_out_t *access = data;
+    sout_access_out_sys_t *sys = access->p_sys;
+
+    vlc_mutex_lock(&sys->lock);
+    for (;;)
+    {
+        while (sys->queue == NULL && !sys->closing)
+            vlc_cond_wait(&sys->wait_data, &sys->lock);
+        if (sys->queue == NULL)
+            break;
+
+        block_t *chain = sys->queue;
+        sys->queue = NULL;
+        sys->queue_last = &sys->queue;
+        sys->writing = true;
+        bool error = sys->error;
+        vlc_mutex_unlock(&sys->lock);
+
+        size_t len;
+        block_ChainProperties(chain, NULL, &len, NULL);
+
+        ssize_t val = -1;
+        if (!error)
+        {
+            Preallocate(access, len);
+#ifdef O_DIRECT
+            if (sys->direct_buf != NULL)
+                val = WriteDirect(access, chain);
+            else
+#endif
+                val = Write(access, chain);
+        }
+        else
+            block_ChainRelease(chain);
+
+        if (val >= 0)
+        {
+            sys->offset += len;
+            if (sys->offset > sys->size)
+                sys->size = sys->offset;
+
+            sys->unsynced += len;
+            if (sys->sync_interval > 0 && sys->unsynced >= sys->sync_interval)
+            {
+                fdatasync(sys->fd);
+                sys->unsynced = 0;
+            }
+        }
+
+        vlc_mutex_lock(&sys->lock);
+        sys->writing = false;
+        sys->queue_size -= len;
+        if (val < 0)
+            sys->error = true;
+        vlc_cond_broadcast(&sys->wait_space);
+    }
+    vlc_mutex_unlock(&sys->lock);
+    return NULL;
+}
+
+static ssize_t WriteAsync(sout_access_out_t *access, block_t *block)
+{
+    sout_access_out_sys_t *sys = access->p_sys;
+    size_t len;
+
+    block_ChainProperties(block, NULL, &len, NULL);
+
+    vlc_mutex_lock(&sys->lock);
+    /* Bounded queue: the stream output only waits if the disk cannot
+     * keep up in the long run */
+    while (sys->queue_size > 0 && sys->queue_size + len > sys->queue_max
+        && !sys->error)
+        vlc_cond_wait(&sys->wait_space, &sys->lock);
+
+    if (sys->error)
+    {
+        vlc_mutex_unlock(&sys->lock);
+        block_ChainRelease(block);
+        return -1;
+    }
+
+    block_ChainLastAppend(&sys->queue_last, block);
+    sys->queue_size += len;
+    vlc_cond_signal(&sys->wait_data);
+    vlc_mutex_unlock(&sys->lock);
+    return len;
+}
+
+/* Waits until the queue has been written, so that the caller can use the file
+ * descriptor */
+static void Drain(sout_access_out_t *access)
+{
+    sout_access_out_sys_t *sys = access->p_sys;
+
+    vlc_mutex_lock(&sys->lock);
+    while ((sys->queue != NULL || sys->writing) && !sys->error)
+        vlc_cond_wait(&sys->wait_space, &sys->lock);
+    vlc_mutex_unlock(&sys->lock);
+
+#ifdef O_DIRECT
+    if (sys->direct_buf != NULL && LeaveDirect(access))
+    {
+        msg_Err(access, "cannot write: %s", vlc_strerror_c(errno));
+        vlc_mutex_lock(&sys->lock);
+        sys->error = true;
+        vlc_mutex_unlock(&sys->lock);
+    }
+#endif
+}
+
+static void SetupAsync(sout_access_out_t *access)
+{
+    sout_access_out_sys_t *sys = access->p_sys;
+    struct stat st;
+
+    sys->queue = NULL;
+    sys->queue_last = &sys->queue;
+    sys->queue_size = 0;
+    sys->queue_max = var_InheritInteger(access, SOUT_CFG_PREFIX"async-size")
+                   << 20;
+    sys->writing = sys->error = sys->closing = false;
+    vlc_mutex_init(&sys->lock);
+    vlc_cond_init(&sys->wait_data);
+    vlc_cond_init(&sys->wait_space);
+
+    sys->offset = lseek(sys->fd, 0, SEEK_CUR);
+    if (sys->offset == -1)
+        sys->offset = 0;
+    sys->size = sys->allocated = sys->offset;
+    sys->prealloc = var_InheritInteger(access, SOUT_CFG_PREFIX"prealloc") << 20;
+    sys->unsynced = 0;
+    sys->sync_interval =
+        (uint64_t)var_InheritInteger(access, SOUT_CFG_PREFIX"datasync") << 20;
+
+#ifdef O_DIRECT
+    sys->direct_buf = NULL;
+    sys->direct_len = 0;
+    if (var_InheritBool(access, SOUT_CFG_PREFIX"direct")
+     && fstat(sys->fd, &st) == 0)
+    {
+        sys->direct_align = 4096;
+        if (st.st_blksize > 0 && (st.st_blksize & (st.st_blksize - 1)) == 0)
+            sys->direct_align = __MAX((size_t)st.st_blksize, 512);
+        sys->direct_size = 1 << 20;
+
+        if (sys->offset % sys->direct_align)
+            msg_Warn(access, "cannot use direct I/O from an unaligned offset");
+        else if (fcntl(sys->fd, F_SETFL, fcntl(sys->fd, F_GETFL) | O_DIRECT))
+            msg_Warn(access, "cannot use direct I/O: %s",
+                     vlc_strerror_c(errno));
+        else
+        {
+            sys->direct_buf = aligned_alloc(sys->direct_align,
+                                            sys->direct_size);
+            if (unlikely(sys->direct_buf == NULL))
+                fcntl(sys->fd, F_SETFL, fcntl(sys->fd, F_GETFL) & ~O_DIRECT);
+        }
+    }
+#else
+    VLC_UNUSED(st);
+#endif
+
+    sys->async = !vlc_clone(&sys->thread, WriteThread, access,
+                            VLC_THREAD_PRIORITY_OUTPUT);
+    if (!sys->async)
+    {
+        msg_Warn(access, "cannot start the write-behind thread");
+#ifdef O_DIRECT
+        if (sys->direct_buf != NULL)
+            LeaveDirect(access);
+#endif
+    }
+}
+
 /*****************************************************************************
  * Seek: seek to a specific location in a file
  *****************************************************************************/
 static int Seek( sout_access_out_t *p_access, off_t i_pos )
 {
-    int *fdp = p_access->p_sys, fd = *fdp;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
 
-    return lseek(fd, i_pos, SEEK_SET);
+    if (p_sys->async)
+    {
+        Drain(p_access);
+        p_sys->offset = i_pos;
+    }
+    return lseek(p_sys->fd, i_pos, SEEK_SET);
 }
 
 static int Control( sout_access_out_t *p_access, int i_query, va_list args )
@@ -223,6 +561,13 @@ static const char *const ppsz_sout_options[] = {
 #ifdef O_SYNC
     "sync",
 #endif
+    "async",
+    "async-size",
+    "prealloc",
+#ifdef O_DIRECT
+    "direct",
+#endif
+    "datasync",
     NULL
 };
 
@@ -233,9 +578,9 @@ static int Open( vlc_object_t *p_this )
 {
     sout_access_out_t   *p_access = (sout_access_out_t*)p_this;
     int fd;
-    int *fdp = vlc_obj_malloc(p_this, sizeof (*fdp));
+    sout_access_out_sys_t *p_sys = vlc_obj_malloc(p_this, sizeof (*p_sys));
 
-    if (unlikely(fdp == NULL))
+    if (unlikely(p_sys == NULL))
         return VLC_ENOMEM;
 
     config_ChainParse( p_access, SOUT_CFG_PREFIX, ppsz_sout_options, p_access->p_cfg );
@@ -320,8 +665,9 @@ static int Open( vlc_object_t *p_this )
             return VLC_EGENERIC;
     }
 
-    *fdp = fd;
-    p_access->p_sys = fdp;
+    p_sys->fd = fd;
+    p_sys->async = false;
+    p_access->p_sys = p_sys;
 
     struct stat st;
 
@@ -357,6 +703,13 @@ static int Open( vlc_object_t *p_this )
     if (append)
         lseek (fd, 0, SEEK_END);
 
+    if (S_ISREG(st.st_mode) && var_GetBool(p_access, SOUT_CFG_PREFIX"async"))
+    {
+        SetupAsync(p_access);
+        if (p_sys->async)
+            p_access->pf_write = WriteAsync;
+    }
+
     return VLC_SUCCESS;
 }
 
@@ -366,7 +719,25 @@ static int Open( vlc_object_t *p_this )
 static void Close( vlc_object_t * p_this )
 {
     sout_access_out_t *p_access = (sout_access_out_t*)p_this;
-    int *fdp = p_access->p_sys, fd = *fdp;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    int fd = p_sys->fd;
+
+    if (p_sys->async)
+    {
+        Drain(p_access);
+
+        vlc_mutex_lock(&p_sys->lock);
+        p_sys->closing = true;
+        vlc_cond_signal(&p_sys->wait_data);
+        vlc_mutex_unlock(&p_sys->lock);
+        vlc_join(p_sys->thread, NULL);
+
+        if (p_sys->queue != NULL)
+            block_ChainRelease(p_sys->queue);
+        /* Give back the preallocated space past the end of the file */
+        if (p_sys->allocated > p_sys->size && ftruncate(fd, p_sys->size))
+            msg_Warn(p_access, "cannot truncate: %s", vlc_strerror_c(errno));
+    }
 
     vlc_close(fd);
     msg_Dbg( p_access, "file access output closed" );
@@ -383,6 +754,21 @@ static void Close( vlc_object_t * p_this )
     "on the file path")
 #define SYNC_TEXT N_("Synchronous writing")
 #define SYNC_LONGTEXT N_( "Open the file with synchronous writing.")
+#define ASYNC_TEXT N_("Write-behind")
+#define ASYNC_LONGTEXT N_( "Write the file from a separate thread, so that " \
+    "a slow disk does not stall the stream output.")
+#define ASYNC_SIZE_TEXT N_("Write-behind queue size (MiB)")
+#define ASYNC_SIZE_LONGTEXT N_( "Amount of data waiting to be written " \
+    "before the stream output has to wait for the disk.")
+#define PREALLOC_TEXT N_("Preallocation extent (MiB)")
+#define PREALLOC_LONGTEXT N_( "Allocate the disk space of the file ahead " \
+    "in extents of that size, in write-behind mode. 0 disables this.")
+#define DIRECT_TEXT N_("Direct I/O")
+#define DIRECT_LONGTEXT N_( "Bypass the operating system cache, in " \
+    "write-behind mode.")
+#define DATASYNC_TEXT N_("Data sync interval (MiB)")
+#define DATASYNC_LONGTEXT N_( "Flush the written data to the disk every " \
+    "that many MiB, in write-behind mode. 0 disables this.")
 
 vlc_module_begin ()
     set_description( N_("File stream output") )
@@ -401,5 +787,20 @@ vlc_module_begin ()
     add_bool( SOUT_CFG_PREFIX "sync", false, SYNC_TEXT,SYNC_LONGTEXT,
               false )
 #endif
+    add_bool( SOUT_CFG_PREFIX "async", false, ASYNC_TEXT, ASYNC_LONGTEXT,
+              true )
+    add_integer( SOUT_CFG_PREFIX "async-size", 32, ASYNC_SIZE_TEXT,
+                 ASYNC_SIZE_LONGTEXT, true )
+        change_integer_range( 1, 1024 )
+    add_integer( SOUT_CFG_PREFIX "prealloc", 64, PREALLOC_TEXT,
+                 PREALLOC_LONGTEXT, true )
+        change_integer_range( 0, 1024 )
+#ifdef O_DIRECT
+    add_bool( SOUT_CFG_PREFIX "direct", false, DIRECT_TEXT, DIRECT_LONGTEXT,
+              true )
+#endif
+    add_integer( SOUT_CFG_PREFIX "datasync", 0, DATASYNC_TEXT,
+                 DATASYNC_LONGTEXT, true )
+        change_integer_range( 0, 65536 )
     set_callbacks( Open, Close )
 vlc_module_end ()
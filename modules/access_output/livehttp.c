@@ -43,6 +43,8 @@
 #include <vlc_fs.h>
 #include <vlc_strings.h>
 #include <vlc_charset.h>
+#include <vlc_httpd.h>
+#include <vlc_memstream.h>
 
 #include <gcrypt.h>
 #include <vlc_gcrypt.h>
@@ -57,6 +59,9 @@
 
 #define MAX_RENAME_RETRIES        10
 
+/* Data waiting for the output thread, before Write() blocks */
+#define OUTPUT_QUEUE_MAX          (32 << 20)
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -105,6 +110,26 @@ static void Close( vlc_object_t * );
 #define INTITIAL_SEG_TEXT N_("Number of first segment")
 #define INITIAL_SEG_LONGTEXT N_("The number of the first segment generated")
 
+#define INIT_TEXT N_("Initialization segment name")
+#define INIT_LONGTEXT N_("Name replacing the #'s of the segment file name "\
+                         "and URL for the initialization segment of "\
+                         "fragmented MP4 streams")
+
+#define MPD_TEXT N_("DASH manifest file")
+#define MPD_LONGTEXT N_("Path to the DASH manifest to create along with "\
+                        "the index, for fragmented MP4 streams")
+
+#define CHUNKED_TEXT N_("Chunked output")
+#define CHUNKED_LONGTEXT N_("Write each keyframe interval, or each fragment "\
+                            "of fragmented MP4 streams, to the current segment "\
+                            "as soon as it is complete, for low latency delivery")
+
+#define HTTPD_TEXT N_("Serve over HTTP")
+#define HTTPD_LONGTEXT N_("Keep the segments in memory and serve them, " \
+    "along with the index and the DASH manifest, with the embedded HTTP " \
+    "server (see --http-host and --http-port). The paths are then those of " \
+    "the URLs, and only the segments of the index are kept.")
+
 vlc_module_begin ()
     set_description( N_("HTTP Live streaming output") )
     set_shortname( N_("LiveHTTP" ))
@@ -135,6 +160,14 @@ vlc_module_begin ()
                  KEYFILE_TEXT, KEYFILE_LONGTEXT)
     add_loadfile(SOUT_CFG_PREFIX "key-loadfile", NULL,
                  KEYLOADFILE_TEXT, KEYLOADFILE_LONGTEXT)
+    add_string( SOUT_CFG_PREFIX "init", "init",
+                INIT_TEXT, INIT_LONGTEXT, true )
+    add_string( SOUT_CFG_PREFIX "mpd", NULL,
+                MPD_TEXT, MPD_LONGTEXT, false )
+    add_bool( SOUT_CFG_PREFIX "chunked", false,
+              CHUNKED_TEXT, CHUNKED_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "httpd", false,
+              HTTPD_TEXT, HTTPD_LONGTEXT, true )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -156,21 +189,57 @@ static const char *const ppsz_sout_options[] = {
     "key-loadfile",
     "generate-iv",
     "initial-segment-number",
+    "init",
+    "mpd",
+    "chunked",
+    "httpd",
     NULL
 };
 
 static ssize_t Write( sout_access_out_t *, block_t * );
 static int Control( sout_access_out_t *, int, va_list );
 
+/* A file served from memory */
+typedef struct
+{
+    httpd_url_t *p_url;
+    vlc_mutex_t *p_lock;
+    block_t *p_data; /* NULL until it is available */
+    const char *psz_mime;
+    unsigned i_max_age; /* 0 if it must not be cached */
+} served_file_t;
+
+typedef struct output_op
+{
+    struct output_op *p_next;
+    enum
+    {
+        OUTPUT_INIT,
+        OUTPUT_OPEN,
+        OUTPUT_WRITE,
+        OUTPUT_CLOSE,
+    } i_type;
+    block_t *p_data;
+    size_t i_size;
+    vlc_tick_t i_length;
+    vlc_tick_t i_max_chunk_length;
+    bool b_isend;
+} output_op_t;
+
 typedef struct output_segment
 {
-    char *psz_filename;
+    char *psz_filename; /* or its URL path when served over HTTP */
     char *psz_uri;
     char *psz_key_uri;
     char *psz_duration;
     vlc_tick_t segment_length;
+    vlc_tick_t segment_start;
+    uint64_t i_size;
     uint32_t i_segment_number;
     uint8_t aes_ivs[16];
+    block_t *p_data;
+    block_t **pp_data_last;
+    served_file_t *p_served;
 } output_segment_t;
 
 typedef struct
@@ -179,9 +248,16 @@ typedef struct
     char *psz_indexPath;
     char *psz_indexUrl;
     char *psz_keyfile;
+    char *psz_initName;
+    char *psz_initUri;
+    char *psz_mpdPath;
+    const char *psz_mimeType;
+    time_t i_availability_start;
     vlc_tick_t i_keyfile_modification;
     vlc_tick_t segment_max_length;
     vlc_tick_t current_segment_length;
+    vlc_tick_t segments_length;
+    vlc_tick_t max_chunk_length;
     uint32_t i_segment;
     block_t *full_segments;
     block_t **full_segments_end;
@@ -196,19 +272,162 @@ typedef struct
     bool b_caching;
     bool b_generate_iv;
     bool b_segment_has_data;
+    bool b_fmp4;
+    bool b_chunked;
+    bool b_segment_open;
     uint8_t aes_ivs[16];
     gcry_cipher_hd_t aes_ctx;
     char *key_uri;
     uint8_t stuffing_bytes[16];
     ssize_t stuffing_size;
     vlc_array_t segments_t;
+
+    /* Everything past the segmentation runs on the output thread, in the
+     * order of the queued operations: the encryption and its setup, the
+     * writes, and the index updates. */
+    vlc_thread_t thread;
+    vlc_mutex_t lock;
+    vlc_cond_t wait_op;
+    vlc_cond_t wait_room;
+    output_op_t *p_ops;
+    output_op_t **pp_ops_last;
+    size_t i_ops_size;
+    bool b_quit;
+    bool b_error;
+    output_segment_t *p_current;
+
+    /* Served over HTTP */
+    httpd_host_t *p_host;
+    vlc_mutex_t serve_lock;
+    served_file_t *p_index_file;
+    served_file_t *p_mpd_file;
+    served_file_t *p_init_file;
 } sout_access_out_sys_t;
 
 static int LoadCryptFile( sout_access_out_t *p_access);
 static int CryptSetup( sout_access_out_t *p_access, char *keyfile );
-static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer );
+static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer, bool b_split );
 static ssize_t writeSegment( sout_access_out_t *p_access );
+static void closeSegment( sout_access_out_t *p_access, bool b_isend );
 static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys );
+static void *OutputThread( void * );
+
+/*****************************************************************************
+ * Files served from memory
+ *****************************************************************************/
+static int ServeCallback( httpd_callback_sys_t *p_cbsys, httpd_client_t *cl,
+                          httpd_message_t *answer, const httpd_message_t *query )
+{
+    served_file_t *p_file = (served_file_t *)p_cbsys;
+    VLC_UNUSED(cl);
+
+    if( !answer || !query )
+        return VLC_SUCCESS;
+
+    answer->i_proto = HTTPD_PROTO_HTTP;
+    answer->i_version = 1;
+    answer->i_type = HTTPD_MSG_ANSWER;
+
+    vlc_mutex_lock( p_file->p_lock );
+    if( p_file->p_data == NULL )
+    {
+        vlc_mutex_unlock( p_file->p_lock );
+        answer->i_status = 404;
+        httpd_MsgAdd( answer, "Cache-Control", "no-cache" );
+        httpd_MsgAdd( answer, "Content-Length", "0" );
+        return VLC_SUCCESS;
+    }
+
+    size_t i_size = p_file->p_data->i_buffer;
+    if( query->i_type != HTTPD_MSG_HEAD )
+    {
+        answer->p_body = malloc( i_size );
+        if( likely(answer->p_body != NULL) )
+        {
+            memcpy( answer->p_body, p_file->p_data->p_buffer, i_size );
+            answer->i_body = i_size;
+        }
+    }
+
+    answer->i_status = answer->p_body || query->i_type == HTTPD_MSG_HEAD ? 200 : 500;
+    httpd_MsgAdd( answer, "Content-Type", "%s", p_file->psz_mime );
+    if( p_file->i_max_age )
+        httpd_MsgAdd( answer, "Cache-Control", "public, max-age=%u", p_file->i_max_age );
+    else
+        httpd_MsgAdd( answer, "Cache-Control", "no-cache" );
+    vlc_mutex_unlock( p_file->p_lock );
+
+    if( httpd_MsgGet( query, "Connection" ) != NULL )
+        httpd_MsgAdd( answer, "Connection", "close" );
+    httpd_MsgAdd( answer, "Content-Length", "%zu",
+                  answer->p_body || query->i_type == HTTPD_MSG_HEAD ? i_size : 0 );
+
+    return VLC_SUCCESS;
+}
+
+static served_file_t *serveNew( sout_access_out_sys_t *p_sys, const char *psz_url,
+                                const char *psz_mime )
+{
+    served_file_t *p_file = malloc( sizeof(*p_file) );
+    if( unlikely(p_file == NULL) )
+        return NULL;
+
+    p_file->p_lock = &p_sys->serve_lock;
+    p_file->p_data = NULL;
+    p_file->psz_mime = psz_mime;
+    p_file->i_max_age = 0;
+    p_file->p_url = httpd_UrlNew( p_sys->p_host, psz_url, NULL, NULL );
+    if( p_file->p_url == NULL )
+    {
+        free( p_file );
+        return NULL;
+    }
+    httpd_UrlCatch( p_file->p_url, HTTPD_MSG_HEAD, ServeCallback,
+                    (httpd_callback_sys_t *)p_file );
+    httpd_UrlCatch( p_file->p_url, HTTPD_MSG_GET, ServeCallback,
+                    (httpd_callback_sys_t *)p_file );
+    return p_file;
+}
+
+/* Replaces the data at once, so that clients never get a partial file */
+static void serveUpdate( served_file_t *p_file, block_t *p_data, unsigned i_max_age )
+{
+    vlc_mutex_lock( p_file->p_lock );
+    block_t *p_old = p_file->p_data;
+    p_file->p_data = p_data;
+    p_file->i_max_age = i_max_age;
+    vlc_mutex_unlock( p_file->p_lock );
+
+    if( p_old )
+        block_Release( p_old );
+}
+
+static void serveDelete( served_file_t *p_file )
+{
+    if( p_file == NULL )
+        return;
+    /* No request is in progress past this */
+    httpd_UrlDelete( p_file->p_url );
+    if( p_file->p_data )
+        block_Release( p_file->p_data );
+    free( p_file );
+}
+
+static void freeSys( sout_access_out_sys_t *p_sys )
+{
+    serveDelete( p_sys->p_index_file );
+    serveDelete( p_sys->p_mpd_file );
+    serveDelete( p_sys->p_init_file );
+    if( p_sys->p_host )
+        httpd_HostDelete( p_sys->p_host );
+    free( p_sys->psz_mpdPath );
+    free( p_sys->psz_initUri );
+    free( p_sys->psz_initName );
+    free( p_sys->psz_indexUrl );
+    free( p_sys->psz_indexPath );
+    free( p_sys );
+}
+
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -247,6 +466,24 @@ static int Open( vlc_object_t *p_this )
     p_sys->b_caching = var_GetBool( p_access, SOUT_CFG_PREFIX "caching") ;
     p_sys->b_generate_iv = var_GetBool( p_access, SOUT_CFG_PREFIX "generate-iv") ;
     p_sys->b_segment_has_data = false;
+    p_sys->b_chunked = var_GetBool( p_access, SOUT_CFG_PREFIX "chunked" );
+
+    bool b_httpd = var_GetBool( p_access, SOUT_CFG_PREFIX "httpd" );
+    if( b_httpd )
+    {
+        /* Bound the memory to the segments of the index */
+        if( p_sys->i_numsegs == 0 )
+        {
+            msg_Warn( p_access, "keeping the last 3 segments only" );
+            p_sys->i_numsegs = 3;
+        }
+        p_sys->b_delsegs = true;
+        if( p_sys->b_chunked )
+        {
+            msg_Warn( p_access, "chunked output is not served over HTTP" );
+            p_sys->b_chunked = false;
+        }
+    }
 
     vlc_array_init( &p_sys->segments_t );
 
@@ -265,29 +502,50 @@ static int Open( vlc_object_t *p_this )
             return VLC_ENOMEM;
         }
         p_sys->psz_indexPath = psz_tmp;
-        if( p_sys->i_initial_segment != 1 )
+        if( p_sys->i_initial_segment != 1 && !b_httpd )
             vlc_unlink( p_sys->psz_indexPath );
     }
 
     p_sys->psz_indexUrl = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "index-url" );
     p_sys->psz_keyfile  = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "key-loadfile" );
     p_sys->key_uri      = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "key-uri" );
+    p_sys->psz_initName = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "init" );
+    p_sys->psz_mpdPath  = var_GetNonEmptyString( p_access, SOUT_CFG_PREFIX "mpd" );
 
     p_access->p_sys = p_sys;
 
+    vlc_mutex_init( &p_sys->serve_lock );
+    if( b_httpd )
+    {
+        p_sys->p_host = vlc_http_HostNew( VLC_OBJECT(p_access) );
+        if( p_sys->p_host == NULL )
+        {
+            msg_Err( p_access, "cannot start HTTP server" );
+            freeSys( p_sys );
+            return VLC_EGENERIC;
+        }
+        if( ( p_sys->psz_indexPath &&
+              !( p_sys->p_index_file = serveNew( p_sys, p_sys->psz_indexPath,
+                                                 "application/vnd.apple.mpegurl" ) ) ) ||
+            ( p_sys->psz_mpdPath &&
+              !( p_sys->p_mpd_file = serveNew( p_sys, p_sys->psz_mpdPath,
+                                               "application/dash+xml" ) ) ) )
+        {
+            msg_Err( p_access, "cannot serve the index" );
+            freeSys( p_sys );
+            return VLC_EGENERIC;
+        }
+    }
+
     if( p_sys->psz_keyfile && ( LoadCryptFile( p_access ) < 0 ) )
     {
-        free( p_sys->psz_indexUrl );
-        free( p_sys->psz_indexPath );
-        free( p_sys );
+        freeSys( p_sys );
         msg_Err( p_access, "Encryption init failed" );
         return VLC_EGENERIC;
     }
     else if( !p_sys->psz_keyfile && ( CryptSetup( p_access, NULL ) < 0 ) )
     {
-        free( p_sys->psz_indexUrl );
-        free( p_sys->psz_indexPath );
-        free( p_sys );
+        freeSys( p_sys );
         msg_Err( p_access, "Encryption init failed" );
         return VLC_EGENERIC;
     }
@@ -296,6 +554,22 @@ static int Open( vlc_object_t *p_this )
     p_sys->i_segment = p_sys->i_initial_segment-1;
     p_sys->psz_cursegPath = NULL;
 
+    vlc_mutex_init( &p_sys->lock );
+    vlc_cond_init( &p_sys->wait_op );
+    vlc_cond_init( &p_sys->wait_room );
+    p_sys->p_ops = NULL;
+    p_sys->pp_ops_last = &p_sys->p_ops;
+    if( vlc_clone( &p_sys->thread, OutputThread, p_access, VLC_THREAD_PRIORITY_OUTPUT ) )
+    {
+        if( p_sys->key_uri )
+        {
+            gcry_cipher_close( p_sys->aes_ctx );
+            free( p_sys->key_uri );
+        }
+        freeSys( p_sys );
+        return VLC_EGENERIC;
+    }
+
     p_access->pf_write = Write;
     p_access->pf_control = Control;
 
@@ -499,8 +773,53 @@ static char *formatSegmentPath( char *psz_path, uint32_t i_seg )
     return psz_result;
 }
 
+/*****************************************************************************
+ * formatSegmentName: create path name with the seg # replaced by a name
+ *****************************************************************************/
+static char *formatSegmentName( const char *psz_path, const char *psz_name )
+{
+    char *psz_result;
+    char *psz_newResult;
+    int ret;
+
+    if ( ! ( psz_result = vlc_strftime( psz_path ) ) )
+        return NULL;
+
+    char *psz_firstNumSign = psz_result + strcspn( psz_result, SEG_NUMBER_PLACEHOLDER );
+    size_t i_cnt = strspn( psz_firstNumSign, SEG_NUMBER_PLACEHOLDER );
+    if ( i_cnt )
+    {
+        *psz_firstNumSign = '\0';
+        ret = asprintf( &psz_newResult, "%s%s%s", psz_result, psz_name, psz_firstNumSign + i_cnt );
+    }
+    else
+        ret = asprintf( &psz_newResult, "%s.%s", psz_result, psz_name );
+    free( psz_result );
+
+    return ret < 0 ? NULL : psz_newResult;
+}
+
+/*****************************************************************************
+ * formatSegmentTemplate: create the DASH segment URL template
+ *****************************************************************************/
+static char *formatSegmentTemplate( const char *psz_path )
+{
+    char *psz_number;
+    size_t i_cnt = strspn( psz_path + strcspn( psz_path, SEG_NUMBER_PLACEHOLDER ),
+                           SEG_NUMBER_PLACEHOLDER );
+
+    if ( asprintf( &psz_number, "$Number%%0%zud$", i_cnt ) < 0 )
+        return NULL;
+
+    char *psz_result = formatSegmentName( psz_path, psz_number );
+    free( psz_number );
+    return psz_result;
+}
+
 static void destroySegment( output_segment_t *segment )
 {
+    serveDelete( segment->p_served );
+    block_ChainRelease( segment->p_data );
     free( segment->psz_filename );
     free( segment->psz_duration );
     free( segment->psz_uri );
@@ -550,10 +869,178 @@ static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_first
     return duration >= (first->segment_length + (p_sys->i_numsegs * p_sys->segment_max_length));
 }
 
+static void formatSeconds( char psz_secs[32], vlc_tick_t duration )
+{
+    int64_t i_ms = MS_FROM_VLC_TICK( duration );
+    snprintf( psz_secs, 32, "%"PRId64".%03u", i_ms / 1000, (unsigned)( i_ms % 1000 ) );
+}
+
+/************************************************************************
+ * publishFile: replace the index or the manifest by the stream content
+ ************************************************************************/
+static int publishFile( sout_access_out_t *p_access, struct vlc_memstream *ms,
+                        const char *psz_path, served_file_t *p_file,
+                        unsigned i_max_age )
+{
+    if( vlc_memstream_close( ms ) )
+        return -1;
+
+    if( p_file )
+    {
+        block_t *p_data = block_heap_Alloc( ms->ptr, ms->length );
+        if( unlikely( !p_data ) )
+            return -1;
+        serveUpdate( p_file, p_data, i_max_age );
+        return 0;
+    }
+
+    /* Write aside and rename, so that readers never get a partial file */
+    char *psz_tmp;
+    if( asprintf( &psz_tmp, "%s.tmp", psz_path ) < 0 )
+    {
+        free( ms->ptr );
+        return -1;
+    }
+
+    FILE *fp = vlc_fopen( psz_tmp, "wt" );
+    if( !fp )
+    {
+        msg_Err( p_access, "cannot open `%s'", psz_tmp );
+        free( psz_tmp );
+        free( ms->ptr );
+        return -1;
+    }
+
+    bool b_ok = fwrite( ms->ptr, 1, ms->length, fp ) == ms->length;
+    free( ms->ptr );
+    if( fclose( fp ) != 0 || !b_ok || vlc_rename( psz_tmp, psz_path ) < 0 )
+    {
+        vlc_unlink( psz_tmp );
+        msg_Err( p_access, "Error moving `%s'", psz_path );
+        free( psz_tmp );
+        return -1;
+    }
+    free( psz_tmp );
+    return 0;
+}
+
+/* Live indexes change with every segment */
+static unsigned indexMaxAge( sout_access_out_sys_t *p_sys, bool b_isend )
+{
+    if( b_isend )
+        return 3600;
+    return __MAX( SEC_FROM_VLC_TICK( p_sys->segment_max_length ) / 2, 1 );
+}
+
+/************************************************************************
+ * updateMPD: write the DASH manifest with the segments of the index
+ ************************************************************************/
+static int updateMPD( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys,
+                      uint32_t i_firstseg, unsigned i_index_offset,
+                      vlc_tick_t max_chunk_length, bool b_isend )
+{
+    vlc_tick_t duration = 0;
+    uint64_t i_size = 0;
+    for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+    {
+        output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, i - i_firstseg + i_index_offset );
+        duration += segment->segment_length;
+        i_size += segment->i_size;
+    }
+    const output_segment_t *first = vlc_array_item_at_index( &p_sys->segments_t, i_index_offset );
+
+    char *psz_template = formatSegmentTemplate( p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path );
+    if ( !psz_template )
+        return -1;
+    char *psz_media = vlc_xml_encode( psz_template );
+    char *psz_init = vlc_xml_encode( p_sys->psz_initUri );
+    free( psz_template );
+
+    struct vlc_memstream ms;
+    if ( !psz_media || !psz_init || vlc_memstream_open( &ms ) )
+    {
+        msg_Err( p_access, "cannot create DASH manifest `%s'", p_sys->psz_mpdPath );
+        free( psz_media );
+        free( psz_init );
+        return -1;
+    }
+
+    char psz_duration[32], psz_seglen[32];
+    formatSeconds( psz_duration, duration );
+    formatSeconds( psz_seglen, p_sys->segment_max_length );
+
+    vlc_memstream_printf( &ms, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                               "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" "
+                               "profiles=\"urn:mpeg:dash:profile:isoff-live:2011\" "
+                               "minBufferTime=\"PT%sS\"", psz_seglen );
+    if ( b_isend )
+        vlc_memstream_printf( &ms, " type=\"static\" mediaPresentationDuration=\"PT%sS\">\n",
+                              psz_duration );
+    else
+    {
+        /* Live: the segments become available as the stream goes */
+        char psz_start[32], psz_now[32];
+        struct tm tm;
+        time_t now = time( NULL );
+        gmtime_r( &p_sys->i_availability_start, &tm );
+        strftime( psz_start, sizeof(psz_start), "%Y-%m-%dT%H:%M:%SZ", &tm );
+        gmtime_r( &now, &tm );
+        strftime( psz_now, sizeof(psz_now), "%Y-%m-%dT%H:%M:%SZ", &tm );
+
+        vlc_memstream_printf( &ms, " type=\"dynamic\" availabilityStartTime=\"%s\" "
+                                   "publishTime=\"%s\" minimumUpdatePeriod=\"PT%sS\"%s%s%s>\n",
+                              psz_start, psz_now, psz_seglen,
+                              p_sys->i_numsegs ? " timeShiftBufferDepth=\"PT" : "",
+                              p_sys->i_numsegs ? psz_duration : "",
+                              p_sys->i_numsegs ? "S\"" : "" );
+    }
+
+    /* Chunks are available before the end of their segment */
+    char psz_offset[64] = "";
+    if ( !b_isend && p_sys->b_chunked && max_chunk_length > 0 &&
+         max_chunk_length < p_sys->segment_max_length )
+    {
+        char psz_secs[32];
+        formatSeconds( psz_secs, p_sys->segment_max_length - max_chunk_length );
+        snprintf( psz_offset, sizeof(psz_offset), " availabilityTimeOffset=\"%s\"", psz_secs );
+    }
+
+    vlc_memstream_printf( &ms, "  <Period id=\"0\" start=\"PT0S\">\n"
+                               "    <AdaptationSet mimeType=\"%s\" segmentAlignment=\"true\" startWithSAP=\"1\">\n"
+                               "      <SegmentTemplate timescale=\"1000\" initialization=\"%s\" media=\"%s\" "
+                               "startNumber=\"%"PRIu32"\" presentationTimeOffset=\"%"PRId64"\"%s>\n"
+                               "        <SegmentTimeline>\n",
+                          p_sys->psz_mimeType, psz_init, psz_media, i_firstseg,
+                          b_isend ? MS_FROM_VLC_TICK( first->segment_start ) : 0,
+                          psz_offset );
+
+    for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+    {
+        output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, i - i_firstseg + i_index_offset );
+        vlc_memstream_printf( &ms, "          <S t=\"%"PRId64"\" d=\"%"PRId64"\"/>\n",
+                              MS_FROM_VLC_TICK( segment->segment_start ),
+                              MS_FROM_VLC_TICK( segment->segment_length ) );
+    }
+
+    vlc_memstream_printf( &ms, "        </SegmentTimeline>\n"
+                               "      </SegmentTemplate>\n"
+                               "      <Representation id=\"0\" bandwidth=\"%"PRIu64"\"/>\n"
+                               "    </AdaptationSet>\n"
+                               "  </Period>\n"
+                               "</MPD>\n",
+                          duration > 0 ? i_size * 8 * CLOCK_FREQ / duration : 0 );
+
+    free( psz_media );
+    free( psz_init );
+    return publishFile( p_access, &ms, p_sys->psz_mpdPath, p_sys->p_mpd_file,
+                        indexMaxAge( p_sys, b_isend ) );
+}
+
 /************************************************************************
  * updateIndexAndDel: If necessary, update index file & delete old segments
  ************************************************************************/
-static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys,
+                              vlc_tick_t max_chunk_length, bool b_isend )
 {
 
     uint32_t i_firstseg;
@@ -574,33 +1061,23 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
     // First update index
     if ( p_sys->psz_indexPath )
     {
-        int val;
-        FILE *fp;
-        char *psz_idxTmp;
-        if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
-            return -1;
-
-        fp = vlc_fopen( psz_idxTmp, "wt");
-        if ( !fp )
-        {
-            msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
-            free( psz_idxTmp );
+        struct vlc_memstream ms;
+        if ( vlc_memstream_open( &ms ) )
             return -1;
-        }
 
-        if ( fprintf( fp, "#EXTM3U\n#EXT-X-TARGETDURATION:%.0f\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
+        /* EXT-X-MAP needs version 6 */
+        vlc_memstream_printf( &ms, "#EXTM3U\n#EXT-X-TARGETDURATION:%.0f\n#EXT-X-VERSION:%d\n#EXT-X-ALLOW-CACHE:%s"
                           "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n%s", ceil(secf_from_vlc_tick( p_sys->segment_max_length )) ,
+                          p_sys->psz_initUri ? 6 : 3,
                           p_sys->b_caching ? "YES" : "NO",
                           p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
                           i_firstseg, ((p_sys->i_initial_segment > 1) && (p_sys->i_initial_segment == i_firstseg)) ? "#EXT-X-DISCONTINUITY\n" : ""
-                          ) < 0 )
-        {
-            free( psz_idxTmp );
-            fclose( fp );
-            return -1;
-        }
-        char *psz_current_uri=NULL;
+                          );
 
+        /* Before any key, as the initialization segment is not encrypted */
+        if ( p_sys->psz_initUri )
+            vlc_memstream_printf( &ms, "#EXT-X-MAP:URI=\"%s\"\n", p_sys->psz_initUri );
+        const char *psz_current_uri = NULL;
 
         for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
         {
@@ -612,9 +1089,7 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
                 ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
               )
             {
-                int ret = 0;
-                free( psz_current_uri );
-                psz_current_uri = strdup( segment->psz_key_uri );
+                psz_current_uri = segment->psz_key_uri;
                 if( p_sys->b_generate_iv )
                 {
                     unsigned long long iv_hi = segment->aes_ivs[0];
@@ -626,57 +1101,29 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
                         iv_lo <<= 8;
                         iv_lo |= segment->aes_ivs[8+j] & 0xff;
                     }
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
-                                   segment->psz_key_uri, iv_hi, iv_lo );
+                    vlc_memstream_printf( &ms, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
+                                          segment->psz_key_uri, iv_hi, iv_lo );
 
                 } else {
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
-                }
-                if( ret < 0 )
-                {
-                    free( psz_current_uri );
-                    free( psz_idxTmp );
-                    fclose( fp );
-                    return -1;
+                    vlc_memstream_printf( &ms, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
                 }
             }
 
-            val = fprintf( fp, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri);
-            if ( val < 0 )
-            {
-                free( psz_current_uri );
-                free( psz_idxTmp );
-                fclose( fp );
-                return -1;
-            }
+            vlc_memstream_printf( &ms, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri );
         }
-        free( psz_current_uri );
 
         if ( b_isend )
-        {
-            if ( fputs ( STR_ENDLIST, fp ) < 0)
-            {
-                free( psz_idxTmp );
-                fclose( fp ) ;
-                return -1;
-            }
-
-        }
-        fclose( fp );
-
-        val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
+            vlc_memstream_puts( &ms, STR_ENDLIST );
 
-        if ( val < 0 )
-        {
-            vlc_unlink( psz_idxTmp );
-            msg_Err( p_access, "Error moving LiveHttp index file" );
-        }
-        else
-            msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
-
-        free( psz_idxTmp );
+        if ( publishFile( p_access, &ms, p_sys->psz_indexPath, p_sys->p_index_file,
+                          indexMaxAge( p_sys, b_isend ) ) )
+            return -1;
+        msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
     }
 
+    if ( p_sys->psz_mpdPath && p_sys->psz_initUri )
+        updateMPD( p_access, p_sys, i_firstseg, i_index_offset, max_chunk_length, b_isend );
+
     // Then take care of deletion
     // Try to follow pantos draft 11 section 6.2.2
     while( p_sys->b_delsegs && p_sys->i_numsegs &&
@@ -687,7 +1134,7 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
          msg_Dbg( p_access, "Removing segment number %d", segment->i_segment_number );
          vlc_array_remove( &p_sys->segments_t, 0 );
 
-         if ( segment->psz_filename )
+         if ( segment->psz_filename && !p_sys->p_host )
          {
              vlc_unlink( segment->psz_filename );
          }
@@ -700,14 +1147,61 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
     return 0;
 }
 
+/* Segments never change, but should not outlive the index in caches */
+static unsigned segmentMaxAge( sout_access_out_sys_t *p_sys )
+{
+    return __MAX( SEC_FROM_VLC_TICK( p_sys->segment_max_length ), 1 ) *
+           ( p_sys->i_numsegs + 1 );
+}
+
+/*****************************************************************************
+ * outputBlock: write the block to the segment file, or keep it in memory
+ *****************************************************************************/
+static ssize_t outputBlock( sout_access_out_t *p_access, output_segment_t *segment,
+                            block_t *p_block )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    ssize_t i_write = p_block->i_buffer;
+
+    if( p_sys->p_host )
+        block_ChainLastAppend( &segment->pp_data_last, p_block );
+    else
+    {
+        size_t i_done = 0;
+        while( i_done < p_block->i_buffer )
+        {
+            ssize_t val = vlc_write( p_sys->i_handle, &p_block->p_buffer[i_done],
+                                     p_block->i_buffer - i_done );
+            if( val == -1 )
+            {
+                if( errno == EINTR )
+                    continue;
+                msg_Err( p_access, "cannot write `%s' (%s)", segment->psz_filename,
+                         vlc_strerror_c(errno) );
+                block_Release( p_block );
+                return -1;
+            }
+            i_done += val;
+        }
+        block_Release( p_block );
+    }
+
+    segment->i_size += i_write;
+    return i_write;
+}
+
 /*****************************************************************************
  * closeCurrentSegment: Close the segment file
  *****************************************************************************/
-static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys,
+                                 vlc_tick_t length, vlc_tick_t max_chunk_length,
+                                 bool b_isend )
 {
-    if ( p_sys->i_handle >= 0 )
+    output_segment_t *segment = p_sys->p_current;
+
+    if ( segment )
     {
-        output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, vlc_array_count( &p_sys->segments_t ) - 1 );
+        p_sys->p_current = NULL;
 
         if( p_sys->key_uri )
         {
@@ -719,23 +1213,50 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
                msg_Err( p_access, "Couldn't encrypt 16 bytes: %s", gpg_strerror(err) );
             } else {
 
-            int ret = vlc_write( p_sys->i_handle, p_sys->stuffing_bytes, 16 );
-            if( ret != 16 )
+            block_t *p_pad = block_Alloc( 16 );
+            if( p_pad )
+                memcpy( p_pad->p_buffer, p_sys->stuffing_bytes, 16 );
+            if( !p_pad || outputBlock( p_access, segment, p_pad ) != 16 )
                 msg_Err( p_access, "Couldn't write 16 bytes" );
             }
             p_sys->stuffing_size = 0;
         }
 
+        if( p_sys->p_host )
+        {
+            /* Available as a whole, before the index refers to it */
+            block_t *p_data = segment->p_data ? block_ChainGather( segment->p_data ) : NULL;
+            segment->p_data = NULL;
+            segment->pp_data_last = &segment->p_data;
 
-        vlc_close( p_sys->i_handle );
-        p_sys->i_handle = -1;
+            if( p_data )
+            {
+                segment->p_served = serveNew( p_sys, segment->psz_filename,
+                                              p_sys->psz_mimeType ? p_sys->psz_mimeType
+                                                                  : "video/mp2t" );
+                if( segment->p_served )
+                    serveUpdate( segment->p_served, p_data, segmentMaxAge( p_sys ) );
+                else
+                {
+                    msg_Err( p_access, "cannot serve `%s'", segment->psz_filename );
+                    block_Release( p_data );
+                }
+            }
+        }
+        else
+        {
+            vlc_close( p_sys->i_handle );
+            p_sys->i_handle = -1;
+        }
 
-        if( ! ( us_asprintf( &segment->psz_duration, "%.2f", secf_from_vlc_tick( p_sys->current_segment_length )) ) )
+        if( ! ( us_asprintf( &segment->psz_duration, "%.2f", secf_from_vlc_tick( length )) ) )
         {
             msg_Err( p_access, "Couldn't set duration on closed segment");
             return;
         }
-        segment->segment_length = p_sys->current_segment_length;
+        segment->segment_length = length;
+        segment->segment_start = p_sys->segments_length;
+        p_sys->segments_length += length;
 
         segment->i_segment_number = p_sys->i_segment;
 
@@ -744,11 +1265,118 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
             msg_Dbg( p_access, "LiveHttpSegmentComplete: %s (%"PRIu32")" , p_sys->psz_cursegPath, p_sys->i_segment );
             free( p_sys->psz_cursegPath );
             p_sys->psz_cursegPath = 0;
-            updateIndexAndDel( p_access, p_sys, b_isend );
+            updateIndexAndDel( p_access, p_sys, max_chunk_length, b_isend );
         }
     }
 }
 
+/*****************************************************************************
+ * queueOp: pass an operation to the output thread
+ *****************************************************************************/
+static int queueOp( sout_access_out_t *p_access, int i_type, block_t *p_data,
+                    bool b_isend )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    output_op_t *op = malloc( sizeof(*op) );
+    if( unlikely( !op ) )
+    {
+        block_ChainRelease( p_data );
+        return -1;
+    }
+
+    op->p_next = NULL;
+    op->i_type = i_type;
+    op->p_data = p_data;
+    block_ChainProperties( p_data, NULL, &op->i_size, NULL );
+    op->i_length = p_sys->current_segment_length;
+    op->i_max_chunk_length = p_sys->max_chunk_length;
+    op->b_isend = b_isend;
+
+    vlc_mutex_lock( &p_sys->lock );
+    /* Let the output catch up */
+    while( p_sys->i_ops_size > OUTPUT_QUEUE_MAX && !p_sys->b_error )
+        vlc_cond_wait( &p_sys->wait_room, &p_sys->lock );
+
+    *p_sys->pp_ops_last = op;
+    p_sys->pp_ops_last = &op->p_next;
+    p_sys->i_ops_size += op->i_size;
+    vlc_cond_signal( &p_sys->wait_op );
+
+    /* Report the failures of the previous operations */
+    bool b_error = p_sys->b_error;
+    p_sys->b_error = false;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    return b_error ? -1 : 0;
+}
+
+static ssize_t writeSegmentData( sout_access_out_t *p_access, block_t *output );
+static ssize_t writeInitSegment( sout_access_out_t *p_access, block_t *p_buffer );
+
+static void *OutputThread( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    for( ;; )
+    {
+        while( !p_sys->p_ops && !p_sys->b_quit )
+            vlc_cond_wait( &p_sys->wait_op, &p_sys->lock );
+
+        output_op_t *op = p_sys->p_ops;
+        if( !op )
+            break;
+        p_sys->p_ops = op->p_next;
+        if( !p_sys->p_ops )
+            p_sys->pp_ops_last = &p_sys->p_ops;
+        vlc_mutex_unlock( &p_sys->lock );
+
+        ssize_t ret = 0;
+        switch( op->i_type )
+        {
+            case OUTPUT_INIT:
+                ret = writeInitSegment( p_access, op->p_data );
+                break;
+            case OUTPUT_OPEN:
+                ret = openNextFile( p_access, p_sys );
+                break;
+            case OUTPUT_WRITE:
+                ret = writeSegmentData( p_access, op->p_data );
+                break;
+            case OUTPUT_CLOSE:
+                closeCurrentSegment( p_access, p_sys, op->i_length,
+                                     op->i_max_chunk_length, op->b_isend );
+                break;
+        }
+
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->i_ops_size -= op->i_size;
+        vlc_cond_signal( &p_sys->wait_room );
+        if( ret < 0 )
+            p_sys->b_error = true;
+        free( op );
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    return NULL;
+}
+
+/*****************************************************************************
+ * closeSegment: end the current segment after the data queued so far
+ *****************************************************************************/
+static void closeSegment( sout_access_out_t *p_access, bool b_isend )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( p_sys->b_segment_open )
+    {
+        queueOp( p_access, OUTPUT_CLOSE, NULL, b_isend );
+        p_sys->b_segment_open = false;
+    }
+}
+
 /*****************************************************************************
  * Close: close the target
  *****************************************************************************/
@@ -791,7 +1419,13 @@ static void Close( vlc_object_t * p_this )
             block_ChainRelease( p_sys->ongoing_segment );
     }
 
-    closeCurrentSegment( p_access, p_sys, true );
+    closeSegment( p_access, true );
+
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->b_quit = true;
+    vlc_cond_signal( &p_sys->wait_op );
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_join( p_sys->thread, NULL );
 
     if( p_sys->key_uri )
     {
@@ -803,7 +1437,8 @@ static void Close( vlc_object_t * p_this )
     {
         output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, 0 );
         vlc_array_remove( &p_sys->segments_t, 0 );
-        if( p_sys->b_delsegs && p_sys->i_numsegs && segment->psz_filename )
+        if( p_sys->b_delsegs && p_sys->i_numsegs && segment->psz_filename &&
+            !p_sys->p_host )
         {
             msg_Dbg( p_access, "Removing segment number %d name %s", segment->i_segment_number, segment->psz_filename );
             vlc_unlink( segment->psz_filename );
@@ -812,9 +1447,7 @@ static void Close( vlc_object_t * p_this )
         destroySegment( segment );
     }
 
-    free( p_sys->psz_indexUrl );
-    free( p_sys->psz_indexPath );
-    free( p_sys );
+    freeSys( p_sys );
 
     msg_Dbg( p_access, "livehttp access output closed" );
 }
@@ -844,7 +1477,7 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
  *****************************************************************************/
 static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
 {
-    int fd;
+    int fd = -1;
 
     uint32_t i_newseg = p_sys->i_segment + 1;
 
@@ -854,6 +1487,7 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
         return -1;
 
     segment->i_segment_number = i_newseg;
+    segment->pp_data_last = &segment->p_data;
     segment->psz_filename = formatSegmentPath( p_access->psz_path, i_newseg );
     char *psz_idxFormat = p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path;
     segment->psz_uri = formatSegmentPath( psz_idxFormat , i_newseg );
@@ -865,14 +1499,18 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
         return -1;
     }
 
-    fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
-                     O_TRUNC, 0666 );
-    if ( fd == -1 )
+    /* Served segments are only kept in memory */
+    if ( !p_sys->p_host )
     {
-        msg_Err( p_access, "cannot open `%s' (%s)", segment->psz_filename,
-                 vlc_strerror_c(errno) );
-        destroySegment( segment );
-        return -1;
+        fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
+                         O_TRUNC, 0666 );
+        if ( fd == -1 )
+        {
+            msg_Err( p_access, "cannot open `%s' (%s)", segment->psz_filename,
+                     vlc_strerror_c(errno) );
+            destroySegment( segment );
+            return -1;
+        }
     }
 
     vlc_array_append_or_abort( &p_sys->segments_t, segment );
@@ -893,14 +1531,16 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
 
     p_sys->psz_cursegPath = strdup(segment->psz_filename);
     p_sys->i_handle = fd;
+    p_sys->p_current = segment;
     p_sys->i_segment = i_newseg;
-    p_sys->b_segment_has_data = false;
-    return fd;
+    if( !p_sys->i_availability_start )
+        p_sys->i_availability_start = time( NULL );
+    return 0;
 }
 /*****************************************************************************
  * CheckSegmentChange: Check if segment needs to be closed and new opened
  *****************************************************************************/
-static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
+static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer, bool b_split )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     ssize_t writevalue = 0;
@@ -911,8 +1551,11 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
     block_ChainProperties( p_sys->full_segments, NULL, NULL, &current_length );
     block_ChainProperties( p_sys->ongoing_segment, NULL, NULL, &ongoing_length );
 
-    if( p_sys->i_handle > 0 &&
-       (( p_buffer->i_length + current_length + ongoing_length ) >= p_sys->segment_max_length ) )
+    /* Chunked segments already got their previous fragments, so they
+     * can only end where the next segment can start */
+    if( p_sys->b_segment_open && ( b_split || !p_sys->b_chunked ) &&
+       (( p_buffer->i_length + p_sys->current_segment_length +
+          current_length + ongoing_length ) >= p_sys->segment_max_length ) )
     {
         writevalue = writeSegment( p_access );
         if( unlikely( writevalue < 0 ) )
@@ -920,18 +1563,24 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
             block_ChainRelease ( p_buffer );
             return -1;
         }
-        closeCurrentSegment( p_access, p_sys, false );
+        closeSegment( p_access, false );
         return writevalue;
     }
 
-    if ( unlikely( p_sys->i_handle < 0 ) )
+    if ( unlikely( !p_sys->b_segment_open ) )
     {
-        if ( openNextFile( p_access, p_sys ) < 0 )
+        if ( queueOp( p_access, OUTPUT_OPEN, NULL, false ) < 0 )
            return -1;
+        p_sys->b_segment_open = true;
+        p_sys->b_segment_has_data = false;
+        p_sys->current_segment_length = 0;
     }
     return writevalue;
 }
 
+/*****************************************************************************
+ * writeSegment: pass the full segments to the output thread
+ *****************************************************************************/
 static ssize_t writeSegment( sout_access_out_t *p_access )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
@@ -942,20 +1591,48 @@ static ssize_t writeSegment( sout_access_out_t *p_access )
     p_sys->full_segments_end = &p_sys->full_segments;
 
     vlc_tick_t current_length = 0;
-    block_ChainProperties( output, NULL, NULL, &current_length );
+    size_t i_size = 0;
+    block_ChainProperties( output, NULL, &i_size, &current_length );
+
+    p_sys->current_segment_length += current_length;
+    if( !output )
+        return 0;
+    if( queueOp( p_access, OUTPUT_WRITE, output, false ) < 0 )
+        return -1;
+    return i_size;
+}
+
+/*****************************************************************************
+ * writeSegmentData: encrypt and output the data of the current segment
+ *****************************************************************************/
+static ssize_t writeSegmentData( sout_access_out_t *p_access, block_t *output )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    output_segment_t *segment = p_sys->p_current;
+
+    /* The segment could not be opened */
+    if( !segment )
+    {
+        block_ChainRelease( output );
+        return -1;
+    }
 
     ssize_t i_write=0;
-    bool crypted = false;
-    p_sys->current_segment_length = current_length;
     while( output )
     {
-        if( p_sys->key_uri && !crypted )
+        block_t *p_next = output->p_next;
+        output->p_next = NULL;
+
+        if( p_sys->key_uri )
         {
             if( p_sys->stuffing_size )
             {
                 output = block_Realloc( output, p_sys->stuffing_size, output->i_buffer );
                 if( unlikely(!output ) )
+                {
+                    block_ChainRelease( p_next );
                     return VLC_ENOMEM;
+                }
                 memcpy( output->p_buffer, p_sys->stuffing_bytes, p_sys->stuffing_size );
                 p_sys->stuffing_size = 0;
             }
@@ -974,35 +1651,106 @@ static ssize_t writeSegment( sout_access_out_t *p_access )
             if( err )
             {
                 msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
+                block_Release( output );
+                block_ChainRelease( p_next );
                 return -1;
             }
-            crypted=true;
+        }
 
+        ssize_t val = outputBlock( p_access, segment, output );
+        if( val < 0 )
+        {
+            block_ChainRelease( p_next );
+            return -1;
         }
+        i_write += val;
+        output = p_next;
+    }
+    return i_write;
+}
+
+static bool isBox( const block_t *p_buffer, const char *psz_type )
+{
+    return p_buffer->i_buffer >= 8 && !memcmp( &p_buffer->p_buffer[4], psz_type, 4 );
+}
+
+/*****************************************************************************
+ * writeInitSegment: write the initialization segment of fragmented MP4
+ *****************************************************************************/
+static ssize_t writeInitSegment( sout_access_out_t *p_access, block_t *p_buffer )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    const char *psz_name = p_sys->psz_initName ? p_sys->psz_initName : "init";
 
-        ssize_t val = vlc_write( p_sys->i_handle, output->p_buffer, output->i_buffer );
-        if ( val == -1 )
+    /* The manifest only needs to know if there is any video track */
+    p_sys->psz_mimeType = "audio/mp4";
+    for( size_t i = 0; i + 16 <= p_buffer->i_buffer; i++ )
+    {
+        if( !memcmp( &p_buffer->p_buffer[i], "hdlr", 4 ) &&
+            !memcmp( &p_buffer->p_buffer[i + 12], "vide", 4 ) )
         {
-           if ( errno == EINTR )
-              continue;
-           return -1;
+            p_sys->psz_mimeType = "video/mp4";
+            break;
         }
+    }
 
+    char *psz_path = formatSegmentName( p_access->psz_path, psz_name );
+    free( p_sys->psz_initUri );
+    p_sys->psz_initUri = formatSegmentName( p_sys->psz_indexUrl ? p_sys->psz_indexUrl
+                                                                : p_access->psz_path, psz_name );
+    if( unlikely( !psz_path || !p_sys->psz_initUri ) )
+    {
+        free( psz_path );
+        block_Release( p_buffer );
+        return -1;
+    }
 
-        if ( (size_t)val >= output->i_buffer )
+    if( p_sys->p_host )
+    {
+        ssize_t i_size = p_buffer->i_buffer;
+        if( !p_sys->p_init_file &&
+            !( p_sys->p_init_file = serveNew( p_sys, psz_path, p_sys->psz_mimeType ) ) )
         {
-           block_t *p_next = output->p_next;
-           block_Release (output);
-           output = p_next;
-           crypted=false;
+            msg_Err( p_access, "cannot serve `%s'", psz_path );
+            free( psz_path );
+            block_Release( p_buffer );
+            return -1;
         }
-        else
+        serveUpdate( p_sys->p_init_file, p_buffer, segmentMaxAge( p_sys ) );
+        free( psz_path );
+        return i_size;
+    }
+
+    int fd = vlc_open( psz_path, O_WRONLY | O_CREAT | O_LARGEFILE | O_TRUNC, 0666 );
+    if( fd == -1 )
+    {
+        msg_Err( p_access, "cannot open `%s' (%s)", psz_path, vlc_strerror_c(errno) );
+        free( psz_path );
+        block_Release( p_buffer );
+        return -1;
+    }
+
+    ssize_t i_write = 0;
+    while( (size_t)i_write < p_buffer->i_buffer )
+    {
+        ssize_t val = vlc_write( fd, &p_buffer->p_buffer[i_write],
+                                 p_buffer->i_buffer - i_write );
+        if( val == -1 )
         {
-           output->p_buffer += val;
-           output->i_buffer -= val;
+            if( errno == EINTR )
+                continue;
+            msg_Err( p_access, "cannot write `%s' (%s)", psz_path, vlc_strerror_c(errno) );
+            i_write = -1;
+            break;
         }
         i_write += val;
     }
+    vlc_close( fd );
+
+    if( i_write >= 0 )
+        msg_Dbg( p_access, "Wrote initialization segment: %s", psz_path );
+    free( psz_path );
+    block_Release( p_buffer );
     return i_write;
 }
 
@@ -1015,10 +1763,44 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     while( p_buffer )
     {
+        block_t *p_temp = p_buffer->p_next;
+        ssize_t ret;
+
+        /* Fragmented MP4 header, out of the segments */
+        if( ( p_buffer->i_flags & BLOCK_FLAG_HEADER ) && isBox( p_buffer, "ftyp" ) )
+        {
+            /* From now on, segments start on the random access fragments */
+            p_sys->b_fmp4 = true;
+
+            p_buffer->p_next = NULL;
+            size_t i_size = p_buffer->i_buffer;
+            if( queueOp( p_access, OUTPUT_INIT, p_buffer, false ) < 0 )
+            {
+                block_ChainRelease( p_temp );
+                return -1;
+            }
+            i_write += i_size;
+            p_buffer = p_temp;
+            continue;
+        }
+
+        /* Fragmented MP4 can only be split before a moof, and the muxer
+         * flags those on which every track starts with a keyframe */
+        bool b_fragment = p_sys->b_fmp4 && isBox( p_buffer, "moof" );
+        bool b_split;
+        if( p_sys->b_fmp4 )
+            b_split = b_fragment && ( p_sys->b_splitanywhere ||
+                                      ( p_buffer->i_flags & BLOCK_FLAG_TYPE_I ) );
+        else
+            b_split = p_sys->b_splitanywhere || ( p_buffer->i_flags & BLOCK_FLAG_HEADER );
+
+        if( b_fragment && p_buffer->i_length > p_sys->max_chunk_length )
+            p_sys->max_chunk_length = p_buffer->i_length;
+
         /* Check if current block is already past segment-length
             and we want to write gathered blocks into segment
             and update playlist */
-        if( p_sys->ongoing_segment && ( p_sys->b_splitanywhere  || ( p_buffer->i_flags & BLOCK_FLAG_HEADER ) ) )
+        if( p_sys->ongoing_segment && ( b_split || ( b_fragment && p_sys->b_chunked ) ) )
         {
             msg_Dbg( p_access, "Moving ongoing segment to full segments-queue" );
             block_ChainLastAppend( &p_sys->full_segments_end, p_sys->ongoing_segment );
@@ -1027,7 +1809,7 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
             p_sys->b_segment_has_data = true;
         }
 
-        ssize_t ret = CheckSegmentChange( p_access, p_buffer );
+        ret = CheckSegmentChange( p_access, p_buffer, b_split );
         if( ret < 0 )
         {
             msg_Err( p_access, "Error in write loop");
@@ -1035,7 +1817,19 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
         }
         i_write += ret;
 
-        block_t *p_temp = p_buffer->p_next;
+        /* Chunked output: the complete fragments go out right away */
+        if( p_sys->b_chunked && p_sys->full_segments && p_sys->b_segment_open )
+        {
+            ret = writeSegment( p_access );
+            if( ret < 0 )
+            {
+                msg_Err( p_access, "Error in write loop");
+                block_ChainRelease( p_buffer );
+                return ret;
+            }
+            i_write += ret;
+        }
+
         p_buffer->p_next = NULL;
         block_ChainLastAppend( &p_sys->ongoing_segment_end, p_buffer );
         p_buffer = p_temp;
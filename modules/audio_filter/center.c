@@ -35,7 +35,8 @@ static block_t *Process ( filter_t *filter, block_t *in_buf )
     (void) filter;
     float *in = (float*)in_buf->p_buffer;
     size_t i_nb_samples = in_buf->i_nb_samples;
-    block_t *out_buf = block_Alloc(sizeof(float) * i_nb_samples * NB_CHANNELS);
+    block_t *out_buf = filter_NewAudioBuffer(filter,
+                                    sizeof(float) * i_nb_samples * NB_CHANNELS);
     if ( !out_buf )
     {
         block_Release(in_buf);
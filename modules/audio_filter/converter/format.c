@@ -31,14 +31,17 @@
 # include "config.h"
 #endif
 #include <math.h>
+#include <string.h>
 #include <assert.h>
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_aout.h>
 #include <vlc_block.h>
+#include <vlc_cpu.h>
 #include <vlc_filter.h>
 
+#ifndef FORMAT_TEST
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -51,436 +54,408 @@ vlc_module_begin()
     set_capability("audio converter", 1)
     set_callback(Open)
 vlc_module_end()
+#endif
 
 /*****************************************************************************
- * Local prototypes
+ * Conversion kernels
+ *****************************************************************************
+ * Samples are converted by chunks of constant size, so that the compiler can
+ * vectorize the loops. Conversions to samples that are not larger are done
+ * in place, through a local buffer. On x86, the kernels are built a second
+ * time for AVX2 and selected at run time.
  *****************************************************************************/
+#define CONVERT_CHUNK 64 /* samples */
 
-typedef block_t *(*cvt_t)(filter_t *, block_t *);
-static const struct vlc_filter_operations *FindConversion(vlc_fourcc_t src, vlc_fourcc_t dst);
+typedef void (*cvt_t)(void *, const void *, size_t);
 
-static int Open(vlc_object_t *object)
+static inline int32_t RoundF(float v)
 {
-    filter_t     *filter = (filter_t *)object;
-
-    const es_format_t *src = &filter->fmt_in;
-    es_format_t       *dst = &filter->fmt_out;
-
-    if (!AOUT_FMTS_SIMILAR(&src->audio, &dst->audio))
-        return VLC_EGENERIC;
-    if (src->i_codec == dst->i_codec)
-        return VLC_EGENERIC;
-
-    const struct vlc_filter_operations *filter_ops = FindConversion(src->i_codec, dst->i_codec);
-    if (filter_ops == NULL)
-        return VLC_EGENERIC;
-
-    filter->ops = filter_ops;
-
-    msg_Dbg(filter, "%4.4s->%4.4s, bits per sample: %i->%i",
-            (char *)&src->i_codec, (char *)&dst->i_codec,
-            src->audio.i_bitspersample, dst->audio.i_bitspersample);
-    return VLC_SUCCESS;
-}
-
-
-/*** from U8 ***/
-static block_t *U8toS16(filter_t *filter, block_t *bsrc)
-{
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 2);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    uint8_t *src = (uint8_t *)bsrc->p_buffer;
-    int16_t *dst = (int16_t *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer; i--;)
-        *dst++ = ((*src++) << 8) - 0x8000;
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
-    return bdst;
+    return v + (v >= 0.f ? .5f : -.5f);
 }
 
-static block_t *U8toFl32(filter_t *filter, block_t *bsrc)
+/* Converts to a signed integer of the given width with Walken's trick:
+ * adding the magic number aligns the rounded integer value on the low-order
+ * bits of the IEEE mantissa, which are then clamped as integers. Unlike
+ * floating point comparisons followed by a rounding, this is branchless and
+ * gets vectorized. */
+static inline int32_t FtoI(float v, unsigned bits)
 {
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 4);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    uint8_t *src = (uint8_t *)bsrc->p_buffer;
-    float   *dst = (float *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer; i--;)
-        *dst++ = ((float)((*src++) - 128)) / 128.f;
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
-    return bdst;
+    const int32_t magic = ((127 + 24 - bits) << 23) | (1 << 22);
+    const int32_t max = magic + (1 << (bits - 1)) - 1;
+    const int32_t min = magic - (1 << (bits - 1));
+    union { float f; int32_t i; } u = { .f = v + 1.5f * (1 << (24 - bits)) };
+
+    int32_t i = u.i > max ? max : u.i;
+    i = i < min ? min : i;
+    return i - magic;
 }
 
-static block_t *U8toS32(filter_t *filter, block_t *bsrc)
+static inline int32_t DtoI(double v, unsigned bits)
 {
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 4);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    uint8_t *src = (uint8_t *)bsrc->p_buffer;
-    int32_t *dst = (int32_t *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer; i--;)
-        *dst++ = ((*src++) << 24) - 0x80000000;
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
-    return bdst;
+    const int64_t magic = ((INT64_C(1023) + 53 - bits) << 52)
+                        | (INT64_C(1) << 51);
+    const int64_t max = magic + (INT64_C(1) << (bits - 1)) - 1;
+    const int64_t min = magic - (INT64_C(1) << (bits - 1));
+    union { double f; int64_t i; } u =
+        { .f = v + 1.5 * (INT64_C(1) << (53 - bits)) };
+
+    int64_t i = u.i > max ? max : u.i;
+    i = i < min ? min : i;
+    return i - magic;
 }
 
-static block_t *U8toFl64(filter_t *filter, block_t *bsrc)
-{
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 8);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    uint8_t *src = (uint8_t *)bsrc->p_buffer;
-    double  *dst = (double *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer; i--;)
-        *dst++ = ((double)((*src++) - 128)) / 128.;
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
-    return bdst;
+#define CONVERT_FUNC(name, chunk, stype, dtype, attr) \
+attr static void name(void *out, const void *in, size_t n) \
+{ \
+    const stype *src = in; \
+    dtype *dst = out; \
+\
+    if (sizeof (dtype) > sizeof (stype)) \
+    {   /* distinct output buffer */ \
+        for (; n >= CONVERT_CHUNK; n -= CONVERT_CHUNK) \
+        { \
+            chunk(dst, src, CONVERT_CHUNK); \
+            src += CONVERT_CHUNK; \
+            dst += CONVERT_CHUNK; \
+        } \
+        chunk(dst, src, n); \
+    } \
+    else \
+    {   /* in place */ \
+        dtype buf[CONVERT_CHUNK]; \
+\
+        for (; n >= CONVERT_CHUNK; n -= CONVERT_CHUNK) \
+        { \
+            chunk(buf, src, CONVERT_CHUNK); \
+            memcpy(dst, buf, sizeof (buf)); \
+            src += CONVERT_CHUNK; \
+            dst += CONVERT_CHUNK; \
+        } \
+        chunk(buf, src, n); \
+        memcpy(dst, buf, n * sizeof (*dst)); \
+    } \
 }
 
-
-/*** from S16N ***/
-static block_t *S16toU8(filter_t *filter, block_t *b)
-{
-    VLC_UNUSED(filter);
-    int16_t *src = (int16_t *)b->p_buffer;
-    uint8_t *dst = (uint8_t *)src;
-    for (size_t i = b->i_buffer / 2; i--;)
-        *dst++ = ((*src++) + 32768) >> 8;
-
-    b->i_buffer /= 2;
-    return b;
-}
-
-static block_t *S16toFl32(filter_t *filter, block_t *bsrc)
-{
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 2);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    int16_t *src = (int16_t *)bsrc->p_buffer;
-    float   *dst = (float *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer / 2; i--;)
-#if 0
-        /* Slow version */
-        *dst++ = (float)*src++ / 32768.f;
+#ifdef HAVE_AVX2_INTRINSICS
+# define CONVERT_FUNC_AVX2(name, stype, dtype) \
+    CONVERT_FUNC(name##AVX2, name##Chunk, stype, dtype, \
+                 __attribute__ ((__target__ ("avx2"))))
+# define CONVERT_ENTRY(name) name, name##AVX2
 #else
-    {   /* This is Walken's trick based on IEEE float format. On my PIII
-         * this takes 16 seconds to perform one billion conversions, instead
-         * of 19 seconds for the above division. */
-        union { float f; int32_t i; } u;
-        u.i = *src++ + 0x43c00000;
-        *dst++ = u.f - 384.f;
-    }
+# define CONVERT_FUNC_AVX2(name, stype, dtype)
+# define CONVERT_ENTRY(name) name
 #endif
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
-    return bdst;
-}
 
-static block_t *S16toS32(filter_t *filter, block_t *bsrc)
-{
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 2);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    int16_t *src = (int16_t *)bsrc->p_buffer;
-    int32_t *dst = (int32_t *)bdst->p_buffer;
-    for (int i = bsrc->i_buffer / 2; i--;)
-        *dst++ = *src++ << 16;
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
-    return bdst;
-}
+#define CONVERT(name, stype, dtype, expr) \
+static inline void name##Chunk(dtype *restrict dst, \
+                               const stype *restrict src, size_t n) \
+{ \
+    for (size_t i = 0; i < n; i++) \
+    { \
+        const stype s = src[i]; \
+        dst[i] = (expr); \
+    } \
+} \
+CONVERT_FUNC(name, name##Chunk, stype, dtype, ) \
+CONVERT_FUNC_AVX2(name, stype, dtype)
 
-static block_t *S16toFl64(filter_t *filter, block_t *bsrc)
-{
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 4);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    int16_t *src = (int16_t *)bsrc->p_buffer;
-    float   *dst = (float *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer / 2; i--;)
-        *dst++ = (double)*src++ / 32768.;
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
-    return bdst;
-}
+/*** from U8 ***/
+CONVERT(U8toS16,   uint8_t, int16_t, (s - 128) * 256)
+CONVERT(U8toFl32,  uint8_t, float,   (s - 128) * (1.f / 128.f))
+CONVERT(U8toS32,   uint8_t, int32_t, (s - 128) * (INT32_C(1) << 24))
+CONVERT(U8toFl64,  uint8_t, double,  (s - 128) * (1. / 128.))
 
+/*** from S16N ***/
+CONVERT(S16toU8,   int16_t, uint8_t, (s + 32768) >> 8)
+CONVERT(S16toFl32, int16_t, float,   s * (1.f / 32768.f))
+CONVERT(S16toS32,  int16_t, int32_t, s * (INT32_C(1) << 16))
+CONVERT(S16toFl64, int16_t, double,  s * (1. / 32768.))
 
 /*** from FL32 ***/
-static block_t *Fl32toU8(filter_t *filter, block_t *b)
-{
-    float   *src = (float *)b->p_buffer;
-    uint8_t *dst = (uint8_t *)src;
-    for (size_t i = b->i_buffer / 4; i--;)
-    {
-        float s = *(src++) * 128.f;
-        if (s >= 127.f)
-            *(dst++) = 255;
-        else
-        if (s <= -128.f)
-            *(dst++) = 0;
-        else
-            *(dst++) = lroundf(s) + 128;
-    }
-    b->i_buffer /= 4;
-    VLC_UNUSED(filter);
-    return b;
-}
+CONVERT(Fl32toU8,  float,   uint8_t, FtoI(s, 8) + 128)
+CONVERT(Fl32toS16, float,   int16_t, FtoI(s, 16))
+CONVERT(Fl32toS32, float,   int32_t, s >= 1.f ? INT32_MAX :
+                                     s <= -1.f ? INT32_MIN :
+                                     RoundF(s * 2147483648.f))
+CONVERT(Fl32toFl64, float,  double,  s)
+
+/*** from S32N ***/
+CONVERT(S32toU8,   int32_t, uint8_t, (s >> 24) + 128)
+CONVERT(S32toS16,  int32_t, int16_t, s >> 16)
+CONVERT(S32toFl32, int32_t, float,   s * (1.f / 2147483648.f))
+CONVERT(S32toFl64, int32_t, double,  s * (1. / 2147483648.))
+
+/*** from FL64 ***/
+CONVERT(Fl64toU8,  double,  uint8_t, DtoI(s, 8) + 128)
+CONVERT(Fl64toS16, double,  int16_t, DtoI(s, 16))
+CONVERT(Fl64toFl32, double, float,   s)
+CONVERT(Fl64toS32, double,  int32_t, DtoI(s, 32))
+
+/* */
+static const struct {
+    vlc_fourcc_t src;
+    vlc_fourcc_t dst;
+    cvt_t convert;
+#ifdef HAVE_AVX2_INTRINSICS
+    cvt_t convert_avx2;
+#endif
+} cvt_directs[] = {
+    { VLC_CODEC_U8,   VLC_CODEC_S16N, CONVERT_ENTRY(U8toS16)    },
+    { VLC_CODEC_U8,   VLC_CODEC_FL32, CONVERT_ENTRY(U8toFl32)   },
+    { VLC_CODEC_U8,   VLC_CODEC_S32N, CONVERT_ENTRY(U8toS32)    },
+    { VLC_CODEC_U8,   VLC_CODEC_FL64, CONVERT_ENTRY(U8toFl64)   },
+
+    { VLC_CODEC_S16N, VLC_CODEC_U8,   CONVERT_ENTRY(S16toU8)    },
+    { VLC_CODEC_S16N, VLC_CODEC_FL32, CONVERT_ENTRY(S16toFl32)  },
+    { VLC_CODEC_S16N, VLC_CODEC_S32N, CONVERT_ENTRY(S16toS32)   },
+    { VLC_CODEC_S16N, VLC_CODEC_FL64, CONVERT_ENTRY(S16toFl64)  },
+
+    { VLC_CODEC_FL32, VLC_CODEC_U8,   CONVERT_ENTRY(Fl32toU8)   },
+    { VLC_CODEC_FL32, VLC_CODEC_S16N, CONVERT_ENTRY(Fl32toS16)  },
+    { VLC_CODEC_FL32, VLC_CODEC_S32N, CONVERT_ENTRY(Fl32toS32)  },
+    { VLC_CODEC_FL32, VLC_CODEC_FL64, CONVERT_ENTRY(Fl32toFl64) },
+
+    { VLC_CODEC_S32N, VLC_CODEC_U8,   CONVERT_ENTRY(S32toU8)    },
+    { VLC_CODEC_S32N, VLC_CODEC_S16N, CONVERT_ENTRY(S32toS16)   },
+    { VLC_CODEC_S32N, VLC_CODEC_FL32, CONVERT_ENTRY(S32toFl32)  },
+    { VLC_CODEC_S32N, VLC_CODEC_FL64, CONVERT_ENTRY(S32toFl64)  },
+
+    { VLC_CODEC_FL64, VLC_CODEC_U8,   CONVERT_ENTRY(Fl64toU8)   },
+    { VLC_CODEC_FL64, VLC_CODEC_S16N, CONVERT_ENTRY(Fl64toS16)  },
+    { VLC_CODEC_FL64, VLC_CODEC_FL32, CONVERT_ENTRY(Fl64toFl32) },
+    { VLC_CODEC_FL64, VLC_CODEC_S32N, CONVERT_ENTRY(Fl64toS32)  },
+};
 
-static block_t *Fl32toS16(filter_t *filter, block_t *b)
+#ifndef FORMAT_TEST
+static cvt_t FindConversion(vlc_fourcc_t src, vlc_fourcc_t dst)
 {
-    VLC_UNUSED(filter);
-    float   *src = (float *)b->p_buffer;
-    int16_t *dst = (int16_t *)src;
-    for (int i = b->i_buffer / 4; i--;) {
-#if 0
-        /* Slow version. */
-        if (*src >= 1.0) *dst = 32767;
-        else if (*src < -1.0) *dst = -32768;
-        else *dst = lroundf(*src * 32768.f);
-        src++; dst++;
-#else
-        /* This is Walken's trick based on IEEE float format. */
-        union { float f; int32_t i; } u;
-        u.f = *src++ + 384.f;
-        if (u.i > 0x43c07fff)
-            *dst++ = 32767;
-        else if (u.i < 0x43bf8000)
-            *dst++ = -32768;
-        else
-            *dst++ = u.i - 0x43c00000;
+    for (size_t i = 0; i < ARRAY_SIZE(cvt_directs); i++) {
+        if (cvt_directs[i].src == src &&
+            cvt_directs[i].dst == dst)
+        {
+#ifdef HAVE_AVX2_INTRINSICS
+            if (vlc_CPU_AVX2())
+                return cvt_directs[i].convert_avx2;
 #endif
+            return cvt_directs[i].convert;
+        }
     }
-    b->i_buffer /= 2;
-    return b;
+    return NULL;
 }
 
-static block_t *Fl32toS32(filter_t *filter, block_t *b)
+/*****************************************************************************
+ * Filter
+ *****************************************************************************/
+static block_t *Convert(filter_t *filter, block_t *bsrc)
 {
-    float   *src = (float *)b->p_buffer;
-    int32_t *dst = (int32_t *)src;
-    for (size_t i = b->i_buffer / 4; i--;)
+    cvt_t convert = (cvt_t)filter->p_sys;
+    size_t n = bsrc->i_buffer / (aout_BitsPerSample(filter->fmt_in.i_codec) / 8);
+    size_t size = n * (aout_BitsPerSample(filter->fmt_out.i_codec) / 8);
+    block_t *bdst = bsrc;
+
+    if (size > bsrc->i_buffer)
     {
-        float s = *(src++) * 2147483648.f;
-        if (s >= 2147483647.f)
-            *(dst++) = 2147483647;
-        else
-        if (s <= -2147483648.f)
-            *(dst++) = -2147483648;
-        else
-            *(dst++) = lroundf(s);
+        bdst = filter_NewAudioBuffer(filter, size);
+        if (unlikely(bdst == NULL))
+        {
+            block_Release(bsrc);
+            return NULL;
+        }
+        block_CopyProperties(bdst, bsrc);
     }
-    VLC_UNUSED(filter);
-    return b;
-}
 
-static block_t *Fl32toFl64(filter_t *filter, block_t *bsrc)
-{
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 2);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    float  *src = (float *)bsrc->p_buffer;
-    double *dst = (double *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer / 4; i--;)
-        *(dst++) = *(src++);
-out:
-    block_Release(bsrc);
-    VLC_UNUSED(filter);
+    convert(bdst->p_buffer, bsrc->p_buffer, n);
+    bdst->i_buffer = size;
+
+    if (bdst != bsrc)
+        block_Release(bsrc);
     return bdst;
 }
 
-
-/*** from S32N ***/
-static block_t *S32toU8(filter_t *filter, block_t *b)
+static int Open(vlc_object_t *object)
 {
-    VLC_UNUSED(filter);
-    int32_t *src = (int32_t *)b->p_buffer;
-    uint8_t *dst = (uint8_t *)src;
-    for (size_t i = b->i_buffer / 4; i--;)
-        *dst++ = ((*src++) >> 24) + 128;
-
-    b->i_buffer /= 4;
-    return b;
-}
+    filter_t     *filter = (filter_t *)object;
 
-static block_t *S32toS16(filter_t *filter, block_t *b)
-{
-    VLC_UNUSED(filter);
-    int32_t *src = (int32_t *)b->p_buffer;
-    int16_t *dst = (int16_t *)src;
-    for (size_t i = b->i_buffer / 4; i--;)
-        *dst++ = (*src++) >> 16;
-
-    b->i_buffer /= 2;
-    return b;
-}
+    const es_format_t *src = &filter->fmt_in;
+    es_format_t       *dst = &filter->fmt_out;
 
-static block_t *S32toFl32(filter_t *filter, block_t *b)
-{
-    VLC_UNUSED(filter);
-    int32_t *src = (int32_t*)b->p_buffer;
-    float   *dst = (float *)src;
-    for (int i = b->i_buffer / 4; i--;)
-        *dst++ = (float)(*src++) / 2147483648.f;
-    return b;
-}
+    if (!AOUT_FMTS_SIMILAR(&src->audio, &dst->audio))
+        return VLC_EGENERIC;
+    if (src->i_codec == dst->i_codec)
+        return VLC_EGENERIC;
 
-static block_t *S32toFl64(filter_t *filter, block_t *bsrc)
-{
-    block_t *bdst = block_Alloc(bsrc->i_buffer * 2);
-    if (unlikely(bdst == NULL))
-        goto out;
-
-    block_CopyProperties(bdst, bsrc);
-    int32_t *src = (int32_t*)bsrc->p_buffer;
-    double  *dst = (double *)bdst->p_buffer;
-    for (size_t i = bsrc->i_buffer / 4; i--;)
-        *dst++ = (double)(*src++) / 2147483648.;
-out:
-    VLC_UNUSED(filter);
-    block_Release(bsrc);
-    return bdst;
+    cvt_t convert = FindConversion(src->i_codec, dst->i_codec);
+    if (convert == NULL)
+        return VLC_EGENERIC;
+
+    static const struct vlc_filter_operations filter_ops = {
+        .filter_audio = Convert,
+    };
+    filter->ops = &filter_ops;
+    filter->p_sys = (void *)convert;
+
+    msg_Dbg(filter, "%4.4s->%4.4s, bits per sample: %i->%i",
+            (char *)&src->i_codec, (char *)&dst->i_codec,
+            src->audio.i_bitspersample, dst->audio.i_bitspersample);
+    return VLC_SUCCESS;
 }
+#endif
 
+#ifdef FORMAT_TEST
+/*****************************************************************************
+ * Test and benchmark of the conversion kernels
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
 
-/*** from FL64 ***/
-static block_t *Fl64toU8(filter_t *filter, block_t *b)
+#define TEST_SAMPLES (1 << 16)
+#define TEST_LOOPS 32
+
+static void FillSamples(vlc_fourcc_t codec, void *buf, size_t n)
 {
-    double  *src = (double *)b->p_buffer;
-    uint8_t *dst = (uint8_t *)src;
-    for (size_t i = b->i_buffer / 8; i--;)
+    uint8_t *p = buf;
+    for (size_t i = 0; i < n * aout_BitsPerSample(codec) / 8; i++)
+        p[i] = rand();
+
+    /* Floating point samples: mostly in range, a few clipping */
+    for (size_t i = 0; i < n; i++)
     {
-        float s = *(src++) * 128.;
-        if (s >= 127.f)
-            *(dst++) = 255;
-        else
-        if (s <= -128.f)
-            *(dst++) = 0;
-        else
-            *(dst++) = lround(s) + 128;
+        double v = (rand() / (double)RAND_MAX) * 2.4 - 1.2;
+        if (codec == VLC_CODEC_FL32)
+            ((float *)buf)[i] = v;
+        else if (codec == VLC_CODEC_FL64)
+            ((double *)buf)[i] = v;
     }
-    b->i_buffer /= 8;
-    VLC_UNUSED(filter);
-    return b;
 }
 
-static block_t *Fl64toS16(filter_t *filter, block_t *b)
+static cvt_t GetKernel(vlc_fourcc_t src, vlc_fourcc_t dst, bool avx2)
 {
-    VLC_UNUSED(filter);
-    double  *src = (double *)b->p_buffer;
-    int16_t *dst = (int16_t *)src;
-    for (size_t i = b->i_buffer / 8; i--;) {
-        const double v = *src++ * 32768.;
-        /* Slow version. */
-        if (v >= 32767.)
-            *dst++ = 32767;
-        else if (v < -32768.)
-            *dst++ = -32768;
-        else
-            *dst++ = lround(v);
-    }
-    b->i_buffer /= 4;
-    return b;
+    for (size_t i = 0; i < ARRAY_SIZE(cvt_directs); i++)
+        if (cvt_directs[i].src == src && cvt_directs[i].dst == dst)
+        {
+#ifdef HAVE_AVX2_INTRINSICS
+            if (avx2)
+                return cvt_directs[i].convert_avx2;
+#else
+            if (avx2)
+                return NULL;
+#endif
+            return cvt_directs[i].convert;
+        }
+    abort();
 }
 
-static block_t *Fl64toFl32(filter_t *filter, block_t *b)
+/* Widening integer conversions must be lossless */
+static void TestRoundTrip(vlc_fourcc_t src, vlc_fourcc_t dst, bool avx2)
 {
-    double *src = (double *)b->p_buffer;
-    float  *dst = (float *)src;
-    for (size_t i = b->i_buffer / 8; i--;)
-        *(dst++) = *(src++);
-
-    VLC_UNUSED(filter);
-    return b;
+    size_t ssize = aout_BitsPerSample(src) / 8;
+    size_t dsize = aout_BitsPerSample(dst) / 8;
+    uint8_t *in = malloc(TEST_SAMPLES * ssize);
+    uint8_t *tmp = malloc(TEST_SAMPLES * dsize);
+    assert(in != NULL && tmp != NULL);
+
+    FillSamples(src, in, TEST_SAMPLES);
+    GetKernel(src, dst, avx2)(tmp, in, TEST_SAMPLES);
+    GetKernel(dst, src, avx2)(tmp, tmp, TEST_SAMPLES); /* in place */
+    if (memcmp(in, tmp, TEST_SAMPLES * ssize))
+    {
+        fprintf(stderr, "%4.4s->%4.4s->%4.4s is not lossless\n",
+                (const char *)&src, (const char *)&dst, (const char *)&src);
+        abort();
+    }
+    free(tmp);
+    free(in);
 }
 
-static block_t *Fl64toS32(filter_t *filter, block_t *b)
+static void TestConversion(vlc_fourcc_t src, vlc_fourcc_t dst, bool has_avx2)
 {
-    double  *src = (double *)b->p_buffer;
-    int32_t *dst = (int32_t *)src;
-    for (size_t i = b->i_buffer / 8; i--;)
+    size_t ssize = aout_BitsPerSample(src) / 8;
+    size_t dsize = aout_BitsPerSample(dst) / 8;
+    size_t size = TEST_SAMPLES * (ssize > dsize ? ssize : dsize);
+    uint8_t *in = malloc(size);
+    uint8_t *ref = malloc(size);
+    uint8_t *out = malloc(size);
+    assert(in != NULL && ref != NULL && out != NULL);
+
+    /* Odd count to exercise the tail of the kernels */
+    const size_t n = TEST_SAMPLES - 3;
+    FillSamples(src, in, TEST_SAMPLES);
+    cvt_t convert = GetKernel(src, dst, false);
+    convert(ref, in, n);
+
+    /* Narrowing conversions are done in place by the filter */
+    if (dsize <= ssize)
     {
-        float s = *(src++) * 2147483648.;
-        if (s >= 2147483647.f)
-            *(dst++) = 2147483647;
-        else
-        if (s <= -2147483648.f)
-            *(dst++) = -2147483648;
-        else
-            *(dst++) = lround(s);
+        memcpy(out, in, n * ssize);
+        convert(out, out, n);
+        if (memcmp(ref, out, n * dsize))
+        {
+            fprintf(stderr, "%4.4s->%4.4s: in place conversion mismatch\n",
+                    (const char *)&src, (const char *)&dst);
+            abort();
+        }
     }
-    VLC_UNUSED(filter);
-    return b;
-}
 
+    vlc_tick_t start = vlc_tick_now();
+    for (unsigned i = 0; i < TEST_LOOPS; i++)
+        convert(out, in, TEST_SAMPLES);
+    vlc_tick_t c_time = vlc_tick_now() - start;
 
-/* */
-/* */
-static const struct {
-    vlc_fourcc_t src;
-    vlc_fourcc_t dst;
-    struct vlc_filter_operations convert;
-} cvt_directs[] = {
-    { VLC_CODEC_U8,   VLC_CODEC_S16N, (struct vlc_filter_operations) { .filter_audio = U8toS16 }    },
-    { VLC_CODEC_U8,   VLC_CODEC_FL32, (struct vlc_filter_operations) { .filter_audio = U8toFl32 }   },
-    { VLC_CODEC_U8,   VLC_CODEC_S32N, (struct vlc_filter_operations) { .filter_audio = U8toS32 }    },
-    { VLC_CODEC_U8,   VLC_CODEC_FL64, (struct vlc_filter_operations) { .filter_audio = U8toFl64 }   },
-
-    { VLC_CODEC_S16N, VLC_CODEC_U8,   (struct vlc_filter_operations) { .filter_audio = S16toU8 }    },
-    { VLC_CODEC_S16N, VLC_CODEC_FL32, (struct vlc_filter_operations) { .filter_audio = S16toFl32 }  },
-    { VLC_CODEC_S16N, VLC_CODEC_S32N, (struct vlc_filter_operations) { .filter_audio = S16toS32 }   },
-    { VLC_CODEC_S16N, VLC_CODEC_FL64, (struct vlc_filter_operations) { .filter_audio = S16toFl64 }  },
-
-    { VLC_CODEC_FL32, VLC_CODEC_U8,   (struct vlc_filter_operations) { .filter_audio = Fl32toU8 }   },
-    { VLC_CODEC_FL32, VLC_CODEC_S16N, (struct vlc_filter_operations) { .filter_audio = Fl32toS16 }  },
-    { VLC_CODEC_FL32, VLC_CODEC_S32N, (struct vlc_filter_operations) { .filter_audio = Fl32toS32 }  },
-    { VLC_CODEC_FL32, VLC_CODEC_FL64, (struct vlc_filter_operations) { .filter_audio = Fl32toFl64 } },
-
-    { VLC_CODEC_S32N, VLC_CODEC_U8,   (struct vlc_filter_operations) { .filter_audio = S32toU8 }    },
-    { VLC_CODEC_S32N, VLC_CODEC_S16N, (struct vlc_filter_operations) { .filter_audio = S32toS16 }   },
-    { VLC_CODEC_S32N, VLC_CODEC_FL32, (struct vlc_filter_operations) { .filter_audio = S32toFl32 }  },
-    { VLC_CODEC_S32N, VLC_CODEC_FL64, (struct vlc_filter_operations) { .filter_audio = S32toFl64 }  },
-
-    { VLC_CODEC_FL64, VLC_CODEC_U8,   (struct vlc_filter_operations) { .filter_audio = Fl64toU8 }   },
-    { VLC_CODEC_FL64, VLC_CODEC_S16N, (struct vlc_filter_operations) { .filter_audio = Fl64toS16 }  },
-    { VLC_CODEC_FL64, VLC_CODEC_FL32, (struct vlc_filter_operations) { .filter_audio = Fl64toFl32 } },
-    { VLC_CODEC_FL64, VLC_CODEC_S32N, (struct vlc_filter_operations) { .filter_audio = Fl64toS32 }  },
-
-    { 0, 0, (struct vlc_filter_operations) { .filter_audio = NULL } }
-};
+    printf("%4.4s->%4.4s: %7.1f Msamples/s", (const char *)&src,
+           (const char *)&dst, TEST_SAMPLES * TEST_LOOPS
+           / (double)(c_time > 0 ? c_time : 1) * CLOCK_FREQ / 1e6);
+
+    if (has_avx2)
+    {
+        convert = GetKernel(src, dst, true);
+        convert(out, in, n);
+        if (memcmp(ref, out, n * dsize))
+        {
+            fprintf(stderr, "\n%4.4s->%4.4s: AVX2 conversion mismatch\n",
+                    (const char *)&src, (const char *)&dst);
+            abort();
+        }
+
+        start = vlc_tick_now();
+        for (unsigned i = 0; i < TEST_LOOPS; i++)
+            convert(out, in, TEST_SAMPLES);
+        vlc_tick_t avx2_time = vlc_tick_now() - start;
+
+        printf(", AVX2: %7.1f Msamples/s", TEST_SAMPLES * TEST_LOOPS
+               / (double)(avx2_time > 0 ? avx2_time : 1) * CLOCK_FREQ / 1e6);
+    }
+    printf("\n");
+
+    free(out);
+    free(ref);
+    free(in);
+}
 
-static const struct vlc_filter_operations *FindConversion(vlc_fourcc_t src, vlc_fourcc_t dst)
+int main(void)
 {
-    for (int i = 0; cvt_directs[i].convert.filter_audio; i++) {
-        if (cvt_directs[i].src == src &&
-            cvt_directs[i].dst == dst)
-            return &cvt_directs[i].convert;
+    bool has_avx2 = false;
+#ifdef HAVE_AVX2_INTRINSICS
+    has_avx2 = vlc_CPU_AVX2();
+#endif
+
+    for (size_t i = 0; i < ARRAY_SIZE(cvt_directs); i++)
+        TestConversion(cvt_directs[i].src, cvt_directs[i].dst, has_avx2);
+
+    static const vlc_fourcc_t lossless[][2] = {
+        { VLC_CODEC_U8,   VLC_CODEC_S16N },
+        { VLC_CODEC_U8,   VLC_CODEC_FL32 },
+        { VLC_CODEC_S16N, VLC_CODEC_FL32 },
+        { VLC_CODEC_S16N, VLC_CODEC_S32N },
+        { VLC_CODEC_S16N, VLC_CODEC_FL64 },
+        { VLC_CODEC_S32N, VLC_CODEC_FL64 },
+        { VLC_CODEC_FL32, VLC_CODEC_FL64 },
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(lossless); i++)
+    {
+        TestRoundTrip(lossless[i][0], lossless[i][1], false);
+        if (has_avx2)
+            TestRoundTrip(lossless[i][0], lossless[i][1], true);
     }
-    return NULL;
+    return 0;
 }
+#endif
@@ -40,7 +40,6 @@
 #include "equalizer_presets.h"
 
 /* TODO:
- *  - optimize a bit (you can hardly do slower ;)
  *  - add tables for more bands (15 and 32 would be cool), maybe with auto coeffs
  *    computation (not too hard once the Q is found).
  *  - support for external preset
@@ -100,26 +99,35 @@ vlc_module_end ()
 /*****************************************************************************
  * Local prototypes
  *****************************************************************************/
+/* The bands are independent band-pass filters fed with the same input: they
+ * are computed side by side, EQZ_LANES at a time, so that the compiler can
+ * map them onto vector registers. The unused bands have null coefficients. */
+#define EQZ_LANES 4
+#define EQZ_BANDS_PADDED \
+    ((EQZ_BANDS_MAX + EQZ_LANES - 1) / EQZ_LANES * EQZ_LANES)
+
+typedef struct
+{
+    float x[2];
+    float y0[EQZ_BANDS_PADDED];
+    float y1[EQZ_BANDS_PADDED];
+} eqz_state_t;
+
 typedef struct
 {
     /* Filter static config */
     int i_band;
-    float *f_alpha;
-    float *f_beta;
-    float *f_gamma;
+    float f_alpha[EQZ_BANDS_PADDED];
+    float f_beta[EQZ_BANDS_PADDED];
+    float f_gamma[EQZ_BANDS_PADDED];
 
     /* Filter dyn config */
-    float *f_amp;   /* Per band amp */
+    float f_amp[EQZ_BANDS_PADDED];   /* Per band amp */
     float f_gamp;   /* Global preamp */
     bool b_2eqz;
 
-    /* Filter state */
-    float x[32][2];
-    float y[32][128][2];
-
-    /* Second filter state */
-    float x2[32][2];
-    float y2[32][128][2];
+    /* Filter state, for each pass */
+    eqz_state_t state[INPUT_CHAN_MAX][2];
 
     vlc_mutex_t lock;
 } filter_sys_t;
@@ -150,7 +158,7 @@ static int Open( vlc_object_t *p_this )
     filter_t     *p_filter = (filter_t *)p_this;
 
     /* Allocate structure */
-    filter_sys_t *p_sys = p_filter->p_sys = malloc( sizeof( *p_sys ) );
+    filter_sys_t *p_sys = p_filter->p_sys = calloc( 1, sizeof( *p_sys ) );
     if( !p_sys )
         return VLC_ENOMEM;
 
@@ -281,22 +289,18 @@ static int EqzInit( filter_t *p_filter, int i_rate )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
     eqz_config_t cfg;
-    int i, ch;
+    int i;
     vlc_value_t val1, val2, val3;
     vlc_object_t *p_aout = vlc_object_parent(p_filter);
-    int i_ret = VLC_ENOMEM;
+
+    if( aout_FormatNbChannels( &p_filter->fmt_in.audio ) > INPUT_CHAN_MAX )
+        return VLC_EGENERIC;
 
     bool b_vlcFreqs = var_InheritBool( p_aout, "equalizer-vlcfreqs" );
     EqzCoeffs( i_rate, 1.0f, b_vlcFreqs, &cfg );
 
-    /* Create the static filter config */
+    /* Create the static filter config, the padding bands stay null */
     p_sys->i_band = cfg.i_band;
-    p_sys->f_alpha = vlc_alloc( p_sys->i_band, sizeof(float) );
-    p_sys->f_beta  = vlc_alloc( p_sys->i_band, sizeof(float) );
-    p_sys->f_gamma = vlc_alloc( p_sys->i_band, sizeof(float) );
-    if( !p_sys->f_alpha || !p_sys->f_beta || !p_sys->f_gamma )
-        goto error;
-
     for( i = 0; i < p_sys->i_band; i++ )
     {
         p_sys->f_alpha[i] = cfg.band[i].f_alpha;
@@ -307,31 +311,6 @@ static int EqzInit( filter_t *p_filter, int i_rate )
     /* Filter dyn config */
     p_sys->b_2eqz = false;
     p_sys->f_gamp = 1.0f;
-    p_sys->f_amp  = vlc_alloc( p_sys->i_band, sizeof(float) );
-    if( !p_sys->f_amp )
-        goto error;
-
-    for( i = 0; i < p_sys->i_band; i++ )
-    {
-        p_sys->f_amp[i] = 0.0f;
-    }
-
-    /* Filter state */
-    for( ch = 0; ch < 32; ch++ )
-    {
-        p_sys->x[ch][0]  =
-        p_sys->x[ch][1]  =
-        p_sys->x2[ch][0] =
-        p_sys->x2[ch][1] = 0.0f;
-
-        for( i = 0; i < p_sys->i_band; i++ )
-        {
-            p_sys->y[ch][i][0]  =
-            p_sys->y[ch][i][1]  =
-            p_sys->y2[ch][i][0] =
-            p_sys->y2[ch][i][1] = 0.0f;
-        }
-    }
 
     var_Create( p_aout, "equalizer-bands", VLC_VAR_STRING | VLC_VAR_DOINHERIT );
     var_Create( p_aout, "equalizer-preset", VLC_VAR_STRING | VLC_VAR_DOINHERIT );
@@ -357,9 +336,7 @@ static int EqzInit( filter_t *p_filter, int i_rate )
     {
         msg_Err(p_filter, "No preset selected");
         free( val2.psz_string );
-        free( p_sys->f_amp );
-        i_ret = VLC_EGENERIC;
-        goto error;
+        return VLC_EGENERIC;
     }
     free( val2.psz_string );
 
@@ -378,68 +355,71 @@ static int EqzInit( filter_t *p_filter, int i_rate )
                  p_sys->f_alpha[i], p_sys->f_beta[i], p_sys->f_gamma[i]);
     }
     return VLC_SUCCESS;
+}
+
+static inline float EqzBands( const filter_sys_t *p_sys,
+                              eqz_state_t *restrict p_state, float x )
+{
+    const float *restrict f_alpha = p_sys->f_alpha;
+    const float *restrict f_beta  = p_sys->f_beta;
+    const float *restrict f_gamma = p_sys->f_gamma;
+    const float *restrict f_amp   = p_sys->f_amp;
+    float *restrict y0 = p_state->y0;
+    float *restrict y1 = p_state->y1;
+    const float dx = x - p_state->x[1];
+    float o[EQZ_LANES] = { 0.0f };
+
+    for( int j = 0; j < EQZ_BANDS_PADDED; j += EQZ_LANES )
+        for( int k = 0; k < EQZ_LANES; k++ )
+        {
+            const float y = f_alpha[j + k] * dx +
+                            f_gamma[j + k] * y0[j + k] -
+                            f_beta[j + k]  * y1[j + k];
+
+            y1[j + k] = y0[j + k];
+            y0[j + k] = y;
+
+            o[k] += y * f_amp[j + k];
+        }
+
+    p_state->x[1] = p_state->x[0];
+    p_state->x[0] = x;
 
-error:
-    free( p_sys->f_alpha );
-    free( p_sys->f_beta );
-    free( p_sys->f_gamma );
-    return i_ret;
+    float sum = 0.0f;
+    for( int k = 0; k < EQZ_LANES; k++ )
+        sum += o[k];
+    return sum;
 }
 
 static void EqzFilter( filter_t *p_filter, float *out, float *in,
                        int i_samples, int i_channels )
 {
     filter_sys_t *p_sys = p_filter->p_sys;
-    int i, ch, j;
 
     vlc_mutex_lock( &p_sys->lock );
-    for( i = 0; i < i_samples; i++ )
+    const float f_gamp = p_sys->f_gamp;
+
+    for( int i = 0; i < i_samples; i++ )
     {
-        for( ch = 0; ch < i_channels; ch++ )
+        for( int ch = 0; ch < i_channels; ch++ )
         {
             const float x = in[ch];
-            float o = 0.0f;
-
-            for( j = 0; j < p_sys->i_band; j++ )
-            {
-                float y = p_sys->f_alpha[j] * ( x - p_sys->x[ch][1] ) +
-                          p_sys->f_gamma[j] * p_sys->y[ch][j][0] -
-                          p_sys->f_beta[j]  * p_sys->y[ch][j][1];
-
-                p_sys->y[ch][j][1] = p_sys->y[ch][j][0];
-                p_sys->y[ch][j][0] = y;
-
-                o += y * p_sys->f_amp[j];
-            }
-            p_sys->x[ch][1] = p_sys->x[ch][0];
-            p_sys->x[ch][0] = x;
+            float o = EqzBands( p_sys, &p_sys->state[ch][0], x );
 
             /* Second filter */
             if( p_sys->b_2eqz )
             {
                 const float x2 = EQZ_IN_FACTOR * x + o;
-                o = 0.0f;
-                for( j = 0; j < p_sys->i_band; j++ )
-                {
-                    float y = p_sys->f_alpha[j] * ( x2 - p_sys->x2[ch][1] ) +
-                              p_sys->f_gamma[j] * p_sys->y2[ch][j][0] -
-                              p_sys->f_beta[j]  * p_sys->y2[ch][j][1];
-
-                    p_sys->y2[ch][j][1] = p_sys->y2[ch][j][0];
-                    p_sys->y2[ch][j][0] = y;
 
-                    o += y * p_sys->f_amp[j];
-                }
-                p_sys->x2[ch][1] = p_sys->x2[ch][0];
-                p_sys->x2[ch][0] = x2;
+                o = EqzBands( p_sys, &p_sys->state[ch][1], x2 );
 
                 /* We add source PCM + filtered PCM */
-                out[ch] = p_sys->f_gamp * p_sys->f_gamp *( EQZ_IN_FACTOR * x2 + o );
+                out[ch] = f_gamp * f_gamp * ( EQZ_IN_FACTOR * x2 + o );
             }
             else
             {
                 /* We add source PCM + filtered PCM */
-                out[ch] = p_sys->f_gamp *( EQZ_IN_FACTOR * x + o );
+                out[ch] = f_gamp * ( EQZ_IN_FACTOR * x + o );
             }
         }
 
@@ -458,12 +438,6 @@ static void EqzClean( filter_t *p_filter )
     var_DelCallback( p_aout, "equalizer-preset", PresetCallback, p_sys );
     var_DelCallback( p_aout, "equalizer-preamp", PreampCallback, p_sys );
     var_DelCallback( p_aout, "equalizer-2pass", TwoPassCallback, p_sys );
-
-    free( p_sys->f_alpha );
-    free( p_sys->f_beta );
-    free( p_sys->f_gamma );
-
-    free( p_sys->f_amp );
 }
 
 
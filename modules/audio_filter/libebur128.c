@@ -22,6 +22,8 @@
 # include "config.h"
 #endif
 
+#include <math.h>
+
 #include <vlc_common.h>
 #include <vlc_aout.h>
 #include <vlc_filter.h>
@@ -88,7 +90,7 @@ SendLoudnessMeter(filter_t *filter)
     struct filter_sys *sys = filter->p_sys;
 
     int error;
-    struct vlc_audio_loudness loudness = { 0, 0, 0, 0, 0 };
+    struct vlc_audio_loudness loudness = { 0, 0, 0, 0, -INFINITY };
 
     error = ebur128_loudness_momentary(sys->state, &loudness.loudness_momentary);
     if (error != EBUR128_SUCCESS)
@@ -115,15 +117,19 @@ SendLoudnessMeter(filter_t *filter)
     }
     if ((sys->state->mode & EBUR128_MODE_TRUE_PEAK) == EBUR128_MODE_TRUE_PEAK)
     {
+        double truepeak = 0.;
         for (unsigned i = 0; i < filter->fmt_in.audio.i_channels; ++i)
         {
-            double truepeak;
-            error = ebur128_true_peak(sys->state, 0, &truepeak);
+            double channel_peak;
+            error = ebur128_true_peak(sys->state, i, &channel_peak);
             if (error != EBUR128_SUCCESS)
                 return error;
-            if (truepeak > loudness.truepeak)
-                loudness.truepeak = truepeak;
+            if (channel_peak > truepeak)
+                truepeak = channel_peak;
         }
+        /* libebur128 returns a linear amplitude */
+        if (truepeak > 0.)
+            loudness.truepeak = 20. * log10(truepeak);
     }
 
     filter_SendAudioLoudness(filter, &loudness);
@@ -280,7 +286,11 @@ static int Open(vlc_object_t *this)
         case 0: break;
         default: vlc_assert_unreachable();
     }
-
+    /* Without the histogram, the integrated loudness and the range are
+     * computed over the list of every block since the start, which grows
+     * without bound and makes each update slower than the previous one. */
+    if (sys->mode & (EBUR128_MODE_I | EBUR128_MODE_LRA))
+        sys->mode |= EBUR128_MODE_HISTOGRAM;
 
     sys->last_update = VLC_TICK_INVALID;
     sys->new_frames = false;
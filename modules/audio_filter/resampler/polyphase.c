@@ -0,0 +1,632 @@
+/*****************************************************************************
+ * polyphase.c : polyphase FIR audio resampler
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *
+ * Each output sample is the inner product of the input history with one
+ * phase of a Kaiser-windowed sinc low-pass filter. When the nominal rates
+ * have a small enough ratio L/M, the L phases are computed once and the
+ * resampler walks them exactly. Other ratios, including the small rate
+ * adjustments requested by the audio output to compensate the clock drift,
+ * use a table of FINE_PHASES phases and interpolate linearly between the
+ * two nearest ones.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_plugin.h>
+#include <vlc_aout.h>
+#include <vlc_block.h>
+#include <vlc_cpu.h>
+#include <vlc_filter.h>
+
+static int  OpenConverter(vlc_object_t *);
+static int  OpenResampler(vlc_object_t *);
+
+vlc_module_begin()
+    set_shortname(N_("Polyphase"))
+    set_description(N_("Polyphase FIR audio resampler"))
+    set_category(CAT_AUDIO)
+    set_subcategory(SUBCAT_AUDIO_RESAMPLER)
+    set_capability("audio converter", 30)
+    set_callback(OpenConverter)
+
+    add_submodule()
+    set_capability("audio resampler", 30)
+    set_callback(OpenResampler)
+    add_shortcut("polyphase")
+vlc_module_end()
+
+#define POLY_TAPS 64 /* filter length when not decimating */
+#define POLY_TAPS_MAX 512
+#define POLY_LANES 8 /* taps are a multiple of this */
+#define POLY_PHASES_MAX 512 /* largest exact phase table */
+#define POLY_CUTOFF .95 /* of the lowest Nyquist frequency */
+#define POLY_BETA 7.86 /* Kaiser window, about 80 dB of stop-band rejection */
+#define FINE_BITS 8
+#define FINE_PHASES (1 << FINE_BITS)
+
+typedef struct
+{
+    unsigned channels;
+    unsigned rate; /* nominal input rate */
+    unsigned taps;
+    bool same_rate; /* no resampling at the nominal input rate */
+
+    /* Exact phases of the nominal ratio, if any */
+    float *table;
+    unsigned phases;
+    unsigned step; /* input advance per output sample, in phases */
+    unsigned phase;
+
+    /* Interpolated phases, with a guard row */
+    float *fine;
+    uint32_t frac; /* 0.32 fixed point position between two input samples */
+    bool use_fine; /* whether frac or phase is the current position */
+
+    /* Planar input history, one row of size samples per channel */
+    float *hist;
+    size_t size;
+    size_t len;
+    size_t pos; /* index of the first tap of the next output sample */
+
+    vlc_tick_t end_pts;
+} filter_sys_t;
+
+/*****************************************************************************
+ * Filter design
+ *****************************************************************************/
+static double BesselI0(double x)
+{
+    double sum = 1., term = 1.;
+
+    for (unsigned k = 1; term > sum * 1e-12; k++)
+    {
+        const double t = x / (2. * k);
+        term *= t * t;
+        sum += term;
+    }
+    return sum;
+}
+
+static void BuildTable(float *table, unsigned rows, unsigned phases,
+                       unsigned taps, double cutoff)
+{
+    const double half = taps / 2.;
+    const double norm = 1. / BesselI0(POLY_BETA);
+
+    for (unsigned r = 0; r < rows; r++)
+    {
+        float *row = table + r * taps;
+        double sum = 0.;
+
+        for (unsigned j = 0; j < taps; j++)
+        {
+            /* Distance from the output sample to the input sample j */
+            const double t = (double)r / phases + half - 1. - j;
+            const double x = t / half;
+            double v = 0.;
+
+            if (fabs(x) < 1.)
+            {
+                const double s = M_PI * cutoff * t;
+
+                v = BesselI0(POLY_BETA * sqrt(1. - x * x)) * norm;
+                if (s != 0.)
+                    v *= sin(s) / s;
+                v *= cutoff;
+            }
+            row[j] = v;
+            sum += v;
+        }
+
+        /* Unity gain at DC for every phase */
+        for (unsigned j = 0; j < taps; j++)
+            row[j] /= sum;
+    }
+}
+
+/*****************************************************************************
+ * Kernels
+ *****************************************************************************
+ * The inner products are accumulated over POLY_LANES independent partial
+ * sums, which keeps the summation order fixed and lets the compiler map the
+ * lanes onto vector registers. On x86, the kernels are built a second time
+ * for AVX2 and selected at run time.
+ *****************************************************************************/
+static inline float Dot(const float *restrict h, const float *restrict x,
+                        unsigned taps)
+{
+    float acc[POLY_LANES] = { 0.f };
+
+    for (size_t i = 0; i < taps; i += POLY_LANES)
+        for (unsigned j = 0; j < POLY_LANES; j++)
+            acc[j] += h[i + j] * x[i + j];
+
+    float sum = 0.f;
+    for (unsigned j = 0; j < POLY_LANES; j++)
+        sum += acc[j];
+    return sum;
+}
+
+static inline size_t ResampleExactInline(filter_sys_t *sys,
+                                         float *restrict out, size_t max)
+{
+    const unsigned taps = sys->taps, channels = sys->channels;
+    size_t pos = sys->pos, n = 0;
+    unsigned phase = sys->phase;
+
+    while (n < max && pos + taps <= sys->len)
+    {
+        const float *h = sys->table + phase * taps;
+
+        for (unsigned c = 0; c < channels; c++)
+            *(out++) = Dot(h, sys->hist + c * sys->size + pos, taps);
+        n++;
+
+        phase += sys->step;
+        pos += phase / sys->phases;
+        phase %= sys->phases;
+    }
+    sys->pos = pos;
+    sys->phase = phase;
+    return n;
+}
+
+static inline size_t ResampleFineInline(filter_sys_t *sys,
+                                        float *restrict out, size_t max,
+                                        uint64_t step)
+{
+    const unsigned taps = sys->taps, channels = sys->channels;
+    size_t pos = sys->pos, n = 0;
+    uint32_t frac = sys->frac;
+
+    while (n < max && pos + taps <= sys->len)
+    {
+        const float *h = sys->fine + (frac >> (32 - FINE_BITS)) * taps;
+        const float w = (frac & ((UINT32_C(1) << (32 - FINE_BITS)) - 1))
+                        * (1.f / (UINT32_C(1) << (32 - FINE_BITS)));
+
+        for (unsigned c = 0; c < channels; c++)
+        {
+            const float *x = sys->hist + c * sys->size + pos;
+            const float a = Dot(h, x, taps);
+            const float b = Dot(h + taps, x, taps);
+
+            *(out++) = a + w * (b - a);
+        }
+        n++;
+
+        const uint64_t next = frac + step;
+        pos += next >> 32;
+        frac = next;
+    }
+    sys->pos = pos;
+    sys->frac = frac;
+    return n;
+}
+
+static size_t ResampleExact(filter_sys_t *sys, float *out, size_t max)
+{
+    return ResampleExactInline(sys, out, max);
+}
+
+static size_t ResampleFine(filter_sys_t *sys, float *out, size_t max,
+                           uint64_t step)
+{
+    return ResampleFineInline(sys, out, max, step);
+}
+
+#ifdef HAVE_AVX2_INTRINSICS
+__attribute__ ((__target__ ("avx2")))
+static size_t ResampleExactAVX2(filter_sys_t *sys, float *out, size_t max)
+{
+    return ResampleExactInline(sys, out, max);
+}
+
+__attribute__ ((__target__ ("avx2")))
+static size_t ResampleFineAVX2(filter_sys_t *sys, float *out, size_t max,
+                               uint64_t step)
+{
+    return ResampleFineInline(sys, out, max, step);
+}
+#endif
+
+/*****************************************************************************
+ * History
+ *****************************************************************************/
+static void Reset(filter_sys_t *sys)
+{
+    /* Silence before the first sample, which is the next one to output */
+    sys->len = sys->taps / 2 - 1;
+    sys->pos = 0;
+    sys->phase = 0;
+    sys->frac = 0;
+    sys->use_fine = false;
+    for (unsigned c = 0; c < sys->channels; c++)
+        memset(sys->hist + c * sys->size, 0, sys->len * sizeof (float));
+}
+
+/** Index of the input sample at or just before the next output sample */
+static size_t Current(const filter_sys_t *sys)
+{
+    return sys->pos + sys->taps / 2 - 1;
+}
+
+static double CurrentFraction(const filter_sys_t *sys)
+{
+    if (sys->use_fine)
+        return sys->frac * (1. / 4294967296.);
+    return sys->phases ? (double)sys->phase / sys->phases : 0.;
+}
+
+static int Reserve(filter_sys_t *sys, size_t frames)
+{
+    if (sys->len + frames <= sys->size)
+        return 0;
+
+    size_t size = sys->len + frames;
+    float *hist = vlc_alloc(size * sys->channels, sizeof (float));
+    if (unlikely(hist == NULL))
+        return -1;
+
+    for (unsigned c = 0; c < sys->channels; c++)
+        memcpy(hist + c * size, sys->hist + c * sys->size,
+               sys->len * sizeof (float));
+    free(sys->hist);
+    sys->hist = hist;
+    sys->size = size;
+    return 0;
+}
+
+static void Append(filter_sys_t *sys, const float *in, size_t frames)
+{
+    for (unsigned c = 0; c < sys->channels; c++)
+    {
+        float *dst = sys->hist + c * sys->size + sys->len;
+
+        for (size_t i = 0; i < frames; i++)
+            dst[i] = in[i * sys->channels + c];
+    }
+    sys->len += frames;
+}
+
+/** Drops the samples that no longer contribute to any output */
+static void Trim(filter_sys_t *sys)
+{
+    assert(sys->pos <= sys->len);
+    if (sys->pos == 0)
+        return;
+
+    sys->len -= sys->pos;
+    for (unsigned c = 0; c < sys->channels; c++)
+    {
+        float *row = sys->hist + c * sys->size;
+        memmove(row, row + sys->pos, sys->len * sizeof (float));
+    }
+    sys->pos = 0;
+}
+
+/*****************************************************************************
+ * Filter callbacks
+ *****************************************************************************/
+static size_t Process(filter_t *filter, float *out, size_t max)
+{
+    filter_sys_t *sys = filter->p_sys;
+    const unsigned rate = filter->fmt_in.audio.i_rate;
+
+    if (sys->phases != 0 && rate == sys->rate)
+    {
+        if (sys->use_fine)
+        {   /* back to the exact phases, at the nearest one */
+            uint64_t phase = ((uint64_t)sys->frac * sys->phases
+                              + (UINT64_C(1) << 31)) >> 32;
+            if (phase == sys->phases)
+            {
+                phase = 0;
+                sys->pos++;
+            }
+            sys->phase = phase;
+            sys->use_fine = false;
+        }
+#ifdef HAVE_AVX2_INTRINSICS
+        if (vlc_CPU_AVX2())
+            return ResampleExactAVX2(sys, out, max);
+#endif
+        return ResampleExact(sys, out, max);
+    }
+
+    if (!sys->use_fine)
+    {
+        sys->frac = sys->phases
+            ? ((uint64_t)sys->phase << 32) / sys->phases : 0;
+        sys->use_fine = true;
+    }
+
+    const uint64_t step = ((uint64_t)rate << 32) / filter->fmt_out.audio.i_rate;
+#ifdef HAVE_AVX2_INTRINSICS
+    if (vlc_CPU_AVX2())
+        return ResampleFineAVX2(sys, out, max, step);
+#endif
+    return ResampleFine(sys, out, max, step);
+}
+
+static block_t *Bypass(filter_t *filter, block_t *in)
+{
+    filter_sys_t *sys = filter->p_sys;
+    size_t cur = Current(sys);
+
+    if (CurrentFraction(sys) >= .5)
+        cur++;
+
+    /* Output the pending samples as is, to get rid of the filter latency */
+    if (cur < sys->len)
+    {
+        const size_t pending = sys->len - cur;
+        const size_t framesize = filter->fmt_out.audio.i_bytes_per_frame;
+        block_t *out = filter_NewAudioBuffer(filter,
+                                    (pending + in->i_nb_samples) * framesize);
+        if (unlikely(out == NULL))
+        {
+            block_Release(in);
+            return NULL;
+        }
+
+        float *dst = (float *)out->p_buffer;
+        for (size_t i = 0; i < pending; i++)
+            for (unsigned c = 0; c < sys->channels; c++)
+                *(dst++) = sys->hist[c * sys->size + cur + i];
+        memcpy(dst, in->p_buffer, in->i_nb_samples * framesize);
+
+        out->i_nb_samples = pending + in->i_nb_samples;
+        out->i_buffer = out->i_nb_samples * framesize;
+        out->i_flags = in->i_flags;
+        out->i_pts = in->i_pts - vlc_tick_from_samples(pending, sys->rate);
+        out->i_length = vlc_tick_from_samples(out->i_nb_samples, sys->rate);
+        block_Release(in);
+        in = out;
+        sys->len = cur;
+    }
+
+    /* Keep the history the filter needs to resume resampling seamlessly */
+    const size_t keep = sys->taps / 2 - 1;
+    size_t frames = in->i_nb_samples;
+    const float *src = (const float *)in->p_buffer;
+
+    if (frames >= keep)
+    {
+        src += (frames - keep) * sys->channels;
+        frames = keep;
+        sys->len = 0;
+        sys->pos = 0;
+    }
+    else
+    {
+        assert(sys->len + frames >= keep);
+        sys->pos = sys->len + frames - keep;
+        Trim(sys);
+    }
+    Append(sys, src, frames);
+    sys->phase = 0;
+    sys->frac = 0;
+    sys->use_fine = false;
+
+    sys->end_pts = in->i_pts + in->i_length;
+    return in;
+}
+
+static block_t *Resample(filter_t *filter, block_t *in)
+{
+    filter_sys_t *sys = filter->p_sys;
+
+    if (in->i_flags & BLOCK_FLAG_DISCONTINUITY)
+        Reset(sys);
+
+    if (sys->same_rate && filter->fmt_in.audio.i_rate == sys->rate)
+        return Bypass(filter, in);
+
+    const unsigned irate = filter->fmt_in.audio.i_rate;
+    const unsigned orate = filter->fmt_out.audio.i_rate;
+    block_t *out = NULL;
+
+    if (Reserve(sys, in->i_nb_samples))
+        goto out;
+
+    /* Time of the next output sample, relative to the first input sample */
+    const double delay = sys->len - Current(sys) - CurrentFraction(sys);
+
+    Append(sys, (const float *)in->p_buffer, in->i_nb_samples);
+
+    const size_t max = (sys->len - Current(sys)) * (uint64_t)orate / irate + 2;
+    out = filter_NewAudioBuffer(filter,
+                                max * filter->fmt_out.audio.i_bytes_per_frame);
+    if (unlikely(out == NULL))
+        goto out;
+
+    size_t n = Process(filter, (float *)out->p_buffer, max);
+    Trim(sys);
+
+    out->i_nb_samples = n;
+    out->i_buffer = n * filter->fmt_out.audio.i_bytes_per_frame;
+    out->i_flags = in->i_flags;
+    out->i_pts = in->i_pts - vlc_tick_from_sec(delay / irate);
+    out->i_length = vlc_tick_from_samples(n, orate);
+    sys->end_pts = out->i_pts + out->i_length;
+out:
+    block_Release(in);
+    return out;
+}
+
+static block_t *Drain(filter_t *filter)
+{
+    filter_sys_t *sys = filter->p_sys;
+    const size_t tail = sys->taps / 2;
+
+    /* Flush the filter latency with silence */
+    if (Current(sys) >= sys->len || Reserve(sys, tail))
+        return NULL;
+
+    for (unsigned c = 0; c < sys->channels; c++)
+        memset(sys->hist + c * sys->size + sys->len, 0, tail * sizeof (float));
+    sys->len += tail;
+
+    const unsigned irate = filter->fmt_in.audio.i_rate;
+    const unsigned orate = filter->fmt_out.audio.i_rate;
+    const size_t max = tail * (uint64_t)orate / irate + 2;
+    block_t *out = filter_NewAudioBuffer(filter,
+                                max * filter->fmt_out.audio.i_bytes_per_frame);
+    if (unlikely(out == NULL))
+        return NULL;
+
+    size_t n = Process(filter, (float *)out->p_buffer, max);
+    Reset(sys);
+
+    out->i_nb_samples = n;
+    out->i_buffer = n * filter->fmt_out.audio.i_bytes_per_frame;
+    out->i_pts = sys->end_pts;
+    out->i_length = vlc_tick_from_samples(n, orate);
+    return out;
+}
+
+static void Flush(filter_t *filter)
+{
+    Reset(filter->p_sys);
+}
+
+static void Close(filter_t *filter)
+{
+    filter_sys_t *sys = filter->p_sys;
+
+    free(sys->hist);
+    free(sys->fine);
+    free(sys->table);
+    free(sys);
+}
+
+static int Open(filter_t *filter, bool resampler)
+{
+    const audio_format_t *fin = &filter->fmt_in.audio;
+    const audio_format_t *fout = &filter->fmt_out.audio;
+
+    if (fin->i_format != VLC_CODEC_FL32 || fout->i_format != VLC_CODEC_FL32
+     || fin->i_channels != fout->i_channels || fin->i_channels == 0
+     || fin->i_rate == 0 || fout->i_rate == 0)
+        return VLC_EGENERIC;
+
+    filter_sys_t *sys = calloc(1, sizeof (*sys));
+    if (unlikely(sys == NULL))
+        return VLC_ENOMEM;
+
+    const double ratio = (double)fout->i_rate / fin->i_rate;
+    double cutoff = 1.;
+    unsigned taps = POLY_TAPS;
+
+    sys->channels = fin->i_channels;
+    sys->rate = fin->i_rate;
+    sys->same_rate = fin->i_rate == fout->i_rate;
+
+    if (!sys->same_rate)
+    {
+        cutoff = POLY_CUTOFF * (ratio < 1. ? ratio : 1.);
+        if (ratio < 1.)
+            taps = ceil(POLY_TAPS / ratio);
+        taps = (taps + POLY_LANES - 1) & ~(POLY_LANES - 1);
+        if (taps > POLY_TAPS_MAX)
+            taps = POLY_TAPS_MAX;
+
+        unsigned a = fin->i_rate, b = fout->i_rate;
+        while (b != 0)
+        {
+            unsigned r = a % b;
+            a = b;
+            b = r;
+        }
+
+        if (fout->i_rate / a <= POLY_PHASES_MAX)
+        {
+            sys->phases = fout->i_rate / a;
+            sys->step = fin->i_rate / a;
+            sys->table = vlc_alloc(sys->phases * taps, sizeof (float));
+            if (unlikely(sys->table == NULL))
+                goto error;
+            BuildTable(sys->table, sys->phases, sys->phases, taps, cutoff);
+        }
+    }
+    sys->taps = taps;
+
+    /* The drift compensation changes the input rate on the fly */
+    if (resampler || sys->phases == 0)
+    {
+        sys->fine = vlc_alloc((FINE_PHASES + 1) * taps, sizeof (float));
+        if (unlikely(sys->fine == NULL))
+            goto error;
+        BuildTable(sys->fine, FINE_PHASES + 1, FINE_PHASES, taps, cutoff);
+    }
+
+    sys->size = taps;
+    sys->hist = vlc_alloc(sys->size * sys->channels, sizeof (float));
+    if (unlikely(sys->hist == NULL))
+        goto error;
+    Reset(sys);
+    sys->end_pts = VLC_TICK_INVALID;
+
+    msg_Dbg(filter, "%u Hz -> %u Hz, %u taps, %u phases", fin->i_rate,
+            fout->i_rate, taps, sys->phases ? sys->phases : FINE_PHASES);
+
+    static const struct vlc_filter_operations filter_ops =
+    {
+        .filter_audio = Resample,
+        .drain_audio = Drain,
+        .flush = Flush,
+        .close = Close,
+    };
+    filter->p_sys = sys;
+    filter->ops = &filter_ops;
+    return VLC_SUCCESS;
+
+error:
+    free(sys->fine);
+    free(sys->table);
+    free(sys);
+    return VLC_ENOMEM;
+}
+
+static int OpenConverter(vlc_object_t *obj)
+{
+    filter_t *filter = (filter_t *)obj;
+
+    if (filter->fmt_in.audio.i_rate == filter->fmt_out.audio.i_rate)
+        return VLC_EGENERIC;
+    return Open(filter, false);
+}
+
+static int OpenResampler(vlc_object_t *obj)
+{
+    return Open((filter_t *)obj, true);
+}
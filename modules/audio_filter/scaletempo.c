@@ -30,12 +30,13 @@
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_aout.h>
+#include <vlc_cpu.h>
 #include <vlc_filter.h>
 #include <vlc_modules.h>
 
 #include <stdatomic.h>
 #include <string.h> /* for memset */
-#include <limits.h> /* form INT_MIN */
+#include <limits.h> /* form INT_MIN, UINT_MAX */
 
 /*****************************************************************************
  * Module descriptor
@@ -44,6 +45,12 @@ static int  Open( vlc_object_t * );
 static void Close( filter_t * );
 static block_t *DoWork( filter_t *, block_t * );
 
+static const int pi_quality_values[] = { 0, 1, 2 };
+static const char *const ppsz_quality_descriptions[] = {
+    N_("Fast"), N_("Normal"), N_("Best") };
+/* Distance in frames between the offsets of the first search pass */
+static const unsigned pi_quality_steps[] = { 4, 2, 1 };
+
 #ifdef PITCH_SHIFTER
 static int  OpenPitch( vlc_object_t * );
 static void ClosePitch( filter_t * );
@@ -68,6 +75,11 @@ vlc_module_begin ()
         N_("Overlap Length"), N_("Percentage of stride to overlap"), true )
     add_integer_with_range( "scaletempo-search", 14, 0, 200,
         N_("Search Length"), N_("Length in milliseconds to search for best overlap position"), true )
+    add_integer( "scaletempo-quality", 1,
+        N_("Search Quality"), N_("Fast and Normal search the overlap position "
+        "on a coarse grid first, then refine it around the best match. "
+        "Best tries every position."), true )
+        change_integer_list( pi_quality_values, ppsz_quality_descriptions )
 #ifdef PITCH_SHIFTER
     add_float_with_range( "pitch-shift", 0, -12, 12,
         N_("Pitch Shift"), N_("Pitch shift in semitones."), false )
@@ -88,6 +100,8 @@ vlc_module_end ()
  * Scaletempo smooths the overlap further by searching within the input buffer
  * for the best overlap position.  Scaletempo uses a statistical cross correlation
  * (roughly a dot-product).  Scaletempo consumes most of its CPU cycles here.
+ * The windowed overlap is computed once per stride, when it is saved, and the
+ * search visits every "step" offset before refining around the best one.
  *
  * NOTE:
  * sample: a single audio sample for one channel
@@ -102,6 +116,7 @@ typedef struct
     unsigned  ms_stride;
     double    percent_overlap;
     unsigned  ms_search;
+    unsigned  search_step;
     /* audio format */
     unsigned  samples_per_frame;  /* AKA number of channels */
     unsigned  bytes_per_sample;
@@ -126,6 +141,7 @@ typedef struct
     void    (*output_overlap)( filter_t *p_filter, void *p_out_buf, unsigned bytes_off );
     /* best overlap */
     unsigned  frames_search;
+    unsigned  samples_corr;       /* padded to CORR_LANES */
     void     *buf_pre_corr;
     void     *table_window;
     unsigned(*best_overlap_offset)( filter_t *p_filter );
@@ -138,41 +154,90 @@ typedef struct
 
 /*****************************************************************************
  * best_overlap_offset: calculate best offset for overlap
+ *****************************************************************************
+ * The correlation is accumulated over CORR_LANES partial sums so that the
+ * compiler maps it onto vector registers. The correlation length is padded
+ * with zero weights, so the loop has no remainder. On x86, the search is
+ * built a second time for AVX2 and selected at run time.
  *****************************************************************************/
-static unsigned best_overlap_offset_float( filter_t *p_filter )
+#define CORR_LANES 8
+
+static inline float correlate( const float *restrict ppc,
+                               const float *restrict ps, unsigned samples )
 {
-    filter_sys_t *p = p_filter->p_sys;
-    float *pw, *po, *ppc, *search_start;
+    float acc[CORR_LANES] = { 0.f };
+
+    for( size_t i = 0; i < samples; i += CORR_LANES )
+        for( unsigned j = 0; j < CORR_LANES; j++ )
+            acc[j] += ppc[i + j] * ps[i + j];
+
+    float corr = 0.f;
+    for( unsigned j = 0; j < CORR_LANES; j++ )
+        corr += acc[j];
+    return corr;
+}
+
+static inline unsigned search_overlap( const filter_sys_t *p )
+{
+    const float *ppc = p->buf_pre_corr;
+    const float *search_start = (const float *)p->buf_queue + p->samples_per_frame;
+    unsigned step = p->search_step;
+    unsigned lo = 0, hi = p->frames_search, skip = UINT_MAX;
     float best_corr = INT_MIN;
     unsigned best_off = 0;
-    unsigned i, off;
-
-    pw  = p->table_window;
-    po  = p->buf_overlap;
-    po += p->samples_per_frame;
-    ppc = p->buf_pre_corr;
-    for( i = p->samples_per_frame; i < p->samples_overlap; i++ ) {
-      *ppc++ = *pw++ * *po++;
-    }
-
-    search_start = (float *)p->buf_queue + p->samples_per_frame;
-    for( off = 0; off < p->frames_search; off++ ) {
-      float corr = 0;
-      float *ps = search_start;
-      ppc = p->buf_pre_corr;
-      for( i = p->samples_per_frame; i < p->samples_overlap; i++ ) {
-        corr += *ppc++ * *ps++;
-      }
-      if( corr > best_corr ) {
-        best_corr = corr;
-        best_off  = off;
-      }
-      search_start += p->samples_per_frame;
+    unsigned off;
+
+    for( ;; ) {
+        for( off = lo; off < hi; off += step ) {
+            if( off == skip )
+                continue;
+            float corr = correlate( ppc, search_start + off * p->samples_per_frame,
+                                    p->samples_corr );
+            if( corr > best_corr ) {
+                best_corr = corr;
+                best_off  = off;
+            }
+        }
+        if( step == 1 )
+            break;
+
+        /* refine between the neighbouring coarse offsets */
+        skip = best_off;
+        lo   = best_off >= step ? best_off - step + 1 : 0;
+        hi   = __MIN( best_off + step, p->frames_search );
+        step = 1;
     }
 
     return best_off * p->bytes_per_frame;
 }
 
+static unsigned best_overlap_offset_float( filter_t *p_filter )
+{
+    return search_overlap( p_filter->p_sys );
+}
+
+#ifdef HAVE_AVX2_INTRINSICS
+__attribute__ ((__target__ ("avx2")))
+static unsigned best_overlap_offset_float_avx2( filter_t *p_filter )
+{
+    return search_overlap( p_filter->p_sys );
+}
+#endif
+
+/*****************************************************************************
+ * update_pre_corr: window the overlap saved for the next stride
+ *****************************************************************************/
+static void update_pre_corr( filter_sys_t *p )
+{
+    float *restrict ppc = p->buf_pre_corr;
+    const float *restrict pw = p->table_window;
+    const float *restrict po = (const float *)p->buf_overlap + p->samples_per_frame;
+    unsigned i;
+
+    for( i = 0; i < p->samples_overlap - p->samples_per_frame; i++ )
+        ppc[i] = pw[i] * po[i];
+}
+
 /*****************************************************************************
  * output_overlap: blend end of previous stride with beginning of current stride
  *****************************************************************************/
@@ -260,6 +325,8 @@ static size_t transform_buffer( filter_t *p_filter,
     memcpy( p->buf_overlap,
             p->buf_queue + bytes_off + p->bytes_stride,
             p->bytes_overlap );
+    if( p->best_overlap_offset )
+        update_pre_corr( p );
     double frames_to_slide = p->frames_stride_scaled + p->frames_stride_error;
     unsigned frames_to_stride_whole = (int)frames_to_slide;
     p->bytes_to_slide       = frames_to_stride_whole * p->bytes_per_frame;
@@ -339,9 +406,11 @@ static int reinit_buffers( filter_t *p_filter )
     }
     else
     {
-        unsigned bytes_pre_corr = ( p->samples_overlap - p->samples_per_frame ) * 4; /* sizeof (int32|float) */
-        p->buf_pre_corr = malloc( bytes_pre_corr );
-        p->table_window = malloc( bytes_pre_corr );
+        /* the padding weights stay zero */
+        p->samples_corr = ( p->samples_overlap - p->samples_per_frame
+                            + CORR_LANES - 1 ) & ~( CORR_LANES - 1 );
+        p->buf_pre_corr = calloc( p->samples_corr, sizeof (float) );
+        p->table_window = calloc( p->samples_corr, sizeof (float) );
         if( ! p->buf_pre_corr || ! p->table_window )
             return VLC_ENOMEM;
         float *pw = p->table_window;
@@ -351,7 +420,12 @@ static int reinit_buffers( filter_t *p_filter )
             for( j = 0; j < p->samples_per_frame; j++ )
                 *pw++ = v;
         }
+        update_pre_corr( p );
         p->best_overlap_offset = best_overlap_offset_float;
+#ifdef HAVE_AVX2_INTRINSICS
+        if( vlc_CPU_AVX2() )
+            p->best_overlap_offset = best_overlap_offset_float_avx2;
+#endif
     }
 
     unsigned new_size = ( p->frames_search + frames_stride + frames_overlap ) * p->bytes_per_frame;
@@ -373,21 +447,23 @@ static int reinit_buffers( filter_t *p_filter )
         }
     }
     p->bytes_queue_max = new_size;
-    p->buf_queue = malloc( p->bytes_queue_max );
+    /* the padded correlation of the last offset may read past the queue */
+    p->buf_queue = malloc( p->bytes_queue_max + CORR_LANES * sizeof (float) );
     if( ! p->buf_queue )
         return VLC_ENOMEM;
+    memset( p->buf_queue + p->bytes_queue_max, 0, CORR_LANES * sizeof (float) );
 
     p->bytes_stride_scaled  = p->bytes_stride * p->scale;
     p->frames_stride_scaled = p->bytes_stride_scaled / p->bytes_per_frame;
 
     msg_Dbg( VLC_OBJECT(p_filter),
-             "%.3f scale, %.3f stride_in, %i stride_out, %i standing, %i overlap, %i search, %i queue, %s mode",
+             "%.3f scale, %.3f stride_in, %i stride_out, %i standing, %i overlap, %i search (step %u), %i queue, %s mode",
              p->scale,
              p->frames_stride_scaled,
              (int)( p->bytes_stride / p->bytes_per_frame ),
              (int)( p->bytes_standing / p->bytes_per_frame ),
              (int)( p->bytes_overlap / p->bytes_per_frame ),
-             p->frames_search,
+             p->frames_search, p->search_step,
              (int)( p->bytes_queue_max / p->bytes_per_frame ),
              "fl32");
 
@@ -421,6 +497,9 @@ static int Open( vlc_object_t *p_this )
     p_sys->ms_stride       = var_InheritInteger( p_this, "scaletempo-stride" );
     p_sys->percent_overlap = var_InheritFloat( p_this, "scaletempo-overlap" );
     p_sys->ms_search       = var_InheritInteger( p_this, "scaletempo-search" );
+    int64_t quality        = var_InheritInteger( p_this, "scaletempo-quality" );
+    p_sys->search_step     = pi_quality_steps[
+        VLC_CLIP( quality, 0, (int64_t)ARRAY_SIZE(pi_quality_steps) - 1 ) ];
 
     msg_Dbg( p_this, "params: %i stride, %.3f overlap, %i search",
              p_sys->ms_stride, p_sys->percent_overlap, p_sys->ms_search );
@@ -578,7 +657,7 @@ static block_t *DoWork( filter_t * p_filter, block_t * p_in_buf )
                                    p_in_buf->i_buffer, 0 );
     if( i_outsize > 0 )
     {
-        p_out_buf = block_Alloc( i_outsize );
+        p_out_buf = filter_NewAudioBuffer( p_filter, i_outsize );
         if( p_out_buf == NULL )
         {
             block_Release( p_in_buf );
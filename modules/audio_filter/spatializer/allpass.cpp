@@ -4,6 +4,10 @@
 // http://www.dreampoint.co.uk
 // This code is public domain
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
 #include "allpass.hpp"
 #include <stddef.h>
 
@@ -19,6 +23,46 @@ void allpass::setbuffer(float *buf, int size)
     bufsize = size;
 }
 
+static inline float allpasstick(float *buf, float input, float feedback)
+{
+    float bufout = undenormalise( *buf );
+
+    *buf = input + (bufout*feedback);
+    return -input + bufout;
+}
+
+/* As for the comb filter, the iterations are independent until the delay line
+ * wraps around */
+static void allpasssegment(float *restrict buf, float *restrict io, int n,
+                           float feedback)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        for (int j = 0; j < 8; j++)
+            io[i + j] = allpasstick(&buf[i + j], io[i + j], feedback);
+    for (; i < n; i++)
+        io[i] = allpasstick(&buf[i], io[i], feedback);
+}
+
+/* Filters the samples in place */
+void allpass::processblock(float *samples, int numsamples)
+{
+    while (numsamples > 0)
+    {
+        int n = bufsize - bufidx;
+        if (n > numsamples)
+            n = numsamples;
+
+        allpasssegment(buffer + bufidx, samples, n, feedback);
+        bufidx += n;
+        if (bufidx >= bufsize)
+            bufidx = 0;
+        samples += n;
+        numsamples -= n;
+    }
+}
+
 void allpass::mute()
 {
     for (int i=0; i<bufsize; i++)
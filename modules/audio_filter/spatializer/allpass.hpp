@@ -13,7 +13,7 @@ class allpass
 public:
         allpass();
     void    setbuffer(float *buf, int size);
-    inline  float    process(float inp);
+    void    processblock(float *samples, int numsamples);
     void    mute();
     void    setfeedback(float val);
     float    getfeedback();
@@ -24,24 +24,6 @@ public:
     int    bufidx;
 };
 
-
-// Big to inline - but crucial for speed
-
-inline float allpass::process(float input)
-{
-    float output;
-    float bufout;
-
-    bufout = undenormalise( buffer[bufidx] );
-
-    output = -input + bufout;
-    buffer[bufidx] = input + (bufout*feedback);
-
-    if(++bufidx>=bufsize) bufidx = 0;
-
-    return output;
-}
-
 #endif//_allpass
 
 //ends
@@ -4,12 +4,15 @@
 // http://www.dreampoint.co.uk
 // This code is public domain
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
 #include "comb.hpp"
 #include <stddef.h>
 
 comb::comb()
 {
-    filterstore = 0;
     bufidx = 0;
     buffer = NULL;
 }
@@ -20,6 +23,50 @@ void comb::setbuffer(float *buf, int size)
     bufsize = size;
 }
 
+static inline float combtick(float *buf, float input,
+                            float damp2, float feedback)
+{
+    float output = undenormalise( *buf );
+    float filterstore = undenormalise( output*damp2 );
+
+    *buf = input + filterstore*feedback;
+    return output;
+}
+
+/* The delay line is read before it is written, and the written samples are
+ * not read again before the next wrap around: the iterations are independent
+ * up to the end of the buffer. */
+static void combsegment(float *restrict buf, const float *restrict in,
+                        float *restrict out, int n, float damp2, float feedback)
+{
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+        for (int j = 0; j < 8; j++)
+            out[i + j] += combtick(&buf[i + j], in[i + j], damp2, feedback);
+    for (; i < n; i++)
+        out[i] += combtick(&buf[i], in[i], damp2, feedback);
+}
+
+/* Adds the filter output to the output buffer */
+void comb::processblock(const float *input, float *output, int numsamples)
+{
+    while (numsamples > 0)
+    {
+        int n = bufsize - bufidx;
+        if (n > numsamples)
+            n = numsamples;
+
+        combsegment(buffer + bufidx, input, output, n, damp2, feedback);
+        bufidx += n;
+        if (bufidx >= bufsize)
+            bufidx = 0;
+        input += n;
+        output += n;
+        numsamples -= n;
+    }
+}
+
 void comb::mute()
 {
     for (int i=0; i<bufsize; i++)
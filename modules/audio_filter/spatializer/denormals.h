@@ -8,11 +8,15 @@
 #ifndef _denormals_
 #define _denormals_
 
+#include <float.h>
+#include <math.h>
 
-#ifdef __cplusplus
-extern "C"
-#endif
-float undenormalise( float );
+/* A comparison rather than fpclassify(), so that the loops using it can be
+ * vectorized. Zeroes are flushed too, which is harmless. */
+static inline float undenormalise( float f )
+{
+    return fabsf( f ) < FLT_MIN ? 0.0f : f;
+}
 
 #endif//_denormals_
 
@@ -89,70 +89,74 @@ void revmodel::mute()
  * /param long numsamples  number of samples to be processed
  * /param int skip             number of channels in the audio stream
  *****************************************************************************/
-void revmodel::processreplace(float *inputL, float *outputL, long /* numsamples */, int skip)
+void revmodel::processreplace(float *inputL, float *outputL, long numsamples, int skip)
 {
-    float outL,outR,input;
-    float inputR;
-    int i;
-
-    outL = outR = 0;
-        /* TODO this module supports only 2 audio channels, let's improve this */
-        if (skip > 1)
-           inputR = inputL[1];
-        else
-           inputR = inputL[0];
-        input = (inputL[0] + inputR) * gain;
-
-        // Accumulate comb filters in parallel
-        for(i=0; i<numcombs; i++)
-        {
-            outL += combL[i].process(input);
-            outR += combR[i].process(input);
-        }
-
-        // Feed through allpasses in series
-        for(i=0; i<numallpasses; i++)
-        {
-            outL = allpassL[i].process(outL);
-            outR = allpassR[i].process(outR);
-        }
+    process(inputL, outputL, numsamples, skip, false);
+}
 
-        // Calculate output REPLACING anything already there
-        outputL[0] = (outL*wet1 + outR*wet2 + inputR*dry);
-           if (skip > 1)
-        outputL[1] = (outR*wet1 + outL*wet2 + inputR*dry);
+void revmodel::processmix(float *inputL, float *outputL, long numsamples, int skip)
+{
+    process(inputL, outputL, numsamples, skip, true);
 }
 
-void revmodel::processmix(float *inputL, float *outputL, long /* numsamples */, int skip)
+/* The filters run over blocks of samples rather than sample by sample, so
+ * that their inner loops can be vectorized. The input of a block is read
+ * before its output is written, so the processing can be done in place. */
+void revmodel::process(float *inputL, float *outputL, long numsamples, int skip, bool mix)
 {
-    float outL,outR,input;
-    float inputR;
+    float input[blocksize], inputR[blocksize];
+    float outL[blocksize], outR[blocksize];
 
-    outL = outR = 0;
-        if (skip > 1)
-           inputR = inputL[1];
-        else
-           inputR = inputL[0];
-        input = (inputL[0] + inputR) * gain;
+    while (numsamples > 0)
+    {
+        int n = numsamples < blocksize ? numsamples : blocksize;
+
+        /* TODO this module supports only 2 audio channels, let's improve this */
+        for (int i = 0; i < n; i++)
+        {
+            inputR[i] = inputL[i * skip + (skip > 1 ? 1 : 0)];
+            input[i] = (inputL[i * skip] + inputR[i]) * gain;
+            outL[i] = outR[i] = 0;
+        }
 
         // Accumulate comb filters in parallel
-        for(int i=0; i<numcombs; i++)
+        for (int i = 0; i < numcombs; i++)
         {
-            outL += combL[i].process(input);
-            outR += combR[i].process(input);
+            combL[i].processblock(input, outL, n);
+            combR[i].processblock(input, outR, n);
         }
 
         // Feed through allpasses in series
-        for(int i=0; i<numallpasses; i++)
+        for (int i = 0; i < numallpasses; i++)
         {
-            outL = allpassL[i].process(outL);
-            outR = allpassR[i].process(outR);
+            allpassL[i].processblock(outL, n);
+            allpassR[i].processblock(outR, n);
         }
 
-        // Calculate output REPLACING anything already there
-        outputL[0] += (outL*wet1 + outR*wet2 + inputR*dry);
-           if (skip > 1)
-        outputL[1] += (outR*wet1 + outL*wet2 + inputR*dry);
+        // Calculate output, either REPLACING or mixing with what is there
+        for (int i = 0; i < n; i++)
+        {
+            float left = outL[i]*wet1 + outR[i]*wet2 + inputR[i]*dry;
+            float right = outR[i]*wet1 + outL[i]*wet2 + inputR[i]*dry;
+
+            if (mix)
+            {
+                outputL[i * skip] += left;
+                if (skip > 1)
+                    outputL[i * skip + 1] += right;
+            }
+            else
+            {
+                outputL[i * skip] = left;
+                if (skip > 1)
+                    outputL[i * skip + 1] = right;
+            }
+        }
+
+        inputL += n * skip;
+        outputL += n * skip;
+        numsamples -= n;
+    }
 }
 
 void revmodel::update()
@@ -35,6 +35,7 @@ public:
     void    setmode(float value);
 private:
     void    update();
+    void    process(float *inputL, float *outputL, long numsamples, int skip, bool mix);
 private:
     float    gain;
     float    roomsize,roomsize1;
@@ -24,6 +24,7 @@ const float initialwidth     = 1;
 const float initialmode      = 0;
 const float freezemode       = 0.5f;
 const int   stereospread     = 23;
+const int   blocksize        = 256;
 
 // These values assume 44.1KHz sample rate
 // they will probably be OK for 48KHz sample rate
@@ -31,6 +31,7 @@
 #include <stddef.h>
 #include <vlc_common.h>
 #include <vlc_plugin.h>
+#include <vlc_cpu.h>
 #include <vlc_aout.h>
 #include <vlc_aout_volume.h>
 
@@ -50,6 +51,27 @@ vlc_module_begin ()
     set_callback( Create )
 vlc_module_end ()
 
+/* The inner loop has a constant trip count so that it gets vectorized.
+ * An AVX variant is picked at run time on x86. */
+#define AMPLIFY_CHUNK 64 /* samples */
+
+#define AMPLIFY(name, type, attr) \
+attr static void name(type *p, size_t n, type mult) \
+{ \
+    for (; n >= AMPLIFY_CHUNK; n -= AMPLIFY_CHUNK, p += AMPLIFY_CHUNK) \
+        for (size_t i = 0; i < AMPLIFY_CHUNK; i++) \
+            p[i] *= mult; \
+    for (size_t i = 0; i < n; i++) \
+        p[i] *= mult; \
+}
+
+AMPLIFY(AmplifyFL32, float, )
+AMPLIFY(AmplifyFL64, double, )
+#ifdef HAVE_AVX2_INTRINSICS
+AMPLIFY(AmplifyFL32AVX, float, __attribute__ ((__target__ ("avx"))))
+AMPLIFY(AmplifyFL64AVX, double, __attribute__ ((__target__ ("avx"))))
+#endif
+
 /**
  * Mixes a new output buffer
  */
@@ -60,8 +82,13 @@ static void FilterFL32( audio_volume_t *p_volume, block_t *p_buffer,
         return; /* nothing to do */
 
     float *p = (float *)p_buffer->p_buffer;
-    for( size_t i = p_buffer->i_buffer / sizeof(*p); i > 0; i-- )
-        *(p++) *= f_multiplier;
+    size_t n = p_buffer->i_buffer / sizeof(*p);
+#ifdef HAVE_AVX2_INTRINSICS
+    if( vlc_CPU_AVX() )
+        AmplifyFL32AVX( p, n, f_multiplier );
+    else
+#endif
+        AmplifyFL32( p, n, f_multiplier );
 
     (void) p_volume;
 }
@@ -74,8 +101,13 @@ static void FilterFL64( audio_volume_t *p_volume, block_t *p_buffer,
     if( mult == 1. )
         return; /* nothing to do */
 
-    for( size_t i = p_buffer->i_buffer / sizeof(*p); i > 0; i-- )
-        *(p++) *= mult;
+    size_t n = p_buffer->i_buffer / sizeof(*p);
+#ifdef HAVE_AVX2_INTRINSICS
+    if( vlc_CPU_AVX() )
+        AmplifyFL64AVX( p, n, mult );
+    else
+#endif
+        AmplifyFL64( p, n, mult );
 
     (void) p_volume;
 }
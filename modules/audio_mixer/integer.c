@@ -27,6 +27,7 @@
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
+#include <vlc_cpu.h>
 #include <vlc_aout.h>
 #include <vlc_aout_volume.h>
 
@@ -40,6 +41,37 @@ vlc_module_begin ()
     set_callback(Activate)
 vlc_module_end ()
 
+/* Branchless clipping over fixed-size chunks, for the vectorizer;
+ * there is also an AVX2 build of each loop. */
+#define AMPLIFY_CHUNK 64 /* samples */
+
+#define AMPLIFY(name, type, wtype, shift, min, max, attr) \
+attr static void name(type *p, size_t n, wtype mult) \
+{ \
+    for (; n >= AMPLIFY_CHUNK; n -= AMPLIFY_CHUNK, p += AMPLIFY_CHUNK) \
+        for (size_t i = 0; i < AMPLIFY_CHUNK; i++) \
+        { \
+            wtype s = (p[i] * mult) >> shift; \
+            s = s > max ? max : s; \
+            p[i] = s < min ? min : s; \
+        } \
+    for (size_t i = 0; i < n; i++) \
+    { \
+        wtype s = (p[i] * mult) >> shift; \
+        s = s > max ? max : s; \
+        p[i] = s < min ? min : s; \
+    } \
+}
+
+AMPLIFY(AmplifyS32N, int32_t, int64_t, 24, INT32_MIN, INT32_MAX, )
+AMPLIFY(AmplifyS16N, int16_t, int32_t, 8, INT16_MIN, INT16_MAX, )
+#ifdef HAVE_AVX2_INTRINSICS
+AMPLIFY(AmplifyS32NAVX2, int32_t, int64_t, 24, INT32_MIN, INT32_MAX,
+        __attribute__ ((__target__ ("avx2"))))
+AMPLIFY(AmplifyS16NAVX2, int16_t, int32_t, 8, INT16_MIN, INT16_MAX,
+        __attribute__ ((__target__ ("avx2"))))
+#endif
+
 static void FilterS32N (audio_volume_t *vol, block_t *block, float volume)
 {
     int32_t *p = (int32_t *)block->p_buffer;
@@ -48,16 +80,13 @@ static void FilterS32N (audio_volume_t *vol, block_t *block, float volume)
     if (mult == (1 << 24))
         return;
 
-    for (size_t n = block->i_buffer / sizeof (*p); n > 0; n--)
-    {
-        int_fast64_t s = (*p * (int_fast64_t)mult) >> INT64_C(24);
-        if (s > INT32_MAX)
-            s = INT32_MAX;
-        else
-        if (s < INT32_MIN)
-            s = INT32_MIN;
-        *(p++) = s;
-    }
+    size_t n = block->i_buffer / sizeof (*p);
+#ifdef HAVE_AVX2_INTRINSICS
+    if (vlc_CPU_AVX2())
+        AmplifyS32NAVX2 (p, n, mult);
+    else
+#endif
+        AmplifyS32N (p, n, mult);
     (void) vol;
 }
 
@@ -69,16 +98,13 @@ static void FilterS16N (audio_volume_t *vol, block_t *block, float volume)
     if (mult == (1 << 8))
         return;
 
-    for (size_t n = block->i_buffer / sizeof (*p); n > 0; n--)
-    {
-        int_fast32_t s = (*p * (int_fast32_t)mult) >> 8;
-        if (s > INT16_MAX)
-            s = INT16_MAX;
-        else
-        if (s < INT16_MIN)
-            s = INT16_MIN;
-        *(p++) = s;
-    }
+    size_t n = block->i_buffer / sizeof (*p);
+#ifdef HAVE_AVX2_INTRINSICS
+    if (vlc_CPU_AVX2())
+        AmplifyS16NAVX2 (p, n, mult);
+    else
+#endif
+        AmplifyS16N (p, n, mult);
     (void) vol;
 }
 
@@ -42,14 +42,39 @@
 static int  Open (vlc_object_t *);
 static void Close(vlc_object_t *);
 
+#define SOUT_CFG_PREFIX "sout-x265-"
+
+#define KEYINT_TEXT N_("Maximum GOP size")
+#define KEYINT_LONGTEXT N_("Sets maximum interval between keyframes.")
+
+#define MIN_KEYINT_TEXT N_("Minimum GOP size")
+#define MIN_KEYINT_LONGTEXT N_("Sets minimum interval between keyframes. " \
+    "0 chooses it from the maximum GOP size and the frame rate.")
+
+#define SCENE_TEXT N_("Extra I-frames aggressivity")
+#define SCENE_LONGTEXT N_("Scene-cut detection. Controls how aggressively " \
+    "to insert extra keyframes. 0 disables scene-cut detection.")
+
 vlc_module_begin ()
     set_description(N_("H.265/HEVC encoder (x265)"))
     set_capability("encoder", 200)
     set_callbacks(Open, Close)
     set_category(CAT_INPUT)
     set_subcategory(SUBCAT_INPUT_VCODEC)
+
+    add_integer(SOUT_CFG_PREFIX "keyint", 250, KEYINT_TEXT,
+                KEYINT_LONGTEXT, false)
+    add_integer(SOUT_CFG_PREFIX "min-keyint", 0, MIN_KEYINT_TEXT,
+                MIN_KEYINT_LONGTEXT, true)
+    add_integer(SOUT_CFG_PREFIX "scenecut", 40, SCENE_TEXT,
+                SCENE_LONGTEXT, true)
+        change_integer_range(0, 100)
 vlc_module_end ()
 
+static const char *const ppsz_sout_options[] = {
+    "keyint", "min-keyint", "scenecut", NULL
+};
+
 typedef struct
 {
     x265_encoder    *h;
@@ -187,6 +212,16 @@ static int  Open (vlc_object_t *p_this)
         return VLC_EGENERIC;
     }
 
+    config_ChainParse(p_enc, SOUT_CFG_PREFIX, ppsz_sout_options, p_enc->p_cfg);
+
+    int i_val = var_GetInteger(p_enc, SOUT_CFG_PREFIX "keyint");
+    if (i_val > 0)
+        param->keyframeMax = i_val;
+    i_val = var_GetInteger(p_enc, SOUT_CFG_PREFIX "min-keyint");
+    if (i_val > 0)
+        param->keyframeMin = i_val;
+    param->scenecutThreshold = var_GetInteger(p_enc, SOUT_CFG_PREFIX "scenecut");
+
     if (p_enc->fmt_out.i_bitrate > 0) {
         param->rc.bitrate = p_enc->fmt_out.i_bitrate / 1000;
         param->rc.rateControlMode = X265_RC_ABR;
@@ -916,6 +916,10 @@ static int Statistics(struct cli_client *cl, const char *const *args,
                    item->p_stats->i_late_pictures);
         cli_printf(cl, _("| frames lost      :    %5"PRIi64),
                    item->p_stats->i_lost_pictures);
+        cli_printf(cl, _("| render time      :    %5"PRIi64" us"),
+                   item->p_stats->i_render_time);
+        cli_printf(cl, _("| display margin   :    %5"PRIi64" us"),
+                   item->p_stats->i_display_slack);
         cli_printf(cl, "|");
 
         /* Audio*/
@@ -619,6 +619,8 @@ static int vlclua_input_item_stats( lua_State *L )
         STATS_INT( displayed_pictures )
         STATS_INT( late_pictures )
         STATS_INT( lost_pictures )
+        STATS_INT( render_time )
+        STATS_INT( display_slack )
         STATS_INT( played_abuffers )
         STATS_INT( lost_abuffers )
 #undef STATS_INT
@@ -26,6 +26,8 @@
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
+#include <vlc_executor.h>
+#include <vlc_list.h>
 #include <vlc_stream.h>
 #include <vlc_modules.h>
 #include <vlc_meta.h>
@@ -42,42 +44,57 @@
 
 struct fingerprinter_sys_t
 {
-    vlc_thread_t thread;
-    vlc_player_t *player;
-    vlc_player_listener_id *listener_id;
+    vlc_executor_t *executor;
 
     atomic_bool abort;
 
+    vlc_mutex_t lock;
+    struct vlc_list tasks; /**< submitted, and not completed, requests */
+
     struct
     {
         vlc_array_t         queue;
         vlc_mutex_t         lock;
-    } incoming, results;
+    } results;
+};
 
-    vlc_cond_t              incoming_cond;
+/* A request, decoded on its own player from an executor thread */
+struct fingerprinter_task
+{
+    fingerprinter_thread_t *fingerprinter;
+    fingerprint_request_t *request;
 
-    struct
-    {
-        vlc_array_t         queue;
-        vlc_cond_t          cond;
-        bool                b_working;
-    } processing;
+    vlc_player_t *player; /**< while fingerprinting, protected by sys->lock */
+    vlc_cond_t cond;
+    bool b_working;
+    vlc_tick_t length;
+
+    struct vlc_runnable runnable;
+    struct vlc_list node;
 };
 
 static int  Open            (vlc_object_t *);
 static void Close           (vlc_object_t *);
 static void CleanSys        (fingerprinter_sys_t *);
-static void *Run(void *);
+static void Run(void *);
 
 /*****************************************************************************
  * Module descriptor
  ****************************************************************************/
+#define THREADS_TEXT N_("Fingerprinting threads")
+#define THREADS_LONGTEXT N_( \
+    "Maximum number of tracks fingerprinted at the same time " \
+    "(0 for the number of CPUs)." )
+
 vlc_module_begin ()
     set_category(CAT_ADVANCED)
     set_subcategory(SUBCAT_ADVANCED_MISC)
     set_shortname(N_("acoustid"))
     set_description(N_("Track fingerprinter (based on Acoustid)"))
     set_capability("fingerprinter", 10)
+    add_integer("fingerprinter-threads", 0, THREADS_TEXT, THREADS_LONGTEXT,
+                true)
+        change_integer_range(0, 64)
     set_callbacks(Open, Close)
 vlc_module_end ()
 
@@ -88,22 +105,26 @@ vlc_module_end ()
 static int EnqueueRequest( fingerprinter_thread_t *f, fingerprint_request_t *r )
 {
     fingerprinter_sys_t *p_sys = f->p_sys;
-    vlc_mutex_lock( &p_sys->incoming.lock );
-    int i_ret = vlc_array_append( &p_sys->incoming.queue, r );
-    vlc_cond_signal( &p_sys->incoming_cond );
-    vlc_mutex_unlock( &p_sys->incoming.lock );
-    return i_ret;
-}
 
-static void QueueIncomingRequests( fingerprinter_sys_t *p_sys )
-{
-    for( size_t i = vlc_array_count( &p_sys->incoming.queue ); i > 0 ; i-- )
-    {
-        fingerprint_request_t *r = vlc_array_item_at_index( &p_sys->incoming.queue, i - 1 );
-        if( vlc_array_append( &p_sys->processing.queue, r ) )
-            fingerprint_request_Delete( r );
-    }
-    vlc_array_clear( &p_sys->incoming.queue );
+    struct fingerprinter_task *task = malloc( sizeof( *task ) );
+    if( unlikely(task == NULL) )
+        return VLC_ENOMEM;
+
+    task->fingerprinter = f;
+    task->request = r;
+    task->player = NULL;
+    vlc_cond_init( &task->cond );
+    task->b_working = false;
+    task->length = 0;
+    task->runnable.run = Run;
+    task->runnable.userdata = task;
+
+    vlc_mutex_lock( &p_sys->lock );
+    vlc_list_append( &task->node, &p_sys->tasks );
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_executor_Submit( p_sys->executor, &task->runnable );
+    return VLC_SUCCESS;
 }
 
 static fingerprint_request_t * GetResult( fingerprinter_thread_t *f )
@@ -137,27 +158,39 @@ static void player_on_state_changed(vlc_player_t *player,
                                     void *p_user_data)
 {
     VLC_UNUSED(player);
-    fingerprinter_sys_t *p_sys = p_user_data;
+    struct fingerprinter_task *task = p_user_data;
     if (new_state == VLC_PLAYER_STATE_STOPPED)
     {
-        p_sys->processing.b_working = false;
-        vlc_cond_signal( &p_sys->processing.cond );
+        task->b_working = false;
+        vlc_cond_signal( &task->cond );
     }
 }
 
-static void DoFingerprint( fingerprinter_thread_t *p_fingerprinter,
+static void player_on_length_changed(vlc_player_t *player, vlc_tick_t new_length,
+                                     void *p_user_data)
+{
+    VLC_UNUSED(player);
+    struct fingerprinter_task *task = p_user_data;
+    task->length = new_length;
+}
+
+static void DoFingerprint( struct fingerprinter_task *task,
                            acoustid_fingerprint_t *fp,
                            const char *psz_uri )
 {
+    fingerprinter_thread_t *p_fingerprinter = task->fingerprinter;
+    fingerprinter_sys_t *p_sys = p_fingerprinter->p_sys;
+
     input_item_t *p_item = input_item_New( NULL, NULL );
     if ( unlikely(p_item == NULL) )
          return;
 
     char *psz_sout_option;
-    /* Note: need at -max- 2 channels, but we can't guess it before playing */
-    /* the stereo upmix could make the mono tracks fingerprint to differ :/ */
+    /* Chromaprint downmixes to mono and resamples to 11025 Hz by itself:
+     * do it while transcoding instead, on a quarter of the samples */
     if ( asprintf( &psz_sout_option,
-                   "sout=#transcode{acodec=%s,channels=2}:chromaprint",
+                   "sout=#transcode{acodec=%s,channels=1,samplerate=11025}"
+                   ":chromaprint",
                    ( VLC_CODEC_S16L == VLC_CODEC_S16N ) ? "s16l" : "s16b" )
          == -1 )
     {
@@ -167,9 +200,20 @@ static void DoFingerprint( fingerprinter_thread_t *p_fingerprinter,
 
     input_item_AddOption( p_item, psz_sout_option, VLC_INPUT_OPTION_TRUSTED );
     free( psz_sout_option );
-    if ( fp->i_duration )
+    input_item_AddOption( p_item, "no-sout-video", VLC_INPUT_OPTION_TRUSTED );
+    input_item_AddOption( p_item, "no-sout-spu", VLC_INPUT_OPTION_TRUSTED );
+
+    /* Only the beginning of the track is fingerprinted: do not decode the
+     * rest of it. The length is an option of the chromaprint plugin. */
+    unsigned i_stop = 0;
+    if ( config_FindConfig( "duration" ) != NULL )
+        i_stop = var_InheritInteger( p_fingerprinter, "duration" );
+    if ( fp->i_duration && ( !i_stop || fp->i_duration < i_stop ) )
+        i_stop = fp->i_duration;
+    if ( i_stop )
     {
-        if ( asprintf( &psz_sout_option, "stop-time=%u", fp->i_duration ) == -1 )
+        /* with a margin, so that the last block reaches the fingerprint */
+        if ( asprintf( &psz_sout_option, "stop-time=%u", i_stop + 1 ) == -1 )
         {
             input_item_Release( p_item );
             return;
@@ -184,31 +228,78 @@ static void DoFingerprint( fingerprinter_thread_t *p_fingerprinter,
     chroma_fingerprint.psz_fingerprint = NULL;
     chroma_fingerprint.i_duration = fp->i_duration;
 
-    var_Create( p_fingerprinter, "fingerprint-data", VLC_VAR_ADDRESS );
-    var_SetAddress( p_fingerprinter, "fingerprint-data", &chroma_fingerprint );
+    /* Each player gets its own data holder, found by the chromaprint stream
+     * output through variable inheritance */
+    vlc_object_t *p_obj = vlc_object_create( p_fingerprinter, sizeof( *p_obj ) );
+    if ( unlikely(p_obj == NULL) )
+    {
+        input_item_Release( p_item );
+        return;
+    }
+    var_Create( p_obj, "fingerprint-data", VLC_VAR_ADDRESS );
+    var_SetAddress( p_obj, "fingerprint-data", &chroma_fingerprint );
 
-    vlc_player_t *player = p_fingerprinter->p_sys->player;
-    vlc_player_Lock(player);
+    vlc_player_t *player = vlc_player_New( p_obj, VLC_PLAYER_LOCK_NORMAL,
+                                           NULL, NULL );
+    if ( player == NULL )
+    {
+        vlc_object_delete( p_obj );
+        input_item_Release( p_item );
+        return;
+    }
 
-    p_fingerprinter->p_sys->processing.b_working = true;
+    static const struct vlc_player_cbs cbs = {
+        .on_state_changed = player_on_state_changed,
+        .on_length_changed = player_on_length_changed,
+    };
 
-    int ret = vlc_player_SetCurrentMedia(player, p_item);
-    if (ret == VLC_SUCCESS)
-        ret = vlc_player_Start(player);
+    vlc_mutex_lock( &p_sys->lock );
+    task->player = player;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_player_Lock(player);
+    vlc_player_listener_id *listener_id =
+        vlc_player_AddListener(player, &cbs, task);
+
+    int ret = VLC_EGENERIC;
+    /* Close() sets abort, then stops the player with its lock held */
+    if ( listener_id != NULL
+      && !atomic_load_explicit( &p_sys->abort, memory_order_relaxed ) )
+    {
+        task->b_working = true;
+        ret = vlc_player_SetCurrentMedia(player, p_item);
+        if (ret == VLC_SUCCESS)
+            ret = vlc_player_Start(player);
+    }
     input_item_Release(p_item);
 
     if (ret == VLC_SUCCESS)
     {
-        while( p_fingerprinter->p_sys->processing.b_working )
-            vlc_player_CondWait(player,
-                                &p_fingerprinter->p_sys->processing.cond);
+        while( task->b_working )
+            vlc_player_CondWait(player, &task->cond);
 
         fp->psz_fingerprint = chroma_fingerprint.psz_fingerprint;
         if( !fp->i_duration ) /* had not given hint */
-            fp->i_duration = chroma_fingerprint.i_duration;
+        {
+            /* The decoding was stopped early: the stream output only knows
+             * the length of the fingerprinted part */
+            if( task->length > 0 )
+                fp->i_duration = SEC_FROM_VLC_TICK( task->length );
+            else
+                fp->i_duration = chroma_fingerprint.i_duration;
+        }
     }
 
+    if (listener_id != NULL)
+        vlc_player_RemoveListener(player, listener_id);
     vlc_player_Unlock(player);
+
+    vlc_mutex_lock( &p_sys->lock );
+    task->player = NULL;
+    vlc_mutex_unlock( &p_sys->lock );
+
+    vlc_player_Delete(player);
+    vlc_object_delete(p_obj);
 }
 
 /*****************************************************************************
@@ -224,40 +315,26 @@ static int Open(vlc_object_t *p_this)
 
     p_fingerprinter->p_sys = p_sys;
 
-    var_Create(p_fingerprinter, "vout", VLC_VAR_STRING);
-    var_SetString(p_fingerprinter, "vout", "dummy");
-    var_Create(p_fingerprinter, "aout", VLC_VAR_STRING);
-    var_SetString(p_fingerprinter, "aout", "dummy");
-    p_sys->player = vlc_player_New(VLC_OBJECT(p_fingerprinter),
-                                   VLC_PLAYER_LOCK_NORMAL, NULL, NULL );
-    if (!p_sys->player)
-    {
-        free(p_sys);
-        return VLC_ENOMEM;
-    }
-
-    static const struct vlc_player_cbs cbs = {
-        .on_state_changed = player_on_state_changed,
-    };
+    unsigned i_threads = var_InheritInteger( p_fingerprinter,
+                                             "fingerprinter-threads" );
+    if ( i_threads == 0 )
+        i_threads = vlc_GetCPUCount();
 
-    vlc_player_Lock(p_sys->player);
-    p_sys->listener_id =
-        vlc_player_AddListener(p_sys->player, &cbs, p_fingerprinter->p_sys);
-    vlc_player_Unlock(p_sys->player);
-    if (!p_sys->listener_id)
+    p_sys->executor = vlc_executor_New( i_threads );
+    if ( !p_sys->executor )
     {
-        vlc_player_Delete(p_sys->player);
         free(p_sys);
         return VLC_ENOMEM;
     }
 
-    atomic_init( &p_sys->abort, false );
-    vlc_array_init( &p_sys->incoming.queue );
-    vlc_mutex_init( &p_sys->incoming.lock );
-    vlc_cond_init( &p_sys->incoming_cond );
+    var_Create(p_fingerprinter, "vout", VLC_VAR_STRING);
+    var_SetString(p_fingerprinter, "vout", "dummy");
+    var_Create(p_fingerprinter, "aout", VLC_VAR_STRING);
+    var_SetString(p_fingerprinter, "aout", "dummy");
 
-    vlc_array_init( &p_sys->processing.queue );
-    vlc_cond_init( &p_sys->processing.cond );
+    atomic_init( &p_sys->abort, false );
+    vlc_mutex_init( &p_sys->lock );
+    vlc_list_init( &p_sys->tasks );
 
     vlc_array_init( &p_sys->results.queue );
     vlc_mutex_init( &p_sys->results.lock );
@@ -267,19 +344,10 @@ static int Open(vlc_object_t *p_this)
     p_fingerprinter->pf_apply = ApplyResult;
 
     var_Create( p_fingerprinter, "results-available", VLC_VAR_BOOL );
-    if( vlc_clone( &p_sys->thread, Run, p_fingerprinter,
-                   VLC_THREAD_PRIORITY_LOW ) )
-    {
-        msg_Err( p_fingerprinter, "cannot spawn fingerprinter thread" );
-        goto error;
-    }
 
+    msg_Dbg( p_fingerprinter, "fingerprinting up to %u tracks at a time",
+             i_threads );
     return VLC_SUCCESS;
-
-error:
-    CleanSys( p_sys );
-    free( p_sys );
-    return VLC_EGENERIC;
 }
 
 /*****************************************************************************
@@ -290,11 +358,29 @@ static void Close(vlc_object_t *p_this)
     fingerprinter_thread_t   *p_fingerprinter = (fingerprinter_thread_t*) p_this;
     fingerprinter_sys_t *p_sys = p_fingerprinter->p_sys;
 
-    vlc_mutex_lock( &p_sys->incoming.lock );
     atomic_store_explicit( &p_sys->abort, true, memory_order_relaxed );
-    vlc_cond_signal( &p_sys->incoming_cond );
-    vlc_mutex_unlock( &p_sys->incoming.lock );
-    vlc_join( p_sys->thread, NULL );
+
+    vlc_mutex_lock( &p_sys->lock );
+    struct fingerprinter_task *task;
+    vlc_list_foreach( task, &p_sys->tasks, node )
+    {
+        if( vlc_executor_Cancel( p_sys->executor, &task->runnable ) )
+        {
+            vlc_list_remove( &task->node );
+            fingerprint_request_Delete( task->request );
+            free( task );
+        }
+        else if( task->player != NULL )
+        {
+            vlc_player_Lock( task->player );
+            vlc_player_Stop( task->player );
+            vlc_player_Unlock( task->player );
+        }
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    /* Wait for the running requests */
+    vlc_executor_Delete( p_sys->executor );
 
     CleanSys( p_sys );
     free( p_sys );
@@ -302,22 +388,11 @@ static void Close(vlc_object_t *p_this)
 
 static void CleanSys( fingerprinter_sys_t *p_sys )
 {
-    for ( size_t i = 0; i < vlc_array_count( &p_sys->incoming.queue ); i++ )
-        fingerprint_request_Delete( vlc_array_item_at_index( &p_sys->incoming.queue, i ) );
-    vlc_array_clear( &p_sys->incoming.queue );
-
-    for ( size_t i = 0; i < vlc_array_count( &p_sys->processing.queue ); i++ )
-        fingerprint_request_Delete( vlc_array_item_at_index( &p_sys->processing.queue, i ) );
-    vlc_array_clear( &p_sys->processing.queue );
+    assert( vlc_list_is_empty( &p_sys->tasks ) );
 
     for ( size_t i = 0; i < vlc_array_count( &p_sys->results.queue ); i++ )
         fingerprint_request_Delete( vlc_array_item_at_index( &p_sys->results.queue, i ) );
     vlc_array_clear( &p_sys->results.queue );
-
-    vlc_player_Lock(p_sys->player);
-    vlc_player_RemoveListener(p_sys->player, p_sys->listener_id);
-    vlc_player_Unlock(p_sys->player);
-    vlc_player_Delete(p_sys->player);
 }
 
 static void fill_metas_with_results( fingerprint_request_t *p_r, acoustid_fingerprint_t *p_f )
@@ -344,81 +419,56 @@ static void fill_metas_with_results( fingerprint_request_t *p_r, acoustid_finger
 /*****************************************************************************
  * Run :
  *****************************************************************************/
-static void *Run( void *opaque )
+static void Run( void *opaque )
 {
-    fingerprinter_thread_t *p_fingerprinter = opaque;
+    struct fingerprinter_task *task = opaque;
+    fingerprinter_thread_t *p_fingerprinter = task->fingerprinter;
     fingerprinter_sys_t *p_sys = p_fingerprinter->p_sys;
+    fingerprint_request_t *p_data = task->request;
 
-    /* main loop */
-    for (;;)
+    char *psz_uri = input_item_GetURI( p_data->p_item );
+    if ( psz_uri != NULL
+      && !atomic_load_explicit( &p_sys->abort, memory_order_relaxed ) )
     {
-        vlc_mutex_lock( &p_sys->incoming.lock );
+        acoustid_fingerprint_t acoustid_print = {0};
 
-        while( vlc_array_count( &p_sys->incoming.queue ) == 0 )
-        {
-            if( atomic_load_explicit( &p_sys->abort, memory_order_relaxed ) )
-            {
-                vlc_mutex_unlock( &p_sys->incoming.lock );
-                return NULL;
-            }
-            vlc_cond_wait( &p_sys->incoming_cond, &p_sys->incoming.lock );
-        }
+        /* overwrite with hint, as in this case, fingerprint's session will be truncated */
+        if ( p_data->i_duration )
+             acoustid_print.i_duration = p_data->i_duration;
 
-        QueueIncomingRequests( p_sys );
+        DoFingerprint( task, &acoustid_print, psz_uri );
 
-        vlc_mutex_unlock( &p_sys->incoming.lock );
-
-        bool results_available = false;
-        while( vlc_array_count( &p_sys->processing.queue ) )
+        if ( !atomic_load_explicit( &p_sys->abort, memory_order_relaxed ) )
         {
-            fingerprint_request_t *p_data = vlc_array_item_at_index( &p_sys->processing.queue, 0 );
-
-            char *psz_uri = input_item_GetURI( p_data->p_item );
-            if ( psz_uri != NULL )
-            {
-                 acoustid_fingerprint_t acoustid_print = {0};
-
-                /* overwrite with hint, as in this case, fingerprint's session will be truncated */
-                if ( p_data->i_duration )
-                     acoustid_print.i_duration = p_data->i_duration;
-
-                DoFingerprint( p_fingerprinter, &acoustid_print, psz_uri );
-                free( psz_uri );
-
-                acoustid_config_t cfg = { .p_obj = VLC_OBJECT(p_fingerprinter),
-                                          .psz_server = NULL, .psz_apikey = NULL };
-                acoustid_lookup_fingerprint( &cfg, &acoustid_print );
-                fill_metas_with_results( p_data, &acoustid_print );
-
-                for( unsigned j = 0; j < acoustid_print.results.count; j++ )
-                     acoustid_result_release( &acoustid_print.results.p_results[j] );
-                if( acoustid_print.results.count )
-                    free( acoustid_print.results.p_results );
-                free( acoustid_print.psz_fingerprint );
-            }
-
-            /* copy results */
-            vlc_mutex_lock( &p_sys->results.lock );
-            if( vlc_array_append( &p_sys->results.queue, p_data ) )
-                fingerprint_request_Delete( p_data );
-            else
-                results_available = true;
-            vlc_mutex_unlock( &p_sys->results.lock );
-
-            // the fingerprint request must not exist both in the
-            // processing and results queue, even in case of thread
-            // cancellation, so remove it immediately
-            vlc_array_remove( &p_sys->processing.queue, 0 );
-
-            if( atomic_load_explicit( &p_sys->abort, memory_order_relaxed ) )
-                return NULL;
+            acoustid_config_t cfg = { .p_obj = VLC_OBJECT(p_fingerprinter),
+                                      .psz_server = NULL, .psz_apikey = NULL };
+            acoustid_lookup_fingerprint( &cfg, &acoustid_print );
+            fill_metas_with_results( p_data, &acoustid_print );
         }
 
-        if ( results_available )
-        {
-            var_TriggerCallback( p_fingerprinter, "results-available" );
-        }
+        for( unsigned j = 0; j < acoustid_print.results.count; j++ )
+             acoustid_result_release( &acoustid_print.results.p_results[j] );
+        if( acoustid_print.results.count )
+            free( acoustid_print.results.p_results );
+        free( acoustid_print.psz_fingerprint );
     }
+    free( psz_uri );
+
+    /* copy results */
+    bool results_available = false;
+    vlc_mutex_lock( &p_sys->results.lock );
+    if( vlc_array_append( &p_sys->results.queue, p_data ) )
+        fingerprint_request_Delete( p_data );
+    else
+        results_available = true;
+    vlc_mutex_unlock( &p_sys->results.lock );
+
+    vlc_mutex_lock( &p_sys->lock );
+    vlc_list_remove( &task->node );
+    vlc_mutex_unlock( &p_sys->lock );
+    free( task );
 
-    vlc_assert_unreachable();
+    if ( results_available
+      && !atomic_load_explicit( &p_sys->abort, memory_order_relaxed ) )
+        var_TriggerCallback( p_fingerprinter, "results-available" );
 }
@@ -54,6 +54,19 @@
     "\"Fast Start\" files are optimized for downloads and allow the user " \
     "to start previewing the file while it is downloading.")
 
+#define RESERVE_TEXT N_("Reserved index duration (s)")
+#define RESERVE_LONGTEXT N_(\
+    "Reserve room at the beginning of the file for the index of that many " \
+    "seconds of media, as estimated from the streams formats, to create " \
+    "\"Fast Start\" files. If the index fits when the file is closed, " \
+    "it is written there without moving the data. 0 disables this.")
+
+#define FRAGDUR_TEXT N_("Fragment duration (ms)")
+#define FRAGDUR_LONGTEXT N_(\
+    "Maximum duration of the fragments of fragmented MP4 output. " \
+    "Fragments are also cut at the video keyframes. Short fragments " \
+    "lower the latency of chunked segmented delivery.")
+
 static int  Open   (vlc_object_t *);
 static void Close  (vlc_object_t *);
 static void CloseFrag  (vlc_object_t *);
@@ -69,6 +82,12 @@ vlc_module_begin ()
     add_bool(SOUT_CFG_PREFIX "faststart", false,
               FASTSTART_TEXT, FASTSTART_LONGTEXT,
               true)
+    add_integer(SOUT_CFG_PREFIX "moov-reserve", 0,
+                RESERVE_TEXT, RESERVE_LONGTEXT, true)
+        change_integer_range(0, 86400)
+    add_integer(SOUT_CFG_PREFIX "fragment-duration", 1500,
+                FRAGDUR_TEXT, FRAGDUR_LONGTEXT, true)
+        change_integer_range(10, 60000)
     set_capability("sout mux", 5)
     add_shortcut("mp4", "mov", "3gp")
     set_callbacks(Open, Close)
@@ -88,7 +107,7 @@ vlc_module_end ()
  * Exported prototypes
  *****************************************************************************/
 static const char *const ppsz_sout_options[] = {
-    "faststart", NULL
+    "faststart", "moov-reserve", "fragment-duration", NULL
 };
 
 static int Control(sout_mux_t *, int, va_list);
@@ -164,6 +183,7 @@ typedef struct
 
     uint64_t i_mdat_pos;
     uint64_t i_pos;
+    uint64_t i_moov_room; /* room reserved for the moov, before the mdat */
     vlc_tick_t  i_read_duration;
     vlc_tick_t  i_start_dts;
 
@@ -173,6 +193,7 @@ typedef struct
 
     /* mp4frag */
     vlc_tick_t     i_written_duration;
+    vlc_tick_t     i_fragment_length;
     uint32_t       i_mfhd_sequence;
 } sout_mux_sys_t;
 
@@ -224,6 +245,48 @@ static block_t *ConvertSUBT(block_t *);
 static bool CreateCurrentEdit(mp4_stream_t *, vlc_tick_t, bool);
 static int MuxStream(sout_mux_t *p_mux, sout_input_t *p_input, mp4_stream_t *p_stream);
 
+/* Worst case size of the index entries of one sample: stsz, stts, ctts,
+ * co64 and stsc, with one chunk per sample */
+#define MP4_SAMPLE_INDEX_SIZE 40
+
+static uint64_t EstimateMoovSize(sout_mux_t *p_mux, vlc_tick_t i_duration)
+{
+    uint64_t i_size = 4096; /* mvhd, udta */
+
+    for (int i = 0; i < p_mux->i_nb_inputs; i++)
+    {
+        const es_format_t *p_fmt = p_mux->pp_inputs[i]->p_fmt;
+        unsigned i_rate; /* samples per second */
+
+        switch (p_fmt->i_cat)
+        {
+            case VIDEO_ES:
+                if (p_fmt->video.i_frame_rate && p_fmt->video.i_frame_rate_base)
+                    i_rate = 1 + p_fmt->video.i_frame_rate /
+                                 p_fmt->video.i_frame_rate_base;
+                else
+                    i_rate = 60;
+                break;
+            case AUDIO_ES:
+                if (p_fmt->audio.i_rate && p_fmt->audio.i_frame_length)
+                    i_rate = 1 + p_fmt->audio.i_rate /
+                                 p_fmt->audio.i_frame_length;
+                else
+                    i_rate = 50;
+                break;
+            default:
+                i_rate = 2;
+                break;
+        }
+
+        /* trak boxes and sample description */
+        i_size += 1024 + p_fmt->i_extra;
+        i_size += samples_from_vlc_tick(i_duration, i_rate) *
+                  MP4_SAMPLE_INDEX_SIZE;
+    }
+    return i_size;
+}
+
 static int WriteSlowStartHeader(sout_mux_t *p_mux)
 {
     sout_mux_sys_t *p_sys = p_mux->p_sys;
@@ -237,10 +300,38 @@ static int WriteSlowStartHeader(sout_mux_t *p_mux)
             return VLC_ENOMEM;
 
         p_sys->i_pos += bo_size(box);
-        p_sys->i_mdat_pos = p_sys->i_pos;
         box_send(p_mux, box);
     }
 
+    /* Reserve room for the moov, in a free box */
+    vlc_tick_t i_reserve = VLC_TICK_FROM_SEC(
+            var_GetInteger(p_mux, SOUT_CFG_PREFIX "moov-reserve"));
+    if (i_reserve > 0)
+    {
+        uint64_t i_room = EstimateMoovSize(p_mux, i_reserve);
+        if (i_room > UINT32_MAX)
+            i_room = UINT32_MAX;
+
+        msg_Dbg(p_mux, "reserving %"PRIu64" bytes for the moov", i_room);
+        for (uint64_t i_left = i_room; i_left > 0; )
+        {
+            block_t *p_free = block_Alloc(__MIN(1 << 20, i_left));
+            if (!p_free)
+                return VLC_ENOMEM;
+            memset(p_free->p_buffer, 0, p_free->i_buffer);
+            if (i_left == i_room)
+            {
+                SetDWBE(p_free->p_buffer, i_room);
+                memcpy(&p_free->p_buffer[4], "free", 4);
+            }
+            i_left -= p_free->i_buffer;
+            sout_AccessOutWrite(p_mux->p_access, p_free);
+        }
+        p_sys->i_moov_room = i_room;
+        p_sys->i_pos += i_room;
+    }
+    p_sys->i_mdat_pos = p_sys->i_pos;
+
     /* Now add mdat header */
     box = box_new("mdat");
     if(!box)
@@ -286,12 +377,15 @@ static int Open(vlc_object_t *p_this)
     p_sys->i_nb_streams = 0;
     p_sys->pp_streams   = NULL;
     p_sys->i_mdat_pos   = 0;
+    p_sys->i_moov_room  = 0;
     p_sys->b_header_sent = false;
 
     p_sys->i_read_duration   = 0;
     p_sys->i_written_duration= 0;
     p_sys->i_start_dts = VLC_TICK_INVALID;
     p_sys->i_mfhd_sequence = 1;
+    p_sys->i_fragment_length = VLC_TICK_FROM_MS(
+            var_GetInteger(p_mux, SOUT_CFG_PREFIX "fragment-duration"));
 
     p_mux->p_sys        = p_sys;
     p_mux->pf_control   = Control;
@@ -312,6 +406,35 @@ static int Open(vlc_object_t *p_this)
     return VLC_SUCCESS;
 }
 
+/* Moves i_size bytes of the output from i_src to i_dst, which may overlap.
+ * Returns the count of bytes moved: the last ones if moving towards the end,
+ * the first ones otherwise. */
+static uint64_t MoveData(sout_mux_t *p_mux, uint64_t i_src, uint64_t i_dst,
+                         uint64_t i_size)
+{
+    uint64_t i_moved = 0;
+
+    while (i_moved < i_size)
+    {
+        size_t i_chunk = __MIN(1 << 20, i_size - i_moved);
+        uint64_t i_offset = i_dst > i_src ? i_size - i_moved - i_chunk
+                                          : i_moved;
+        block_t *p_buf = block_Alloc(i_chunk);
+        if (!p_buf)
+            break;
+        sout_AccessOutSeek(p_mux->p_access, i_src + i_offset);
+        ssize_t i_read = sout_AccessOutRead(p_mux->p_access, p_buf);
+        if (i_read < 0 || (size_t) i_read < i_chunk) {
+            block_Release(p_buf);
+            break;
+        }
+        sout_AccessOutSeek(p_mux->p_access, i_dst + i_offset);
+        sout_AccessOutWrite(p_mux->p_access, p_buf);
+        i_moved += i_chunk;
+    }
+    return i_moved;
+}
+
 /*****************************************************************************
  * Close:
  *****************************************************************************/
@@ -350,12 +473,16 @@ static void Close(vlc_object_t *p_this)
     bo_t *moov = mp4mux_GetMoov(p_sys->muxh, VLC_OBJECT(p_mux), 0);
 
     /* Check we need to create "fast start" files */
-    p_sys->b_fast_start = var_GetBool(p_this, SOUT_CFG_PREFIX "faststart");
+    const uint64_t i_room_pos = p_sys->i_mdat_pos - p_sys->i_moov_room;
+    uint64_t i_room = 0;
+    p_sys->b_fast_start = p_sys->i_moov_room > 0 ||
+                          var_GetBool(p_this, SOUT_CFG_PREFIX "faststart");
     while (p_sys->b_fast_start && moov && moov->b)
     {
         /* Move data to the end of the file so we can fit the moov header
-         * at the start */
+         * at the start, unless it fits in the reserved room */
         uint64_t i_mdatsize = p_sys->i_pos - p_sys->i_mdat_pos;
+        uint64_t i_shift;
 
         /* moving samples will need new moov with 64bit atoms ? */
         if(!b_64bitext && p_sys->i_pos + bo_size(moov) > UINT32_MAX)
@@ -372,47 +499,63 @@ static void Close(vlc_object_t *p_this)
         }
         /* We now know our final MOOV size */
 
-        /* Fix-up samples to chunks table in MOOV header to they point to next MDAT location */
-        mp4mux_ShiftSamples(p_sys->muxh, bo_size(moov));
-        msg_Dbg(p_this,"Moving data by %"PRIu64, (uint64_t)bo_size(moov));
-        bo_t *shifted = mp4mux_GetMoov(p_sys->muxh, VLC_OBJECT(p_mux), 0);
-        if(!shifted)
-        {
-            /* fail */
-            p_sys->b_fast_start = false;
-            continue;
-        }
-        assert(bo_size(shifted) == bo_size(moov));
-        bo_free(moov);
-        moov = shifted;
+        /* The room left after the moov must fit a free box */
+        if (bo_size(moov) > p_sys->i_moov_room)
+            i_shift = bo_size(moov) - p_sys->i_moov_room;
+        else if (bo_size(moov) + 8 > p_sys->i_moov_room &&
+                 bo_size(moov) != p_sys->i_moov_room)
+            i_shift = bo_size(moov) + 8 - p_sys->i_moov_room;
+        else
+            i_shift = 0;
 
-        /* Make space, move MDAT data by moov size towards the end */
-        while (i_mdatsize > 0)
+        bo_t *shifted = NULL;
+        if (i_shift > 0)
         {
-            size_t i_chunk = __MIN(32768, i_mdatsize);
-            block_t *p_buf = block_Alloc(i_chunk);
-            sout_AccessOutSeek(p_mux->p_access,
-                                p_sys->i_mdat_pos + i_mdatsize - i_chunk);
-            ssize_t i_read = sout_AccessOutRead(p_mux->p_access, p_buf);
-            if (i_read < 0 || (size_t) i_read < i_chunk) {
-                msg_Warn(p_this, "read() not supported by access output, "
-                          "won't create a fast start file");
+            /* Fix-up samples to chunks table in MOOV header to they point to next MDAT location */
+            mp4mux_ShiftSamples(p_sys->muxh, i_shift);
+            msg_Dbg(p_this,"Moving data by %"PRIu64, i_shift);
+            shifted = mp4mux_GetMoov(p_sys->muxh, VLC_OBJECT(p_mux), 0);
+            if(!shifted)
+            {
+                /* fail */
+                mp4mux_ShiftSamples(p_sys->muxh, -(int64_t)i_shift);
                 p_sys->b_fast_start = false;
-                block_Release(p_buf);
-                break;
+                continue;
             }
-            sout_AccessOutSeek(p_mux->p_access, p_sys->i_mdat_pos + i_mdatsize +
-                               bo_size(moov) - i_chunk);
-            sout_AccessOutWrite(p_mux->p_access, p_buf);
-            i_mdatsize -= i_chunk;
+            assert(bo_size(shifted) == bo_size(moov));
         }
 
-        if (!p_sys->b_fast_start) /* failed above */
+        /* Make space, move MDAT data by the shift towards the end */
+        uint64_t i_moved = 0;
+        if (i_shift > 0)
+            i_moved = MoveData(p_mux, p_sys->i_mdat_pos,
+                               p_sys->i_mdat_pos + i_shift, i_mdatsize);
+        if (i_shift > 0 && i_moved < i_mdatsize)
+        {
+            msg_Warn(p_this, "cannot move the data (read() not supported by "
+                      "access output?), won't create a fast start file");
+            /* Keep the unshifted moov, and put back the data moved so far */
+            uint64_t i_left = i_mdatsize - i_moved;
+            if (i_moved > 0 &&
+                MoveData(p_mux, p_sys->i_mdat_pos + i_left + i_shift,
+                         p_sys->i_mdat_pos + i_left, i_moved) < i_moved)
+                msg_Err(p_this, "cannot move the data back, the file is "
+                        "corrupt");
+            mp4mux_ShiftSamples(p_sys->muxh, -(int64_t)i_shift);
+            bo_free(shifted);
+            p_sys->b_fast_start = false;
             continue;
+        }
+        if (shifted != NULL)
+        {
+            bo_free(moov);
+            moov = shifted;
+        }
 
         /* Update pos pointers */
-        i_moov_pos = p_sys->i_mdat_pos;
-        p_sys->i_mdat_pos += bo_size(moov);
+        i_moov_pos = i_room_pos;
+        p_sys->i_mdat_pos += i_shift;
+        i_room = p_sys->i_moov_room + i_shift - bo_size(moov);
 
         p_sys->b_fast_start = false;
     }
@@ -422,6 +565,14 @@ static void Close(vlc_object_t *p_this)
     if (moov != NULL)
         box_send(p_mux, moov);
 
+    /* Shrink the free box to what is left of the reserved room */
+    if (i_room > 0 && bo_init(&bo, 8))
+    {
+        bo_add_32be  (&bo, i_room);
+        bo_add_fourcc(&bo, "free");
+        sout_AccessOutWrite(p_mux->p_access, bo.b);
+    }
+
 cleanup:
     /* Clean-up */
     for (unsigned int i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++)
@@ -901,8 +1052,6 @@ static void box_send(sout_mux_t *p_mux,  bo_t *box)
 /***************************************************************************
     MP4 Live submodule
 ****************************************************************************/
-#define FRAGMENT_LENGTH  VLC_TICK_FROM_MS(1500)
-
 #define ENQUEUE_ENTRY(object, entry) \
     do {\
         if (object.p_last)\
@@ -967,6 +1116,7 @@ static bo_t *GetMoofBox(sout_mux_t *p_mux, size_t *pi_mdat_total_size,
 
     bo_t            *moof, *mfhd;
     size_t           i_fixupoffset = 0;
+    bool             b_random_access = true;
 
     *pi_mdat_total_size = 0;
 
@@ -1070,7 +1220,10 @@ static bo_t *GetMoofBox(sout_mux_t *p_mux, size_t *pi_mdat_total_size,
             uint32_t i_trun_flags = 0x0;
 
             if (p_stream->b_hasiframes && !(p_stream->read.p_first->p_block->i_flags & BLOCK_FLAG_TYPE_I))
+            {
                 i_trun_flags |= MP4_TRUN_FIRST_FLAGS;
+                b_random_access = false;
+            }
 
             if (!b_allsamelength ||
                 ( !(i_tfhd_flags & MP4_TFHD_DFLT_SAMPLE_DURATION) &&
@@ -1178,8 +1331,10 @@ static bo_t *GetMoofBox(sout_mux_t *p_mux, size_t *pi_mdat_total_size,
         bo_set_32be(moof, i_fixupoffset, bo_size(moof) + 8);
     }
 
-    /* set iframe flag, so the streaming server always starts from moof */
-    moof->b->i_flags |= BLOCK_FLAG_TYPE_I;
+    /* set iframe flag when every track starts on a keyframe, so the
+     * streaming server and the segmenters only start from such moofs */
+    if (b_random_access)
+        moof->b->i_flags |= BLOCK_FLAG_TYPE_I;
 
     return moof;
 }
@@ -1211,6 +1366,7 @@ static void WriteFragmentMDAT(sout_mux_t *p_mux, size_t i_total_size)
             p_stream->i_written_duration += p_entry->p_block->i_length;
 
             p_entry->p_block->i_flags &= ~BLOCK_FLAG_TYPE_I; // clear flag for http stream
+            p_entry->p_block->i_length = 0; // the moof carries the duration
             sout_AccessOutWrite(p_mux->p_access, p_entry->p_block);
 
             p_stream->towrite.p_first = p_entry->p_next;
@@ -1288,7 +1444,7 @@ static void WriteFragments(sout_mux_t *p_mux, bool b_flush)
 {
     sout_mux_sys_t *p_sys = (sout_mux_sys_t*) p_mux->p_sys;
     bo_t *moof = NULL;
-    vlc_tick_t i_barrier_time = p_sys->i_written_duration + FRAGMENT_LENGTH;
+    vlc_tick_t i_barrier_time = p_sys->i_written_duration + p_sys->i_fragment_length;
     size_t i_mdat_size = 0;
     bool b_has_samples = false;
 
@@ -1334,9 +1490,19 @@ static void WriteFragments(sout_mux_t *p_mux, bool b_flush)
 
     if (moof)
     {
+        /* the segmenters time the output from the moof */
+        for (unsigned int i = 0; i < p_sys->i_nb_streams; i++)
+        {
+            vlc_tick_t i_length = 0;
+            for (const mp4_fragentry_t *p_entry = p_sys->pp_streams[i]->towrite.p_first;
+                 p_entry; p_entry = p_entry->p_next)
+                i_length += p_entry->p_block->i_length;
+            if (i_length > moof->b->i_length)
+                moof->b->i_length = i_length;
+        }
+
         msg_Dbg(p_mux, "writing moof @ %"PRId64, p_sys->i_pos);
         p_sys->i_pos += bo_size(moof);
-        assert(moof->b->i_flags & BLOCK_FLAG_TYPE_I); /* http sout */
         box_send(p_mux, moof);
         msg_Dbg(p_mux, "writing mdat @ %"PRId64, p_sys->i_pos);
         WriteFragmentMDAT(p_mux, i_mdat_size);
@@ -1476,7 +1642,7 @@ static int MuxFrag(sout_mux_t *p_mux)
         p_stream->p_held_entry = NULL;
 
         if (p_stream->b_hasiframes && (p_heldblock->i_flags & BLOCK_FLAG_TYPE_I) &&
-            mp4mux_track_GetDuration(p_stream->tinfo) - p_sys->i_written_duration < FRAGMENT_LENGTH)
+            mp4mux_track_GetDuration(p_stream->tinfo) - p_sys->i_written_duration < p_sys->i_fragment_length)
         {
             /* Flag the last iframe time, we'll use it as boundary so it will start
                next fragment */
@@ -1529,7 +1695,7 @@ static int MuxFrag(sout_mux_t *p_mux)
     p_sys->i_written_duration = i_min_written_duration;
 
     /* we have prerolled enough to know all streams, and have enough date to create a fragment */
-    if (p_stream->read.p_first && p_sys->i_read_duration - p_sys->i_written_duration >= FRAGMENT_LENGTH)
+    if (p_stream->read.p_first && p_sys->i_read_duration - p_sys->i_written_duration >= p_sys->i_fragment_length)
         WriteFragments(p_mux, false);
 
     return VLC_SUCCESS;
@@ -39,6 +39,8 @@
 #include <vlc_block.h>
 #include <vlc_rand.h>
 #include <vlc_charset.h>
+#include <vlc_atomic.h>
+#include <vlc_executor.h>
 
 #include <vlc_iso_lang.h>
 
@@ -159,6 +161,16 @@ static const char *const ts_standards_list_text[] =
 #define BMAX_TEXT N_( "Maximum B (deprecated)")
 #define BMAX_LONGTEXT N_( "This setting is deprecated and not used anymore")
 
+#define MUXRATE_TEXT N_("Mux rate (bits/s)")
+#define MUXRATE_LONGTEXT N_("Send the TS packets at this constant rate, " \
+  "with PCRs matching the position of their packet exactly. The stream " \
+  "must fit this rate on average over the DTS delay. 0 disables this.")
+
+#define STUFFING_TEXT N_("Null packet stuffing")
+#define STUFFING_LONGTEXT N_("If a mux rate is set, fill the unused " \
+  "bandwidth with null packets for a constant bitrate. Otherwise, the " \
+  "bitrate is only capped to the mux rate.")
+
 #define DTS_TEXT N_("DTS delay (ms)")
 #define DTS_LONGTEXT N_("Delay the DTS (decoding time " \
   "stamps) and PTS (presentation timestamps) of the data in the " \
@@ -228,6 +240,9 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "pcr", 70, PCR_TEXT, PCR_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmin", 0, BMIN_TEXT, BMIN_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmax", 0, BMAX_TEXT, BMAX_LONGTEXT, true)
+    add_integer( SOUT_CFG_PREFIX "muxrate", 0, MUXRATE_TEXT, MUXRATE_LONGTEXT, true)
+        change_integer_range( 0, 1000000000 )
+    add_bool( SOUT_CFG_PREFIX "stuffing", true, STUFFING_TEXT, STUFFING_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "dts-delay", 400, DTS_TEXT, DTS_LONGTEXT, true)
 
     add_bool( SOUT_CFG_PREFIX "crypt-audio", true, ACRYPT_TEXT, ACRYPT_LONGTEXT, true)
@@ -249,7 +264,7 @@ static const char *const ppsz_sout_options[] = {
     "netid", "sdtdesc",
     "es-id-pid", "shaping", "pcr", "bmin", "bmax", "use-key-frames",
     "dts-delay", "csa-ck", "csa2-ck", "csa-use", "csa-pkt", "crypt-audio", "crypt-video",
-    "muxpmt", "program-pmt", "alignment",
+    "muxpmt", "program-pmt", "alignment", "muxrate", "stuffing",
     NULL
 };
 
@@ -323,6 +338,106 @@ static inline void BufferChainClean( sout_buffer_chain_t *c )
     BufferChainInit( c );
 }
 
+/*****************************************************************************
+ * TS packets pool
+ *****************************************************************************/
+#define TS_POOL_MAX 4096 /* Maximum number of recycled packets kept */
+
+typedef struct
+{
+    vlc_atomic_rc_t rc; /* one per packet in use, and one for the muxer */
+    vlc_mutex_t     lock;
+    block_t         *p_free;
+    size_t          i_free;
+} ts_packet_pool_t;
+
+typedef struct
+{
+    block_t          self;
+    ts_packet_pool_t *p_pool;
+    uint8_t          p_data[188];
+} ts_packet_t;
+
+static ts_packet_pool_t *TSPoolNew( void )
+{
+    ts_packet_pool_t *p_pool = malloc( sizeof(*p_pool) );
+    if( unlikely(p_pool == NULL) )
+        return NULL;
+
+    vlc_atomic_rc_init( &p_pool->rc );
+    vlc_mutex_init( &p_pool->lock );
+    p_pool->p_free = NULL;
+    p_pool->i_free = 0;
+    return p_pool;
+}
+
+static void TSPoolRelease( ts_packet_pool_t *p_pool )
+{
+    if( !vlc_atomic_rc_dec( &p_pool->rc ) )
+        return;
+
+    while( p_pool->p_free != NULL )
+    {
+        block_t *p_block = p_pool->p_free;
+
+        p_pool->p_free = p_block->p_next;
+        free( container_of( p_block, ts_packet_t, self ) );
+    }
+    free( p_pool );
+}
+
+static void TSPacketRelease( block_t *p_block )
+{
+    ts_packet_t *p_packet = container_of( p_block, ts_packet_t, self );
+    ts_packet_pool_t *p_pool = p_packet->p_pool;
+
+    vlc_mutex_lock( &p_pool->lock );
+    if( p_pool->i_free < TS_POOL_MAX )
+    {
+        p_block->p_next = p_pool->p_free;
+        p_pool->p_free = p_block;
+        p_pool->i_free++;
+        p_packet = NULL;
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+
+    free( p_packet );
+    TSPoolRelease( p_pool );
+}
+
+static const struct vlc_block_callbacks ts_packet_cbs =
+{
+    TSPacketRelease,
+};
+
+/* Gets a 188 bytes block, recycled if possible */
+static block_t *TSPacketAlloc( ts_packet_pool_t *p_pool )
+{
+    ts_packet_t *p_packet = NULL;
+
+    vlc_mutex_lock( &p_pool->lock );
+    if( p_pool->p_free != NULL )
+    {
+        p_packet = container_of( p_pool->p_free, ts_packet_t, self );
+        p_pool->p_free = p_packet->self.p_next;
+        p_pool->i_free--;
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+
+    if( p_packet == NULL )
+    {
+        p_packet = malloc( sizeof(*p_packet) );
+        if( unlikely(p_packet == NULL) )
+            return NULL;
+        p_packet->p_pool = p_pool;
+    }
+
+    vlc_atomic_rc_inc( &p_pool->rc );
+    block_Init( &p_packet->self, &ts_packet_cbs, p_packet->p_data,
+                sizeof(p_packet->p_data) );
+    return &p_packet->self;
+}
+
 typedef struct
 {
     sout_buffer_chain_t chain_pes;
@@ -331,6 +446,9 @@ typedef struct
     int                 i_pes_used;
     bool                b_key_frame;
 
+    /* TS packets of the first i_pes_packetized PES of chain_pes */
+    sout_buffer_chain_t chain_ts;
+    int                 i_pes_packetized;
 } pes_state_t;
 
 typedef struct
@@ -338,12 +456,18 @@ typedef struct
     tsmux_stream_t  ts;
     pesmux_stream_t pes;
     pes_state_t  state;
+
+    ts_packet_pool_t    *p_pool;
+    struct vlc_runnable packetizer;
 } sout_input_sys_t;
 
 typedef struct
 {
     sout_input_t    *p_pcr_input;
 
+    vlc_executor_t  *executor; /* PES to TS packetization threads */
+    ts_packet_pool_t *p_pool;
+
     vlc_mutex_t     csa_lock;
 
     dvbpsi_t        *p_dvbpsi;
@@ -381,6 +505,19 @@ typedef struct
 
     vlc_tick_t      i_pcr;  /* last PCR emited */
 
+    /* constant rate output */
+    uint64_t        i_muxrate;
+    bool            b_stuffing;
+    bool            b_rate_started;
+    int64_t         i_rate_pcr;   /* 27 MHz date of the next packet slot */
+    uint64_t        i_rate_frac;  /* and its fraction, times the mux rate */
+    int64_t         i_rate_report;
+    uint64_t        i_rate_packets;
+    uint64_t        i_rate_nulls;
+    uint64_t        i_rate_late;  /* packets sent after their DTS */
+    vlc_tick_t      i_rate_delay; /* how late the output is behind the media */
+    vlc_tick_t      i_rate_max_delay;
+
     csa_t           *csa;
     int             i_csa_pkt_size;
     bool            b_crypt_audio;
@@ -480,8 +617,12 @@ static void TSDate      ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
 static void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 
-static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream, bool b_pcr );
-static void TSSetPCR( block_t *p_ts, vlc_tick_t i_dts );
+static void TSPacketize( void * );
+static bool TSPacketizeStreams( sout_mux_t *p_mux );
+static block_t *TSNext( sout_input_sys_t *p_stream );
+static block_t *TSNewPCR( sout_input_sys_t *p_stream, const block_t *p_next );
+static void TSSetPCR( block_t *p_ts, int64_t i_pcr );
+static void TSRateReport( sout_mux_t *p_mux );
 
 static csa_t *csaSetup( vlc_object_t *p_this )
 {
@@ -553,9 +694,17 @@ static int Open( vlc_object_t *p_this )
         return VLC_ENOMEM;
     p_sys->i_num_pmt = 1;
 
+    p_sys->p_pool = TSPoolNew();
+    if( !p_sys->p_pool )
+    {
+        free( p_sys );
+        return VLC_ENOMEM;
+    }
+
     p_sys->p_dvbpsi = dvbpsi_new( &dvbpsi_messages, DVBPSI_MSG_DEBUG );
     if( !p_sys->p_dvbpsi )
     {
+        TSPoolRelease( p_sys->p_pool );
         free( p_sys );
         return VLC_ENOMEM;
     }
@@ -743,10 +892,22 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->b_use_key_frames = var_GetBool( p_mux, SOUT_CFG_PREFIX "use-key-frames" );
 
+    p_sys->i_muxrate = var_GetInteger( p_mux, SOUT_CFG_PREFIX "muxrate" );
+    p_sys->b_stuffing = var_GetBool( p_mux, SOUT_CFG_PREFIX "stuffing" );
+    p_sys->b_rate_started = false;
+    p_sys->i_rate_packets = p_sys->i_rate_nulls = p_sys->i_rate_late = 0;
+    p_sys->i_rate_delay = p_sys->i_rate_max_delay = 0;
+    if( p_sys->i_muxrate )
+        msg_Dbg( p_mux, "mux rate=%"PRIu64" stuffing=%d",
+                 p_sys->i_muxrate, p_sys->b_stuffing );
+
     p_mux->p_sys        = p_sys;
 
     p_sys->csa = csaSetup(p_this);
 
+    /* Without threads, the streams are packetized one after the other */
+    p_sys->executor = vlc_executor_New( vlc_GetCPUCount() );
+
     p_mux->pf_control   = Control;
     p_mux->pf_addstream = AddStream;
     p_mux->pf_delstream = DelStream;
@@ -766,6 +927,14 @@ static void Close( vlc_object_t * p_this )
     if( p_sys->p_dvbpsi )
         dvbpsi_delete( p_sys->p_dvbpsi );
 
+    if( p_sys->b_rate_started )
+        TSRateReport( p_mux );
+
+    if( p_sys->executor )
+        vlc_executor_Delete( p_sys->executor );
+    /* The access output may still hold packets */
+    TSPoolRelease( p_sys->p_pool );
+
     if( p_sys->csa )
     {
         var_DelCallback( p_mux, SOUT_CFG_PREFIX "csa-ck", ChangeKeyCallback, p_mux );
@@ -974,6 +1143,11 @@ static int AddStream( sout_mux_t *p_mux, sout_input_t *p_input )
 
     /* Init pes chain */
     BufferChainInit( &p_stream->state.chain_pes );
+    BufferChainInit( &p_stream->state.chain_ts );
+
+    p_stream->p_pool = p_sys->p_pool;
+    p_stream->packetizer.run = TSPacketize;
+    p_stream->packetizer.userdata = p_stream;
 
     /* We only change PMT version (PAT isn't changed) */
     p_sys->i_pmt_version_number = ( p_sys->i_pmt_version_number + 1 )%32;
@@ -1011,6 +1185,7 @@ static void DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
 
     /* Empty all data in chain_pes */
     BufferChainClean( &p_stream->state.chain_pes );
+    BufferChainClean( &p_stream->state.chain_ts );
 
     pid = var_GetInteger( p_mux, SOUT_CFG_PREFIX "pid-video" );
     if ( pid > 0 && pid == p_stream->ts.i_pid )
@@ -1039,6 +1214,23 @@ static void DelStream( sout_mux_t *p_mux, sout_input_t *p_input )
     p_sys->i_pmt_version_number %= 32;
 }
 
+/* Drops the PES of a stream, and their TS packets */
+static void ResetPES( sout_input_sys_t *p_stream )
+{
+    block_t *p_ts = BufferChainPeek( &p_stream->state.chain_ts );
+
+    /* Those packets were never sent */
+    if( p_ts != NULL )
+        p_stream->ts.i_continuity_counter = p_ts->p_buffer[3] & 0x0f;
+
+    BufferChainClean( &p_stream->state.chain_pes );
+    BufferChainClean( &p_stream->state.chain_ts );
+    p_stream->state.i_pes_packetized = 0;
+    p_stream->state.i_pes_dts = 0;
+    p_stream->state.i_pes_used = 0;
+    p_stream->state.i_pes_length = 0;
+}
+
 static void SetHeader( sout_buffer_chain_t *c,
                         int depth )
 {
@@ -1145,6 +1337,11 @@ static block_t *Encap_J2K( block_t *p_data, const es_format_t *p_fmt )
         return NULL;
     }
 
+    /* The header overwrites the boxes before the codestream */
+    p_data = block_Unshare( p_data );
+    if( unlikely(!p_data) )
+        return NULL;
+
     if( i_offset < 38 )
     {
         block_t *p_realloc = block_Realloc( p_data, 38 - i_offset, p_data->i_buffer );
@@ -1260,10 +1457,7 @@ static bool MuxStreams(sout_mux_t *p_mux )
                 if ( ( i_spu_delay >= VLC_TICK_FROM_SEC(100)) ||
                      ( i_spu_delay < VLC_TICK_FROM_MS(10) ) )
                 {
-                    BufferChainClean( &p_stream->state.chain_pes );
-                    p_stream->state.i_pes_dts = 0;
-                    p_stream->state.i_pes_used = 0;
-                    p_stream->state.i_pes_length = 0;
+                    ResetPES( p_stream );
                     continue;
                 }
             }
@@ -1331,18 +1525,9 @@ static bool MuxStreams(sout_mux_t *p_mux )
                       p_pcr_stream->state.i_pes_dts );
             block_Release( p_data );
 
-            BufferChainClean( &p_stream->state.chain_pes );
-            p_stream->state.i_pes_dts = 0;
-            p_stream->state.i_pes_used = 0;
-            p_stream->state.i_pes_length = 0;
-
+            ResetPES( p_stream );
             if( p_input->p_fmt->i_cat != SPU_ES )
-            {
-                BufferChainClean( &p_pcr_stream->state.chain_pes );
-                p_pcr_stream->state.i_pes_dts = 0;
-                p_pcr_stream->state.i_pes_used = 0;
-                p_pcr_stream->state.i_pes_length = 0;
-            }
+                ResetPES( p_pcr_stream );
 
             continue;
         }
@@ -1484,10 +1669,18 @@ static bool MuxStreams(sout_mux_t *p_mux )
             i_packet_count += ( i_size + 183 ) / 184;
         }
     }
-    /* add overhead for PCR (not really exact) */
-    i_packet_count += (8 * i_pcr_length / p_sys->i_pcr_delay + 175) / 176;
+    /* add overhead for PCR */
+    i_packet_count += i_pcr_length / p_sys->i_pcr_delay + 1;
+
+    /* 3: split the PES of every stream into TS packets */
+    if( !TSPacketizeStreams( p_mux ) )
+    {
+        /* The PES are kept, and packetized again on the next call */
+        msg_Err( p_mux, "cannot allocate TS packets" );
+        return true;
+    }
 
-    /* 3: mux PES into TS */
+    /* 4: interleave the TS packets */
     BufferChainInit( &chain_ts );
     /* append PAT/PMT  -> FIXME with big pcr delay it won't have enough pat/pmt */
     bool pat_was_previous = true; //This is to prevent unnecessary double PAT/PMT insertions
@@ -1527,26 +1720,26 @@ static bool MuxStreams(sout_mux_t *p_mux )
         p_stream = (sout_input_sys_t*)p_mux->pp_inputs[i_stream]->p_sys;
         sout_input_t *p_input = p_mux->pp_inputs[i_stream];
 
-        /* do we need to issue pcr */
-        bool b_pcr = false;
+        /* Take the next TS packet, preceded by the PCR if needed */
+        block_t *p_ts = TSNext( p_stream );
+        block_t *p_pcr = NULL;
         vlc_tick_t packet_length = i_pcr_length * i_packet_pos / i_packet_count;
         if( p_stream == p_pcr_stream &&
             i_pcr_dts + packet_length >=
             p_sys->i_pcr + p_sys->i_pcr_delay )
         {
-            b_pcr = true;
-            p_sys->i_pcr = i_pcr_dts + packet_length;
+            /* Otherwise, the PCR is sent along with the next packet */
+            p_pcr = TSNewPCR( p_stream, p_ts );
+            if( likely(p_pcr != NULL) )
+                p_sys->i_pcr = i_pcr_dts + packet_length;
         }
-
-        /* Build the TS packet */
-        block_t *p_ts = TSNew( p_mux, p_stream, b_pcr );
         if( p_sys->csa != NULL &&
              (p_input->p_fmt->i_cat != AUDIO_ES || p_sys->b_crypt_audio) &&
              (p_input->p_fmt->i_cat != VIDEO_ES || p_sys->b_crypt_video) )
         {
             p_ts->i_flags |= BLOCK_FLAG_SCRAMBLED;
         }
-        i_packet_pos++;
+        i_packet_pos += p_pcr != NULL ? 2 : 1;
 
         /* Write PAT/PMT before every keyframe if use-key-frames is enabled,
          * this helps to do segmenting with livehttp-output so it can cut segment
@@ -1569,10 +1762,12 @@ static bool MuxStreams(sout_mux_t *p_mux )
         pat_was_previous = false;
 
         /* */
+        if( p_pcr != NULL )
+            BufferChainAppend( &chain_ts, p_pcr );
         BufferChainAppend( &chain_ts, p_ts );
     }
 
-    /* 4: date and send */
+    /* 5: date and send */
     TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
     return false;
 }
@@ -1761,12 +1956,152 @@ static void TSSchedule( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
         TSDate( p_mux, &new_chain, i_pcr_length, i_pcr_dts );
 }
 
+#define PCR_FREQ INT64_C(27000000)
+
+static int64_t PCRFromTick( vlc_tick_t i_tick )
+{
+    lldiv_t d = lldiv( i_tick, CLOCK_FREQ );
+    return d.quot * PCR_FREQ + d.rem * PCR_FREQ / CLOCK_FREQ;
+}
+
+static block_t *TSNewNull( ts_packet_pool_t *p_pool )
+{
+    block_t *p_ts = TSPacketAlloc( p_pool );
+    if( unlikely(p_ts == NULL) )
+        return NULL;
+
+    p_ts->p_buffer[0] = 0x47;
+    p_ts->p_buffer[1] = 0x1f;
+    p_ts->p_buffer[2] = 0xff;
+    p_ts->p_buffer[3] = 0x10;
+    memset( &p_ts->p_buffer[4], 0xff, 184 );
+    return p_ts;
+}
+
+static void TSRateReport( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    msg_Dbg( p_mux, "mux rate: %"PRIu64" packets, %"PRIu64" null, %"PRIu64
+             " late, output delayed by %"PRId64" ms (max %"PRId64" ms)",
+             p_sys->i_rate_packets, p_sys->i_rate_nulls, p_sys->i_rate_late,
+             MS_FROM_VLC_TICK(p_sys->i_rate_delay),
+             MS_FROM_VLC_TICK(p_sys->i_rate_max_delay) );
+}
+
+/* Constant rate dating: every packet takes the next slot of the output,
+ * the date of which is known exactly from the mux rate. The packets are
+ * spread over the slots up to the end of the chain, and the free slots are
+ * stuffed. When a chain does not fit, the output lags behind the media,
+ * using up the DTS delay, and catches up with the next chains. */
+static void TSDateRate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
+                        vlc_tick_t i_pcr_length, vlc_tick_t i_pcr_dts )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+    const uint64_t i_slot = 188 * 8 * PCR_FREQ; /* times the mux rate */
+    const vlc_tick_t i_slot_length = vlc_tick_from_frac( 188 * 8, p_sys->i_muxrate );
+    const int64_t i_start = PCRFromTick( i_pcr_dts - p_sys->first_dts );
+    const int64_t i_end = PCRFromTick( i_pcr_dts + i_pcr_length - p_sys->first_dts );
+    const int i_packet_count = p_chain_ts->i_depth;
+
+    /* Do not stuff gaps in the input */
+    if( !p_sys->b_rate_started || i_start - p_sys->i_rate_pcr > PCR_FREQ )
+    {
+        if( p_sys->b_rate_started )
+            msg_Warn( p_mux, "skipping a %"PRId64" ms gap",
+                      ( i_start - p_sys->i_rate_pcr ) / ( PCR_FREQ / 1000 ) );
+        p_sys->i_rate_pcr = i_start;
+        p_sys->i_rate_frac = 0;
+        p_sys->i_rate_report = i_start;
+        p_sys->b_rate_started = true;
+    }
+
+    int64_t i_slots = 0;
+    if( i_end > p_sys->i_rate_pcr )
+        i_slots = ( ( i_end - p_sys->i_rate_pcr ) * p_sys->i_muxrate
+                    - p_sys->i_rate_frac + i_slot - 1 ) / i_slot;
+    if( i_slots < i_packet_count )
+        i_slots = i_packet_count;
+
+    int i_sent = 0;
+    for( int64_t i = 0; i < i_slots; i++ )
+    {
+        block_t *p_ts = NULL;
+        const vlc_tick_t i_dts = p_sys->first_dts +
+                                 vlc_tick_from_frac( p_sys->i_rate_pcr, PCR_FREQ );
+
+        if( ( i + 1 ) * i_packet_count / i_slots > i_sent )
+        {
+            p_ts = BufferChainGet( p_chain_ts );
+            i_sent++;
+
+            /* The decoder would need it before it arrives */
+            if( p_ts->i_dts && !( p_ts->i_flags & BLOCK_FLAG_CLOCK ) &&
+                i_dts > p_ts->i_dts + p_sys->i_dts_delay )
+                p_sys->i_rate_late++;
+        }
+        else if( p_sys->b_stuffing )
+        {
+            p_ts = TSNewNull( p_sys->p_pool );
+            p_sys->i_rate_nulls++;
+        }
+
+        if( p_ts != NULL )
+        {
+            p_ts->i_dts    = i_dts;
+            p_ts->i_length = i_slot_length;
+
+            if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
+                TSSetPCR( p_ts, p_sys->i_rate_pcr );
+            if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
+            {
+                vlc_mutex_lock( &p_sys->csa_lock );
+                csa_Encrypt( p_sys->csa, p_ts->p_buffer, p_sys->i_csa_pkt_size );
+                vlc_mutex_unlock( &p_sys->csa_lock );
+            }
+
+            /* latency */
+            p_ts->i_dts += p_sys->i_shaping_delay * 3 / 2;
+
+            sout_AccessOutWrite( p_mux->p_access, p_ts );
+        }
+
+        p_sys->i_rate_packets++;
+        p_sys->i_rate_frac += i_slot;
+        p_sys->i_rate_pcr += p_sys->i_rate_frac / p_sys->i_muxrate;
+        p_sys->i_rate_frac %= p_sys->i_muxrate;
+    }
+
+    p_sys->i_rate_delay = vlc_tick_from_frac( __MAX( p_sys->i_rate_pcr - i_end, 0 ),
+                                             PCR_FREQ );
+    if( p_sys->i_rate_delay > p_sys->i_rate_max_delay )
+    {
+        if( p_sys->i_rate_delay > p_sys->i_dts_delay &&
+            p_sys->i_rate_max_delay <= p_sys->i_dts_delay )
+            msg_Warn( p_mux, "mux rate exceeded, the output is %"PRId64
+                      " ms late", MS_FROM_VLC_TICK(p_sys->i_rate_delay) );
+        p_sys->i_rate_max_delay = p_sys->i_rate_delay;
+    }
+
+    if( p_sys->i_rate_pcr - p_sys->i_rate_report >= 10 * PCR_FREQ )
+    {
+        TSRateReport( p_mux );
+        p_sys->i_rate_report = p_sys->i_rate_pcr;
+    }
+}
+
 static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
                     vlc_tick_t i_pcr_length, vlc_tick_t i_pcr_dts )
 {
     sout_mux_sys_t  *p_sys = p_mux->p_sys;
     int i_packet_count = p_chain_ts->i_depth;
 
+    if( p_sys->i_muxrate )
+    {
+        TSDateRate( p_mux, p_chain_ts, i_pcr_length, i_pcr_dts );
+        return;
+    }
+
     if ( likely(i_pcr_length / 1000 > 0) )
     {
         int i_bitrate = ((uint64_t)i_packet_count * 188 * 8000)
@@ -1798,7 +2133,7 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
         if( p_ts->i_flags & BLOCK_FLAG_CLOCK )
         {
             /* msg_Dbg( p_mux, "pcr=%lld ms", p_ts->i_dts / 1000 ); */
-            TSSetPCR( p_ts, p_ts->i_dts - p_sys->first_dts );
+            TSSetPCR( p_ts, PCRFromTick( p_ts->i_dts - p_sys->first_dts ) );
         }
         if( p_ts->i_flags & BLOCK_FLAG_SCRAMBLED )
         {
@@ -1814,78 +2149,129 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
     }
 }
 
-static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
-                       bool b_pcr )
+/* Splits the PES which are not packetized yet into TS packets.
+ * This only depends on the stream, so that the streams can be packetized
+ * concurrently. The PCR are sent in packets of their own, see TSNewPCR().
+ * A PES is packetized as a whole or, if its packets cannot be allocated, left
+ * for a later call along with the following ones. */
+static void TSPacketize( void *opaque )
 {
-    VLC_UNUSED(p_mux);
+    sout_input_sys_t *p_stream = opaque;
     block_t *p_pes = p_stream->state.chain_pes.p_first;
 
-    bool b_new_pes = false;
-    bool b_adaptation_field = false;
-
-    int i_payload_max = 184 - ( b_pcr ? 8 : 0 );
+    for( int i = 0; i < p_stream->state.i_pes_packetized; i++ )
+        p_pes = p_pes->p_next;
 
-    if( p_stream->state.i_pes_used <= 0 )
+    for( ; p_pes != NULL; p_pes = p_pes->p_next )
     {
-        b_new_pes = true;
-    }
-    int i_payload = __MIN( (int)p_pes->i_buffer - p_stream->state.i_pes_used,
-                       i_payload_max );
+        sout_buffer_chain_t chain;
+        size_t i_count = __MAX( ( p_pes->i_buffer + 183 ) / 184, 1 );
 
-    if( b_pcr || i_payload < i_payload_max )
-    {
-        b_adaptation_field = true;
-    }
+        BufferChainInit( &chain );
+        for( size_t i = 0; i < i_count; i++ )
+        {
+            block_t *p_ts = TSPacketAlloc( p_stream->p_pool );
+            if( unlikely(p_ts == NULL) )
+            {
+                BufferChainClean( &chain );
+                return;
+            }
+            BufferChainAppend( &chain, p_ts );
+        }
 
-    block_t *p_ts = block_Alloc( 188 );
+        size_t i_used = 0;
 
-    if (b_new_pes && !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) && p_pes->i_flags & BLOCK_FLAG_TYPE_I)
-    {
-        p_ts->i_flags |= BLOCK_FLAG_TYPE_I;
-    }
+        for( block_t *p_ts = chain.p_first; p_ts != NULL; p_ts = p_ts->p_next )
+        {
+            size_t i_payload = __MIN( p_pes->i_buffer - i_used, 184 );
 
-    p_ts->i_dts = p_pes->i_dts;
+            if( i_used == 0 && !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) &&
+                (p_pes->i_flags & BLOCK_FLAG_TYPE_I) )
+            {
+                p_ts->i_flags |= BLOCK_FLAG_TYPE_I;
+            }
 
-    p_ts->p_buffer[0] = 0x47;
-    p_ts->p_buffer[1] = ( b_new_pes ? 0x40 : 0x00 ) |
-        ( ( p_stream->ts.i_pid >> 8 )&0x1f );
-    p_ts->p_buffer[2] = p_stream->ts.i_pid & 0xff;
-    p_ts->p_buffer[3] = ( b_adaptation_field ? 0x30 : 0x10 ) |
-        p_stream->ts.i_continuity_counter;
+            p_ts->i_dts = p_pes->i_dts;
 
-    p_stream->ts.i_continuity_counter = (p_stream->ts.i_continuity_counter+1)%16;
-    p_stream->ts.b_discontinuity = p_pes->i_flags & BLOCK_FLAG_DISCONTINUITY;
+            p_ts->p_buffer[0] = 0x47;
+            p_ts->p_buffer[1] = ( i_used == 0 ? 0x40 : 0x00 ) |
+                ( ( p_stream->ts.i_pid >> 8 )&0x1f );
+            p_ts->p_buffer[2] = p_stream->ts.i_pid & 0xff;
+            p_ts->p_buffer[3] = ( i_payload < 184 ? 0x30 : 0x10 ) |
+                p_stream->ts.i_continuity_counter;
 
-    if( b_adaptation_field )
-    {
-        int i_stuffing = i_payload_max - i_payload;
-        if( b_pcr )
-        {
-            p_ts->i_flags |= BLOCK_FLAG_CLOCK;
+            p_stream->ts.i_continuity_counter = (p_stream->ts.i_continuity_counter+1)%16;
 
-            p_ts->p_buffer[4] = 7 + i_stuffing;
-            p_ts->p_buffer[5] = 1 << 4; /* PCR_flag */
-            if( p_stream->ts.b_discontinuity )
+            if( i_payload < 184 )
             {
-                p_ts->p_buffer[5] |= 0x80; /* flag TS dicontinuity */
-                p_stream->ts.b_discontinuity = false;
+                int i_stuffing = 184 - i_payload;
+
+                p_ts->p_buffer[4] = --i_stuffing;
+                if( i_stuffing-- )
+                {
+                    p_ts->p_buffer[5] = 0;
+                    memset(&p_ts->p_buffer[6], 0xff, i_stuffing);
+                }
             }
-            memset(&p_ts->p_buffer[12], 0xff, i_stuffing);
+
+            /* copy payload */
+            memcpy( &p_ts->p_buffer[188 - i_payload],
+                    &p_pes->p_buffer[i_used], i_payload );
+            i_used += i_payload;
         }
-        else
+
+        BufferChainAppend( &p_stream->state.chain_ts, chain.p_first );
+        p_stream->state.i_pes_packetized++;
+    }
+}
+
+/* Returns false if some PES could not be packetized */
+static bool TSPacketizeStreams( sout_mux_t *p_mux )
+{
+    sout_mux_sys_t *p_sys = p_mux->p_sys;
+
+    if( p_sys->executor == NULL || p_mux->i_nb_inputs < 2 )
+    {
+        for (int i = 0; i < p_mux->i_nb_inputs; i++ )
+            TSPacketize( p_mux->pp_inputs[i]->p_sys );
+    }
+    else
+    {
+        for (int i = 0; i < p_mux->i_nb_inputs; i++ )
         {
-            p_ts->p_buffer[4] = --i_stuffing;
-            if( i_stuffing-- )
-            {
-                p_ts->p_buffer[5] = 0;
-                memset(&p_ts->p_buffer[6], 0xff, i_stuffing);
-            }
+            sout_input_sys_t *p_stream = (sout_input_sys_t*)p_mux->pp_inputs[i]->p_sys;
+
+            if( p_stream->state.i_pes_packetized < p_stream->state.chain_pes.i_depth )
+                vlc_executor_Submit( p_sys->executor, &p_stream->packetizer );
         }
+        vlc_executor_WaitIdle( p_sys->executor );
+    }
+
+    for (int i = 0; i < p_mux->i_nb_inputs; i++ )
+    {
+        sout_input_sys_t *p_stream = (sout_input_sys_t*)p_mux->pp_inputs[i]->p_sys;
+
+        if( p_stream->state.i_pes_packetized < p_stream->state.chain_pes.i_depth )
+            return false;
     }
+    return true;
+}
+
+/* Takes the next TS packet of a stream */
+static block_t *TSNext( sout_input_sys_t *p_stream )
+{
+    block_t *p_pes = p_stream->state.chain_pes.p_first;
+    block_t *p_ts = BufferChainGet( &p_stream->state.chain_ts );
+
+    assert( p_ts != NULL );
 
-    /* copy payload */
-    memcpy( &p_ts->p_buffer[188 - i_payload],
-            &p_pes->p_buffer[p_stream->state.i_pes_used], i_payload );
+    /* Flagged once, on the next PCR, see TSNewPCR() */
+    if( p_stream->state.i_pes_used == 0 &&
+        (p_pes->i_flags & BLOCK_FLAG_DISCONTINUITY) )
+        p_stream->ts.b_discontinuity = true;
+
+    int i_payload = __MIN( (int)p_pes->i_buffer - p_stream->state.i_pes_used,
+                           184 );
 
     p_stream->state.i_pes_used += i_payload;
     p_stream->state.i_pes_dts = p_pes->i_dts + p_pes->i_length *
@@ -1895,6 +2281,7 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
     if( p_stream->state.i_pes_used >= (int)p_pes->i_buffer )
     {
         block_Release(BufferChainGet( &p_stream->state.chain_pes ));
+        p_stream->state.i_pes_packetized--;
 
         p_pes = p_stream->state.chain_pes.p_first;
         p_stream->state.i_pes_length = 0;
@@ -1917,17 +2304,48 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
     return p_ts;
 }
 
-static void TSSetPCR( block_t *p_ts, vlc_tick_t i_dts )
+/* Builds a packet with no payload, carrying the PCR (set by TSDate) along
+ * with the TS packet p_next of the stream */
+static block_t *TSNewPCR( sout_input_sys_t *p_stream, const block_t *p_next )
+{
+    block_t *p_ts = TSPacketAlloc( p_stream->p_pool );
+    if( unlikely(p_ts == NULL) )
+        return NULL;
+
+    p_ts->i_flags |= BLOCK_FLAG_CLOCK;
+    p_ts->i_dts = p_next->i_dts;
+
+    p_ts->p_buffer[0] = 0x47;
+    p_ts->p_buffer[1] = ( p_stream->ts.i_pid >> 8 )&0x1f;
+    p_ts->p_buffer[2] = p_stream->ts.i_pid & 0xff;
+    /* The continuity counter only increases with the payload */
+    p_ts->p_buffer[3] = 0x20 | ( ( p_next->p_buffer[3] - 1 )&0x0f );
+
+    p_ts->p_buffer[4] = 183;
+    p_ts->p_buffer[5] = 1 << 4; /* PCR_flag */
+    if( p_stream->ts.b_discontinuity )
+    {
+        p_ts->p_buffer[5] |= 0x80; /* flag TS dicontinuity */
+        p_stream->ts.b_discontinuity = false;
+    }
+    memset( &p_ts->p_buffer[12], 0xff, 188 - 12 );
+
+    return p_ts;
+}
+
+/* Sets the PCR, in 27 MHz units */
+static void TSSetPCR( block_t *p_ts, int64_t i_pcr )
 {
-    int64_t i_pcr = TO_SCALE_NZ(i_dts);
-
-    p_ts->p_buffer[6]  = ( i_pcr >> 25 )&0xff;
-    p_ts->p_buffer[7]  = ( i_pcr >> 17 )&0xff;
-    p_ts->p_buffer[8]  = ( i_pcr >> 9  )&0xff;
-    p_ts->p_buffer[9]  = ( i_pcr >> 1  )&0xff;
-    p_ts->p_buffer[10] = ( i_pcr << 7  )&0x80;
-    p_ts->p_buffer[10] |= 0x7e;
-    p_ts->p_buffer[11] = 0; /* we don't set PCR extension */
+    int64_t i_base = i_pcr / 300;
+    int i_ext = i_pcr % 300;
+
+    p_ts->p_buffer[6]  = ( i_base >> 25 )&0xff;
+    p_ts->p_buffer[7]  = ( i_base >> 17 )&0xff;
+    p_ts->p_buffer[8]  = ( i_base >> 9  )&0xff;
+    p_ts->p_buffer[9]  = ( i_base >> 1  )&0xff;
+    p_ts->p_buffer[10] = ( i_base << 7  )&0x80;
+    p_ts->p_buffer[10] |= 0x7e | ( i_ext >> 8 );
+    p_ts->p_buffer[11] = i_ext & 0xff;
 }
 
 void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c )
@@ -33,6 +33,8 @@
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
+#include <vlc_cpu.h>
+#include <vlc_executor.h>
 #include <vlc_filter.h>
 #include <vlc_image.h>
 #include <vlc_subpicture.h>
@@ -51,6 +53,22 @@ static subpicture_t *Filter ( filter_t *, vlc_tick_t );
 static int MosaicCallback   ( vlc_object_t *, char const *, vlc_value_t,
                               vlc_value_t, void * );
 
+/*****************************************************************************
+ * mosaic_tile_t : one mosaic element being composed
+ *****************************************************************************/
+typedef struct
+{
+    image_handler_t *p_image; /* Kept across frames to reuse the converter */
+
+    picture_t *p_picture;     /* Bridged picture */
+    subpicture_region_t *p_region;
+    video_format_t fmt_in, fmt_out;
+    bool b_keep;
+    bool b_converted;
+
+    struct vlc_runnable runnable;
+} mosaic_tile_t;
+
 /*****************************************************************************
  * filter_sys_t : filter descriptor
  *****************************************************************************/
@@ -58,7 +76,9 @@ typedef struct
 {
     vlc_mutex_t lock;         /* Internal filter lock */
 
-    image_handler_t *p_image;
+    vlc_executor_t *executor; /* Tiles conversion threads */
+    mosaic_tile_t *p_tiles;
+    int i_tiles, i_tiles_max;
 
     int i_position;           /* Mosaic positioning method */
     bool b_ar;          /* Do we keep the aspect ratio ? */
@@ -270,6 +290,83 @@ static void mosaic_ParseSetOffsets( vlc_object_t *p_this,
 #define mosaic_ParseSetOffsets( a, b, c ) \
             mosaic_ParseSetOffsets( VLC_OBJECT( a ), b, c )
 
+/*****************************************************************************
+ * Tiles handling
+ *****************************************************************************/
+static void ConvertTile( void *opaque )
+{
+    mosaic_tile_t *p_tile = opaque;
+    picture_t *p_converted = p_tile->p_picture;
+
+    if( !p_tile->b_keep )
+        p_converted = image_Convert( p_tile->p_image, p_tile->p_picture,
+                                     &p_tile->fmt_in, &p_tile->fmt_out );
+
+    p_tile->b_converted = p_converted != NULL;
+    if( !p_converted )
+        return;
+
+    /* FIXME the copy is probably not needed anymore */
+    picture_Copy( p_tile->p_region->p_picture, p_converted );
+    if( !p_tile->b_keep )
+        picture_Release( p_converted );
+}
+
+static mosaic_tile_t *GetTile( filter_t *p_filter, int i_tile )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    if( i_tile >= p_sys->i_tiles_max )
+    {
+        mosaic_tile_t *p_tiles = realloc( p_sys->p_tiles,
+                                          (i_tile + 1) * sizeof(*p_tiles) );
+        if( p_tiles == NULL )
+            return NULL;
+        p_sys->p_tiles = p_tiles;
+
+        for( int i = p_sys->i_tiles_max; i <= i_tile; i++ )
+        {
+            p_tiles[i].p_image = NULL;
+            p_tiles[i].p_picture = NULL;
+            p_tiles[i].p_region = NULL;
+        }
+        /* the runnables point to the (moved) tiles */
+        for( int i = 0; i <= i_tile; i++ )
+        {
+            p_tiles[i].runnable.run = ConvertTile;
+            p_tiles[i].runnable.userdata = &p_tiles[i];
+        }
+        p_sys->i_tiles_max = i_tile + 1;
+    }
+
+    mosaic_tile_t *p_tile = &p_sys->p_tiles[i_tile];
+    if( !p_sys->b_keep && p_tile->p_image == NULL )
+    {
+        p_tile->p_image = image_HandlerCreate( p_filter );
+        if( p_tile->p_image == NULL )
+            return NULL;
+    }
+    p_tile->b_converted = false;
+    return p_tile;
+}
+
+static void ReleaseTiles( filter_sys_t *p_sys )
+{
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+    {
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+        if( p_tile->p_region )
+            subpicture_region_Delete( p_tile->p_region );
+        picture_Release( p_tile->p_picture );
+        video_format_Clean( &p_tile->fmt_in );
+        video_format_Clean( &p_tile->fmt_out );
+        p_tile->p_region = NULL;
+        p_tile->p_picture = NULL;
+    }
+    p_sys->i_tiles = 0;
+}
+
 static const struct vlc_filter_operations filter_ops = {
     .source_sub = Filter, .close = DestroyFilter,
 };
@@ -330,10 +427,12 @@ static int CreateFilter( filter_t *p_filter )
 
     p_sys->b_keep = var_CreateGetBoolCommand( p_filter,
                                               CFG_PREFIX "keep-picture" );
-    if ( !p_sys->b_keep )
-    {
-        p_sys->p_image = image_HandlerCreate( p_filter );
-    }
+
+    p_sys->p_tiles = NULL;
+    p_sys->i_tiles = p_sys->i_tiles_max = 0;
+    p_sys->executor = NULL;
+    if( vlc_GetCPUCount() > 1 )
+        p_sys->executor = vlc_executor_New( vlc_GetCPUCount() );
 
     p_sys->i_order_length = 0;
     p_sys->ppsz_order = NULL;
@@ -402,10 +501,14 @@ static void DestroyFilter( filter_t *p_filter )
     DEL_CB( order );
 #undef DEL_CB
 
-    if( !p_sys->b_keep )
+    if( p_sys->executor )
+        vlc_executor_Delete( p_sys->executor );
+    for( int i = 0; i < p_sys->i_tiles_max; i++ )
     {
-        image_HandlerDelete( p_sys->p_image );
+        if( p_sys->p_tiles[i].p_image )
+            image_HandlerDelete( p_sys->p_tiles[i].p_image );
     }
+    free( p_sys->p_tiles );
 
     if( p_sys->i_order_length )
     {
@@ -520,12 +623,13 @@ static subpicture_t *Filter( filter_t *p_filter, vlc_tick_t date )
                        * p_sys->i_borderh ) / p_sys->i_rows );
 
     i_real_index = 0;
+    p_sys->i_tiles = 0;
 
     for( int i_index = 0; i_index < p_bridge->i_es_num; i_index++ )
     {
         bridged_es_t *p_es = p_bridge->pp_es[i_index];
         video_format_t fmt_in, fmt_out;
-        picture_t *p_converted;
+        picture_t *p_picture;
 
         if ( p_es->b_empty )
             continue;
@@ -590,13 +694,13 @@ static subpicture_t *Filter( filter_t *p_filter, vlc_tick_t date )
         video_format_Init( &fmt_in, 0 );
         video_format_Init( &fmt_out, 0 );
 
-        p_converted = vlc_picture_chain_PeekFront( &p_es->pictures );
+        p_picture = vlc_picture_chain_PeekFront( &p_es->pictures );
         if ( !p_sys->b_keep )
         {
             /* Convert the images */
-            fmt_in.i_chroma = p_converted->format.i_chroma;
-            fmt_in.i_height = p_converted->format.i_height;
-            fmt_in.i_width = p_converted->format.i_width;
+            fmt_in.i_chroma = p_picture->format.i_chroma;
+            fmt_in.i_height = p_picture->format.i_height;
+            fmt_in.i_width = p_picture->format.i_width;
 
             if( fmt_in.i_chroma == VLC_CODEC_YUVA ||
                 fmt_in.i_chroma == VLC_CODEC_RGBA )
@@ -623,41 +727,26 @@ static subpicture_t *Filter( filter_t *p_filter, vlc_tick_t date )
 
             fmt_out.i_visible_width = fmt_out.i_width;
             fmt_out.i_visible_height = fmt_out.i_height;
-
-            p_converted = image_Convert( p_sys->p_image, p_converted,
-                                         &fmt_in, &fmt_out );
-            if( !p_converted )
-            {
-                msg_Warn( p_filter,
-                           "image resizing and chroma conversion failed" );
-                video_format_Clean( &fmt_in );
-                video_format_Clean( &fmt_out );
-                continue;
-            }
         }
         else
         {
-            fmt_in.i_width = fmt_out.i_width = p_converted->format.i_width;
-            fmt_in.i_height = fmt_out.i_height = p_converted->format.i_height;
-            fmt_in.i_chroma = fmt_out.i_chroma = p_converted->format.i_chroma;
+            fmt_in.i_width = fmt_out.i_width = p_picture->format.i_width;
+            fmt_in.i_height = fmt_out.i_height = p_picture->format.i_height;
+            fmt_in.i_chroma = fmt_out.i_chroma = p_picture->format.i_chroma;
             fmt_out.i_visible_width = fmt_out.i_width;
             fmt_out.i_visible_height = fmt_out.i_height;
         }
 
-        p_region = subpicture_region_New( &fmt_out );
-        /* FIXME the copy is probably not needed anymore */
-        if( p_region )
-            picture_Copy( p_region->p_picture, p_converted );
-        if( !p_sys->b_keep )
-            picture_Release( p_converted );
-
+        mosaic_tile_t *p_tile = GetTile( p_filter, p_sys->i_tiles );
+        p_region = p_tile ? subpicture_region_New( &fmt_out ) : NULL;
         if( !p_region )
         {
             video_format_Clean( &fmt_in );
             video_format_Clean( &fmt_out );
             msg_Err( p_filter, "cannot allocate SPU region" );
-            subpicture_Delete( p_spu );
             vlc_global_unlock( VLC_MOSAIC_MUTEX );
+            ReleaseTiles( p_sys );
+            subpicture_Delete( p_spu );
             vlc_mutex_unlock( &p_sys->lock );
             return NULL;
         }
@@ -713,22 +802,57 @@ static subpicture_t *Filter( filter_t *p_filter, vlc_tick_t date )
         p_region->i_align = p_sys->i_align;
         p_region->i_alpha = p_es->i_alpha;
 
+        /* The conversion itself is done once all the tiles are known, so
+         * that they can be processed concurrently */
+        p_tile->p_picture = picture_Hold( p_picture );
+        p_tile->p_region = p_region;
+        p_tile->fmt_in = fmt_in;
+        p_tile->fmt_out = fmt_out;
+        p_tile->b_keep = p_sys->b_keep;
+        p_sys->i_tiles++;
+    }
+
+    /* The pictures are held by the tiles, the bridge can be released */
+    vlc_global_unlock( VLC_MOSAIC_MUTEX );
+
+    if( p_sys->executor != NULL && p_sys->i_tiles > 1 )
+    {
+        for( int i = 0; i < p_sys->i_tiles; i++ )
+            vlc_executor_Submit( p_sys->executor,
+                                 &p_sys->p_tiles[i].runnable );
+        vlc_executor_WaitIdle( p_sys->executor );
+    }
+    else
+    {
+        for( int i = 0; i < p_sys->i_tiles; i++ )
+            ConvertTile( &p_sys->p_tiles[i] );
+    }
+
+    for( int i = 0; i < p_sys->i_tiles; i++ )
+    {
+        mosaic_tile_t *p_tile = &p_sys->p_tiles[i];
+
+        if( !p_tile->b_converted )
+        {
+            msg_Warn( p_filter,
+                      "image resizing and chroma conversion failed" );
+            continue;
+        }
+
         if( p_region_prev == NULL )
         {
-            p_spu->p_region = p_region;
+            p_spu->p_region = p_tile->p_region;
         }
         else
         {
-            p_region_prev->p_next = p_region;
+            p_region_prev->p_next = p_tile->p_region;
         }
 
-        video_format_Clean( &fmt_in );
-        video_format_Clean( &fmt_out );
-
-        p_region_prev = p_region;
+        p_region_prev = p_tile->p_region;
+        p_tile->p_region = NULL;
     }
+    ReleaseTiles( p_sys );
 
-    vlc_global_unlock( VLC_MOSAIC_MUTEX );
     vlc_mutex_unlock( &p_sys->lock );
 
     return p_spu;
@@ -924,10 +1048,6 @@ static int MosaicCallback( vlc_object_t *p_this, char const *psz_var,
     {
         vlc_mutex_lock( &p_sys->lock );
         p_sys->b_keep = newval.b_bool;
-        if ( !p_sys->b_keep && !p_sys->p_image )
-        {
-            p_sys->p_image = image_HandlerCreate( p_this );
-        }
         vlc_mutex_unlock( &p_sys->lock );
     }
 
@@ -133,7 +133,10 @@ static int Send( sout_stream_t *p_stream, void *id, block_t *p_buffer )
             else
                 p_buffer->i_pts += p_sys->i_delay;
 
-            vlc_input_decoder_Decode( id, p_buffer, false );
+            /* The decoder owns its input, which must not be shared */
+            p_buffer = block_Unshare( p_buffer );
+            if( p_buffer )
+                vlc_input_decoder_Decode( id, p_buffer, false );
         }
 
         p_buffer = p_next;
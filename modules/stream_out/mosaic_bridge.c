@@ -606,6 +606,11 @@ static int Send( sout_stream_t *p_stream, void *id, block_t *p_buffer )
         return VLC_SUCCESS;
     }
 
+    /* Some decoders modify their input data */
+    p_buffer = block_Unshare( p_buffer );
+    if( !p_buffer )
+        return VLC_ENOMEM;
+
     int ret = p_sys->p_decoder->pf_decode( p_sys->p_decoder, p_buffer );
     return ret == VLCDEC_SUCCESS ? VLC_SUCCESS : VLC_EGENERIC;
 }
@@ -50,6 +50,7 @@ void transcode_encoder_delete( transcode_encoder_t *p_enc )
         {
             block_ChainRelease( p_enc->p_buffers );
             picture_fifo_Delete( p_enc->pp_pics );
+            free( p_enc->p_dates );
         }
         es_format_Clean( &p_enc->p_encoder->fmt_in );
         es_format_Clean( &p_enc->p_encoder->fmt_out );
@@ -42,6 +42,7 @@ typedef struct
             struct
             {
                 unsigned int i_count;
+                unsigned int i_shared; /* threads of the process-wide pool */
                 int          i_priority;
                 uint32_t     pool_size;
             } threads;
@@ -17,6 +17,9 @@
  * along with this program; if not, If not, see https://www.gnu.org/licenses/
  *****************************************************************************/
 #include <vlc_picture_fifo.h>
+#include <vlc_list.h>
+
+typedef struct transcode_encoder_pool_t transcode_encoder_pool_t;
 
 struct transcode_encoder_t
 {
@@ -31,8 +34,29 @@ struct transcode_encoder_t
     /* output buffers */
     block_t         *p_buffers;
     bool b_threaded;
+
+    /* shared threads */
+    transcode_encoder_pool_t *p_pool;
+    struct vlc_list pool_node;
+    bool            b_scheduled;
+    bool            b_running;
+    vlc_tick_t      i_deadline;
+    vlc_tick_t      *p_dates; /* arrival of the waiting pictures */
+    unsigned        i_dates_first;
+    unsigned        i_dates_count;
+    unsigned        i_dates_size;
 };
 
+transcode_encoder_pool_t *transcode_encoder_pool_hold( vlc_object_t *,
+                                                       unsigned i_threads,
+                                                       int i_priority );
+void transcode_encoder_pool_release( transcode_encoder_pool_t * );
+void transcode_encoder_pool_push( transcode_encoder_pool_t *,
+                                  transcode_encoder_t *, picture_t * );
+/* Waits for the pool to be done with the pictures of the encoder */
+void transcode_encoder_pool_wait( transcode_encoder_pool_t *,
+                                  transcode_encoder_t * );
+
 int transcode_encoder_audio_open( transcode_encoder_t *p_enc,
                                   const transcode_encoder_config_t *p_cfg );
 int transcode_encoder_video_open( transcode_encoder_t *p_enc,
@@ -0,0 +1,235 @@
+/*****************************************************************************
+ * pool.c: transcoding encoder threads shared by the whole process
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, If not, see https://www.gnu.org/licenses/
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_codec.h>
+#include <vlc_list.h>
+#include "encoder.h"
+#include "encoder_priv.h"
+
+/*
+ * The pool has a set of worker threads, and a list of the encoders that have
+ * pictures waiting. A worker takes the encoder whose oldest picture has been
+ * waiting the longest, and encodes that single picture. An encoder is never
+ * run by two workers at once, so that its pictures are encoded in order.
+ *
+ * The pool is created by its first user, and grows to the largest number of
+ * threads requested. It is destroyed with its last user.
+ */
+struct transcode_encoder_pool_t
+{
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait_work;
+    vlc_cond_t      wait_idle;
+    struct vlc_list ready;  /* encoders with waiting pictures */
+    bool            b_quit;
+
+    vlc_thread_t   *p_threads;
+    unsigned        i_threads;
+    unsigned        i_refs;
+};
+
+static vlc_mutex_t pool_lock = VLC_STATIC_MUTEX;
+static transcode_encoder_pool_t *shared_pool = NULL;
+
+/* Called with lock_out held */
+static picture_t *PopPicture( transcode_encoder_t *p_enc )
+{
+    picture_t *p_pic = picture_fifo_Pop( p_enc->pp_pics );
+    if( p_pic )
+    {
+        p_enc->i_dates_first = (p_enc->i_dates_first + 1) % p_enc->i_dates_size;
+        p_enc->i_dates_count--;
+    }
+    return p_pic;
+}
+
+static void *PoolThread( void *data )
+{
+    transcode_encoder_pool_t *pool = data;
+
+    vlc_mutex_lock( &pool->lock );
+    for( ;; )
+    {
+        while( !pool->b_quit && vlc_list_is_empty( &pool->ready ) )
+            vlc_cond_wait( &pool->wait_work, &pool->lock );
+        if( vlc_list_is_empty( &pool->ready ) )
+            break;
+
+        /* Earliest deadline first */
+        transcode_encoder_t *p_enc = NULL, *it;
+        vlc_list_foreach( it, &pool->ready, pool_node )
+            if( p_enc == NULL || it->i_deadline < p_enc->i_deadline )
+                p_enc = it;
+        vlc_list_remove( &p_enc->pool_node );
+        p_enc->b_scheduled = false;
+        p_enc->b_running = true;
+        vlc_mutex_unlock( &pool->lock );
+
+        vlc_mutex_lock( &p_enc->lock_out );
+        picture_t *p_pic = PopPicture( p_enc );
+        vlc_mutex_unlock( &p_enc->lock_out );
+
+        block_t *p_block = NULL;
+        if( p_pic )
+        {
+            vlc_sem_post( &p_enc->picture_pool_has_room );
+            p_block = p_enc->p_encoder->pf_encode_video( p_enc->p_encoder, p_pic );
+            picture_Release( p_pic );
+        }
+
+        vlc_mutex_lock( &pool->lock );
+        vlc_mutex_lock( &p_enc->lock_out );
+        block_ChainAppend( &p_enc->p_buffers, p_block );
+        p_enc->b_running = false;
+        if( p_enc->i_dates_count > 0 )
+        {
+            p_enc->i_deadline = p_enc->p_dates[p_enc->i_dates_first];
+            vlc_list_append( &p_enc->pool_node, &pool->ready );
+            p_enc->b_scheduled = true;
+        }
+        else
+            vlc_cond_broadcast( &pool->wait_idle );
+        vlc_mutex_unlock( &p_enc->lock_out );
+    }
+    vlc_mutex_unlock( &pool->lock );
+
+    return NULL;
+}
+
+transcode_encoder_pool_t *transcode_encoder_pool_hold( vlc_object_t *p_obj,
+                                                       unsigned i_threads,
+                                                       int i_priority )
+{
+    vlc_mutex_lock( &pool_lock );
+
+    transcode_encoder_pool_t *pool = shared_pool;
+    if( pool == NULL )
+    {
+        pool = calloc( 1, sizeof(*pool) );
+        if( unlikely(pool == NULL) )
+            goto error;
+        vlc_mutex_init( &pool->lock );
+        vlc_cond_init( &pool->wait_work );
+        vlc_cond_init( &pool->wait_idle );
+        vlc_list_init( &pool->ready );
+        shared_pool = pool;
+    }
+
+    if( pool->i_threads < i_threads )
+    {
+        vlc_thread_t *p_threads = realloc( pool->p_threads,
+                                           i_threads * sizeof(*p_threads) );
+        if( unlikely(p_threads == NULL) )
+            i_threads = pool->i_threads;
+        else
+            pool->p_threads = p_threads;
+
+        while( pool->i_threads < i_threads )
+        {
+            if( vlc_clone( &pool->p_threads[pool->i_threads], PoolThread, pool,
+                           i_priority ) )
+            {
+                msg_Warn( p_obj, "cannot create encoder thread" );
+                break;
+            }
+            pool->i_threads++;
+        }
+        msg_Dbg( p_obj, "%u shared encoder threads", pool->i_threads );
+    }
+
+    if( pool->i_threads == 0 )
+    {
+        assert( pool->i_refs == 0 );
+        free( pool->p_threads );
+        free( pool );
+        shared_pool = NULL;
+        goto error;
+    }
+
+    pool->i_refs++;
+    vlc_mutex_unlock( &pool_lock );
+    return pool;
+
+error:
+    vlc_mutex_unlock( &pool_lock );
+    return NULL;
+}
+
+void transcode_encoder_pool_release( transcode_encoder_pool_t *pool )
+{
+    vlc_mutex_lock( &pool_lock );
+    assert( pool == shared_pool );
+
+    if( --pool->i_refs == 0 )
+    {
+        vlc_mutex_lock( &pool->lock );
+        pool->b_quit = true;
+        vlc_cond_broadcast( &pool->wait_work );
+        vlc_mutex_unlock( &pool->lock );
+
+        for( unsigned i = 0; i < pool->i_threads; i++ )
+            vlc_join( pool->p_threads[i], NULL );
+        free( pool->p_threads );
+        free( pool );
+        shared_pool = NULL;
+    }
+
+    vlc_mutex_unlock( &pool_lock );
+}
+
+void transcode_encoder_pool_push( transcode_encoder_pool_t *pool,
+                                  transcode_encoder_t *p_enc, picture_t *p_pic )
+{
+    vlc_tick_t now = vlc_tick_now();
+
+    /* Blocks the decoder while the encoder is too far behind */
+    vlc_sem_wait( &p_enc->picture_pool_has_room );
+
+    vlc_mutex_lock( &p_enc->lock_out );
+    picture_fifo_Push( p_enc->pp_pics, picture_Hold( p_pic ) );
+    assert( p_enc->i_dates_count < p_enc->i_dates_size );
+    p_enc->p_dates[(p_enc->i_dates_first + p_enc->i_dates_count++)
+                   % p_enc->i_dates_size] = now;
+    vlc_mutex_unlock( &p_enc->lock_out );
+
+    vlc_mutex_lock( &pool->lock );
+    /* Otherwise, the worker running it will schedule it again */
+    if( !p_enc->b_scheduled && !p_enc->b_running )
+    {
+        p_enc->i_deadline = now;
+        vlc_list_append( &p_enc->pool_node, &pool->ready );
+        p_enc->b_scheduled = true;
+        vlc_cond_signal( &pool->wait_work );
+    }
+    vlc_mutex_unlock( &pool->lock );
+}
+
+void transcode_encoder_pool_wait( transcode_encoder_pool_t *pool,
+                                  transcode_encoder_t *p_enc )
+{
+    vlc_mutex_lock( &pool->lock );
+    while( p_enc->b_scheduled || p_enc->b_running )
+        vlc_cond_wait( &pool->wait_idle, &pool->lock );
+    vlc_mutex_unlock( &pool->lock );
+}
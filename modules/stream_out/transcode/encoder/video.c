@@ -410,6 +410,14 @@ static void* EncoderThread( void *obj )
 
 int transcode_encoder_video_drain( transcode_encoder_t *p_enc, block_t **out )
 {
+    if( p_enc->p_pool )
+    {
+        transcode_encoder_pool_wait( p_enc->p_pool, p_enc );
+        transcode_encoder_pool_release( p_enc->p_pool );
+        p_enc->p_pool = NULL;
+        block_ChainAppend( out, transcode_encoder_get_output_async( p_enc ) );
+    }
+
     if( !p_enc->b_threaded )
     {
         block_t *p_block;
@@ -435,6 +443,13 @@ int transcode_encoder_video_drain( transcode_encoder_t *p_enc, block_t **out )
 
 void transcode_encoder_video_close( transcode_encoder_t *p_enc )
 {
+    if( p_enc->p_pool )
+    {
+        transcode_encoder_pool_wait( p_enc->p_pool, p_enc );
+        transcode_encoder_pool_release( p_enc->p_pool );
+        p_enc->p_pool = NULL;
+    }
+
     if( p_enc->b_threaded && !p_enc->b_abort )
     {
         vlc_mutex_lock( &p_enc->lock_out );
@@ -471,7 +486,27 @@ int transcode_encoder_video_open( transcode_encoder_t *p_enc,
     p_enc->p_buffers = NULL;
     p_enc->b_abort = false;
 
-    if( p_cfg->video.threads.i_count > 0 )
+    if( p_cfg->video.threads.i_shared > 0 )
+    {
+        free( p_enc->p_dates );
+        p_enc->p_dates = vlc_alloc( p_cfg->video.threads.pool_size,
+                                    sizeof(*p_enc->p_dates) );
+        if( p_enc->p_dates != NULL )
+            p_enc->p_pool =
+                transcode_encoder_pool_hold( VLC_OBJECT(p_enc->p_encoder),
+                                             p_cfg->video.threads.i_shared,
+                                             p_cfg->video.threads.i_priority );
+        if( p_enc->p_pool == NULL )
+        {
+            module_unneed( p_enc->p_encoder, p_enc->p_encoder->p_module );
+            p_enc->p_encoder->p_module = NULL;
+            return VLC_EGENERIC;
+        }
+        p_enc->i_dates_size = p_cfg->video.threads.pool_size;
+        p_enc->i_dates_first = p_enc->i_dates_count = 0;
+        p_enc->b_scheduled = p_enc->b_running = false;
+    }
+    else if( p_cfg->video.threads.i_count > 0 )
     {
         if( vlc_clone( &p_enc->thread, EncoderThread, p_enc, p_cfg->video.threads.i_priority ) )
         {
@@ -487,6 +522,12 @@ int transcode_encoder_video_open( transcode_encoder_t *p_enc,
 
 block_t * transcode_encoder_video_encode( transcode_encoder_t *p_enc, picture_t *p_pic )
 {
+    if( p_enc->p_pool )
+    {
+        transcode_encoder_pool_push( p_enc->p_pool, p_enc, p_pic );
+        return NULL;
+    }
+
     if( !p_enc->b_threaded )
     {
         return p_enc->p_encoder->pf_encode_video( p_enc->p_encoder, p_pic );
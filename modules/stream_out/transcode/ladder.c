@@ -0,0 +1,421 @@
+/*****************************************************************************
+ * ladder.c: transcoding stream output module (video renditions ladder)
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+
+#include "transcode.h"
+
+/*
+ * The ladder encodes the pictures of a video stream into several extra
+ * renditions. Decoding and the shared filters (deinterlace, fps, user
+ * filters and overlays) run once, on the stream output thread. Each
+ * rendition then holds a reference to the filtered pictures, and scales and
+ * encodes them on its own thread.
+ *
+ * There is no way to force the key frames of an encoder. All the renditions
+ * get the very same pictures and dates, and are started, drained and
+ * restarted together, so that encoders configured with a fixed GOP keep
+ * their key frames aligned.
+ */
+
+typedef struct
+{
+    transcode_ladder_t *ladder;
+    const transcode_encoder_config_t *p_cfg;
+    unsigned        i_rank;
+
+    transcode_encoder_t *encoder;
+    filter_chain_t  *p_conv; /**< scaler to the encoder input format */
+    video_format_t  src; /**< format the scaler was set up for */
+    void            *downstream_id;
+
+    vlc_thread_t    thread;
+    vlc_mutex_t     lock;
+    vlc_cond_t      wait;
+    vlc_sem_t       room; /**< bounds the pictures queued to the thread */
+    picture_fifo_t  *pics;
+    bool            b_running;
+    bool            b_draining;
+    bool            b_error;
+
+    block_t         *p_out; /**< encoded data, not sent downstream yet */
+} ladder_rendition_t;
+
+struct transcode_ladder_t
+{
+    sout_stream_t        *p_stream;
+    sout_stream_id_sys_t *id;
+
+    size_t               i_count;
+    ladder_rendition_t   renditions[];
+};
+
+struct ladder_encoder_owner
+{
+    encoder_t enc;
+    sout_stream_id_sys_t *id;
+};
+
+static vlc_decoder_device *ladder_get_encoder_device( encoder_t *enc )
+{
+    struct ladder_encoder_owner *p_owner =
+        container_of( enc, struct ladder_encoder_owner, enc );
+
+    /* The device, if any, was created along with the main encoder */
+    vlc_decoder_device *dec_dev = p_owner->id->dec_dev;
+    return dec_dev ? vlc_decoder_device_Hold( dec_dev ) : NULL;
+}
+
+static const struct encoder_owner_callbacks ladder_encoder_cbs = {
+    { ladder_get_encoder_device, }
+};
+
+static encoder_t *ladder_encoder_create( sout_stream_t *p_stream,
+                                         sout_stream_id_sys_t *id )
+{
+    struct ladder_encoder_owner *p_owner =
+        (struct ladder_encoder_owner *)sout_EncoderCreate( p_stream, sizeof(*p_owner) );
+    if( unlikely(p_owner == NULL) )
+        return NULL;
+
+    p_owner->id = id;
+    p_owner->enc.cbs = &ladder_encoder_cbs;
+    return &p_owner->enc;
+}
+
+static void rendition_set_src( ladder_rendition_t *r, picture_t *p_pic )
+{
+    sout_stream_t *p_stream = r->ladder->p_stream;
+
+    transcode_remove_filters( &r->p_conv );
+    video_format_Clean( &r->src );
+    video_format_Copy( &r->src, &p_pic->format );
+
+    const es_format_t *p_enc_in = transcode_encoder_format_in( r->encoder );
+    if( p_pic->format.i_chroma == p_enc_in->i_codec &&
+        p_pic->format.i_width  == p_enc_in->video.i_width &&
+        p_pic->format.i_height == p_enc_in->video.i_height &&
+        p_pic->format.i_visible_width  == p_enc_in->video.i_visible_width &&
+        p_pic->format.i_visible_height == p_enc_in->video.i_visible_height )
+        return;
+
+    es_format_t src;
+    es_format_Init( &src, VIDEO_ES, p_pic->format.i_chroma );
+    video_format_Copy( &src.video, &p_pic->format );
+
+    r->p_conv = filter_chain_NewVideo( p_stream, false, NULL );
+    if( r->p_conv )
+    {
+        filter_chain_Reset( r->p_conv, &src, picture_GetVideoContext( p_pic ),
+                            p_enc_in );
+        if( filter_chain_AppendConverter( r->p_conv, NULL ) )
+        {
+            msg_Err( p_stream, "cannot scale rendition %u to %ux%u",
+                     r->i_rank, p_enc_in->video.i_visible_width,
+                     p_enc_in->video.i_visible_height );
+            transcode_remove_filters( &r->p_conv );
+            r->b_error = true;
+        }
+    }
+    else
+        r->b_error = true;
+
+    es_format_Clean( &src );
+}
+
+static block_t *rendition_encode( ladder_rendition_t *r, picture_t *p_pic )
+{
+    if( !video_format_IsSimilar( &r->src, &p_pic->format ) )
+        rendition_set_src( r, p_pic );
+
+    if( r->b_error )
+    {
+        picture_Release( p_pic );
+        return NULL;
+    }
+
+    if( r->p_conv )
+    {
+        p_pic = filter_chain_VideoFilter( r->p_conv, p_pic );
+        if( !p_pic )
+            return NULL;
+    }
+
+    block_t *p_block = transcode_encoder_encode( r->encoder, p_pic );
+    picture_Release( p_pic );
+    return p_block;
+}
+
+static void *RenditionThread( void *data )
+{
+    ladder_rendition_t *r = data;
+    int canc = vlc_savecancel();
+
+    vlc_mutex_lock( &r->lock );
+    for( ;; )
+    {
+        picture_t *p_pic;
+
+        while( (p_pic = picture_fifo_Pop( r->pics )) == NULL && !r->b_draining )
+            vlc_cond_wait( &r->wait, &r->lock );
+        if( p_pic == NULL )
+            break; /* drained */
+
+        vlc_sem_post( &r->room );
+
+        /* release lock while scaling and encoding */
+        vlc_mutex_unlock( &r->lock );
+        block_t *p_block = rendition_encode( r, p_pic );
+        vlc_mutex_lock( &r->lock );
+
+        block_ChainAppend( &r->p_out, p_block );
+    }
+    vlc_mutex_unlock( &r->lock );
+
+    vlc_restorecancel( canc );
+    return NULL;
+}
+
+static int rendition_start( ladder_rendition_t *r, picture_t *p_pic )
+{
+    transcode_ladder_t *ladder = r->ladder;
+    sout_stream_t *p_stream = ladder->p_stream;
+    sout_stream_id_sys_t *id = ladder->id;
+
+    transcode_encoder_video_configure( VLC_OBJECT(p_stream),
+                                       &p_pic->format, r->p_cfg,
+                                       &p_pic->format,
+                                       picture_GetVideoContext( p_pic ),
+                                       r->encoder );
+
+    if( transcode_encoder_open( r->encoder, r->p_cfg ) != VLC_SUCCESS )
+    {
+        msg_Err( p_stream, "cannot open the encoder of rendition %u", r->i_rank );
+        return VLC_EGENERIC;
+    }
+
+    video_format_Init( &r->src, 0 );
+    rendition_set_src( r, p_pic );
+    if( r->b_error )
+        goto error;
+
+    if( !r->downstream_id )
+    {
+        /* Give each rendition its own ES id, so that they can be told apart
+         * (and selected) downstream */
+        es_format_t orig = id->p_decoder->fmt_in;
+        orig.i_id += 1000 * r->i_rank;
+
+        r->downstream_id =
+            id->pf_transcode_downstream_add( p_stream, &orig,
+                                             transcode_encoder_format_out( r->encoder ) );
+        if( !r->downstream_id )
+        {
+            msg_Err( p_stream, "cannot output rendition %u", r->i_rank );
+            goto error;
+        }
+    }
+
+    r->b_draining = false;
+    if( vlc_clone( &r->thread, RenditionThread, r,
+                   r->p_cfg->video.threads.i_priority ) )
+        goto error;
+
+    msg_Dbg( p_stream, "rendition %u: %ux%u %ukb/s", r->i_rank,
+             transcode_encoder_format_out( r->encoder )->video.i_visible_width,
+             transcode_encoder_format_out( r->encoder )->video.i_visible_height,
+             r->p_cfg->video.i_bitrate / 1000 );
+
+    r->b_running = true;
+    return VLC_SUCCESS;
+
+error:
+    transcode_remove_filters( &r->p_conv );
+    video_format_Clean( &r->src );
+    transcode_encoder_close( r->encoder );
+    return VLC_EGENERIC;
+}
+
+static void rendition_stop( ladder_rendition_t *r, bool b_eos )
+{
+    vlc_mutex_lock( &r->lock );
+    r->b_draining = true;
+    vlc_cond_signal( &r->wait );
+    vlc_mutex_unlock( &r->lock );
+    vlc_join( r->thread, NULL );
+    r->b_running = false;
+
+    /* The thread is gone, no need to lock anymore */
+    transcode_encoder_drain( r->encoder, &r->p_out );
+    transcode_encoder_close( r->encoder );
+    transcode_remove_filters( &r->p_conv );
+    video_format_Clean( &r->src );
+
+    if( b_eos && r->p_out )
+    {
+        block_t *p_last = r->p_out;
+        while( p_last->p_next )
+            p_last = p_last->p_next;
+        p_last->i_flags |= BLOCK_FLAG_END_OF_SEQUENCE;
+    }
+}
+
+transcode_ladder_t *transcode_ladder_new( sout_stream_t *p_stream,
+                                          sout_stream_id_sys_t *id,
+                                          const transcode_encoder_config_t *p_cfgs,
+                                          size_t i_count )
+{
+    transcode_ladder_t *ladder =
+        calloc( 1, sizeof(*ladder) + i_count * sizeof(ladder->renditions[0]) );
+    if( unlikely(ladder == NULL) )
+        return NULL;
+
+    ladder->p_stream = p_stream;
+    ladder->id = id;
+
+    for( size_t i = 0; i < i_count; i++ )
+    {
+        ladder_rendition_t *r = &ladder->renditions[i];
+        r->ladder = ladder;
+        r->p_cfg = &p_cfgs[i];
+        r->i_rank = i + 1;
+
+        /* As for the main encoder, only check that an encoder is available
+         * until the first picture tells the actual input format */
+        es_format_t encoder_tested_fmt_in;
+        es_format_Init( &encoder_tested_fmt_in, VIDEO_ES, 0 );
+
+        if( transcode_encoder_test( ladder_encoder_create( p_stream, id ),
+                                    r->p_cfg, &id->p_decoder->fmt_in,
+                                    id->p_decoder->fmt_out.i_codec,
+                                    &encoder_tested_fmt_in ) == VLC_SUCCESS )
+            r->encoder = transcode_encoder_new( ladder_encoder_create( p_stream, id ),
+                                                &encoder_tested_fmt_in );
+        es_format_Clean( &encoder_tested_fmt_in );
+
+        if( !r->encoder )
+            break;
+
+        r->pics = picture_fifo_New();
+        if( !r->pics )
+        {
+            transcode_encoder_delete( r->encoder );
+            break;
+        }
+        vlc_mutex_init( &r->lock );
+        vlc_cond_init( &r->wait );
+        vlc_sem_init( &r->room, r->p_cfg->video.threads.pool_size );
+        ladder->i_count++;
+    }
+
+    if( ladder->i_count < i_count )
+    {
+        msg_Err( p_stream, "cannot create the encoder of rendition %zu",
+                 ladder->i_count + 1 );
+        transcode_ladder_delete( ladder );
+        return NULL;
+    }
+    return ladder;
+}
+
+void transcode_ladder_delete( transcode_ladder_t *ladder )
+{
+    for( size_t i = 0; i < ladder->i_count; i++ )
+    {
+        ladder_rendition_t *r = &ladder->renditions[i];
+
+        if( r->b_running )
+            rendition_stop( r, false );
+        block_ChainRelease( r->p_out );
+        picture_fifo_Delete( r->pics );
+        transcode_encoder_delete( r->encoder );
+        if( r->downstream_id )
+            sout_StreamIdDel( ladder->p_stream->p_next, r->downstream_id );
+    }
+    free( ladder );
+}
+
+void transcode_ladder_push( transcode_ladder_t *ladder, picture_t *p_pic )
+{
+    for( size_t i = 0; i < ladder->i_count; i++ )
+    {
+        ladder_rendition_t *r = &ladder->renditions[i];
+
+        if( !r->b_running &&
+            ( r->b_error || rendition_start( r, p_pic ) != VLC_SUCCESS ) )
+        {
+            r->b_error = true;
+            continue;
+        }
+
+        /* Wait for the rendition to catch up, rather than queuing
+         * pictures without bounds */
+        vlc_sem_wait( &r->room );
+        vlc_mutex_lock( &r->lock );
+        picture_fifo_Push( r->pics, picture_Hold( p_pic ) );
+        vlc_cond_signal( &r->wait );
+        vlc_mutex_unlock( &r->lock );
+    }
+}
+
+void transcode_ladder_drain( transcode_ladder_t *ladder, bool b_eos )
+{
+    for( size_t i = 0; i < ladder->i_count; i++ )
+    {
+        ladder_rendition_t *r = &ladder->renditions[i];
+        if( r->b_running )
+            rendition_stop( r, b_eos );
+    }
+}
+
+int transcode_ladder_output( transcode_ladder_t *ladder )
+{
+    int i_ret = VLC_SUCCESS;
+
+    for( size_t i = 0; i < ladder->i_count; i++ )
+    {
+        ladder_rendition_t *r = &ladder->renditions[i];
+
+        vlc_mutex_lock( &r->lock );
+        block_t *p_out = r->p_out;
+        r->p_out = NULL;
+        vlc_mutex_unlock( &r->lock );
+
+        /* Pick up what the encoder thread, if any, has output */
+        block_ChainAppend( &p_out, transcode_encoder_get_output_async( r->encoder ) );
+
+        if( !p_out )
+            continue;
+        if( !r->downstream_id )
+            block_ChainRelease( p_out );
+        else if( sout_StreamIdSend( ladder->p_stream->p_next,
+                                    r->downstream_id, p_out ) )
+            i_ret = VLC_EGENERIC;
+    }
+    return i_ret;
+}
@@ -0,0 +1,740 @@
+/*****************************************************************************
+ * smartcut.c: transcoding stream output module (smart cut)
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Preamble
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+
+#include "transcode.h"
+#include "../../packetizer/hxxx_nal.h"
+#include "../../packetizer/h264_nal.h"
+#include "../../packetizer/hevc_nal.h"
+
+/*
+ * A smart cut copies the coded video from the first random access point
+ * after the start of the clip, and re-encodes only the pictures before it,
+ * starting from the previous random access point. The same is done at the
+ * end of the clip, with the last group of pictures, so that the output
+ * starts and stops on the requested pictures.
+ *
+ * The groups of pictures are held until the next random access point, as it
+ * is only known then whether they contain the end of the clip. The other
+ * elementary streams are cut on their own timestamps.
+ *
+ * The leading pictures of an open GOP reference the previous group, and are
+ * re-encoded along with it: at the start of the clip, the head is held until
+ * the leading pictures of the first copied random access point are known,
+ * and at the end, the last copied group is decoded again before the tail.
+ */
+enum
+{
+    SMARTCUT_WAIT, /* before the first random access point of the clip */
+    SMARTCUT_COPY,
+    SMARTCUT_DONE,
+};
+
+struct transcode_smartcut_t
+{
+    int         i_state;
+    bool        b_video;    /* Cut on random access points */
+    bool        b_reencode; /* Re-encode the edges, else copy the whole GOPs */
+    vlc_fourcc_t i_codec;
+
+    /* Clip, in the stream timestamps, resolved with the first block */
+    vlc_tick_t  i_start;
+    vlc_tick_t  i_stop;
+
+    /* Group of pictures from the last random access point */
+    block_t    *p_gop;
+    block_t   **pp_gop_last;
+    vlc_tick_t  i_gop_key;      /* date of its random access point */
+    vlc_tick_t  i_gop_max;      /* latest date of its pictures */
+
+    /* Head of the clip, held along with the first copied random access point
+     * and its leading pictures, if it is open */
+    block_t    *p_head;
+    block_t    *p_leading;
+    block_t   **pp_leading_last;
+
+    /* Last copied group of pictures, if the next one is open */
+    block_t    *p_prev;
+    vlc_tick_t  i_prev_max;     /* latest date of its pictures */
+
+    vlc_tick_t  i_leading;      /* date of the first copied RAP */
+    vlc_tick_t  i_last_dts;     /* last video dts sent downstream */
+
+    /* Pictures given to the encoder */
+    vlc_tick_t  i_keep_start;
+    vlc_tick_t  i_keep_stop;
+
+    transcode_encoder_config_t enc_cfg;
+    sout_filters_config_t filters_cfg;
+};
+
+static vlc_tick_t BlockDate( const block_t *p_block )
+{
+    return p_block->i_pts != VLC_TICK_INVALID ? p_block->i_pts : p_block->i_dts;
+}
+
+/* pb_open tells if the following leading pictures may reference the
+ * previous group of pictures, and be output */
+static bool IsRandomAccess( const transcode_smartcut_t *sc, const block_t *p_block,
+                            bool *pb_open )
+{
+    *pb_open = false;
+    if( !(p_block->i_flags & BLOCK_FLAG_TYPE_I) )
+        return false;
+    if( sc->i_codec != VLC_CODEC_H264 && sc->i_codec != VLC_CODEC_HEVC )
+        return true;
+
+    /* The parameter sets can only change on an IDR (IRAP) picture, not
+     * on the recovery points */
+    hxxx_iterator_ctx_t it;
+    hxxx_iterator_init( &it, p_block->p_buffer, p_block->i_buffer, 0 );
+    const uint8_t *p_nal;
+    size_t i_nal;
+    while( hxxx_annexb_iterate_next( &it, &p_nal, &i_nal ) )
+    {
+        if( i_nal < 2 )
+            continue;
+        if( sc->i_codec == VLC_CODEC_H264 )
+        {
+            if( (p_nal[0] & 0x1f) == H264_NAL_SLICE_IDR )
+                return true;
+        }
+        else
+        {
+            uint8_t i_type = hevc_getNALType( p_nal );
+            if( i_type >= HEVC_NAL_BLA_W_LP && i_type <= HEVC_NAL_CRA )
+            {
+                /* The RASL pictures of a BLA are never output */
+                *pb_open = i_type == HEVC_NAL_CRA;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void ResolveClip( sout_stream_t *p_stream, transcode_smartcut_t *sc,
+                         const block_t *p_block )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    if( p_sys->i_smartcut_origin == VLC_TICK_INVALID )
+    {
+        vlc_tick_t i_date = p_block->i_dts != VLC_TICK_INVALID ?
+                            p_block->i_dts : p_block->i_pts;
+        if( i_date == VLC_TICK_INVALID )
+        {
+            vlc_mutex_unlock( &p_sys->lock );
+            return;
+        }
+        p_sys->i_smartcut_origin = i_date;
+        msg_Dbg( p_stream, "smart cut from %"PRId64" to %"PRId64" ms",
+                 MS_FROM_VLC_TICK( p_sys->i_smartcut_start ),
+                 p_sys->i_smartcut_stop ?
+                 MS_FROM_VLC_TICK( p_sys->i_smartcut_stop ) : -1 );
+    }
+    sc->i_start = p_sys->i_smartcut_origin + p_sys->i_smartcut_start;
+    sc->i_stop = p_sys->i_smartcut_stop ?
+                 p_sys->i_smartcut_origin + p_sys->i_smartcut_stop : INT64_MAX;
+    vlc_mutex_unlock( &p_sys->lock );
+}
+
+static void GopAppend( transcode_smartcut_t *sc, block_t *p_block )
+{
+    vlc_tick_t i_date = BlockDate( p_block );
+    if( sc->p_gop == NULL )
+        sc->i_gop_key = sc->i_gop_max = i_date;
+    else if( i_date != VLC_TICK_INVALID && i_date > sc->i_gop_max )
+        sc->i_gop_max = i_date;
+    block_ChainLastAppend( &sc->pp_gop_last, p_block );
+}
+
+static block_t *GopGet( transcode_smartcut_t *sc )
+{
+    block_t *p_gop = sc->p_gop;
+    sc->p_gop = NULL;
+    sc->pp_gop_last = &sc->p_gop;
+    return p_gop;
+}
+
+static block_t *GopDuplicate( const block_t *p_gop )
+{
+    block_t *p_dup = NULL;
+    block_t **pp_last = &p_dup;
+    for( ; p_gop; p_gop = p_gop->p_next )
+    {
+        block_t *p_block = block_Duplicate( p_gop );
+        if( p_block == NULL )
+        {
+            block_ChainRelease( p_dup );
+            return NULL;
+        }
+        block_ChainLastAppend( &pp_last, p_block );
+    }
+    return p_dup;
+}
+
+static int SendVideo( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
+                      block_t *p_chain )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+    for( block_t *p = p_chain; p; p = p->p_next )
+        if( p->i_dts != VLC_TICK_INVALID )
+            sc->i_last_dts = p->i_dts;
+    if( p_chain == NULL )
+        return VLC_SUCCESS;
+    return sout_StreamIdSend( p_stream->p_next, id->downstream_id, p_chain );
+}
+
+/* The encoder may only have the parameter sets in its extra data */
+static block_t *PrependHeaders( sout_stream_id_sys_t *id, block_t *p_chain )
+{
+    const es_format_t *p_fmt = transcode_encoder_format_out( id->encoder );
+    const uint8_t *p_extra = p_fmt->p_extra;
+    size_t i_extra = p_fmt->i_extra;
+
+    if( i_extra < 4 || !( !memcmp( p_extra, annexb_startcode4, 4 ) ||
+                          !memcmp( p_extra, annexb_startcode3, 3 ) ) )
+        return p_chain;
+
+    block_t *p_next = p_chain->p_next;
+    p_chain->p_next = NULL;
+    block_t *p_new = block_Realloc( p_chain, i_extra, p_chain->i_buffer );
+    if( p_new == NULL )
+    {
+        block_ChainRelease( p_next );
+        return NULL;
+    }
+    memcpy( p_new->p_buffer, p_extra, i_extra );
+    p_new->p_next = p_next;
+    return p_new;
+}
+
+/* Ends the coded video sequence, so that the decoder starts a new one with
+ * the parameter sets of the copied random access point */
+static block_t *AppendEndOfSequence( const transcode_smartcut_t *sc,
+                                     block_t *p_block )
+{
+    static const uint8_t h264_eos[] = { 0, 0, 0, 1, H264_NAL_END_OF_SEQ };
+    static const uint8_t hevc_eos[] = { 0, 0, 0, 1, HEVC_NAL_EOS << 1, 1 };
+    const uint8_t *p_eos = sc->i_codec == VLC_CODEC_H264 ? h264_eos : hevc_eos;
+    size_t i_eos = sc->i_codec == VLC_CODEC_H264 ? sizeof(h264_eos)
+                                                 : sizeof(hevc_eos);
+
+    size_t i_buffer = p_block->i_buffer;
+    block_t *p_new = block_Realloc( p_block, 0, i_buffer + i_eos );
+    if( p_new )
+        memcpy( &p_new->p_buffer[i_buffer], p_eos, i_eos );
+    return p_new;
+}
+
+/* Decodes the group of pictures, and encodes the pictures between
+ * i_keep_start and i_keep_stop. The encoder is closed at the end, so that
+ * the next edge starts with a new coded video sequence. */
+static int Reencode( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
+                     block_t *p_gop, block_t **pp_out )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+    block_t *p_out = NULL;
+    int i_ret = VLC_SUCCESS;
+
+    *pp_out = NULL;
+    if( !sc->b_reencode || id->b_error || p_gop == NULL )
+    {
+        block_ChainRelease( p_gop );
+        return VLC_EGENERIC;
+    }
+
+    while( p_gop && i_ret == VLC_SUCCESS )
+    {
+        block_t *p_block = p_gop;
+        p_gop = p_gop->p_next;
+        p_block->p_next = NULL;
+
+        /* Decoders may write to the data they are given */
+        if( !(p_block = block_Unshare( p_block )) )
+        {
+            i_ret = VLC_ENOMEM;
+            break;
+        }
+        i_ret = transcode_video_process( p_stream, id, p_block, &p_out );
+        block_ChainAppend( pp_out, p_out );
+    }
+    block_ChainRelease( p_gop );
+
+    if( i_ret == VLC_SUCCESS )
+    {
+        /* Drain the decoder and the encoder */
+        i_ret = transcode_video_process( p_stream, id, NULL, &p_out );
+        block_ChainAppend( pp_out, p_out );
+    }
+
+    if( i_ret == VLC_SUCCESS && *pp_out )
+    {
+        block_t *p_first = PrependHeaders( id, *pp_out );
+        if( p_first == NULL )
+            i_ret = VLC_ENOMEM;
+        *pp_out = p_first;
+    }
+
+    transcode_video_restart( id );
+
+    if( i_ret != VLC_SUCCESS )
+    {
+        block_ChainRelease( *pp_out );
+        *pp_out = NULL;
+        id->b_error = false;
+    }
+    return i_ret;
+}
+
+/* Re-encodes the head of the clip, up to the random access point p_key.
+ * p_leading, if not NULL, is decoded after p_gop: the random access point
+ * and its leading pictures. */
+static int OutputHead( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
+                       block_t *p_gop, const block_t *p_key,
+                       const block_t *p_leading )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+    block_t *p_out;
+
+    sc->i_keep_start = sc->i_start;
+    sc->i_keep_stop = p_key ? __MIN( BlockDate( p_key ), sc->i_stop )
+                            : sc->i_stop;
+
+    block_t *p_dup = GopDuplicate( p_gop );
+    if( p_dup && p_leading )
+    {
+        block_t *p_dup_leading = GopDuplicate( p_leading );
+        if( p_dup_leading == NULL )
+        {
+            block_ChainRelease( p_dup );
+            p_dup = NULL;
+        }
+        block_ChainAppend( &p_dup, p_dup_leading );
+    }
+
+    if( Reencode( p_stream, id, p_dup, &p_out ) )
+    {
+        if( sc->b_reencode )
+            msg_Warn( p_stream, "cannot re-encode the start of the clip, "
+                                "copying from the previous keyframe" );
+        return SendVideo( p_stream, id, p_gop );
+    }
+    block_ChainRelease( p_gop );
+    if( p_out == NULL )
+        return VLC_SUCCESS;
+
+    /* The copied pictures follow in decoding order */
+    if( p_key && p_key->i_dts != VLC_TICK_INVALID )
+    {
+        int i_count;
+        block_ChainProperties( p_out, &i_count, NULL, NULL );
+        block_t **pp_blocks = vlc_alloc( i_count, sizeof(*pp_blocks) );
+        if( pp_blocks )
+        {
+            int i = 0;
+            for( block_t *p = p_out; p; p = p->p_next )
+                pp_blocks[i++] = p;
+
+            vlc_tick_t i_limit = p_key->i_dts;
+            while( i-- > 0 )
+            {
+                if( pp_blocks[i]->i_dts >= i_limit )
+                    pp_blocks[i]->i_dts = i_limit - 1;
+                i_limit = pp_blocks[i]->i_dts;
+            }
+            free( pp_blocks );
+        }
+    }
+
+    block_t *p_last = p_out;
+    while( p_last->p_next )
+        p_last = p_last->p_next;
+    if( p_key )
+    {
+        block_t **pp_last = &p_out;
+        while( *pp_last != p_last )
+            pp_last = &(*pp_last)->p_next;
+        if( !(*pp_last = AppendEndOfSequence( sc, p_last )) )
+        {
+            block_ChainRelease( p_out );
+            return VLC_ENOMEM;
+        }
+    }
+
+    return SendVideo( p_stream, id, p_out );
+}
+
+/* Re-encodes the held head of the clip, once the leading pictures of the
+ * first copied random access point are known */
+static int OutputHeldHead( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+    block_t *p_head = sc->p_head;
+    block_t *p_leading = sc->p_leading;
+
+    sc->p_head = NULL;
+    sc->p_leading = NULL;
+    int i_ret = OutputHead( p_stream, id, p_head, p_leading, p_leading );
+    block_ChainRelease( p_leading );
+
+    /* The copied pictures were held after the head */
+    if( sc->i_gop_key >= sc->i_stop )
+    {
+        block_ChainRelease( GopGet( sc ) );
+        sc->i_state = SMARTCUT_DONE;
+    }
+    else if( sc->i_stop == INT64_MAX && sc->p_gop )
+    {
+        if( SendVideo( p_stream, id, GopGet( sc ) ) )
+            i_ret = VLC_EGENERIC;
+    }
+    return i_ret;
+}
+
+/* Re-encodes the tail of the clip, from the held random access point, or
+ * from the last copied picture if the held group of pictures is open */
+static int OutputTail( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+    block_t *p_prev = sc->p_prev;
+    block_t *p_gop = GopGet( sc );
+    block_t *p_out;
+
+    sc->p_prev = NULL;
+    sc->i_keep_start = p_prev ? __MAX( sc->i_prev_max + 1, sc->i_start )
+                              : __MAX( sc->i_gop_key, sc->i_start );
+    sc->i_keep_stop = sc->i_stop;
+
+    block_t *p_dup = GopDuplicate( p_gop );
+    if( p_prev )
+    {
+        block_ChainAppend( &p_prev, p_dup );
+        p_dup = p_prev;
+    }
+
+    if( Reencode( p_stream, id, p_dup, &p_out ) )
+    {
+        if( sc->b_reencode )
+            msg_Warn( p_stream, "cannot re-encode the end of the clip, "
+                                "copying up to the next keyframe" );
+        return SendVideo( p_stream, id, p_gop );
+    }
+    block_ChainRelease( p_gop );
+
+    /* The copied pictures precede in decoding order: delay the whole tail,
+     * so that its DTS follow them while staying monotonic and before PTS */
+    vlc_tick_t i_shift = 0;
+    if( sc->i_last_dts != VLC_TICK_INVALID )
+        for( block_t *p = p_out; p; p = p->p_next )
+            if( p->i_dts != VLC_TICK_INVALID )
+                i_shift = __MAX( i_shift, sc->i_last_dts + 1 - p->i_dts );
+
+    if( i_shift > 0 )
+        for( block_t *p = p_out; p; p = p->p_next )
+        {
+            if( p->i_dts != VLC_TICK_INVALID )
+                p->i_dts += i_shift;
+            if( p->i_pts != VLC_TICK_INVALID )
+                p->i_pts += i_shift;
+        }
+
+    return SendVideo( p_stream, id, p_out );
+}
+
+static int SendCut( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
+                    block_t *p_block )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+    vlc_tick_t i_date = p_block->i_dts != VLC_TICK_INVALID ?
+                        p_block->i_dts : p_block->i_pts;
+
+    if( i_date != VLC_TICK_INVALID )
+    {
+        if( sc->i_state == SMARTCUT_WAIT && i_date >= sc->i_start )
+            sc->i_state = SMARTCUT_COPY;
+        if( sc->i_state == SMARTCUT_COPY && i_date >= sc->i_stop )
+            sc->i_state = SMARTCUT_DONE;
+    }
+
+    if( sc->i_state != SMARTCUT_COPY )
+    {
+        block_Release( p_block );
+        return VLC_SUCCESS;
+    }
+    return sout_StreamIdSend( p_stream->p_next, id->downstream_id, p_block );
+}
+
+static int Flush( sout_stream_t *p_stream, sout_stream_id_sys_t *id )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+    int i_ret = VLC_SUCCESS;
+
+    if( sc->p_head )
+        i_ret = OutputHeldHead( p_stream, id );
+
+    if( sc->p_gop )
+    {
+        if( sc->i_state == SMARTCUT_WAIT )
+        {
+            if( sc->i_gop_max >= sc->i_start )
+                i_ret = OutputHead( p_stream, id, GopGet( sc ), NULL, NULL );
+        }
+        /* A GOP cut in decoding order is still decodable */
+        else if( sc->i_state == SMARTCUT_COPY && sc->i_gop_max < sc->i_stop )
+            i_ret = SendVideo( p_stream, id, GopGet( sc ) );
+        else if( sc->i_state == SMARTCUT_COPY )
+            i_ret = OutputTail( p_stream, id );
+        block_ChainRelease( GopGet( sc ) );
+    }
+    block_ChainRelease( sc->p_prev );
+    sc->p_prev = NULL;
+    sc->i_state = SMARTCUT_DONE;
+    return i_ret;
+}
+
+int transcode_smartcut_send( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
+                             block_t *p_block )
+{
+    transcode_smartcut_t *sc = id->p_smartcut;
+
+    if( p_block == NULL )
+        return Flush( p_stream, id );
+
+    if( sc->i_state == SMARTCUT_DONE || id->downstream_id == NULL )
+    {
+        block_ChainRelease( p_block );
+        return VLC_SUCCESS;
+    }
+
+    if( sc->i_start == VLC_TICK_INVALID )
+        ResolveClip( p_stream, sc, p_block );
+    if( sc->i_start == VLC_TICK_INVALID )
+    {
+        block_ChainRelease( p_block );
+        return VLC_SUCCESS;
+    }
+
+    if( !sc->b_video )
+        return SendCut( p_stream, id, p_block );
+
+    bool b_open;
+    bool b_key = IsRandomAccess( sc, p_block, &b_open );
+    vlc_tick_t i_date = BlockDate( p_block );
+    int i_ret = VLC_SUCCESS;
+
+    if( sc->i_state == SMARTCUT_WAIT )
+    {
+        if( !b_key || i_date < sc->i_start )
+        {
+            if( b_key )
+                block_ChainRelease( GopGet( sc ) );
+            /* Nothing to decode before the first random access point */
+            if( b_key || sc->p_gop )
+                GopAppend( sc, p_block );
+            else
+                block_Release( p_block );
+            return VLC_SUCCESS;
+        }
+
+        if( sc->p_gop && b_open && sc->b_reencode &&
+            (sc->p_leading = block_Duplicate( p_block )) )
+        {
+            /* Held until the leading pictures of p_block, which may be in
+             * the clip, are known */
+            sc->p_head = GopGet( sc );
+            sc->pp_leading_last = &sc->p_leading->p_next;
+        }
+        else if( sc->p_gop && sc->i_gop_max >= sc->i_start )
+            i_ret = OutputHead( p_stream, id, GopGet( sc ), p_block, NULL );
+        block_ChainRelease( GopGet( sc ) );
+
+        if( i_date >= sc->i_stop && sc->p_head == NULL )
+        {
+            block_Release( p_block );
+            sc->i_state = SMARTCUT_DONE;
+            return i_ret;
+        }
+        sc->i_state = SMARTCUT_COPY;
+        sc->i_leading = i_date;
+    }
+    else
+    {
+        if( sc->p_head )
+        {
+            if( !b_key && i_date != VLC_TICK_INVALID && i_date < sc->i_leading )
+            {
+                /* Decoded with the head, not copied */
+                block_ChainLastAppend( &sc->pp_leading_last, p_block );
+                return VLC_SUCCESS;
+            }
+            i_ret = OutputHeldHead( p_stream, id );
+            if( sc->i_state == SMARTCUT_DONE )
+            {
+                block_Release( p_block );
+                return i_ret;
+            }
+        }
+
+        if( b_key )
+        {
+            sc->i_leading = VLC_TICK_INVALID;
+            if( sc->p_gop && sc->i_gop_max < sc->i_stop )
+            {
+                /* The leading pictures of the next group may be in the tail */
+                block_ChainRelease( sc->p_prev );
+                sc->p_prev = NULL;
+                if( b_open && sc->b_reencode )
+                {
+                    sc->p_prev = GopDuplicate( sc->p_gop );
+                    sc->i_prev_max = sc->i_gop_max;
+                }
+                if( SendVideo( p_stream, id, GopGet( sc ) ) )
+                    i_ret = VLC_EGENERIC;
+            }
+            else if( sc->p_gop && OutputTail( p_stream, id ) )
+                i_ret = VLC_EGENERIC;
+
+            /* Unless its leading pictures may be in the clip */
+            if( i_date >= sc->i_stop && sc->p_prev == NULL )
+            {
+                block_Release( p_block );
+                sc->i_state = SMARTCUT_DONE;
+                return i_ret;
+            }
+        }
+        else if( sc->i_leading != VLC_TICK_INVALID &&
+                 i_date != VLC_TICK_INVALID && i_date < sc->i_leading )
+        {
+            block_Release( p_block );
+            return VLC_SUCCESS;
+        }
+    }
+
+    /* Without an end, there is no tail to look for */
+    if( sc->i_stop == INT64_MAX && sc->p_head == NULL )
+    {
+        if( sc->p_gop )
+            i_ret = SendVideo( p_stream, id, GopGet( sc ) );
+        return SendVideo( p_stream, id, p_block ) ? VLC_EGENERIC : i_ret;
+    }
+
+    GopAppend( sc, p_block );
+    return i_ret;
+}
+
+bool transcode_smartcut_keep_picture( const transcode_smartcut_t *sc,
+                                      vlc_tick_t i_date )
+{
+    return i_date == VLC_TICK_INVALID ||
+           ( i_date >= sc->i_keep_start && i_date < sc->i_keep_stop );
+}
+
+int transcode_smartcut_init( sout_stream_t *p_stream, const es_format_t *p_fmt,
+                             sout_stream_id_sys_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+
+    transcode_smartcut_t *sc = calloc( 1, sizeof(*sc) );
+    if( unlikely(sc == NULL) )
+        return VLC_ENOMEM;
+
+    sc->i_state = SMARTCUT_WAIT;
+    sc->i_codec = p_fmt->i_codec;
+    sc->i_start = VLC_TICK_INVALID;
+    sc->i_leading = VLC_TICK_INVALID;
+    sc->i_last_dts = VLC_TICK_INVALID;
+    sc->pp_gop_last = &sc->p_gop;
+    transcode_encoder_config_init( &sc->enc_cfg );
+    sout_filters_config_init( &sc->filters_cfg );
+    id->p_smartcut = sc;
+
+    sc->b_video = p_fmt->i_cat == VIDEO_ES;
+    if( sc->b_video &&
+        ( p_fmt->i_codec == VLC_CODEC_H264 || p_fmt->i_codec == VLC_CODEC_HEVC ) )
+    {
+        /* Same codec and settings as the copied pictures, without filters */
+        sc->enc_cfg = p_sys->venc_cfg;
+        sc->enc_cfg.psz_name = p_sys->venc_cfg.psz_name ?
+                               strdup( p_sys->venc_cfg.psz_name ) : NULL;
+        sc->enc_cfg.psz_lang = p_sys->venc_cfg.psz_lang ?
+                               strdup( p_sys->venc_cfg.psz_lang ) : NULL;
+        sc->enc_cfg.p_config_chain =
+            config_ChainDuplicate( p_sys->venc_cfg.p_config_chain );
+        sc->enc_cfg.i_codec = p_fmt->i_codec;
+        sc->enc_cfg.video.f_scale = 0;
+        sc->enc_cfg.video.i_width = 0;
+        sc->enc_cfg.video.i_height = 0;
+        sc->enc_cfg.video.i_maxwidth = 0;
+        sc->enc_cfg.video.i_maxheight = 0;
+        sc->enc_cfg.video.fps.num = 0;
+        sc->enc_cfg.video.fps.den = 0;
+        id->p_enccfg = &sc->enc_cfg;
+        id->p_filterscfg = &sc->filters_cfg;
+
+        sc->b_reencode = !transcode_video_init( p_stream, p_fmt, id );
+        if( !sc->b_reencode )
+        {
+            id->b_transcode = false;
+            msg_Warn( p_stream, "cannot re-encode %4.4s, cutting on keyframes",
+                      (const char *)&p_fmt->i_codec );
+        }
+    }
+    else if( sc->b_video )
+        msg_Dbg( p_stream, "cutting %4.4s on keyframes",
+                 (const char *)&p_fmt->i_codec );
+
+    /* The re-encoded pictures go along with the copied ones */
+    id->downstream_id = id->pf_transcode_downstream_add( p_stream, p_fmt, p_fmt );
+    if( id->downstream_id == NULL )
+    {
+        if( sc->b_reencode )
+        {
+            transcode_video_clean( id );
+            id->b_transcode = false;
+        }
+        transcode_smartcut_delete( sc );
+        id->p_smartcut = NULL;
+        return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+void transcode_smartcut_delete( transcode_smartcut_t *sc )
+{
+    block_ChainRelease( sc->p_gop );
+    block_ChainRelease( sc->p_head );
+    block_ChainRelease( sc->p_leading );
+    block_ChainRelease( sc->p_prev );
+    transcode_encoder_config_clean( &sc->enc_cfg );
+    sout_filters_config_clean( &sc->filters_cfg );
+    free( sc );
+}
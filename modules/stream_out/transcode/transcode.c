@@ -75,6 +75,14 @@
 #define MAXHEIGHT_TEXT N_("Maximum video height")
 #define MAXHEIGHT_LONGTEXT N_( \
     "Maximum output video height." )
+#define VLADDER_TEXT N_("Video renditions")
+#define VLADDER_LONGTEXT N_( \
+    "Comma-separated list of extra video renditions, each given as " \
+    "WIDTHxHEIGHT[@BITRATE] where either dimension may be left out " \
+    "(eg: 1280x720@3000,x360@800). The video is decoded and filtered once, " \
+    "then each rendition is scaled and encoded on its own thread, with the " \
+    "other encoder settings. Rendition N gets the ES id of the video plus " \
+    "1000*N. Use encoder options with a fixed GOP to keep key frames aligned.")
 #define VFILTER_TEXT N_("Video filter")
 #define VFILTER_LONGTEXT N_( \
     "Video filters will be applied to the video streams (after overlays " \
@@ -119,9 +127,29 @@
     "be overlayed directly onto the video. You can specify a colon-separated "\
     "list of subpicture modules." )
 
+#define SMARTCUT_TEXT N_("Smart cut")
+#define SMARTCUT_LONGTEXT N_( \
+    "Cut a clip out of the stream, copying the H.264 and HEVC video and " \
+    "re-encoding only the pictures between the edges of the clip and the " \
+    "nearest keyframes, with the video encoder settings. The other streams " \
+    "are copied, and cut on their own timestamps." )
+#define SMARTCUT_START_TEXT N_("Smart cut start")
+#define SMARTCUT_START_LONGTEXT N_( \
+    "Start of the clip, in seconds from the first timestamp of the stream." )
+#define SMARTCUT_STOP_TEXT N_("Smart cut stop")
+#define SMARTCUT_STOP_LONGTEXT N_( \
+    "End of the clip, in seconds from the first timestamp of the stream. " \
+    "0 keeps the rest of the stream." )
+
 #define THREADS_TEXT N_("Number of threads")
 #define THREADS_LONGTEXT N_( \
     "Number of threads used for the transcoding." )
+#define SHARED_TEXT N_("Shared encoder threads")
+#define SHARED_LONGTEXT N_( \
+    "Encode the video of all the transcoded streams of the process on a " \
+    "common pool of threads, instead of a thread per stream. The pool has " \
+    "the largest number of threads requested by the streams, and encodes " \
+    "the pictures in the order they arrive. 0 disables this." )
 #define HP_TEXT N_("High priority")
 #define HP_LONGTEXT N_( \
     "Runs the optional encoder thread at the OUTPUT priority instead of " \
@@ -177,6 +205,8 @@ vlc_module_begin ()
                  MAXHEIGHT_LONGTEXT, true )
     add_module_list(SOUT_CFG_PREFIX "vfilter", "video filter", NULL,
                     VFILTER_TEXT, VFILTER_LONGTEXT)
+    add_string( SOUT_CFG_PREFIX "vladder", NULL, VLADDER_TEXT,
+                VLADDER_LONGTEXT, true )
 
     set_section( N_("Audio"), NULL )
     add_module(SOUT_CFG_PREFIX "aenc", "encoder", NULL,
@@ -207,10 +237,21 @@ vlc_module_begin ()
     add_module_list(SOUT_CFG_PREFIX "sfilter", "sub source", NULL,
                     SFILTER_TEXT, SFILTER_LONGTEXT)
 
+    set_section( N_("Smart cut"), NULL )
+    add_bool( SOUT_CFG_PREFIX "smartcut", false, SMARTCUT_TEXT,
+              SMARTCUT_LONGTEXT, false )
+    add_float( SOUT_CFG_PREFIX "smartcut-start", 0, SMARTCUT_START_TEXT,
+               SMARTCUT_START_LONGTEXT, false )
+    add_float( SOUT_CFG_PREFIX "smartcut-stop", 0, SMARTCUT_STOP_TEXT,
+               SMARTCUT_STOP_LONGTEXT, false )
+
     set_section( N_("Miscellaneous"), NULL )
     add_integer( SOUT_CFG_PREFIX "threads", 0, THREADS_TEXT,
                  THREADS_LONGTEXT, true )
         change_integer_range( 0, 32 )
+    add_integer( SOUT_CFG_PREFIX "shared-threads", 0, SHARED_TEXT,
+                 SHARED_LONGTEXT, true )
+        change_integer_range( 0, 256 )
     add_integer( SOUT_CFG_PREFIX "pool-size", 10, POOL_TEXT, POOL_LONGTEXT, true )
         change_integer_range( 1, 1000 )
     add_bool( SOUT_CFG_PREFIX "high-priority", false, HP_TEXT, HP_LONGTEXT,
@@ -224,7 +265,8 @@ static const char *const ppsz_sout_options[] = {
     "deinterlace-module", "threads", "aenc", "acodec", "ab", "alang",
     "afilter", "samplerate", "channels", "senc", "scodec", "soverlay",
     "sfilter", "high-priority", "maxwidth", "maxheight", "pool-size",
-    NULL
+    "vladder", "shared-threads", "smartcut", "smartcut-start",
+    "smartcut-stop", NULL
 };
 
 /*****************************************************************************
@@ -324,6 +366,7 @@ static void SetVideoEncoderConfig( sout_stream_t *p_stream, transcode_encoder_co
     p_cfg->video.i_maxheight = var_GetInteger( p_stream, SOUT_CFG_PREFIX "maxheight" );
 
     p_cfg->video.threads.i_count = var_GetInteger( p_stream, SOUT_CFG_PREFIX "threads" );
+    p_cfg->video.threads.i_shared = var_GetInteger( p_stream, SOUT_CFG_PREFIX "shared-threads" );
     p_cfg->video.threads.pool_size = var_GetInteger( p_stream, SOUT_CFG_PREFIX "pool-size" );
 
 #if VLC_THREAD_PRIORITY_OUTPUT != VLC_THREAD_PRIORITY_VIDEO
@@ -334,6 +377,59 @@ static void SetVideoEncoderConfig( sout_stream_t *p_stream, transcode_encoder_co
         p_cfg->video.threads.i_priority = VLC_THREAD_PRIORITY_VIDEO;
 }
 
+static void SetVideoLadderConfig( sout_stream_t *p_stream, sout_stream_sys_t *p_sys )
+{
+    char *psz_string = var_GetNonEmptyString( p_stream, SOUT_CFG_PREFIX "vladder" );
+    if( !psz_string )
+        return;
+
+    char *psz_save;
+    for( char *psz = strtok_r( psz_string, ",", &psz_save ); psz != NULL;
+         psz = strtok_r( NULL, ",", &psz_save ) )
+    {
+        /* WIDTHxHEIGHT[@BITRATE] */
+        char *psz_end;
+        unsigned i_width = strtoul( psz, &psz_end, 10 );
+        unsigned i_height = 0, i_bitrate = 0;
+        if( *psz_end == 'x' )
+            i_height = strtoul( psz_end + 1, &psz_end, 10 );
+        if( *psz_end == '@' )
+            i_bitrate = strtoul( psz_end + 1, &psz_end, 10 );
+        if( *psz_end != '\0' || ( !i_width && !i_height ) )
+        {
+            msg_Warn( p_stream, "invalid video rendition `%s', ignored", psz );
+            continue;
+        }
+
+        transcode_encoder_config_t *p_cfgs =
+            realloc( p_sys->p_vladder_cfg,
+                     (p_sys->i_vladder + 1) * sizeof(*p_cfgs) );
+        if( unlikely(p_cfgs == NULL) )
+            break;
+        p_sys->p_vladder_cfg = p_cfgs;
+
+        /* Same settings as the main video encoder, but for the size */
+        transcode_encoder_config_t *p_cfg = &p_cfgs[p_sys->i_vladder++];
+        *p_cfg = p_sys->venc_cfg;
+        p_cfg->psz_name = p_sys->venc_cfg.psz_name ?
+                          strdup( p_sys->venc_cfg.psz_name ) : NULL;
+        p_cfg->psz_lang = p_sys->venc_cfg.psz_lang ?
+                          strdup( p_sys->venc_cfg.psz_lang ) : NULL;
+        p_cfg->p_config_chain = config_ChainDuplicate( p_sys->venc_cfg.p_config_chain );
+
+        p_cfg->video.f_scale = 0;
+        p_cfg->video.i_width = i_width;
+        p_cfg->video.i_height = i_height;
+        if( i_bitrate )
+            p_cfg->video.i_bitrate = i_bitrate < 16000 ? i_bitrate * 1000
+                                                       : i_bitrate;
+
+        msg_Dbg( p_stream, "video rendition %zu: %ux%u %ukb/s", p_sys->i_vladder,
+                 i_width, i_height, p_cfg->video.i_bitrate / 1000 );
+    }
+    free( psz_string );
+}
+
 static void SetSPUEncoderConfig( sout_stream_t *p_stream, transcode_encoder_config_t *p_cfg )
 {
     char *psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "senc" );
@@ -395,6 +491,23 @@ static int Open( vlc_object_t *p_this )
     config_ChainParse( p_stream, SOUT_CFG_PREFIX, ppsz_sout_options,
                    p_stream->p_cfg );
 
+    /* Smart cut parameters */
+    p_sys->b_smartcut = var_GetBool( p_stream, SOUT_CFG_PREFIX "smartcut" );
+    if( p_sys->b_smartcut )
+    {
+        float f_start = var_GetFloat( p_stream, SOUT_CFG_PREFIX "smartcut-start" );
+        float f_stop = var_GetFloat( p_stream, SOUT_CFG_PREFIX "smartcut-stop" );
+        if( f_start < 0 || f_stop < 0 || ( f_stop > 0 && f_stop <= f_start ) )
+        {
+            msg_Err( p_stream, "invalid smart cut %f-%f", f_start, f_stop );
+            free( p_sys );
+            return VLC_EGENERIC;
+        }
+        p_sys->i_smartcut_start = vlc_tick_from_sec( f_start );
+        p_sys->i_smartcut_stop = vlc_tick_from_sec( f_stop );
+        p_sys->i_smartcut_origin = VLC_TICK_INVALID;
+    }
+
     /* Audio transcoding parameters */
     transcode_encoder_config_init( &p_sys->aenc_cfg );
     SetAudioEncoderConfig( p_stream, &p_sys->aenc_cfg );
@@ -423,6 +536,10 @@ static int Open( vlc_object_t *p_this )
                  p_sys->venc_cfg.video.i_bitrate / 1000 );
     }
 
+    /* Video renditions, the main encoder settings are needed */
+    if( p_sys->venc_cfg.i_codec )
+        SetVideoLadderConfig( p_stream, p_sys );
+
     /* Video Filter Parameters */
     sout_filters_config_init( &p_sys->vfilters_cfg );
 
@@ -481,6 +598,9 @@ static void Close( vlc_object_t * p_this )
 
     transcode_encoder_config_clean( &p_sys->venc_cfg );
     sout_filters_config_clean( &p_sys->vfilters_cfg );
+    for( size_t i = 0; i < p_sys->i_vladder; i++ )
+        transcode_encoder_config_clean( &p_sys->p_vladder_cfg[i] );
+    free( p_sys->p_vladder_cfg );
 
     transcode_encoder_config_clean( &p_sys->aenc_cfg );
     sout_filters_config_clean( &p_sys->afilters_cfg );
@@ -492,6 +612,8 @@ static void Close( vlc_object_t * p_this )
 
 static void DeleteSoutStreamID( sout_stream_id_sys_t *id )
 {
+    if( id->p_smartcut )
+        transcode_smartcut_delete( id->p_smartcut );
     free( id );
 }
 
@@ -626,7 +748,9 @@ static void *Add( sout_stream_t *p_stream, const es_format_t *p_fmt )
 
     bool success;
 
-    if( p_fmt->i_cat == AUDIO_ES && id->p_enccfg->i_codec )
+    if( p_sys->b_smartcut )
+        success = !transcode_smartcut_init( p_stream, p_fmt, id );
+    else if( p_fmt->i_cat == AUDIO_ES && id->p_enccfg->i_codec )
     {
         success = !transcode_audio_init(p_stream, p_fmt, id);
         vlc_mutex_lock( &p_sys->lock );
@@ -637,6 +761,17 @@ static void *Add( sout_stream_t *p_stream, const es_format_t *p_fmt )
     else if( p_fmt->i_cat == VIDEO_ES && id->p_enccfg->i_codec )
     {
         success = !transcode_video_init(p_stream, p_fmt, id);
+        if( success && p_sys->i_vladder )
+        {
+            id->p_ladder = transcode_ladder_new( p_stream, id,
+                                                 p_sys->p_vladder_cfg,
+                                                 p_sys->i_vladder );
+            if( !id->p_ladder )
+            {
+                transcode_video_clean( id );
+                success = false;
+            }
+        }
         vlc_mutex_lock( &p_sys->lock );
         if( success && !p_sys->id_video )
             p_sys->id_video = id;
@@ -702,7 +837,12 @@ static void Del( sout_stream_t *p_stream, void *_id )
             break;
         }
     }
-    else decoder_Destroy( id->p_decoder );
+    else
+    {
+        if( id->p_smartcut )
+            Send( p_stream, id, NULL );
+        decoder_Destroy( id->p_decoder );
+    }
 
     if( id->downstream_id ) sout_StreamIdDel( p_stream->p_next, id->downstream_id );
 
@@ -717,6 +857,9 @@ static int Send( sout_stream_t *p_stream, void *_id, block_t *p_buffer )
     if( id->b_error )
         goto error;
 
+    if( id->p_smartcut )
+        return transcode_smartcut_send( p_stream, id, p_buffer );
+
     if( !id->b_transcode )
     {
         if( id->downstream_id )
@@ -725,6 +868,10 @@ static int Send( sout_stream_t *p_stream, void *_id, block_t *p_buffer )
             goto error;
     }
 
+    /* Decoders may write to the data they are given, e.g. to pad it */
+    if( p_buffer && !(p_buffer = block_Unshare( p_buffer )) )
+        return VLC_ENOMEM;
+
     int i_ret;
     switch( id->p_decoder->fmt_in.i_cat )
     {
@@ -40,6 +40,8 @@ void sout_filters_config_clean( sout_filters_config_t *p_cfg )
 }
 
 typedef struct sout_stream_id_sys_t sout_stream_id_sys_t;
+typedef struct transcode_ladder_t transcode_ladder_t;
+typedef struct transcode_smartcut_t transcode_smartcut_t;
 
 typedef struct
 {
@@ -52,6 +54,8 @@ typedef struct
     /* Video */
     transcode_encoder_config_t venc_cfg;
     sout_filters_config_t vfilters_cfg;
+    transcode_encoder_config_t *p_vladder_cfg; /**< extra renditions */
+    size_t          i_vladder;
 
     /* SPU */
     transcode_encoder_config_t senc_cfg;
@@ -63,6 +67,11 @@ typedef struct
     sout_stream_id_sys_t *id_master_sync;
     /* Spu's video */
     sout_stream_id_sys_t *id_video;
+    /* Smart cut, relative to the first timestamp */
+    bool            b_smartcut;
+    vlc_tick_t      i_smartcut_start;
+    vlc_tick_t      i_smartcut_stop; /* 0 for the end of the stream */
+    vlc_tick_t      i_smartcut_origin;
 
 } sout_stream_sys_t;
 
@@ -82,6 +91,8 @@ struct sout_stream_id_sys_t
     /* Decoder */
     decoder_t       *p_decoder;
 
+    transcode_smartcut_t *p_smartcut; /**< edges to re-encode, or NULL */
+
     struct
     {
         vlc_mutex_t lock;
@@ -125,6 +136,7 @@ struct sout_stream_id_sys_t
              spu_t           *p_spu;
              vlc_decoder_device *dec_dev;
              vlc_video_context *enc_vctx_in;
+             transcode_ladder_t *p_ladder; /**< extra renditions, or NULL */
          };
          struct
          {
@@ -209,3 +221,22 @@ int transcode_video_get_output_dimensions( sout_stream_id_sys_t *,
 void transcode_video_push_spu( sout_stream_t *, sout_stream_id_sys_t *, subpicture_t * );
 int  transcode_video_init    ( sout_stream_t *, const es_format_t *,
                                sout_stream_id_sys_t *);
+void transcode_video_restart ( sout_stream_id_sys_t * );
+
+/* SMART CUT */
+
+int  transcode_smartcut_init( sout_stream_t *, const es_format_t *,
+                              sout_stream_id_sys_t * );
+void transcode_smartcut_delete( transcode_smartcut_t * );
+int  transcode_smartcut_send( sout_stream_t *, sout_stream_id_sys_t *, block_t * );
+bool transcode_smartcut_keep_picture( const transcode_smartcut_t *, vlc_tick_t );
+
+/* VIDEO LADDER */
+
+transcode_ladder_t *transcode_ladder_new( sout_stream_t *, sout_stream_id_sys_t *,
+                                          const transcode_encoder_config_t *,
+                                          size_t );
+void transcode_ladder_delete( transcode_ladder_t * );
+void transcode_ladder_push  ( transcode_ladder_t *, picture_t * );
+void transcode_ladder_drain ( transcode_ladder_t *, bool b_eos );
+int  transcode_ladder_output( transcode_ladder_t * );
@@ -136,11 +136,6 @@ static int video_update_format_decoder( decoder_t *p_dec, vlc_video_context *vct
     return chain_works;
 }
 
-static picture_t *video_new_buffer_encoder( transcode_encoder_t *p_enc )
-{
-    return picture_NewFromFormat( &transcode_encoder_format_in( p_enc )->video );
-}
-
 static picture_t *transcode_video_filter_buffer_new( filter_t *p_filter )
 {
     assert(p_filter->fmt_out.video.i_chroma == p_filter->fmt_out.i_codec);
@@ -340,6 +335,9 @@ static int transcode_video_filters_init( sout_stream_t *p_stream,
 
 void transcode_video_clean( sout_stream_id_sys_t *id )
 {
+    if( id->p_ladder )
+        transcode_ladder_delete( id->p_ladder );
+
     /* Close encoder */
     transcode_encoder_close( id->encoder );
     transcode_encoder_delete( id->encoder );
@@ -358,6 +356,21 @@ void transcode_video_clean( sout_stream_id_sys_t *id )
         vlc_decoder_device_Release( id->dec_dev );
 }
 
+void transcode_video_restart( sout_stream_id_sys_t *id )
+{
+    if( id->p_decoder->pf_flush )
+        id->p_decoder->pf_flush( id->p_decoder );
+    vlc_picture_chain_t pics = transcode_dequeue_all_pics( id );
+    while( !vlc_picture_chain_IsEmpty( &pics ) )
+        picture_Release( vlc_picture_chain_PopFront( &pics ) );
+
+    /* Reopened, along with the filters, with the next picture */
+    transcode_encoder_close( id->encoder );
+    transcode_remove_filters( &id->p_f_chain );
+    transcode_remove_filters( &id->p_uf_chain );
+    transcode_remove_filters( &id->p_final_conv_static );
+}
+
 void transcode_video_push_spu( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                                subpicture_t *p_subpicture )
 {
@@ -407,9 +420,8 @@ static picture_t * RenderSubpictures( sout_stream_id_sys_t *id, picture_t *p_pic
     {
         if( filter_chain_IsEmpty( id->p_f_chain ) )
         {
-            /* We can't modify the picture, we need to duplicate it,
-                 * in this point the picture is already p_encoder->fmt.in format*/
-            picture_t *p_tmp = video_new_buffer_encoder( id->encoder );
+            /* We can't modify the picture, we need to duplicate it */
+            picture_t *p_tmp = picture_NewFromFormat( &p_pic->format );
             if( likely( p_tmp ) )
             {
                 picture_Copy( p_tmp, p_pic );
@@ -463,6 +475,14 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
             continue;
         }
 
+        /* Only the edges of a smart cut are encoded */
+        if( p_pic && id->p_smartcut &&
+            !transcode_smartcut_keep_picture( id->p_smartcut, p_pic->date ) )
+        {
+            picture_Release( p_pic );
+            continue;
+        }
+
         if( p_pic && ( unlikely(!transcode_encoder_opened(id->encoder)) ||
               !video_format_IsSimilar( &id->decoder_out.video, &p_pic->format ) ) )
         {
@@ -592,20 +612,26 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
             for ( ;; p_in = NULL /* drain second time */ )
             {
                 /* Run user specified filter chain */
-                filter_chain_t * secondary_chains[] = { id->p_uf_chain,
-                                                        id->p_final_conv_static };
-                for( size_t i=0; p_in && i<ARRAY_SIZE(secondary_chains); i++ )
+                if( id->p_uf_chain )
+                    p_in = filter_chain_VideoFilter( id->p_uf_chain, p_in );
+
+                if( p_in && id->p_ladder )
                 {
-                    if( !secondary_chains[i] )
-                        continue;
-                    p_in = filter_chain_VideoFilter( secondary_chains[i], p_in );
+                    /* Blend subpictures before they are shared with
+                     * the other renditions */
+                    p_in = RenderSubpictures( id, p_in );
+                    transcode_ladder_push( id->p_ladder, p_in );
                 }
 
+                if( p_in && id->p_final_conv_static )
+                    p_in = filter_chain_VideoFilter( id->p_final_conv_static, p_in );
+
                 if( !p_in )
                     break;
 
                 /* Blend subpictures */
-                p_in = RenderSubpictures( id, p_in );
+                if( !id->p_ladder )
+                    p_in = RenderSubpictures( id, p_in );
 
                 if( p_in )
                 {
@@ -623,6 +649,9 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
             if( transcode_encoder_drain( id->encoder, out ) != VLC_SUCCESS )
                 goto error;
             transcode_encoder_close( id->encoder );
+            /* Restart the renditions along with the main encoder */
+            if( id->p_ladder )
+                transcode_ladder_drain( id->p_ladder, true );
             /* Close filters */
             transcode_remove_filters( &id->p_f_chain );
             transcode_remove_filters( &id->p_uf_chain );
@@ -638,7 +667,8 @@ error:
         id->b_error = true;
     }
 
-    if( id->p_enccfg->video.threads.i_count >= 1 )
+    if( id->p_enccfg->video.threads.i_count >= 1 ||
+        id->p_enccfg->video.threads.i_shared >= 1 )
     {
         /* Pick up any return data the encoder thread wants to output. */
         block_ChainAppend( out, transcode_encoder_get_output_async( id->encoder ) );
@@ -652,8 +682,13 @@ error:
             msg_Dbg( p_stream, "Flushing done");
         else
             msg_Warn( p_stream, "Flushing failed");
+        if( id->p_ladder )
+            transcode_ladder_drain( id->p_ladder, false );
     }
 
+    if( id->p_ladder && transcode_ladder_output( id->p_ladder ) != VLC_SUCCESS )
+        msg_Warn( p_stream, "cannot output renditions" );
+
     if( b_eos )
         tag_last_block_with_flag( out, BLOCK_FLAG_END_OF_SEQUENCE );
 
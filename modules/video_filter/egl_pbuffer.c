@@ -127,18 +127,45 @@ static bool DestroyImageKHR(vlc_gl_t *gl, void *image)
     return sys->eglDestroyImageKHR(sys->display, image);
 }
 
+static EGLDisplay GetSurfacelessDisplay(void)
+{
+#if defined(EGL_EXT_platform_base) && defined(EGL_MESA_platform_surfaceless)
+    const char *exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (exts == NULL
+     || !vlc_gl_StrHasToken(exts, "EGL_MESA_platform_surfaceless"))
+        return EGL_NO_DISPLAY;
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getDisplay == NULL)
+        return EGL_NO_DISPLAY;
+
+    return getDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+                      NULL);
+#else
+    return EGL_NO_DISPLAY;
+#endif
+}
+
 static int InitEGL(vlc_gl_t *gl, unsigned width, unsigned height)
 {
     struct vlc_gl_pbuffer *sys = gl->sys;
 
-    sys->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    if (sys->display == EGL_NO_DISPLAY)
-        return VLC_EGENERIC;
-
     /* Initialize EGL display */
     EGLint major, minor;
-    if (eglInitialize(sys->display, &major, &minor) != EGL_TRUE)
-        goto error;
+    sys->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (sys->display == EGL_NO_DISPLAY
+     || eglInitialize(sys->display, &major, &minor) != EGL_TRUE)
+    {
+        /* No windowing system (headless), use the surfaceless platform if
+         * available */
+        sys->display = GetSurfacelessDisplay();
+        if (sys->display == EGL_NO_DISPLAY)
+            return VLC_EGENERIC;
+        if (eglInitialize(sys->display, &major, &minor) != EGL_TRUE)
+            goto error;
+    }
     msg_Dbg(gl, "EGL version %s by %s, API %s",
             eglQueryString(sys->display, EGL_VERSION),
             eglQueryString(sys->display, EGL_VENDOR),
@@ -174,17 +201,37 @@ static int InitEGL(vlc_gl_t *gl, unsigned width, unsigned height)
     if (eglChooseConfig(sys->display, conf_attr, cfgv, 1, &cfgc) != EGL_TRUE
      || cfgc == 0)
     {
-        msg_Err (gl, "cannot choose EGL configuration");
-        goto error;
+#ifdef EGL_KHR_no_config_context
+        /* Rendering is done in framebuffer objects, so the pbuffer is not
+         * actually needed if the context can be bound without a surface
+         * (software rasterizers on the surfaceless platform expose no
+         * configuration at all) */
+        const char *exts = eglQueryString(sys->display, EGL_EXTENSIONS);
+        if (exts != NULL
+         && vlc_gl_StrHasToken(exts, "EGL_KHR_no_config_context")
+         && vlc_gl_StrHasToken(exts, "EGL_KHR_surfaceless_context"))
+        {
+            msg_Dbg(gl, "no EGL configuration, using a surfaceless context");
+            cfgv[0] = EGL_NO_CONFIG_KHR;
+            sys->surface = EGL_NO_SURFACE;
+        }
+        else
+#endif
+        {
+            msg_Err (gl, "cannot choose EGL configuration");
+            goto error;
+        }
     }
-
-    /* Create a drawing surface */
-    sys->surface = eglCreatePbufferSurface(sys->display, cfgv[0], surface_attr);
-    if (sys->surface == EGL_NO_SURFACE)
+    else
     {
-        msg_Err (gl, "cannot create EGL window surface");
-        assert(false);
-        goto error;
+        /* Create a drawing surface */
+        sys->surface = eglCreatePbufferSurface(sys->display, cfgv[0],
+                                               surface_attr);
+        if (sys->surface == EGL_NO_SURFACE)
+        {
+            msg_Err (gl, "cannot create EGL window surface");
+            goto error;
+        }
     }
 
 #ifdef USE_OPENGL_ES2
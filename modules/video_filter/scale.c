@@ -1,6 +1,6 @@
 /*****************************************************************************
  * scale.c: video scaling module for YUVP/A, I420 and RGBA pictures
- *  Uses the low quality "nearest neighbour" algorithm.
+ *  Uses bilinear interpolation, or "nearest neighbour" for palettized YUVP.
  *****************************************************************************
  * Copyright (C) 2003-2007 VLC authors and VideoLAN
  *
@@ -29,6 +29,8 @@
 # include "config.h"
 #endif
 
+#include <limits.h>
+
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_filter.h>
@@ -38,7 +40,7 @@
  * Local prototypes
  ****************************************************************************/
 static int  OpenFilter ( filter_t * );
-VIDEO_FILTER_WRAPPER(Filter)
+VIDEO_FILTER_WRAPPER_CLOSE(Filter, CloseFilter)
 
 /*****************************************************************************
  * Module descriptor
@@ -48,6 +50,35 @@ vlc_module_begin ()
     set_callback_video_converter( OpenFilter, 10 )
 vlc_module_end ()
 
+/* Interpolation weights are 8-bits fixed point values */
+#define WEIGHT_BITS 8
+#define WEIGHT_ONE  (1 << WEIGHT_BITS)
+
+/* Interpolation coefficients for one plane, only recomputed when the
+ * source or destination geometry changes */
+typedef struct
+{
+    unsigned i_src_width, i_src_height;
+    unsigned i_dst_width, i_dst_height;
+
+    unsigned *pi_x;      /* leftmost source sample of each column */
+    unsigned *pi_x_next; /* rightmost source sample of each column */
+    uint16_t *pi_x_weight;
+    unsigned *pi_y;
+    unsigned *pi_y_next;
+    uint16_t *pi_y_weight;
+} scale_table_t;
+
+typedef struct
+{
+    scale_table_t tables[PICTURE_PLANE_MAX];
+
+    /* Horizontally scaled source lines */
+    uint16_t *p_lines[2];
+    unsigned i_line_y[2];
+    size_t i_line_size;
+} filter_sys_t;
+
 /*****************************************************************************
  * OpenFilter: probe the filter and return score
  *****************************************************************************/
@@ -69,6 +100,11 @@ static int OpenFilter( filter_t *p_filter )
     if( p_filter->fmt_in.video.orientation != p_filter->fmt_out.video.orientation )
         return VLC_EGENERIC;
 
+    filter_sys_t *p_sys = calloc( 1, sizeof(*p_sys) );
+    if( p_sys == NULL )
+        return VLC_ENOMEM;
+    p_filter->p_sys = p_sys;
+
 #warning Converter cannot (really) change output format.
     video_format_ScaleCropAr( &p_filter->fmt_out.video, &p_filter->fmt_in.video );
 
@@ -81,105 +117,282 @@ static int OpenFilter( filter_t *p_filter )
     return VLC_SUCCESS;
 }
 
-/****************************************************************************
- * Filter: the whole thing
- ****************************************************************************/
-static void Filter( filter_t *p_filter, picture_t *p_pic, picture_t *p_pic_dst )
+static void CleanTable( scale_table_t *p_table )
 {
-#warning Converter cannot (really) change output format.
-    video_format_ScaleCropAr( &p_filter->fmt_out.video, &p_filter->fmt_in.video );
+    free( p_table->pi_x );
+    free( p_table->pi_x_next );
+    free( p_table->pi_x_weight );
+    free( p_table->pi_y );
+    free( p_table->pi_y_next );
+    free( p_table->pi_y_weight );
+    memset( p_table, 0, sizeof(*p_table) );
+}
+
+static void CloseFilter( filter_t *p_filter )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+    for( unsigned i = 0; i < PICTURE_PLANE_MAX; i++ )
+        CleanTable( &p_sys->tables[i] );
+    free( p_sys->p_lines[0] );
+    free( p_sys->p_lines[1] );
+    free( p_sys );
+}
+
+/*****************************************************************************
+ * Coefficients
+ *****************************************************************************/
+
+/* Maps destination samples onto the source grid, aligning the sample
+ * centers (like swscale does), and stores the two nearest source samples
+ * along with the weight of the second one. */
+static int ComputeAxis( unsigned i_src, unsigned i_dst, unsigned **ppi_pos,
+                        unsigned **ppi_next, uint16_t **ppi_weight )
+{
+    unsigned *pi_pos = vlc_alloc( i_dst, sizeof(*pi_pos) );
+    unsigned *pi_next = vlc_alloc( i_dst, sizeof(*pi_next) );
+    uint16_t *pi_weight = vlc_alloc( i_dst, sizeof(*pi_weight) );
 
-    if( p_filter->fmt_in.video.i_chroma != VLC_CODEC_RGBA &&
-        p_filter->fmt_in.video.i_chroma != VLC_CODEC_ARGB &&
-        p_filter->fmt_in.video.i_chroma != VLC_CODEC_BGRA &&
-        p_filter->fmt_in.video.i_chroma != VLC_CODEC_RGB32 )
+    if( unlikely(pi_pos == NULL || pi_next == NULL || pi_weight == NULL) )
     {
-        for( int i_plane = 0; i_plane < p_pic_dst->i_planes; i_plane++ )
+        free( pi_pos );
+        free( pi_next );
+        free( pi_weight );
+        return VLC_ENOMEM;
+    }
+
+    for( unsigned i = 0; i < i_dst; i++ )
+    {
+        /* 16.16 fixed point source position of the sample center */
+        int64_t i_center = ( (2 * (int64_t)i + 1) * i_src << 16 )
+                         / ( 2 * (int64_t)i_dst ) - (1 << 15);
+        if( i_center < 0 )
+            i_center = 0;
+
+        unsigned i_pos = i_center >> 16;
+        if( i_pos >= i_src - 1 )
         {
-            const int i_src_pitch    = p_pic->p[i_plane].i_pitch;
-            const int i_dst_pitch    = p_pic_dst->p[i_plane].i_pitch;
-            const int i_src_height   = p_filter->fmt_in.video.i_height;
-            const int i_src_width    = p_filter->fmt_in.video.i_width;
-            const int i_dst_height   = p_filter->fmt_out.video.i_height;
-            const int i_dst_width    = p_filter->fmt_out.video.i_width;
-            const int i_dst_visible_lines =
-                                       p_pic_dst->p[i_plane].i_visible_lines;
-            const int i_dst_visible_pitch =
-                                       p_pic_dst->p[i_plane].i_visible_pitch;
-            const int i_dst_hidden_pitch  = i_dst_pitch - i_dst_visible_pitch;
-#define SHIFT_SIZE 16
-            const int i_height_coef  = ( i_src_height << SHIFT_SIZE )
-                                       / i_dst_height;
-            const int i_width_coef   = ( i_src_width << SHIFT_SIZE )
-                                       / i_dst_width;
-            const int i_src_height_1 = i_src_height - 1;
-            const int i_src_width_1  = i_src_width - 1;
-
-            uint8_t *p_src = p_pic->p[i_plane].p_pixels;
-            uint8_t *p_dst = p_pic_dst->p[i_plane].p_pixels;
-            uint8_t *p_dstendline = p_dst + i_dst_visible_pitch;
-            const uint8_t *p_dstend = p_dst + i_dst_visible_lines*i_dst_pitch;
-
-            const int i_shift_height = i_dst_height / i_src_height;
-            const int i_shift_width = i_dst_width / i_src_width;
-
-            int l = 1<<(SHIFT_SIZE-i_shift_height);
-            for( ; p_dst < p_dstend;
-                 p_dst += i_dst_hidden_pitch,
-                 p_dstendline += i_dst_pitch, l += i_height_coef )
-            {
-                int k = 1<<(SHIFT_SIZE-i_shift_width);
-                uint8_t *p_srcl = p_src
-                       + (__MIN( i_src_height_1, l >> SHIFT_SIZE )*i_src_pitch);
-
-                for( ; p_dst < p_dstendline; p_dst++, k += i_width_coef )
-                {
-                    *p_dst = p_srcl[__MIN( i_src_width_1, k >> SHIFT_SIZE )];
-                }
-            }
+            pi_pos[i] = pi_next[i] = i_src - 1;
+            pi_weight[i] = 0;
+            continue;
         }
+        pi_pos[i] = i_pos;
+        pi_next[i] = i_pos + 1;
+        pi_weight[i] = ( i_center >> (16 - WEIGHT_BITS) ) & (WEIGHT_ONE - 1);
     }
-    else /* RGBA */
+
+    *ppi_pos = pi_pos;
+    *ppi_next = pi_next;
+    *ppi_weight = pi_weight;
+    return VLC_SUCCESS;
+}
+
+static int UpdateTable( scale_table_t *p_table,
+                        unsigned i_src_width, unsigned i_src_height,
+                        unsigned i_dst_width, unsigned i_dst_height )
+{
+    if( p_table->pi_x != NULL &&
+        p_table->i_src_width == i_src_width &&
+        p_table->i_src_height == i_src_height &&
+        p_table->i_dst_width == i_dst_width &&
+        p_table->i_dst_height == i_dst_height )
+        return VLC_SUCCESS;
+
+    CleanTable( p_table );
+
+    if( ComputeAxis( i_src_width, i_dst_width, &p_table->pi_x,
+                     &p_table->pi_x_next, &p_table->pi_x_weight ) )
+        return VLC_ENOMEM;
+    if( ComputeAxis( i_src_height, i_dst_height, &p_table->pi_y,
+                     &p_table->pi_y_next, &p_table->pi_y_weight ) )
     {
-        const int i_src_pitch = p_pic->p->i_pitch;
-        const int i_dst_pitch = p_pic_dst->p->i_pitch;
-        const int i_src_height   = p_filter->fmt_in.video.i_height;
-        const int i_src_width    = p_filter->fmt_in.video.i_width;
-        const int i_dst_height   = p_filter->fmt_out.video.i_height;
-        const int i_dst_width    = p_filter->fmt_out.video.i_width;
-        const int i_dst_visible_lines =
-                                   p_pic_dst->p->i_visible_lines;
-        const int i_dst_visible_pitch =
-                                   p_pic_dst->p->i_visible_pitch;
-        const int i_dst_hidden_pitch  = i_dst_pitch - i_dst_visible_pitch;
-        const int i_height_coef  = ( i_src_height << SHIFT_SIZE )
-                                   / i_dst_height;
-        const int i_width_coef   = ( i_src_width << SHIFT_SIZE )
-                                   / i_dst_width;
-        const int i_src_height_1 = i_src_height - 1;
-        const int i_src_width_1  = i_src_width - 1;
-
-        uint32_t *p_src = (uint32_t*)p_pic->p->p_pixels;
-        uint32_t *p_dst = (uint32_t*)p_pic_dst->p->p_pixels;
-        uint32_t *p_dstendline = p_dst + (i_dst_visible_pitch>>2);
-        const uint32_t *p_dstend = p_dst + i_dst_visible_lines*(i_dst_pitch>>2);
-
-        const int i_shift_height = i_dst_height / i_src_height;
-        const int i_shift_width = i_dst_width / i_src_width;
-
-        int l = 1<<(SHIFT_SIZE-i_shift_height);
-        for( ; p_dst < p_dstend;
-             p_dst += (i_dst_hidden_pitch>>2),
-             p_dstendline += (i_dst_pitch>>2),
-             l += i_height_coef )
+        CleanTable( p_table );
+        return VLC_ENOMEM;
+    }
+
+    p_table->i_src_width = i_src_width;
+    p_table->i_src_height = i_src_height;
+    p_table->i_dst_width = i_dst_width;
+    p_table->i_dst_height = i_dst_height;
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * Bilinear scaling
+ *****************************************************************************/
+
+/* The component count is a compile-time constant in each caller, so that
+ * the inner loop gets fully unrolled. */
+static inline void ScaleLine( uint16_t *restrict p_dst,
+                              const uint8_t *restrict p_src,
+                              const scale_table_t *p_table,
+                              const unsigned i_comps )
+{
+    for( unsigned x = 0; x < p_table->i_dst_width; x++ )
+    {
+        const uint8_t *p_a = &p_src[p_table->pi_x[x] * i_comps];
+        const uint8_t *p_b = &p_src[p_table->pi_x_next[x] * i_comps];
+        const unsigned i_weight = p_table->pi_x_weight[x];
+
+        for( unsigned c = 0; c < i_comps; c++ )
+            p_dst[c] = p_a[c] * (WEIGHT_ONE - i_weight) + p_b[c] * i_weight;
+        p_dst += i_comps;
+    }
+}
+
+/* Straight loop over contiguous samples, vectorized by the compiler */
+static void BlendLines( uint8_t *restrict p_dst,
+                        const uint16_t *restrict p_a,
+                        const uint16_t *restrict p_b,
+                        unsigned i_weight, size_t i_count )
+{
+    const unsigned i_weight_a = WEIGHT_ONE - i_weight;
+
+    if( i_weight == 0 )
+    {
+        for( size_t i = 0; i < i_count; i++ )
+            p_dst[i] = ( p_a[i] + (1 << (WEIGHT_BITS - 1)) ) >> WEIGHT_BITS;
+        return;
+    }
+
+    for( size_t i = 0; i < i_count; i++ )
+        p_dst[i] = ( p_a[i] * i_weight_a + p_b[i] * i_weight
+                     + (1 << (2 * WEIGHT_BITS - 1)) ) >> (2 * WEIGHT_BITS);
+}
+
+static const uint16_t *GetLine( filter_sys_t *p_sys,
+                                const scale_table_t *p_table,
+                                const plane_t *p_src, unsigned i_comps,
+                                unsigned y, unsigned i_keep )
+{
+    for( unsigned i = 0; i < 2; i++ )
+        if( p_sys->i_line_y[i] == y )
+            return p_sys->p_lines[i];
+
+    /* Overwrite the line that is not needed by the current output line */
+    unsigned i = p_sys->i_line_y[0] == i_keep ? 1 : 0;
+    const uint8_t *p_in = &p_src->p_pixels[y * p_src->i_pitch];
+
+    if( i_comps == 4 )
+        ScaleLine( p_sys->p_lines[i], p_in, p_table, 4 );
+    else
+        ScaleLine( p_sys->p_lines[i], p_in, p_table, 1 );
+    p_sys->i_line_y[i] = y;
+    return p_sys->p_lines[i];
+}
+
+static void ScalePlane( filter_t *p_filter, const plane_t *p_src,
+                        plane_t *p_dst, scale_table_t *p_table )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+    const unsigned i_comps = p_src->i_pixel_pitch;
+    const unsigned i_src_width = p_src->i_visible_pitch / i_comps;
+    const unsigned i_dst_width = p_dst->i_visible_pitch / i_comps;
+    const unsigned i_src_height = p_src->i_visible_lines;
+    const unsigned i_dst_height = p_dst->i_visible_lines;
+
+    if( i_src_width == 0 || i_src_height == 0 || i_dst_width == 0 )
+        return;
+
+    if( UpdateTable( p_table, i_src_width, i_src_height,
+                     i_dst_width, i_dst_height ) )
+        return;
+
+    const size_t i_line_size = (size_t)i_dst_width * i_comps;
+    if( p_sys->i_line_size < i_line_size )
+    {
+        uint16_t *p_line0 = realloc( p_sys->p_lines[0],
+                                     i_line_size * sizeof(uint16_t) );
+        if( p_line0 != NULL )
+            p_sys->p_lines[0] = p_line0;
+        uint16_t *p_line1 = realloc( p_sys->p_lines[1],
+                                     i_line_size * sizeof(uint16_t) );
+        if( p_line1 != NULL )
+            p_sys->p_lines[1] = p_line1;
+        if( p_line0 == NULL || p_line1 == NULL )
+            return;
+        p_sys->i_line_size = i_line_size;
+    }
+    p_sys->i_line_y[0] = p_sys->i_line_y[1] = UINT_MAX;
+
+    for( unsigned y = 0; y < i_dst_height; y++ )
+    {
+        const unsigned i_y = p_table->pi_y[y];
+        const unsigned i_y_next = p_table->pi_y_next[y];
+        const uint16_t *p_a = GetLine( p_sys, p_table, p_src, i_comps,
+                                       i_y, i_y_next );
+        const uint16_t *p_b = GetLine( p_sys, p_table, p_src, i_comps,
+                                       i_y_next, i_y );
+
+        BlendLines( &p_dst->p_pixels[y * p_dst->i_pitch], p_a, p_b,
+                    p_table->pi_y_weight[y], i_line_size );
+    }
+}
+
+/*****************************************************************************
+ * Nearest neighbour scaling, for palettized pictures
+ *****************************************************************************/
+#define SHIFT_SIZE 16
+
+static void ScaleNearest( filter_t *p_filter, const plane_t *p_src_plane,
+                          plane_t *p_dst_plane )
+{
+    const int i_src_pitch    = p_src_plane->i_pitch;
+    const int i_dst_pitch    = p_dst_plane->i_pitch;
+    const int i_src_height   = p_filter->fmt_in.video.i_height;
+    const int i_src_width    = p_filter->fmt_in.video.i_width;
+    const int i_dst_height   = p_filter->fmt_out.video.i_height;
+    const int i_dst_width    = p_filter->fmt_out.video.i_width;
+    const int i_dst_visible_lines = p_dst_plane->i_visible_lines;
+    const int i_dst_visible_pitch = p_dst_plane->i_visible_pitch;
+    const int i_dst_hidden_pitch  = i_dst_pitch - i_dst_visible_pitch;
+    const int i_height_coef  = ( i_src_height << SHIFT_SIZE ) / i_dst_height;
+    const int i_width_coef   = ( i_src_width << SHIFT_SIZE ) / i_dst_width;
+    const int i_src_height_1 = i_src_height - 1;
+    const int i_src_width_1  = i_src_width - 1;
+
+    uint8_t *p_src = p_src_plane->p_pixels;
+    uint8_t *p_dst = p_dst_plane->p_pixels;
+    uint8_t *p_dstendline = p_dst + i_dst_visible_pitch;
+    const uint8_t *p_dstend = p_dst + i_dst_visible_lines*i_dst_pitch;
+
+    const int i_shift_height = i_dst_height / i_src_height;
+    const int i_shift_width = i_dst_width / i_src_width;
+
+    int l = 1<<(SHIFT_SIZE-i_shift_height);
+    for( ; p_dst < p_dstend;
+         p_dst += i_dst_hidden_pitch,
+         p_dstendline += i_dst_pitch, l += i_height_coef )
+    {
+        int k = 1<<(SHIFT_SIZE-i_shift_width);
+        uint8_t *p_srcl = p_src
+               + (__MIN( i_src_height_1, l >> SHIFT_SIZE )*i_src_pitch);
+
+        for( ; p_dst < p_dstendline; p_dst++, k += i_width_coef )
         {
-            int k = 1<<(SHIFT_SIZE-i_shift_width);
-            uint32_t *p_srcl = p_src
-                    + (__MIN( i_src_height_1, l >> SHIFT_SIZE )*(i_src_pitch>>2));
-            for( ; p_dst < p_dstendline; p_dst++, k += i_width_coef )
-            {
-                *p_dst = p_srcl[__MIN( i_src_width_1, k >> SHIFT_SIZE )];
-            }
+            *p_dst = p_srcl[__MIN( i_src_width_1, k >> SHIFT_SIZE )];
         }
     }
 }
+
+/****************************************************************************
+ * Filter: the whole thing
+ ****************************************************************************/
+static void Filter( filter_t *p_filter, picture_t *p_pic, picture_t *p_pic_dst )
+{
+    filter_sys_t *p_sys = p_filter->p_sys;
+
+#warning Converter cannot (really) change output format.
+    video_format_ScaleCropAr( &p_filter->fmt_out.video, &p_filter->fmt_in.video );
+
+    if( p_filter->fmt_in.video.i_chroma == VLC_CODEC_YUVP )
+    {
+        /* Palette indexes cannot be interpolated */
+        ScaleNearest( p_filter, &p_pic->p[0], &p_pic_dst->p[0] );
+        return;
+    }
+
+    for( int i_plane = 0; i_plane < p_pic_dst->i_planes; i_plane++ )
+        ScalePlane( p_filter, &p_pic->p[i_plane], &p_pic_dst->p[i_plane],
+                    &p_sys->tables[i_plane] );
+}
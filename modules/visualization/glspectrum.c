@@ -43,8 +43,7 @@
 
 #include <math.h>
 
-#include "visual/fft.h"
-#include "visual/window.h"
+#include "visual/analyser.h"
 
 
 /*****************************************************************************
@@ -84,9 +83,6 @@ typedef struct
     /* Audio data */
     vlc_queue_t queue;
     bool dead;
-    unsigned i_channels;
-    unsigned i_prev_nb_samples;
-    int16_t *p_prev_s16_buff;
 
     /* Opengl */
     vlc_gl_t *gl;
@@ -94,8 +90,8 @@ typedef struct
     float f_rotationAngle;
     float f_rotationIncrement;
 
-    /* FFT window parameters */
-    window_param wind_param;
+    /* Spectrum analysis */
+    visual_analyser *analyser;
 } filter_sys_t;
 
 
@@ -130,16 +126,14 @@ static int Open(vlc_object_t * p_this)
 
     p_filter->p_sys = p_sys;
 
-    /* Create the object for the thread */
-    p_sys->i_channels = aout_FormatNbChannels(&p_filter->fmt_in.audio);
-    p_sys->i_prev_nb_samples = 0;
-    p_sys->p_prev_s16_buff = NULL;
-
     p_sys->f_rotationAngle = 0;
     p_sys->f_rotationIncrement = ROTATION_INCREMENT;
 
-    /* Fetch the FFT window parameters */
-    window_get_param( VLC_OBJECT( p_filter ), &p_sys->wind_param );
+    /* Set up the FFT once for all the buffers */
+    p_sys->analyser = visual_analyser_New(VLC_OBJECT(p_filter),
+                            aout_FormatNbChannels(&p_filter->fmt_in.audio));
+    if (p_sys->analyser == NULL)
+        return VLC_EGENERIC;
 
     /* Create the FIFO for the audio data. */
     vlc_queue_Init(&p_sys->queue, offsetof (block_t, p_next));
@@ -153,12 +147,16 @@ static int Open(vlc_object_t * p_this)
 
     p_sys->gl = vlc_gl_surface_Create(p_this, &cfg, NULL);
     if (p_sys->gl == NULL)
+    {
+        visual_analyser_Delete(p_sys->analyser);
         return VLC_EGENERIC;
+    }
 
     /* Create the thread */
     if (vlc_clone(&p_sys->thread, Thread, p_filter,
                   VLC_THREAD_PRIORITY_VIDEO)) {
         vlc_gl_surface_Destroy(p_sys->gl);
+        visual_analyser_Delete(p_sys->analyser);
         return VLC_ENOMEM;
     }
 
@@ -184,7 +182,7 @@ static void Close(filter_t *p_filter)
 
     /* Free the ressources */
     vlc_gl_surface_Destroy(p_sys->gl);
-    free(p_sys->p_prev_s16_buff);
+    visual_analyser_Delete(p_sys->analyser);
 }
 
 
@@ -370,76 +368,17 @@ static void *Thread( void *p_data )
         const unsigned xscale[] = {0,1,2,3,4,5,6,7,8,11,15,20,27,
                                    36,47,62,82,107,141,184,255};
 
-        fft_state *p_state = NULL; /* internal FFT data */
-        DEFINE_WIND_CONTEXT(wind_ctx); /* internal window data */
-
         unsigned i, j;
-        float p_output[FFT_BUFFER_SIZE];           /* Raw FFT Result  */
-        int16_t p_buffer1[FFT_BUFFER_SIZE];        /* Buffer on which we perform
-                                                      the FFT (first channel) */
+        const float *p_output;                     /* Raw FFT Result  */
         int16_t p_dest[FFT_BUFFER_SIZE];           /* Adapted FFT result */
-        float *p_buffl = (float*)block->p_buffer;  /* Original buffer */
-
-        int16_t  *p_buffs;                         /* int16_t converted buffer */
-        int16_t  *p_s16_buff;                      /* int16_t converted buffer */
 
         if (!block->i_nb_samples) {
             msg_Err(p_filter, "no samples yet");
             goto release;
         }
 
-        /* Allocate the buffer only if the number of samples change */
-        if (block->i_nb_samples != p_sys->i_prev_nb_samples)
-        {
-            free(p_sys->p_prev_s16_buff);
-            p_sys->p_prev_s16_buff = malloc(block->i_nb_samples *
-                                            p_sys->i_channels *
-                                            sizeof(int16_t));
-            if (!p_sys->p_prev_s16_buff)
-                goto release;
-            p_sys->i_prev_nb_samples = block->i_nb_samples;
-        }
-        p_buffs = p_s16_buff = p_sys->p_prev_s16_buff;
-
-        /* Convert the buffer to int16_t
-           Pasted from float32tos16.c */
-        for (i = block->i_nb_samples * p_sys->i_channels; i--;)
-        {
-            union {float f; int32_t i;} u;
-
-            u.f = *p_buffl + 384.f;
-            if (u.i > 0x43c07fff)
-                *p_buffs = 32767;
-            else if (u.i < 0x43bf8000)
-                *p_buffs = -32768;
-            else
-                *p_buffs = u.i - 0x43c00000;
-
-            p_buffl++; p_buffs++;
-        }
-        p_state = visual_fft_init();
-        if (!p_state)
-        {
-            msg_Err(p_filter,"unable to initialize FFT transform");
-            goto release;
-        }
-        if (!window_init(FFT_BUFFER_SIZE, &p_sys->wind_param, &wind_ctx))
-        {
-            msg_Err(p_filter,"unable to initialize FFT window");
-            goto release;
-        }
-        p_buffs = p_s16_buff;
-        for (i = 0 ; i < FFT_BUFFER_SIZE; i++)
-        {
-            p_output[i] = 0;
-            p_buffer1[i] = *p_buffs;
-
-            p_buffs += p_sys->i_channels;
-            if (p_buffs >= &p_s16_buff[block->i_nb_samples * p_sys->i_channels])
-                p_buffs = p_s16_buff;
-        }
-        window_scale_in_place (p_buffer1, &wind_ctx);
-        fft_perform (p_buffer1, p_output, p_state);
+        visual_analyser_Feed(p_sys->analyser, block);
+        p_output = visual_analyser_Spectrum(p_sys->analyser);
 
         for (i = 0; i< FFT_BUFFER_SIZE; ++i)
             p_dest[i] = p_output[i] *  (2 ^ 16)
@@ -486,8 +425,6 @@ static void *Thread( void *p_data )
         vlc_gl_Swap(gl);
 
 release:
-        window_close(&wind_ctx);
-        fft_close(p_state);
         vlc_gl_ReleaseCurrent(gl);
         block_Release(block);
     }
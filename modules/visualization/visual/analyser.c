@@ -0,0 +1,122 @@
+/*****************************************************************************
+ * analyser.c : spectrum analysis shared by the visualizations
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <string.h>
+
+#include "analyser.h"
+#include "window.h"
+
+struct visual_analyser
+{
+    fft_state *fft;
+    window_context window;
+    unsigned channels;
+    bool stale; /* The spectrum does not match the history */
+
+    int16_t history[FFT_BUFFER_SIZE]; /* Last samples of the first channel */
+    int16_t input[FFT_BUFFER_SIZE];   /* Windowed samples */
+    float spectrum[FFT_BUFFER_SIZE];
+};
+
+visual_analyser *visual_analyser_New( vlc_object_t *obj, unsigned channels )
+{
+    visual_analyser *analyser = calloc( 1, sizeof (*analyser) );
+    if( unlikely(analyser == NULL) )
+        return NULL;
+
+    window_param param;
+    window_get_param( obj, &param );
+
+    analyser->fft = visual_fft_init();
+    if( analyser->fft == NULL )
+    {
+        msg_Err( obj, "unable to initialize FFT transform" );
+        goto error;
+    }
+    if( !window_init( FFT_BUFFER_SIZE, &param, &analyser->window ) )
+    {
+        msg_Err( obj, "unable to initialize FFT window" );
+        fft_close( analyser->fft );
+        goto error;
+    }
+
+    analyser->channels = channels;
+    analyser->stale = true;
+    return analyser;
+
+error:
+    free( analyser );
+    return NULL;
+}
+
+void visual_analyser_Delete( visual_analyser *analyser )
+{
+    window_close( &analyser->window );
+    fft_close( analyser->fft );
+    free( analyser );
+}
+
+void visual_analyser_Feed( visual_analyser *analyser, const block_t *block )
+{
+    const float *in = (const float *)block->p_buffer;
+    size_t count = block->i_nb_samples;
+
+    if( count > FFT_BUFFER_SIZE )
+        count = FFT_BUFFER_SIZE;
+    if( count == 0 )
+        return;
+
+    /* Shift the older samples out */
+    int16_t *out = analyser->history + FFT_BUFFER_SIZE - count;
+    memmove( analyser->history, analyser->history + count,
+             (FFT_BUFFER_SIZE - count) * sizeof (*analyser->history) );
+
+    /* Convert the first channel to int16_t
+     * Pasted from float32tos16.c */
+    for( size_t i = 0; i < count; i++ )
+    {
+        union { float f; int32_t i; } u;
+
+        u.f = in[i * analyser->channels] + 384.f;
+        if( u.i > 0x43c07fff )
+            out[i] = 32767;
+        else if( u.i < 0x43bf8000 )
+            out[i] = -32768;
+        else
+            out[i] = u.i - 0x43c00000;
+    }
+    analyser->stale = true;
+}
+
+const float *visual_analyser_Spectrum( visual_analyser *analyser )
+{
+    if( analyser->stale )
+    {
+        memcpy( analyser->input, analyser->history, sizeof (analyser->input) );
+        window_scale_in_place( analyser->input, &analyser->window );
+        fft_perform( analyser->input, analyser->spectrum, analyser->fft );
+        analyser->stale = false;
+    }
+    return analyser->spectrum;
+}
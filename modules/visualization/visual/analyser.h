@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * analyser.h : spectrum analysis shared by the visualizations
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_VISUAL_ANALYSER_H_
+#define VLC_VISUAL_ANALYSER_H_
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+
+#include "fft.h"
+
+/**
+ * Spectrum analyser
+ *
+ * The analyser keeps the last FFT_BUFFER_SIZE samples of the first channel of
+ * the stream, so that short buffers are analysed along with the end of the
+ * previous ones. The FFT window and the transform tables are set up once,
+ * and the spectrum is computed at most once per buffer, however many
+ * visualizations use it.
+ *
+ * It is not thread-safe: it must be used from the rendering thread only.
+ */
+typedef struct visual_analyser visual_analyser;
+
+/**
+ * Creates an analyser, with the FFT window parameters of obj.
+ *
+ * \param channels number of interleaved channels of the FL32 buffers
+ * \return the analyser, or NULL on error
+ */
+visual_analyser *visual_analyser_New( vlc_object_t *obj, unsigned channels );
+void visual_analyser_Delete( visual_analyser *analyser );
+
+/**
+ * Feeds the samples of a buffer.
+ *
+ * At most the FFT_BUFFER_SIZE first samples of the buffer are kept. This is
+ * cheap: the transform itself is only computed when the spectrum is needed.
+ */
+void visual_analyser_Feed( visual_analyser *analyser, const block_t *block );
+
+/**
+ * Gets the power spectrum of the last FFT_BUFFER_SIZE fed samples.
+ *
+ * \return FFT_BUFFER_SIZE intensities, ranging from 0 to
+ * ((FFT_BUFFER_SIZE / 2) * 32768) ^ 2. Only the first
+ * FFT_BUFFER_SIZE / 2 + 1 are meaningful, the others are zero.
+ */
+const float *visual_analyser_Spectrum( visual_analyser *analyser );
+
+#endif /* include-guard */
@@ -40,7 +40,7 @@
 static void fft_prepare(const sound_sample *input, float * re, float * im,
                         const unsigned int *bitReverse);
 static void fft_calculate(float * re, float * im,
-                          const float *costable, const float *sintable );
+                          const float *tw_real, const float *tw_imag );
 static void fft_output(const float *re, const float *im, float *output);
 static int reverseBits(unsigned int initial);
 
@@ -57,7 +57,9 @@ static int reverseBits(unsigned int initial);
 fft_state *visual_fft_init(void)
 {
     fft_state *p_state;
-    unsigned int i;
+    unsigned int i, exchanges;
+    float costable[FFT_BUFFER_SIZE / 2];
+    float sintable[FFT_BUFFER_SIZE / 2];
 
     p_state = malloc( sizeof(*p_state) );
     if(! p_state )
@@ -70,8 +72,21 @@ fft_state *visual_fft_init(void)
     for(i = 0; i < FFT_BUFFER_SIZE / 2; i++)
     {
         float j = 2 * PI * i / FFT_BUFFER_SIZE;
-        p_state->costable[i] = cos(j);
-        p_state->sintable[i] = sin(j);
+        costable[i] = cos(j);
+        sintable[i] = sin(j);
+    }
+
+    /* Lay the factors of each step out contiguously, so that the innermost
+     * loop of fft_calculate() reads them without stride */
+    for(exchanges = 1; exchanges < FFT_BUFFER_SIZE; exchanges <<= 1)
+    {
+        unsigned int factfact = FFT_BUFFER_SIZE / 2 / exchanges;
+
+        for(i = 0; i < exchanges; i++)
+        {
+            p_state->twiddle_real[exchanges - 1 + i] = costable[i * factfact];
+            p_state->twiddle_imag[exchanges - 1 + i] = sintable[i * factfact];
+        }
     }
 
     return p_state;
@@ -91,7 +106,8 @@ void fft_perform(const sound_sample *input, float *output, fft_state *state) {
     fft_prepare(input, state->real, state->imag, state->bitReverse );
 
     /* Do the actual FFT */
-    fft_calculate(state->real, state->imag, state->costable, state->sintable);
+    fft_calculate(state->real, state->imag,
+                  state->twiddle_real, state->twiddle_imag);
 
     /* Convert the FFT output into intensities */
     fft_output(state->real, state->imag, output);
@@ -148,49 +164,58 @@ static void fft_output(const float * re, const float * im, float *output)
 }
 
 
+/*
+ * Perform the butterflies of one exchange group
+ */
+static inline void fft_butterflies(float *restrict re0, float *restrict im0,
+                                   float *restrict re1, float *restrict im1,
+                                   const float *restrict fact_real,
+                                   const float *restrict fact_imag,
+                                   size_t exchanges)
+{
+    for(size_t j = 0; j < exchanges; j++) {
+        float tmp_real = fact_real[j] * re1[j] - fact_imag[j] * im1[j];
+        float tmp_imag = fact_real[j] * im1[j] + fact_imag[j] * re1[j];
+        re1[j] = re0[j] - tmp_real;
+        im1[j] = im0[j] - tmp_imag;
+        re0[j] += tmp_real;
+        im0[j] += tmp_imag;
+    }
+}
+
 /*
  * Actually perform the FFT
  */
-static void fft_calculate(float * re, float * im, const float *costable, const float *sintable )
+static void fft_calculate(float * re, float * im,
+                          const float *tw_real, const float *tw_imag)
 {
-    unsigned int i, j, k;
-    unsigned int exchanges;
-    float fact_real, fact_imag;
-    float tmp_real, tmp_imag;
-    unsigned int factfact;
-
-    /* Set up some variables to reduce calculation in the loops */
-    exchanges = 1;
-    factfact = FFT_BUFFER_SIZE / 2;
-
-    /* Loop through the divide and conquer steps */
-    for(i = FFT_BUFFER_SIZE_LOG; i != 0; i--) {
-        /* In this step, we have 2 ^ (i - 1) exchange groups, each with
-         * 2 ^ (FFT_BUFFER_SIZE_LOG - i) exchanges
+    /* Loop through the divide and conquer steps. In each step, there are
+     * FFT_BUFFER_SIZE / (2 * exchanges) exchange groups, each with exchanges
+     * butterflies. The butterflies of a group are independent and work on
+     * contiguous data, so that they can be vectorized. */
+    for(size_t exchanges = 1; exchanges < FFT_BUFFER_SIZE; exchanges <<= 1) {
+        /* factor ^ (exchanges) = -1
+         * So, real = cos(j * PI / exchanges),
+         *     imag = sin(j * PI / exchanges)
          */
-        /* Loop through the exchanges in a group */
-        for(j = 0; j != exchanges; j++) {
-            /* Work out factor for this exchange
-             * factor ^ (exchanges) = -1
-             * So, real = cos(j * PI / exchanges),
-             *     imag = sin(j * PI / exchanges)
-             */
-            fact_real = costable[j * factfact];
-            fact_imag = sintable[j * factfact];
-
-            /* Loop through all the exchange groups */
-            for(k = j; k < FFT_BUFFER_SIZE; k += exchanges << 1) {
-                int k1 = k + exchanges;
-                tmp_real = fact_real * re[k1] - fact_imag * im[k1];
-                tmp_imag = fact_real * im[k1] + fact_imag * re[k1];
-                re[k1] = re[k] - tmp_real;
-                im[k1] = im[k] - tmp_imag;
-                re[k]  += tmp_real;
-                im[k]  += tmp_imag;
-            }
+        const float *fact_real = tw_real + exchanges - 1;
+        const float *fact_imag = tw_imag + exchanges - 1;
+
+        /* Loop through all the exchange groups */
+        for(size_t group = 0; group < FFT_BUFFER_SIZE;
+            group += exchanges << 1) {
+            float *re0 = re + group, *im0 = im + group;
+
+            if(exchanges % 4 == 0) {
+                /* Blocks of 4 butterflies, for the vectorizer */
+                for(size_t j = 0; j < exchanges; j += 4)
+                    fft_butterflies(re0 + j, im0 + j,
+                                    re0 + exchanges + j, im0 + exchanges + j,
+                                    fact_real + j, fact_imag + j, 4);
+            } else
+                fft_butterflies(re0, im0, re0 + exchanges, im0 + exchanges,
+                                fact_real, fact_imag, exchanges);
         }
-        exchanges <<= 1;
-        factfact >>= 1;
     }
 }
 
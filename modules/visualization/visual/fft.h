@@ -39,10 +39,10 @@ struct _struct_fft_state {
      /* */
      unsigned int bitReverse[FFT_BUFFER_SIZE];
 
-     /* The next two tables could be made to use less space in memory, since they
-      * overlap hugely, but hey. */
-     float sintable[FFT_BUFFER_SIZE / 2];
-     float costable[FFT_BUFFER_SIZE / 2];
+     /* Factors of each divide and conquer step, stored contiguously: the
+      * step with n exchanges per group uses the n entries from n - 1. */
+     float twiddle_real[FFT_BUFFER_SIZE - 1];
+     float twiddle_imag[FFT_BUFFER_SIZE - 1];
 };
 
 /* FFT prototypes */
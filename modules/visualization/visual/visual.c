@@ -38,6 +38,7 @@
 #include <vlc_queue.h>
 
 #include "visual.h"
+#include "analyser.h"
 
 #include "window_presets.h"
 
@@ -184,6 +185,7 @@ typedef struct
     vout_thread_t   *p_vout;
     visual_effect_t **effect;
     int             i_effect;
+    visual_analyser *analyser;
     bool            dead;
     vlc_thread_t    thread;
 } filter_sys_t;
@@ -220,6 +222,7 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->i_effect = 0;
     p_sys->effect   = NULL;
+    p_sys->analyser = NULL;
 
     /* Parse the effect list */
     psz_parser = psz_effects = var_CreateGetString( p_filter, "effect-list" );
@@ -239,6 +242,7 @@ static int Open( vlc_object_t *p_this )
 
         p_effect->p_data   = NULL;
         p_effect->pf_run   = NULL;
+        p_effect->p_analyser = NULL;
 
         for( unsigned i = 0; i < effectc; i++ )
         {
@@ -297,6 +301,14 @@ static int Open( vlc_object_t *p_this )
         goto error;
     }
 
+    /* The spectrum is computed once per buffer for all the effects */
+    p_sys->analyser = visual_analyser_New( VLC_OBJECT(p_filter),
+                          aout_FormatNbChannels( &p_filter->fmt_in.audio ) );
+    if( p_sys->analyser == NULL )
+        goto error;
+    for( int i = 0; i < p_sys->i_effect; i++ )
+        p_sys->effect[i]->p_analyser = p_sys->analyser;
+
     /* Open the video output */
     video_format_t fmt = {
         .i_chroma = VLC_CODEC_I420,
@@ -333,6 +345,8 @@ static int Open( vlc_object_t *p_this )
     return VLC_SUCCESS;
 
 error:
+    if( p_sys->analyser != NULL )
+        visual_analyser_Delete( p_sys->analyser );
     for( int i = 0; i < p_sys->i_effect; i++ )
         free( p_sys->effect[i] );
     free( p_sys->effect );
@@ -357,6 +371,8 @@ static block_t *DoRealWork( filter_t *p_filter, block_t *p_in_buf )
                 p_outpic->p[i].i_visible_lines * p_outpic->p[i].i_pitch );
     }
 
+    visual_analyser_Feed( p_sys->analyser, p_in_buf );
+
     /* We can now call our visualization effects */
     for( int i = 0; i < p_sys->i_effect; i++ )
     {
@@ -421,6 +437,7 @@ static void Close( filter_t * p_filter )
 #undef p_effect
     }
 
+    visual_analyser_Delete( p_sys->analyser );
     free( p_sys->effect );
     free( p_sys );
 }
@@ -33,6 +33,7 @@ struct visual_effect_t
     int        i_width;
     int        i_height;
     int        i_nb_chans;
+    struct visual_analyser *p_analyser; /* Spectrum shared by the effects */
 
     /* Channels index */
     int        i_idx_left;
@@ -77,6 +77,17 @@ typedef struct
     } sync;
     vlc_tick_t original_pts;
 
+    /* Latest timing report of the output module. It is published without
+     * locking from any (possibly real-time) thread, and applied by the
+     * decoder thread on the next play. */
+    struct
+    {
+        atomic_uint seq; /**< Odd while a report is being written */
+        atomic_int_least64_t system_ts;
+        atomic_int_least64_t audio_ts;
+        unsigned applied; /**< Sequence of the last applied report */
+    } timing;
+
     int requested_stereo_mode; /**< Requested stereo mode set by the user */
 
     /* Original input format and profile, won't change for the lifetime of a
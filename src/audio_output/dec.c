@@ -50,6 +50,45 @@ static void aout_Drain(audio_output_t *aout)
     }
 }
 
+/**
+ * Reads the latest timing report of the output module, if it was not applied
+ * yet. This never waits for the module: if a report is being written, it will
+ * be read on the next play.
+ */
+static bool aout_TimingRead(aout_owner_t *owner, vlc_tick_t *restrict system_ts,
+                            vlc_tick_t *restrict audio_ts)
+{
+    unsigned seq;
+
+    do
+    {
+        seq = atomic_load_explicit(&owner->timing.seq, memory_order_acquire);
+        if (seq == owner->timing.applied || (seq & 1))
+            return false;
+
+        *system_ts = atomic_load_explicit(&owner->timing.system_ts,
+                                          memory_order_relaxed);
+        *audio_ts = atomic_load_explicit(&owner->timing.audio_ts,
+                                         memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    }
+    while (atomic_load_explicit(&owner->timing.seq,
+                                memory_order_relaxed) != seq);
+
+    owner->timing.applied = seq;
+    return true;
+}
+
+/**
+ * Ignores the timing reports published so far, as they refer to samples that
+ * were flushed or drained.
+ */
+static void aout_TimingDiscard(aout_owner_t *owner)
+{
+    owner->timing.applied =
+        atomic_load_explicit(&owner->timing.seq, memory_order_relaxed) & ~1u;
+}
+
 /**
  * Creates an audio output
  */
@@ -130,6 +169,7 @@ error:
     owner->sync.discontinuity = true;
     owner->original_pts = VLC_TICK_INVALID;
     owner->sync.delay = owner->sync.request_delay = 0;
+    aout_TimingDiscard(owner);
 
     atomic_init (&owner->buffers_lost, 0);
     atomic_init (&owner->buffers_played, 0);
@@ -291,6 +331,19 @@ static void aout_DecSynchronize(audio_output_t *aout, vlc_tick_t system_now,
     aout_owner_t *owner = aout_owner (aout);
     vlc_tick_t delay;
 
+    /* Plugins rendering from a real-time callback can instead report the
+     * playback time of a sample, with aout_TimingReport(). */
+    if (!owner->sync.discontinuity)
+    {
+        vlc_tick_t system_ts, audio_ts;
+
+        if (aout_TimingRead(owner, &system_ts, &audio_ts))
+        {
+            aout_RequestRetiming(aout, system_ts, audio_ts);
+            return;
+        }
+    }
+
     if (aout_TimeGet(aout, &delay) != 0)
         return; /* nothing can be done if timing is unknown */
 
@@ -585,6 +638,7 @@ void aout_DecFlush(audio_output_t *aout)
             owner->sync.request_delay = owner->sync.delay;
             owner->sync.delay = 0;
         }
+        aout_TimingDiscard(owner);
     }
     owner->sync.discontinuity = true;
     owner->original_pts = VLC_TICK_INVALID;
@@ -605,6 +659,7 @@ void aout_DecDrain(audio_output_t *aout)
     }
 
     aout_Drain(aout);
+    aout_TimingDiscard(owner);
 
     vlc_clock_Reset(owner->sync.clock);
     if (owner->filters)
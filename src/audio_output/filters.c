@@ -36,10 +36,166 @@
 #include <vlc_modules.h>
 #include <vlc_aout.h>
 #include <vlc_filter.h>
+#include <vlc_list.h>
+#include <vlc_atomic.h>
 #include <libvlc.h>
 #include "aout_internal.h"
 #include "../video_output/vout_internal.h" /* for vout_Request */
 
+#define AOUT_MAX_FILTERS 10
+
+struct aout_filters
+{
+    filter_t *rate_filter; /**< The filter adjusting samples count
+        (either the scaletempo filter or a resampler) */
+    filter_t *resampler; /**< The resampler */
+    int resampling; /**< Current resampling (Hz) */
+    vlc_clock_t *clock;
+    struct aout_buffer_pool *pool; /**< Output buffers of the filters */
+
+    unsigned count; /**< Number of filters */
+    filter_t *tab[AOUT_MAX_FILTERS]; /**< Configured user filters
+        (e.g. equalization) and their conversions */
+};
+
+/*
+ * Output buffers of the filters
+ *
+ * Most converters, remixers and resamplers cannot work in place and need a
+ * new block for every audio buffer. The buffers are recycled by the pipeline
+ * so that steady-state filtering does not hit the heap. The pool outlives
+ * the pipeline as long as some of its buffers are in use downstream.
+ */
+#define AOUT_BUFFER_POOL_MAX 64 /* released buffers kept for reuse */
+
+struct aout_buffer_pool
+{
+    vlc_mutex_t lock;
+    struct vlc_list buffers; /**< Released buffers, most recent first */
+    unsigned count; /**< Number of released buffers */
+    bool closed; /**< Set when the pipeline is destroyed */
+    vlc_atomic_rc_t rc;
+};
+
+struct aout_buffer
+{
+    block_t block;
+    struct vlc_list node;
+    struct aout_buffer_pool *pool;
+    size_t size; /**< Allocated payload size */
+    max_align_t payload[];
+};
+
+static struct aout_buffer_pool *aout_buffer_pool_New(void)
+{
+    struct aout_buffer_pool *pool = malloc(sizeof (*pool));
+    if (unlikely(pool == NULL))
+        return NULL;
+
+    vlc_mutex_init(&pool->lock);
+    vlc_list_init(&pool->buffers);
+    pool->count = 0;
+    pool->closed = false;
+    vlc_atomic_rc_init(&pool->rc);
+    return pool;
+}
+
+static void aout_buffer_pool_Release(struct aout_buffer_pool *pool)
+{
+    if (vlc_atomic_rc_dec(&pool->rc))
+    {
+        assert(vlc_list_is_empty(&pool->buffers));
+        free(pool);
+    }
+}
+
+static void aout_buffer_pool_Close(struct aout_buffer_pool *pool)
+{
+    struct aout_buffer *buf;
+
+    vlc_mutex_lock(&pool->lock);
+    pool->closed = true;
+    vlc_list_foreach(buf, &pool->buffers, node)
+    {
+        vlc_list_remove(&buf->node);
+        free(buf);
+        aout_buffer_pool_Release(pool);
+    }
+    pool->count = 0;
+    vlc_mutex_unlock(&pool->lock);
+
+    aout_buffer_pool_Release(pool);
+}
+
+static void aout_buffer_Recycle(block_t *block)
+{
+    struct aout_buffer *buf = container_of(block, struct aout_buffer, block);
+    struct aout_buffer_pool *pool = buf->pool;
+
+    vlc_mutex_lock(&pool->lock);
+    if (!pool->closed && pool->count < AOUT_BUFFER_POOL_MAX)
+    {
+        vlc_list_prepend(&buf->node, &pool->buffers);
+        pool->count++;
+        buf = NULL;
+    }
+    vlc_mutex_unlock(&pool->lock);
+
+    if (buf != NULL)
+    {
+        free(buf);
+        aout_buffer_pool_Release(pool);
+    }
+}
+
+static const struct vlc_block_callbacks aout_buffer_cbs = {
+    aout_buffer_Recycle,
+};
+
+static block_t *aout_buffer_New(struct aout_buffer_pool *pool, size_t size)
+{
+    struct aout_buffer *buf, *found = NULL;
+
+    vlc_mutex_lock(&pool->lock);
+    vlc_list_foreach(buf, &pool->buffers, node)
+        if (buf->size >= size)
+        {
+            vlc_list_remove(&buf->node);
+            pool->count--;
+            found = buf;
+            break;
+        }
+    vlc_mutex_unlock(&pool->lock);
+
+    if (found == NULL)
+    {
+        /* Round up so that buffers can be reused for slightly larger
+         * packets later on */
+        size_t alloc = (size + 4095) & ~(size_t)4095;
+        if (unlikely(alloc < size))
+            return NULL;
+
+        found = malloc(sizeof (*found) + alloc);
+        if (unlikely(found == NULL))
+            return NULL;
+        found->pool = pool;
+        found->size = alloc;
+        vlc_atomic_rc_inc(&pool->rc);
+    }
+
+    return block_Init(&found->block, &aout_buffer_cbs, found->payload, size);
+}
+
+static block_t *aout_filter_NewBuffer(filter_t *filter, size_t size)
+{
+    aout_filters_t *filters = filter->owner.sys;
+    return aout_buffer_New(filters->pool, size);
+}
+
+static const struct filter_audio_callbacks aout_filter_cbs = {
+    .buffer_new = aout_filter_NewBuffer,
+};
+
 filter_t *aout_filter_Create(vlc_object_t *obj, const filter_owner_t *restrict owner,
                              const char *type, const char *name,
                              const audio_sample_format_t *infmt,
@@ -91,20 +247,22 @@ filter_t *aout_filter_Create(vlc_object_t *obj, const filter_owner_t *restrict o
 }
 
 static filter_t *FindConverter (vlc_object_t *obj,
+                                const filter_owner_t *owner,
                                 const audio_sample_format_t *infmt,
                                 const audio_sample_format_t *outfmt)
 {
-    return aout_filter_Create(obj, NULL, "audio converter", NULL, infmt, outfmt,
-                              NULL, true);
+    return aout_filter_Create(obj, owner, "audio converter", NULL, infmt,
+                              outfmt, NULL, true);
 }
 
 static filter_t *FindResampler (vlc_object_t *obj,
+                                const filter_owner_t *owner,
                                 const audio_sample_format_t *infmt,
                                 const audio_sample_format_t *outfmt)
 {
     char *modlist = var_InheritString(obj, "audio-resampler");
-    filter_t *filter = aout_filter_Create(obj, NULL, "audio resampler", modlist,
-                                          infmt, outfmt, NULL, true);
+    filter_t *filter = aout_filter_Create(obj, owner, "audio resampler",
+                                          modlist, infmt, outfmt, NULL, true);
     free(modlist);
     return filter;
 }
@@ -124,7 +282,8 @@ static void aout_FiltersPipelineDestroy(filter_t *const *filters, unsigned n)
     }
 }
 
-static filter_t *TryFormat (vlc_object_t *obj, vlc_fourcc_t codec,
+static filter_t *TryFormat (vlc_object_t *obj, const filter_owner_t *owner,
+                            vlc_fourcc_t codec,
                             audio_sample_format_t *restrict fmt)
 {
     audio_sample_format_t output = *fmt;
@@ -133,7 +292,7 @@ static filter_t *TryFormat (vlc_object_t *obj, vlc_fourcc_t codec,
     output.i_format = codec;
     aout_FormatPrepare (&output);
 
-    filter_t *filter = FindConverter (obj, fmt, &output);
+    filter_t *filter = FindConverter (obj, owner, fmt, &output);
     if (filter != NULL)
         *fmt = output;
     return filter;
@@ -142,6 +301,7 @@ static filter_t *TryFormat (vlc_object_t *obj, vlc_fourcc_t codec,
 /**
  * Allocates audio format conversion filters
  * @param obj parent VLC object for new filters
+ * @param owner owner of the new filters
  * @param filters table of filters [IN/OUT]
  * @param count pointer to the number of filters in the table [IN/OUT]
  * @param max size of filters table [IN]
@@ -149,7 +309,9 @@ static filter_t *TryFormat (vlc_object_t *obj, vlc_fourcc_t codec,
  * @param outfmt output audio format
  * @return 0 on success, -1 on failure
  */
-static int aout_FiltersPipelineCreate(vlc_object_t *obj, filter_t **filters,
+static int aout_FiltersPipelineCreate(vlc_object_t *obj,
+                                      const filter_owner_t *owner,
+                                      filter_t **filters,
                                       unsigned *count, unsigned max,
                                  const audio_sample_format_t *restrict infmt,
                                  const audio_sample_format_t *restrict outfmt,
@@ -181,7 +343,7 @@ static int aout_FiltersPipelineCreate(vlc_object_t *obj, filter_t **filters,
             if (n == max)
                 goto overflow;
 
-            filter_t *f = TryFormat (obj, VLC_CODEC_FL32, &input);
+            filter_t *f = TryFormat (obj, owner, VLC_CODEC_FL32, &input);
             if (f == NULL)
             {
                 msg_Err (obj, "cannot find %s for conversion pipeline",
@@ -210,7 +372,7 @@ static int aout_FiltersPipelineCreate(vlc_object_t *obj, filter_t **filters,
         config_chain_t *cfg = NULL;
         if (headphones)
             config_ChainParseOptions(&cfg, "{headphones=true}");
-        filter_t *f = aout_filter_Create(obj, NULL, filter_type, NULL,
+        filter_t *f = aout_filter_Create(obj, owner, filter_type, NULL,
                                          &input, &output, cfg, true);
         if (cfg)
             config_ChainDestroy(cfg);
@@ -235,7 +397,7 @@ static int aout_FiltersPipelineCreate(vlc_object_t *obj, filter_t **filters,
         audio_sample_format_t output = input;
         output.i_rate = outfmt->i_rate;
 
-        filter_t *f = FindConverter (obj, &input, &output);
+        filter_t *f = FindConverter (obj, owner, &input, &output);
         if (f == NULL)
         {
             msg_Err (obj, "cannot find %s for conversion pipeline",
@@ -253,7 +415,7 @@ static int aout_FiltersPipelineCreate(vlc_object_t *obj, filter_t **filters,
         if (max == 0)
             goto overflow;
 
-        filter_t *f = TryFormat (obj, outfmt->i_format, &input);
+        filter_t *f = TryFormat (obj, owner, outfmt->i_format, &input);
         if (f == NULL)
         {
             msg_Err (obj, "cannot find %s for conversion pipeline",
@@ -344,21 +506,6 @@ static void aout_FiltersPipelineChangeViewpoint(filter_t *const *filters,
         filter_ChangeViewpoint (filters[i], vp);
 }
 
-#define AOUT_MAX_FILTERS 10
-
-struct aout_filters
-{
-    filter_t *rate_filter; /**< The filter adjusting samples count
-        (either the scaletempo filter or a resampler) */
-    filter_t *resampler; /**< The resampler */
-    int resampling; /**< Current resampling (Hz) */
-    vlc_clock_t *clock;
-
-    unsigned count; /**< Number of filters */
-    filter_t *tab[AOUT_MAX_FILTERS]; /**< Configured user filters
-        (e.g. equalization) and their conversions */
-};
-
 /** Callback for visualization selection */
 static int VisualizationCallback (vlc_object_t *obj, const char *var,
                                   vlc_value_t oldval, vlc_value_t newval,
@@ -392,9 +539,10 @@ vout_thread_t *aout_filter_GetVout(filter_t *filter, const video_format_t *fmt)
     if (unlikely(vout == NULL))
         return NULL;
 
+    aout_filters_t *filters = filter->owner.sys;
     video_format_t adj_fmt = *fmt;
     vout_configuration_t cfg = {
-        .vout = vout, .clock = filter->owner.sys, .fmt = &adj_fmt,
+        .vout = vout, .clock = filters->clock, .fmt = &adj_fmt,
     };
 
     video_format_AdjustColorSpace(&adj_fmt);
@@ -419,7 +567,10 @@ static int AppendFilter(vlc_object_t *obj, const char *type, const char *name,
         return -1;
     }
 
-    const filter_owner_t owner = { .sys = filters->clock };
+    const filter_owner_t owner = {
+        .audio = &aout_filter_cbs,
+        .sys = filters,
+    };
     filter_t *filter = aout_filter_Create(obj, &owner, type, name,
                                           infmt, outfmt, cfg, false);
     if (filter == NULL)
@@ -429,8 +580,9 @@ static int AppendFilter(vlc_object_t *obj, const char *type, const char *name,
     }
 
     /* convert to the filter input format if necessary */
-    if (aout_FiltersPipelineCreate (obj, filters->tab, &filters->count,
-                                    max - 1, infmt, &filter->fmt_in.audio, false))
+    if (aout_FiltersPipelineCreate (obj, &owner, filters->tab,
+                                    &filters->count, max - 1, infmt,
+                                    &filter->fmt_in.audio, false))
     {
         msg_Err (filter, "cannot add user %s \"%s\" (skipped)", type, name);
         filter_Close( filter );
@@ -505,6 +657,12 @@ aout_filters_t *aout_FiltersNewWithClock(vlc_object_t *obj, const vlc_clock_t *c
     filters->resampler = NULL;
     filters->resampling = 0;
     filters->count = 0;
+    filters->pool = aout_buffer_pool_New();
+    if (unlikely(filters->pool == NULL))
+    {
+        free(filters);
+        return NULL;
+    }
     if (clock)
     {
         filters->clock = vlc_clock_CreateSlave(clock, AUDIO_ES);
@@ -514,6 +672,11 @@ aout_filters_t *aout_FiltersNewWithClock(vlc_object_t *obj, const vlc_clock_t *c
     else
         filters->clock = NULL;
 
+    const filter_owner_t owner = {
+        .audio = &aout_filter_cbs,
+        .sys = filters,
+    };
+
     /* Prepare format structure */
     aout_FormatPrint (obj, "input", infmt);
     audio_sample_format_t input_format = *infmt;
@@ -527,7 +690,7 @@ aout_filters_t *aout_FiltersNewWithClock(vlc_object_t *obj, const vlc_clock_t *c
         if (!AOUT_FMTS_IDENTICAL(infmt, outfmt))
         {
             aout_FormatsPrint (obj, "pass-through:", infmt, outfmt);
-            filters->tab[0] = FindConverter(obj, infmt, outfmt);
+            filters->tab[0] = FindConverter(obj, &owner, infmt, outfmt);
             if (filters->tab[0] == NULL)
             {
                 msg_Err (obj, "cannot setup pass-through");
@@ -551,8 +714,9 @@ aout_filters_t *aout_FiltersNewWithClock(vlc_object_t *obj, const vlc_clock_t *c
 
         /* convert to the output format (minus resampling) if necessary */
         output_format.i_rate = input_format.i_rate;
-        if (aout_FiltersPipelineCreate (obj, filters->tab, &filters->count,
-                                  AOUT_MAX_FILTERS, &input_format, &output_format,
+        if (aout_FiltersPipelineCreate (obj, &owner, filters->tab,
+                                  &filters->count, AOUT_MAX_FILTERS,
+                                  &input_format, &output_format,
                                   cfg->headphones))
         {
             msg_Warn (obj, "cannot setup audio renderer pipeline");
@@ -575,7 +739,8 @@ aout_filters_t *aout_FiltersNewWithClock(vlc_object_t *obj, const vlc_clock_t *c
         audio_sample_format_t input_phys_format = input_format;
         aout_SetWavePhysicalChannels(&input_phys_format);
 
-        filter_t *f = FindConverter (obj, &input_format, &input_phys_format);
+        filter_t *f = FindConverter (obj, &owner, &input_format,
+                                     &input_phys_format);
         if (f == NULL)
         {
             msg_Err (obj, "cannot find channel converter");
@@ -627,8 +792,9 @@ aout_filters_t *aout_FiltersNewWithClock(vlc_object_t *obj, const vlc_clock_t *c
 
     /* convert to the output format (minus resampling) if necessary */
     output_format.i_rate = input_format.i_rate;
-    if (aout_FiltersPipelineCreate (obj, filters->tab, &filters->count,
-                              AOUT_MAX_FILTERS, &input_format, &output_format, false))
+    if (aout_FiltersPipelineCreate (obj, &owner, filters->tab,
+                              &filters->count, AOUT_MAX_FILTERS,
+                              &input_format, &output_format, false))
     {
         msg_Err (obj, "cannot setup filtering pipeline");
         goto error;
@@ -638,7 +804,7 @@ aout_filters_t *aout_FiltersNewWithClock(vlc_object_t *obj, const vlc_clock_t *c
     /* insert the resampler */
     output_format.i_rate = outfmt->i_rate;
     assert (AOUT_FMTS_IDENTICAL(&output_format, outfmt));
-    filters->resampler = FindResampler (obj, &input_format,
+    filters->resampler = FindResampler (obj, &owner, &input_format,
                                         &output_format);
     if (filters->resampler == NULL && input_format.i_rate != outfmt->i_rate)
     {
@@ -655,6 +821,7 @@ error:
     var_DelCallback(obj, "visual", VisualizationCallback, NULL);
     if (filters->clock)
         vlc_clock_Delete(filters->clock);
+    aout_buffer_pool_Close(filters->pool);
     free (filters);
     return NULL;
 }
@@ -702,6 +869,7 @@ void aout_FiltersDelete (vlc_object_t *obj, aout_filters_t *filters)
     var_DelCallback(obj, "visual", VisualizationCallback, NULL);
     if (filters->clock)
         vlc_clock_Delete(filters->clock);
+    aout_buffer_pool_Close(filters->pool);
     free (filters);
 }
 
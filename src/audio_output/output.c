@@ -66,7 +66,19 @@ static int var_CopyDevice (vlc_object_t *src, const char *name,
 static void aout_TimingNotify(audio_output_t *aout, vlc_tick_t system_ts,
                               vlc_tick_t audio_ts)
 {
-    aout_RequestRetiming(aout, system_ts, audio_ts);
+    aout_owner_t *owner = aout_owner (aout);
+    unsigned seq = atomic_load_explicit(&owner->timing.seq,
+                                        memory_order_relaxed);
+
+    /* Sequence lock: the reader retries (or gives up) if the sequence is odd
+     * or changed while it was reading the timestamps. */
+    atomic_store_explicit(&owner->timing.seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&owner->timing.system_ts, system_ts,
+                          memory_order_relaxed);
+    atomic_store_explicit(&owner->timing.audio_ts, audio_ts,
+                          memory_order_relaxed);
+    atomic_store_explicit(&owner->timing.seq, seq + 2, memory_order_release);
 }
 
 /**
@@ -225,6 +237,10 @@ audio_output_t *aout_New (vlc_object_t *parent)
     vlc_viewpoint_init (&owner->vp.value);
     vlc_list_init(&owner->dev.list);
     atomic_init (&owner->vp.update, false);
+    atomic_init (&owner->timing.seq, 0);
+    atomic_init (&owner->timing.system_ts, VLC_TICK_INVALID);
+    atomic_init (&owner->timing.audio_ts, VLC_TICK_INVALID);
+    owner->timing.applied = 0;
     vlc_atomic_rc_init(&owner->rc);
     vlc_audio_meter_Init(&owner->meter, aout);
 
@@ -131,6 +131,13 @@ struct vlc_input_decoder_t
     bool             vout_started;
     enum vlc_vout_order vout_order;
 
+    /* Loudness measurement, in place of the aout. The result is only written
+     * by the ModuleThread, and read once it is stopped (from DeleteDecoder) */
+    struct vlc_audio_meter meter;
+    bool meter_ready;
+    bool has_loudness;
+    struct vlc_audio_loudness loudness;
+
     /* -- Theses variables need locking on read *and* write -- */
     /* Preroll */
     vlc_tick_t i_preroll_end;
@@ -1105,13 +1112,19 @@ static void ModuleThread_UpdateStatVideo( vlc_input_decoder_t *p_owner,
     unsigned displayed = 0;
     unsigned vout_lost = 0;
     unsigned vout_late = 0;
+    vlc_tick_t render_time = 0;
+    vlc_tick_t slack = 0;
+    unsigned scheduled = 0;
     if( p_owner->p_vout != NULL )
     {
-        vout_GetResetStatistic( p_owner->p_vout, &displayed, &vout_lost, &vout_late );
+        vout_GetResetStatistic( p_owner->p_vout, &displayed, &vout_lost,
+                                &vout_late, &render_time, &slack,
+                                &scheduled );
     }
     if (lost) vout_lost++;
 
-    decoder_Notify(p_owner, on_new_video_stats, 1, vout_lost, displayed, vout_late);
+    decoder_Notify(p_owner, on_new_video_stats, 1, vout_lost, displayed,
+                   vout_late, render_time, slack, scheduled);
 }
 
 static void ModuleThread_QueueVideo( decoder_t *p_dec, picture_t *p_pic )
@@ -1258,6 +1271,77 @@ static void ModuleThread_QueueAudio( decoder_t *p_dec, block_t *p_aout_buf )
     ModuleThread_UpdateStatAudio( p_owner, success != VLC_SUCCESS );
 }
 
+static void LoudnessMeter_OnLoudness( vlc_tick_t date,
+                                      const struct vlc_audio_loudness *loudness,
+                                      void *data )
+{
+    vlc_input_decoder_t *p_owner = data;
+    VLC_UNUSED(date);
+
+    /* The last measurement covers the whole track */
+    p_owner->loudness = *loudness;
+    p_owner->has_loudness = true;
+}
+
+static const struct vlc_audio_meter_cbs loudness_meter_cbs =
+{
+    .on_loudness = LoudnessMeter_OnLoudness,
+};
+
+static int ModuleThread_UpdateLoudnessFormat( decoder_t *p_dec )
+{
+    vlc_input_decoder_t *p_owner = dec_get_owner( p_dec );
+
+    p_dec->fmt_out.audio.i_format = p_dec->fmt_out.i_codec;
+
+    if( p_owner->meter_ready &&
+        AOUT_FMTS_IDENTICAL(&p_dec->fmt_out.audio, &p_owner->fmt.audio) )
+        return 0;
+
+    vlc_mutex_lock( &p_owner->lock );
+    DecoderUpdateFormatLocked( p_owner );
+    aout_FormatPrepare( &p_owner->fmt.audio );
+    vlc_mutex_unlock( &p_owner->lock );
+
+    p_dec->fmt_out.audio.i_bytes_per_frame =
+        p_owner->fmt.audio.i_bytes_per_frame;
+    p_dec->fmt_out.audio.i_frame_length =
+        p_owner->fmt.audio.i_frame_length;
+
+    /* A format change restarts the measurement */
+    p_owner->meter_ready =
+        vlc_audio_meter_Reset( &p_owner->meter,
+                               &p_owner->fmt.audio ) == VLC_SUCCESS;
+    if( !p_owner->meter_ready )
+    {
+        msg_Err( p_dec, "cannot measure the loudness of %4.4s audio",
+                 (const char *)&p_owner->fmt.audio.i_format );
+        return -1;
+    }
+    return 0;
+}
+
+static void ModuleThread_QueueLoudness( decoder_t *p_dec, block_t *p_block )
+{
+    vlc_input_decoder_t *p_owner = dec_get_owner( p_dec );
+
+    vlc_mutex_lock( &p_owner->lock );
+    if( p_owner->b_waiting )
+    {
+        p_owner->b_has_data = true;
+        vlc_cond_signal( &p_owner->wait_acknowledge );
+    }
+    DecoderWaitUnblock( p_owner );
+    vlc_mutex_unlock( &p_owner->lock );
+
+    /* No clock: the track is decoded as fast as the demuxer feeds it */
+    if( p_owner->meter_ready )
+        vlc_audio_meter_Process( &p_owner->meter, p_block, p_block->i_pts );
+    block_Release( p_block );
+
+    decoder_Notify(p_owner, on_new_audio_stats, 1, 0, 0);
+}
+
 static void ModuleThread_PlaySpu( vlc_input_decoder_t *p_owner, subpicture_t *p_subpic )
 {
     decoder_t *p_dec = &p_owner->dec;
@@ -1767,6 +1851,14 @@ static const struct decoder_owner_callbacks dec_audio_cbs =
     },
     .get_attachments = InputThread_GetInputAttachments,
 };
+static const struct decoder_owner_callbacks dec_loudness_cbs =
+{
+    .audio = {
+        .format_update = ModuleThread_UpdateLoudnessFormat,
+        .queue = ModuleThread_QueueLoudness,
+    },
+    .get_attachments = InputThread_GetInputAttachments,
+};
 static const struct decoder_owner_callbacks dec_spu_cbs =
 {
     .spu = {
@@ -1788,7 +1880,8 @@ static vlc_input_decoder_t *
 CreateDecoder( vlc_object_t *p_parent,
                const es_format_t *fmt, vlc_clock_t *p_clock,
                input_resource_t *p_resource, sout_instance_t *p_sout,
-               bool b_thumbnailing, const struct vlc_input_decoder_callbacks *cbs,
+               enum vlc_input_decoder_mode mode,
+               const struct vlc_input_decoder_callbacks *cbs,
                void *cbs_userdata )
 {
     decoder_t *p_dec;
@@ -1809,6 +1902,8 @@ CreateDecoder( vlc_object_t *p_parent,
     p_owner->p_aout = NULL;
     p_owner->p_vout = NULL;
     p_owner->vout_started = false;
+    p_owner->meter_ready = false;
+    p_owner->has_loudness = false;
     p_owner->i_spu_channel = VOUT_SPU_CHANNEL_INVALID;
     p_owner->i_spu_order = 0;
     p_owner->p_sout = p_sout;
@@ -1879,13 +1974,34 @@ CreateDecoder( vlc_object_t *p_parent,
     switch( fmt->i_cat )
     {
         case VIDEO_ES:
-            if( !b_thumbnailing )
+            if( mode != VLC_INPUT_DECODER_THUMBNAILING )
                 p_dec->cbs = &dec_video_cbs;
             else
                 p_dec->cbs = &dec_thumbnailer_cbs;
             break;
         case AUDIO_ES:
-            p_dec->cbs = &dec_audio_cbs;
+            if( mode != VLC_INPUT_DECODER_LOUDNESS )
+            {
+                p_dec->cbs = &dec_audio_cbs;
+                break;
+            }
+            p_dec->cbs = &dec_loudness_cbs;
+
+            const struct vlc_audio_meter_plugin_owner meter_owner = {
+                .cbs = &loudness_meter_cbs,
+                .sys = p_owner,
+            };
+
+            /* True peak, integrated loudness and loudness range */
+            vlc_audio_meter_Init( &p_owner->meter, VLC_OBJECT(p_dec) );
+            if( vlc_audio_meter_AddPlugin( &p_owner->meter, "ebur128{mode=4}",
+                                           &meter_owner ) == NULL )
+            {
+                msg_Err( p_dec, "cannot load the loudness meter" );
+                vlc_audio_meter_Destroy( &p_owner->meter );
+                p_dec->cbs = NULL;
+                return p_owner;
+            }
             break;
         case SPU_ES:
             p_dec->cbs = &dec_spu_cbs;
@@ -1976,6 +2092,14 @@ static void DeleteDecoder( vlc_input_decoder_t *p_owner )
                 aout_DecDelete( p_owner->p_aout );
                 input_resource_PutAout( p_owner->p_resource, p_owner->p_aout );
             }
+            if( p_dec->cbs == &dec_loudness_cbs )
+            {
+                /* Flushing sends the measurement of the end of the track */
+                vlc_audio_meter_Flush( &p_owner->meter );
+                vlc_audio_meter_Destroy( &p_owner->meter );
+                if( p_owner->has_loudness )
+                    decoder_Notify(p_owner, on_loudness, &p_owner->loudness);
+            }
             break;
         case VIDEO_ES: {
             vout_thread_t *vout = p_owner->p_vout;
@@ -2046,7 +2170,7 @@ static void DecoderUnsupportedCodec( decoder_t *p_dec, const es_format_t *fmt, b
 static vlc_input_decoder_t *
 decoder_New( vlc_object_t *p_parent, const es_format_t *fmt,
              vlc_clock_t *p_clock, input_resource_t *p_resource,
-             sout_instance_t *p_sout, bool thumbnailing,
+             sout_instance_t *p_sout, enum vlc_input_decoder_mode mode,
              const struct vlc_input_decoder_callbacks *cbs, void *userdata)
 {
     const char *psz_type = p_sout ? N_("packetizer") : N_("decoder");
@@ -2055,7 +2179,7 @@ decoder_New( vlc_object_t *p_parent, const es_format_t *fmt,
     /* Create the decoder configuration structure */
     vlc_input_decoder_t *p_owner =
         CreateDecoder( p_parent, fmt, p_clock, p_resource, p_sout,
-                       thumbnailing, cbs, userdata );
+                       mode, cbs, userdata );
     if( p_owner == NULL )
     {
         msg_Err( p_parent, "could not create %s", psz_type );
@@ -2119,11 +2243,11 @@ decoder_New( vlc_object_t *p_parent, const es_format_t *fmt,
 vlc_input_decoder_t *
 vlc_input_decoder_New( vlc_object_t *parent, es_format_t *fmt,
                   vlc_clock_t *p_clock, input_resource_t *resource,
-                  sout_instance_t *p_sout, bool thumbnailing,
+                  sout_instance_t *p_sout, enum vlc_input_decoder_mode mode,
                   const struct vlc_input_decoder_callbacks *cbs,
                   void *cbs_userdata)
 {
-    return decoder_New( parent, fmt, p_clock, resource, p_sout, thumbnailing,
+    return decoder_New( parent, fmt, p_clock, resource, p_sout, mode,
                         cbs, cbs_userdata );
 }
 
@@ -2134,8 +2258,8 @@ vlc_input_decoder_t *
 vlc_input_decoder_Create( vlc_object_t *p_parent, const es_format_t *fmt,
                      input_resource_t *p_resource )
 {
-    return decoder_New( p_parent, fmt, NULL, p_resource, NULL, false, NULL,
-                        NULL );
+    return decoder_New( p_parent, fmt, NULL, p_resource, NULL,
+                        VLC_INPUT_DECODER_PLAYBACK, NULL, NULL );
 }
 
 
@@ -2396,8 +2520,8 @@ int vlc_input_decoder_SetCcState( vlc_input_decoder_t *p_owner, vlc_fourcc_t cod
         fmt.subs.cc.i_channel = i_channel;
         fmt.subs.cc.i_reorder_depth = p_owner->cc.desc.i_reorder_depth;
         p_ccowner = vlc_input_decoder_New( VLC_OBJECT(p_dec), &fmt, p_owner->p_clock,
-                                      p_owner->p_resource, p_owner->p_sout, false,
-                                      NULL, NULL );
+                                      p_owner->p_resource, p_owner->p_sout,
+                                      VLC_INPUT_DECODER_PLAYBACK, NULL, NULL );
         if( !p_ccowner )
         {
             msg_Err( p_dec, "could not create decoder" );
@@ -28,6 +28,21 @@
 #include <vlc_codec.h>
 #include <vlc_mouse.h>
 
+struct vlc_audio_loudness;
+
+/**
+ * What the decoded data are used for
+ */
+enum vlc_input_decoder_mode
+{
+    /** Render to the audio/video outputs */
+    VLC_INPUT_DECODER_PLAYBACK,
+    /** Hand the first video picture over, cf. on_thumbnail_ready */
+    VLC_INPUT_DECODER_THUMBNAILING,
+    /** Measure the audio loudness without any output, cf. on_loudness */
+    VLC_INPUT_DECODER_LOUDNESS,
+};
+
 struct vlc_input_decoder_callbacks {
     /* notifications */
     void (*on_vout_started)(vlc_input_decoder_t *decoder, vout_thread_t *vout,
@@ -37,10 +52,16 @@ struct vlc_input_decoder_callbacks {
                             void *userdata);
     void (*on_thumbnail_ready)(vlc_input_decoder_t *decoder, picture_t *pic,
                                void *userdata);
+    /* Final measurement of the whole audio track, sent once when the
+     * decoder is deleted */
+    void (*on_loudness)(vlc_input_decoder_t *decoder,
+                        const struct vlc_audio_loudness *loudness,
+                        void *userdata);
 
     void (*on_new_video_stats)(vlc_input_decoder_t *decoder, unsigned decoded,
                                unsigned lost, unsigned displayed, unsigned late,
-                               void *userdata);
+                               vlc_tick_t render_time, vlc_tick_t slack,
+                               unsigned scheduled, void *userdata);
     void (*on_new_audio_stats)(vlc_input_decoder_t *decoder, unsigned decoded,
                                unsigned lost, unsigned played, void *userdata);
 
@@ -52,7 +73,8 @@ struct vlc_input_decoder_callbacks {
 
 vlc_input_decoder_t *
 vlc_input_decoder_New( vlc_object_t *parent, es_format_t *, vlc_clock_t *,
-                       input_resource_t *, sout_instance_t *, bool thumbnailing,
+                       input_resource_t *, sout_instance_t *,
+                       enum vlc_input_decoder_mode mode,
                        const struct vlc_input_decoder_callbacks *cbs,
                        void *userdata ) VLC_USED;
 
@@ -347,7 +347,9 @@ decoder_on_thumbnail_ready(vlc_input_decoder_t *decoder, picture_t *pic, void *u
 
 static void
 decoder_on_new_video_stats(vlc_input_decoder_t *decoder, unsigned decoded, unsigned lost,
-                           unsigned displayed, unsigned late, void *userdata)
+                           unsigned displayed, unsigned late,
+                           vlc_tick_t render_time, vlc_tick_t slack,
+                           unsigned scheduled, void *userdata)
 {
     (void) decoder;
 
@@ -370,6 +372,12 @@ decoder_on_new_video_stats(vlc_input_decoder_t *decoder, unsigned decoded, unsig
                               memory_order_relaxed);
     atomic_fetch_add_explicit(&stats->late_pictures, late,
                               memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->render_time, render_time,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->display_slack, slack,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->scheduled_pictures, scheduled,
+                              memory_order_relaxed);
 }
 
 static void
@@ -414,10 +422,32 @@ decoder_get_attachments(vlc_input_decoder_t *decoder,
     return input_GetAttachments(p_sys->p_input, ppp_attachment);
 }
 
+static void
+decoder_on_loudness(vlc_input_decoder_t *decoder,
+                    const struct vlc_audio_loudness *loudness, void *userdata)
+{
+    (void) decoder;
+
+    es_out_id_t *id = userdata;
+    es_out_t *out = id->out;
+    es_out_sys_t *p_sys = container_of(out, es_out_sys_t, out);
+
+    if (!p_sys->p_input)
+        return;
+
+    struct vlc_input_event event = {
+        .type = INPUT_EVENT_LOUDNESS,
+        .loudness = loudness,
+    };
+
+    input_SendEvent(p_sys->p_input, &event);
+}
+
 static const struct vlc_input_decoder_callbacks decoder_cbs = {
     .on_vout_started = decoder_on_vout_started,
     .on_vout_stopped = decoder_on_vout_stopped,
     .on_thumbnail_ready = decoder_on_thumbnail_ready,
+    .on_loudness = decoder_on_loudness,
     .on_new_video_stats = decoder_on_new_video_stats,
     .on_new_audio_stats = decoder_on_new_audio_stats,
     .get_attachments = decoder_get_attachments,
@@ -812,7 +842,8 @@ static int EsOutSetRecord(  es_out_t *out, bool b_record )
             p_es->p_dec_record =
                 vlc_input_decoder_New( VLC_OBJECT(p_input), &p_es->fmt, NULL,
                                        input_priv(p_input)->p_resource,
-                                       p_sys->p_sout_record, false,
+                                       p_sys->p_sout_record,
+                                       VLC_INPUT_DECODER_PLAYBACK,
                                        &decoder_cbs, p_es );
 
             if( p_es->p_dec_record && p_sys->b_buffering )
@@ -2188,9 +2219,15 @@ static void EsOutCreateDecoder( es_out_t *out, es_out_id_t *p_es )
     }
 
     input_thread_private_t *priv = input_priv(p_input);
+    enum vlc_input_decoder_mode mode = VLC_INPUT_DECODER_PLAYBACK;
+    if( priv->b_thumbnailing )
+        mode = VLC_INPUT_DECODER_THUMBNAILING;
+    else if( priv->b_loudness )
+        mode = VLC_INPUT_DECODER_LOUDNESS;
+
     dec = vlc_input_decoder_New( VLC_OBJECT(p_input), &p_es->fmt, p_es->p_clock,
                                  priv->p_resource, priv->p_sout,
-                                 priv->b_thumbnailing, &decoder_cbs, p_es );
+                                 mode, &decoder_cbs, p_es );
     if( dec != NULL )
     {
         vlc_input_decoder_ChangeRate( dec, p_sys->rate );
@@ -2203,7 +2240,8 @@ static void EsOutCreateDecoder( es_out_t *out, es_out_id_t *p_es )
             p_es->p_dec_record =
                 vlc_input_decoder_New( VLC_OBJECT(p_input), &p_es->fmt, NULL,
                                        priv->p_resource, p_sys->p_sout_record,
-                                       false, &decoder_cbs, p_es );
+                                       VLC_INPUT_DECODER_PLAYBACK,
+                                       &decoder_cbs, p_es );
             if( p_es->p_dec_record && p_sys->b_buffering )
                 vlc_input_decoder_StartWait( p_es->p_dec_record );
         }
@@ -2251,6 +2289,7 @@ static void EsOutSelectEs( es_out_t *out, es_out_id_t *es, bool b_force )
     es_out_sys_t *p_sys = container_of(out, es_out_sys_t, out);
     input_thread_t *p_input = p_sys->p_input;
     bool b_thumbnailing = input_priv(p_input)->b_thumbnailing;
+    bool b_loudness = input_priv(p_input)->b_loudness;
 
     if( EsIsSelected( es ) )
     {
@@ -2283,7 +2322,8 @@ static void EsOutSelectEs( es_out_t *out, es_out_id_t *es, bool b_force )
         {
             if( es->fmt.i_cat == VIDEO_ES || es->fmt.i_cat == SPU_ES )
             {
-                if( !var_GetBool( p_input, b_sout ? "sout-video" : "video" ) )
+                if( b_loudness
+                 || !var_GetBool( p_input, b_sout ? "sout-video" : "video" ) )
                 {
                     msg_Dbg( p_input, "video is disabled, not selecting ES 0x%x",
                              es->fmt.i_id );
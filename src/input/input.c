@@ -63,6 +63,7 @@ enum input_create_option {
     INPUT_CREATE_OPTION_NONE,
     INPUT_CREATE_OPTION_PREPARSING,
     INPUT_CREATE_OPTION_THUMBNAILING,
+    INPUT_CREATE_OPTION_LOUDNESS,
 };
 
 static  void *Run( void * );
@@ -157,6 +158,15 @@ input_thread_t *input_CreateThumbnailer(vlc_object_t *obj,
                    INPUT_CREATE_OPTION_THUMBNAILING, NULL, NULL );
 }
 
+input_thread_t *input_CreateLoudnessAnalyser(vlc_object_t *obj,
+                                             input_thread_events_cb events_cb,
+                                             void *events_data,
+                                             input_item_t *item)
+{
+    return Create( obj, events_cb, events_data, item,
+                   INPUT_CREATE_OPTION_LOUDNESS, NULL, NULL );
+}
+
 /**
  * Start a input_thread_t created by input_Create.
  *
@@ -289,6 +299,9 @@ static input_thread_t *Create( vlc_object_t *p_parent,
         case INPUT_CREATE_OPTION_THUMBNAILING:
             option_str = "thumbnailing ";
             break;
+        case INPUT_CREATE_OPTION_LOUDNESS:
+            option_str = "loudness analysis of ";
+            break;
         default:
             option_str = "";
             break;
@@ -304,6 +317,7 @@ static input_thread_t *Create( vlc_object_t *p_parent,
     priv->events_data = events_data;
     priv->b_preparsing = option == INPUT_CREATE_OPTION_PREPARSING;
     priv->b_thumbnailing = option == INPUT_CREATE_OPTION_THUMBNAILING;
+    priv->b_loudness = option == INPUT_CREATE_OPTION_LOUDNESS;
     priv->b_can_pace_control = true;
     priv->i_start = 0;
     priv->i_stop  = 0;
@@ -316,7 +330,9 @@ static input_thread_t *Create( vlc_object_t *p_parent,
     priv->normal_time = VLC_TICK_0;
     TAB_INIT( priv->i_attachment, priv->attachment );
     priv->p_sout   = NULL;
-    priv->b_out_pace_control = priv->b_thumbnailing;
+    /* Neither thumbnails nor loudness measurements are rendered: do not wait
+     * for the clock */
+    priv->b_out_pace_control = priv->b_thumbnailing || priv->b_loudness;
     priv->p_renderer = p_renderer && priv->b_preparsing == false ?
                 vlc_renderer_item_hold( p_renderer ) : NULL;
 
@@ -339,7 +355,7 @@ static input_thread_t *Create( vlc_object_t *p_parent,
 
     /* setup the preparse depth of the item
      * if we are preparsing, use the i_preparse_depth of the parent item */
-    if( priv->b_preparsing || priv->b_thumbnailing )
+    if( priv->b_preparsing || priv->b_thumbnailing || priv->b_loudness )
     {
         p_input->obj.logger = NULL;
         p_input->obj.no_interact = true;
@@ -786,7 +802,7 @@ static int InitSout( input_thread_t * p_input )
 {
     input_thread_private_t *priv = input_priv(p_input);
 
-    if( priv->b_preparsing )
+    if( priv->b_preparsing || priv->b_loudness )
         return VLC_SUCCESS;
 
     /* Find a usable sout and attach it to p_input */
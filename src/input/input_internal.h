@@ -143,6 +143,9 @@ typedef enum input_event_type_e
 
     /* Thumbnail generation */
     INPUT_EVENT_THUMBNAIL_READY,
+
+    /* Loudness analysis */
+    INPUT_EVENT_LOUDNESS,
 } input_event_type_e;
 
 #define VLC_INPUT_CAPABILITIES_SEEKABLE (1<<0)
@@ -301,6 +304,8 @@ struct vlc_input_event
         float subs_fps;
         /* INPUT_EVENT_THUMBNAIL_READY */
         picture_t *thumbnail;
+        /* INPUT_EVENT_LOUDNESS */
+        const struct vlc_audio_loudness *loudness;
     };
 };
 
@@ -339,6 +344,23 @@ input_thread_t *input_CreateThumbnailer(vlc_object_t *obj,
                                         void *events_data, input_item_t *item)
 VLC_USED;
 
+/**
+ * Create an input thread measuring the loudness of the audio track
+ *
+ * The audio is decoded as fast as possible, without any output. The
+ * measurement of the whole track is sent by the INPUT_EVENT_LOUDNESS event,
+ * while the input thread is ending.
+ *
+ * @param obj parent object
+ * @param item input item to analyse
+ * @return an input thread or NULL on error
+ */
+input_thread_t *input_CreateLoudnessAnalyser(vlc_object_t *obj,
+                                             input_thread_events_cb events_cb,
+                                             void *events_data,
+                                             input_item_t *item)
+VLC_USED;
+
 int input_Start( input_thread_t * );
 
 void input_Stop( input_thread_t * );
@@ -481,6 +503,7 @@ typedef struct input_thread_private_t
     bool        is_stopped;
     bool        b_recording;
     bool        b_thumbnailing;
+    bool        b_loudness;
     float       rate;
     vlc_tick_t  normal_time;
 
@@ -715,6 +738,9 @@ int subtitles_Filter( const char *);
 /* meta.c */
 void vlc_audio_replay_gain_MergeFromMeta( audio_replay_gain_t *p_dst,
                                           const vlc_meta_t *p_meta );
+struct vlc_audio_loudness;
+int vlc_audio_replay_gain_SetMetaFromLoudness( vlc_meta_t *p_meta,
+                                    const struct vlc_audio_loudness *p_loudness );
 
 /* stats.c */
 typedef struct input_rate_t
@@ -741,6 +767,9 @@ struct input_stats {
     atomic_uintmax_t displayed_pictures;
     atomic_uintmax_t late_pictures;
     atomic_uintmax_t lost_pictures;
+    atomic_intmax_t render_time;
+    atomic_intmax_t display_slack;
+    atomic_uintmax_t scheduled_pictures; /* with a display deadline */
 };
 
 struct input_stats *input_stats_Create(void);
@@ -26,8 +26,10 @@
 #endif
 
 #include <assert.h>
+#include <math.h>
 
 #include <vlc_common.h>
+#include <vlc_aout.h>
 #include <vlc_url.h>
 #include <vlc_arrays.h>
 #include <vlc_modules.h>
@@ -306,3 +308,41 @@ void vlc_audio_replay_gain_MergeFromMeta( audio_replay_gain_t *p_dst,
         p_dst->pf_peak[AUDIO_REPLAY_GAIN_ALBUM] = us_atof( psz_value );
     }
 }
+
+/* ReplayGain 2.0 reference level, in LUFS */
+#define REPLAY_GAIN_REFERENCE (-18.)
+
+int vlc_audio_replay_gain_SetMetaFromLoudness( vlc_meta_t *p_meta,
+                                    const struct vlc_audio_loudness *p_loudness )
+{
+    /* Nothing above the gating threshold: silence or too short */
+    if( !isfinite( p_loudness->loudness_integrated ) )
+        return VLC_EGENERIC;
+
+    const struct
+    {
+        const char *psz_name;
+        const char *psz_format;
+        double f_value;
+    } tags[] = {
+        { "REPLAYGAIN_TRACK_GAIN", "%.2f dB",
+          REPLAY_GAIN_REFERENCE - p_loudness->loudness_integrated },
+        { "REPLAYGAIN_TRACK_PEAK", "%.6f",
+          pow( 10., p_loudness->truepeak / 20. ) },
+        { "REPLAYGAIN_TRACK_RANGE", "%.2f dB", p_loudness->loudness_range },
+        { "REPLAYGAIN_REFERENCE_LOUDNESS", "%.2f LUFS", REPLAY_GAIN_REFERENCE },
+    };
+
+    for( size_t i = 0; i < ARRAY_SIZE(tags); i++ )
+    {
+        char *psz_value;
+
+        if( !isfinite( tags[i].f_value ) )
+            continue;
+        if( us_asprintf( &psz_value, tags[i].psz_format, tags[i].f_value ) < 0 )
+            return VLC_ENOMEM;
+        vlc_meta_AddExtra( p_meta, tags[i].psz_name, psz_value );
+        free( psz_value );
+    }
+    return VLC_SUCCESS;
+}
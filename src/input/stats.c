@@ -68,6 +68,9 @@ struct input_stats *input_stats_Create(void)
     atomic_init(&stats->displayed_pictures, 0);
     atomic_init(&stats->late_pictures, 0);
     atomic_init(&stats->lost_pictures, 0);
+    atomic_init(&stats->render_time, 0);
+    atomic_init(&stats->display_slack, 0);
+    atomic_init(&stats->scheduled_pictures, 0);
     return stats;
 }
 
@@ -111,6 +114,27 @@ void input_stats_Compute(struct input_stats *stats, input_stats_t *st)
                                                     memory_order_relaxed);
     st->i_lost_pictures = atomic_load_explicit(&stats->lost_pictures,
                                                memory_order_relaxed);
+    if (st->i_displayed_pictures > 0)
+    {
+        vlc_tick_t render_time = atomic_load_explicit(&stats->render_time,
+                                                      memory_order_relaxed);
+        st->i_render_time =
+            US_FROM_VLC_TICK(render_time / st->i_displayed_pictures);
+    }
+    else
+        st->i_render_time = 0;
+
+    /* Only the pictures with a deadline, not those rendered at once */
+    uintmax_t scheduled = atomic_load_explicit(&stats->scheduled_pictures,
+                                               memory_order_relaxed);
+    if (scheduled > 0)
+    {
+        vlc_tick_t slack = atomic_load_explicit(&stats->display_slack,
+                                                memory_order_relaxed);
+        st->i_display_slack = US_FROM_VLC_TICK(slack / (vlc_tick_t)scheduled);
+    }
+    else
+        st->i_display_slack = 0;
 }
 
 /** Update a counter element with new values
@@ -330,6 +330,11 @@ static const char *const ppsz_align_descriptions[] =
 #define VIDEO_TITLE_SHOW_LONGTEXT N_( \
     "Display the title of the video on top of the movie.")
 
+#define PICTURE_CACHE_TEXT N_("Picture buffer cache (MiB)")
+#define PICTURE_CACHE_LONGTEXT N_( \
+    "Amount of memory kept to reuse the buffers of the released pictures. " \
+    "0 disables the cache.")
+
 #define VIDEO_TITLE_TIMEOUT_TEXT N_("Show video title for x milliseconds")
 #define VIDEO_TITLE_TIMEOUT_LONGTEXT N_( \
     "Show the video title for n milliseconds, default is 5000 ms (5 sec.)")
@@ -1613,6 +1618,9 @@ vlc_module_begin ()
               SKIP_FRAMES_LONGTEXT, true )
     add_bool( "quiet-synchro", 0, QUIET_SYNCHRO_TEXT,
               QUIET_SYNCHRO_LONGTEXT, true )
+    add_integer( "picture-cache", 64, PICTURE_CACHE_TEXT,
+                 PICTURE_CACHE_LONGTEXT, true )
+        change_integer_range( 0, 4096 )
     add_bool( "keyboard-events", true, KEYBOARD_EVENTS_TEXT,
               KEYBOARD_EVENTS_LONGTEXT, true )
     add_bool( "mouse-events", true, MOUSE_EVENTS_TEXT,
@@ -65,6 +65,7 @@
 #include <vlc_thumbnailer.h>
 
 #include "libvlc.h"
+#include "misc/picture.h"
 
 #include <vlc_vlm.h>
 
@@ -95,6 +96,7 @@ libvlc_int_t * libvlc_InternalCreate( void )
     priv->main_playlist = NULL;
     priv->p_vlm = NULL;
     priv->media_source_provider = NULL;
+    priv->picture_cache = false;
 
     vlc_ExitInit( &priv->exit );
 
@@ -205,6 +207,9 @@ int libvlc_InternalInit( libvlc_int_t *p_libvlc, int i_argc,
 
     vlc_CPU_dump( VLC_OBJECT(p_libvlc) );
 
+    picture_cache_Hold( (size_t)var_InheritInteger( p_libvlc, "picture-cache" ) << 20 );
+    priv->picture_cache = true;
+
     if( var_InheritBool( p_libvlc, "media-library") )
     {
         priv->p_media_library = libvlc_MlCreate( p_libvlc );
@@ -384,6 +389,9 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
 
     libvlc_InternalActionsClean( p_libvlc );
 
+    if( priv->picture_cache )
+        picture_cache_Release();
+
     /* Save the configuration */
     if( !var_InheritBool( p_libvlc, "ignore-config" ) )
         config_AutoSaveConfigFile( VLC_OBJECT(p_libvlc) );
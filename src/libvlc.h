@@ -191,6 +191,7 @@ typedef struct libvlc_priv_t
     vlc_actions_t *actions; ///< Hotkeys handler
     struct vlc_medialibrary_t *p_media_library; ///< Media library instance
     struct vlc_thumbnailer_t *p_thumbnailer; ///< Lazily instantiated media thumbnailer
+    bool picture_cache; ///< Whether the picture buffer cache is held
 
     /* Exit callback */
     vlc_exit_t       exit;
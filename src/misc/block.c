@@ -32,6 +32,7 @@
 #include <fcntl.h>
 
 #include <vlc_common.h>
+#include <vlc_atomic.h>
 #include <vlc_block.h>
 #include <vlc_fs.h>
 
@@ -141,6 +142,152 @@ void block_Release(block_t *block)
     block->cbs->free(block);
 }
 
+/** Payload shared by several blocks */
+struct block_shared
+{
+    vlc_atomic_rc_t rc;
+    block_t *block; /**< block holding the payload */
+    atomic_bool headroom; /**< whether a view took the room before it */
+};
+
+/** Block referencing a shared payload */
+struct block_view
+{
+    block_t self;
+    struct block_shared *shared;
+};
+
+static void block_view_Release(block_t *block)
+{
+    struct block_view *view = container_of(block, struct block_view, self);
+    struct block_shared *shared = view->shared;
+
+    if (vlc_atomic_rc_dec(&shared->rc))
+    {
+        block_Release(shared->block);
+        free(shared);
+    }
+    free(view);
+}
+
+static const struct vlc_block_callbacks block_view_cbs =
+{
+    block_view_Release,
+};
+
+static bool block_IsShared(const block_t *block)
+{
+    return block->cbs == &block_view_cbs;
+}
+
+/**
+ * Checks whether a shared block can be expanded in place.
+ *
+ * The shared payload itself is read-only. But the spare room in front of it
+ * is not used by anyone, so that one of the views can take it over to
+ * prepend a header, as muxers commonly do.
+ */
+static bool block_view_CanExpand(block_t *block, size_t prebody, size_t body)
+{
+    struct block_view *view = container_of(block, struct block_view, self);
+    struct block_shared *shared = view->shared;
+    const uint8_t *payload = shared->block->p_buffer;
+
+    if (body > block->i_buffer)
+        return false;
+    if (prebody == 0)
+        return true;
+
+    if (block->p_start == block->p_buffer && block->p_buffer == payload
+     && !atomic_exchange_explicit(&shared->headroom, true,
+                                  memory_order_relaxed))
+    {
+        size_t room = payload - shared->block->p_start;
+
+        block->p_start -= room;
+        block->i_size += room;
+    }
+
+    return block->p_buffer <= payload
+        && (size_t)(block->p_buffer - block->p_start) >= prebody;
+}
+
+static block_t *block_view_New(struct block_shared *shared,
+                               const block_t *from)
+{
+    struct block_view *view = malloc(sizeof (*view));
+    if (unlikely(view == NULL))
+        return NULL;
+
+    /* No spare room around the payload: it belongs to the other views */
+    block_Init(&view->self, &block_view_cbs, from->p_buffer, from->i_buffer);
+    block_CopyProperties(&view->self, from);
+    view->shared = shared;
+    return &view->self;
+}
+
+block_t *block_Share(block_t **pp_block)
+{
+    block_t *block = *pp_block;
+
+    block_Check(block);
+
+    if (!block_IsShared(block))
+    {   /* Hand the payload over to a first view */
+        struct block_shared *shared = malloc(sizeof (*shared));
+        if (unlikely(shared == NULL))
+            return NULL;
+
+        block_t *view = block_view_New(shared, block);
+        if (unlikely(view == NULL))
+        {
+            free(shared);
+            return NULL;
+        }
+        vlc_atomic_rc_init(&shared->rc);
+        shared->block = block;
+        atomic_init(&shared->headroom, false);
+        *pp_block = block = view;
+    }
+
+    struct block_shared *shared =
+        container_of(block, struct block_view, self)->shared;
+    block_t *view = block_view_New(shared, block);
+    if (likely(view != NULL))
+        vlc_atomic_rc_inc(&shared->rc);
+    return view;
+}
+
+block_t *block_Unshare(block_t *block)
+{
+    if (!block_IsShared(block))
+        return block;
+
+    struct block_view *view = container_of(block, struct block_view, self);
+    struct block_shared *shared = view->shared;
+
+    /* The other views are gone, and they only ever read the payload: take it
+     * back rather than copying it. Acquire their releases of the payload. */
+    if (atomic_load_explicit(&shared->rc.refs, memory_order_acquire) == 1)
+    {
+        block_t *payload = shared->block;
+
+        assert(block->p_buffer >= payload->p_start);
+        assert(block->p_buffer + block->i_buffer
+               <= payload->p_start + payload->i_size);
+        payload->p_buffer = block->p_buffer;
+        payload->i_buffer = block->i_buffer;
+        block_CopyProperties(payload, block);
+        free(shared);
+        free(view);
+        return payload;
+    }
+
+    block_t *copy = block_Duplicate(block);
+    block_Release(block);
+    return copy;
+}
+
 block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
 {
     block_Check( p_block );
@@ -174,10 +321,12 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
         p_block->i_buffer = i_body;
 
     size_t requested = i_prebody + i_body;
+    /* Shared payloads are never expanded in place */
+    const bool b_shared = block_IsShared( p_block );
 
     if( p_block->i_buffer == 0 )
     {   /* Corner case: nothing to preserve */
-        if( requested <= p_block->i_size )
+        if( requested <= p_block->i_size && ( !b_shared || requested == 0 ) )
         {   /* Enough room: recycle buffer */
             size_t extra = p_block->i_size - requested;
 
@@ -196,12 +345,15 @@ block_t *block_TryRealloc (block_t *p_block, ssize_t i_prebody, size_t i_body)
         return p_rea;
     }
 
+    /* Second, reallocate the buffer if we lack space. */
+    assert( i_prebody >= 0 );
+    bool b_copy = b_shared
+               && !block_view_CanExpand( p_block, i_prebody, i_body );
     uint8_t *p_start = p_block->p_start;
     uint8_t *p_end = p_start + p_block->i_size;
 
-    /* Second, reallocate the buffer if we lack space. */
-    assert( i_prebody >= 0 );
-    if( (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
+    if( b_copy
+     || (size_t)(p_block->p_buffer - p_start) < (size_t)i_prebody
      || (size_t)(p_end - p_block->p_buffer) < i_body )
     {
         block_t *p_rea = block_Alloc( requested );
@@ -34,6 +34,7 @@
 #include <limits.h>
 
 #include <vlc_common.h>
+#include <vlc_list.h>
 #include "picture.h"
 #include <vlc_image.h>
 #include <vlc_block.h>
@@ -60,6 +61,142 @@ static void picture_DestroyDummy( picture_t *p_picture )
     (void) p_picture;
 }
 
+/*****************************************************************************
+ * Picture buffer recycling
+ *****************************************************************************/
+
+/* Pixel buffers released by picture_NewFromFormat() pictures are kept in a
+ * cache, keyed by size, so that filter chains and video outputs restarting
+ * with the same (or a previously used) format do not have to go through the
+ * allocator and fault fresh pages in again. The cache is enabled while a
+ * libvlc instance holds it, and emptied when the last one releases it. */
+struct picture_cached_buffer
+{
+    struct vlc_list node;
+    int fd;
+    void *base;
+    size_t size;
+};
+
+static struct
+{
+    vlc_mutex_t lock;
+    struct vlc_list buffers; /* most recently released first */
+    size_t total_size;
+    size_t max_size; /* largest budget of the holders, 0 if disabled */
+    unsigned users;
+} picture_cache = {
+    VLC_STATIC_MUTEX, VLC_LIST_INITIALIZER(&picture_cache.buffers), 0, 0, 0,
+};
+
+/* Called with the lock held */
+static void picture_cache_Trim(struct vlc_list *evicted)
+{
+    /* Evict the least recently released buffers beyond the budget */
+    while (picture_cache.total_size > picture_cache.max_size)
+    {
+        struct picture_cached_buffer *last =
+            vlc_list_last_entry_or_null(&picture_cache.buffers,
+                                        struct picture_cached_buffer, node);
+        assert(last != NULL);
+        vlc_list_remove(&last->node);
+        picture_cache.total_size -= last->size;
+        vlc_list_append(&last->node, evicted);
+    }
+}
+
+static void picture_cache_Free(struct vlc_list *evicted)
+{
+    struct picture_cached_buffer *buf;
+
+    vlc_list_foreach(buf, evicted, node)
+    {
+        picture_Deallocate(buf->fd, buf->base, buf->size);
+        free(buf);
+    }
+}
+
+void picture_cache_Hold(size_t max_size)
+{
+    vlc_mutex_lock(&picture_cache.lock);
+    picture_cache.users++;
+    if (max_size > picture_cache.max_size)
+        picture_cache.max_size = max_size;
+    vlc_mutex_unlock(&picture_cache.lock);
+}
+
+void picture_cache_Release(void)
+{
+    struct vlc_list evicted;
+
+    vlc_list_init(&evicted);
+
+    vlc_mutex_lock(&picture_cache.lock);
+    assert(picture_cache.users > 0);
+    if (--picture_cache.users == 0)
+    {
+        picture_cache.max_size = 0;
+        picture_cache_Trim(&evicted);
+    }
+    vlc_mutex_unlock(&picture_cache.lock);
+
+    picture_cache_Free(&evicted);
+}
+
+static void *picture_AllocateCached(int *restrict fdp, size_t size)
+{
+    struct picture_cached_buffer *buf, *found = NULL;
+
+    vlc_mutex_lock(&picture_cache.lock);
+    vlc_list_foreach(buf, &picture_cache.buffers, node)
+        if (buf->size == size)
+        {
+            vlc_list_remove(&buf->node);
+            picture_cache.total_size -= size;
+            found = buf;
+            break;
+        }
+    vlc_mutex_unlock(&picture_cache.lock);
+
+    if (found == NULL)
+        return picture_Allocate(fdp, size);
+
+    void *base = found->base;
+    *fdp = found->fd;
+    free(found);
+    return base;
+}
+
+static void picture_DeallocateCached(int fd, void *base, size_t size)
+{
+    struct vlc_list evicted;
+    struct picture_cached_buffer *buf = malloc(sizeof (*buf));
+
+    if (buf == NULL)
+    {
+        picture_Deallocate(fd, base, size);
+        return;
+    }
+
+    buf->fd = fd;
+    buf->base = base;
+    buf->size = size;
+    vlc_list_init(&evicted);
+
+    vlc_mutex_lock(&picture_cache.lock);
+    if (size <= picture_cache.max_size)
+    {
+        vlc_list_prepend(&buf->node, &picture_cache.buffers);
+        picture_cache.total_size += size;
+        picture_cache_Trim(&evicted);
+    }
+    else
+        vlc_list_append(&buf->node, &evicted);
+    vlc_mutex_unlock(&picture_cache.lock);
+
+    picture_cache_Free(&evicted);
+}
+
 /**
  * Destroys a picture allocated with picture_NewFromFormat().
  */
@@ -68,7 +205,7 @@ static void picture_DestroyFromFormat(picture_t *pic)
     picture_buffer_t *res = pic->p_sys;
 
     if (res != NULL)
-        picture_Deallocate(res->fd, res->base, res->size);
+        picture_DeallocateCached(res->fd, res->base, res->size);
 }
 
 VLC_WEAK void *picture_Allocate(int *restrict fdp, size_t size)
@@ -299,7 +436,7 @@ picture_t *picture_NewFromFormat(const video_format_t *restrict fmt)
     if (unlikely(pic_size >= PICTURE_SW_SIZE_MAX))
         goto error;
 
-    unsigned char *buf = picture_Allocate(&res->fd, pic_size);
+    unsigned char *buf = picture_AllocateCached(&res->fd, pic_size);
     if (unlikely(buf == NULL))
         goto error;
 
@@ -36,4 +36,11 @@ typedef struct
 void *picture_Allocate(int *, size_t);
 void picture_Deallocate(int, void *, size_t);
 
+/**
+ * Enables the cache of the released picture buffers, up to max_size bytes,
+ * until the matching picture_cache_Release().
+ */
+void picture_cache_Hold(size_t max_size);
+void picture_cache_Release(void);
+
 picture_t * picture_InternalClone(picture_t *, void (*pf_destroy)(picture_t *), void *);
@@ -24,7 +24,9 @@
 
 #include <vlc_common.h>
 #include <vlc_atomic.h>
+#include <vlc_aout.h>
 #include <vlc_executor.h>
+#include <vlc_meta.h>
 
 #include "input/input_interface.h"
 #include "input/input_internal.h"
@@ -59,6 +61,10 @@ struct task
     vlc_cond_t cond_ended;
     bool preparse_ended;
     int preparse_status;
+    bool loudness_ended;
+    bool loudness_failed;
+    bool has_loudness;
+    struct vlc_audio_loudness loudness;
     bool fetch_ended;
 
     atomic_bool interrupted;
@@ -97,6 +103,9 @@ TaskNew(input_preparser_t *preparser, input_item_t *item,
     vlc_cond_init(&task->cond_ended);
     task->preparse_ended = false;
     task->preparse_status = ITEM_PREPARSE_SKIPPED;
+    task->loudness_ended = false;
+    task->loudness_failed = false;
+    task->has_loudness = false;
     task->fetch_ended = false;
 
     atomic_init(&task->interrupted, false);
@@ -234,6 +243,94 @@ Parse(struct task *task, vlc_tick_t deadline)
     input_item_parser_id_Release(task->parser);
 }
 
+static void
+OnLoudnessEvent(input_thread_t *input, const struct vlc_input_event *event,
+                void *task_)
+{
+    VLC_UNUSED(input);
+    struct task *task = task_;
+
+    if (event->type == INPUT_EVENT_LOUDNESS)
+    {
+        /* Sent while the input thread ends, joined by input_Close() */
+        task->loudness = *event->loudness;
+        task->has_loudness = true;
+        return;
+    }
+
+    if (event->type != INPUT_EVENT_STATE)
+        return;
+    if (event->state.value != END_S && event->state.value != ERROR_S)
+        return;
+
+    vlc_mutex_lock(&task->lock);
+    if (event->state.value == ERROR_S)
+        task->loudness_failed = true;
+    task->loudness_ended = true;
+    vlc_mutex_unlock(&task->lock);
+
+    vlc_cond_signal(&task->cond_ended);
+}
+
+static bool
+NeedsLoudness(struct task *task)
+{
+    if (!(task->options & META_REQUEST_OPTION_PARSE_LOUDNESS)
+     || task->preparse_status != ITEM_PREPARSE_DONE)
+        return false;
+
+    input_item_t *item = task->item;
+    bool has_audio = false;
+
+    vlc_mutex_lock(&item->lock);
+    for (int i = 0; i < item->i_es && !has_audio; i++)
+        has_audio = item->es[i]->i_cat == AUDIO_ES;
+    bool measured =
+        vlc_meta_GetExtra(item->p_meta, "REPLAYGAIN_TRACK_GAIN") != NULL;
+    vlc_mutex_unlock(&item->lock);
+
+    return has_audio && !measured;
+}
+
+static void
+AnalyseLoudness(struct task *task)
+{
+    if (!NeedsLoudness(task))
+        return;
+
+    /* The whole audio track is decoded, as fast as the CPU allows: this is
+     * not bound to the preparsing timeout, but it can be interrupted */
+    input_thread_t *input =
+        input_CreateLoudnessAnalyser(task->preparser->owner, OnLoudnessEvent,
+                                     task, task->item);
+    if (!input)
+        return;
+
+    if (input_Start(input) != VLC_SUCCESS)
+    {
+        input_Close(input);
+        return;
+    }
+
+    vlc_mutex_lock(&task->lock);
+    while (!task->loudness_ended && !atomic_load(&task->interrupted))
+        vlc_cond_wait(&task->cond_ended, &task->lock);
+    vlc_mutex_unlock(&task->lock);
+
+    input_Stop(input);
+    input_Close(input);
+
+    /* A stopped or failed input only measured a part of the track */
+    if (!task->has_loudness || task->loudness_failed
+     || atomic_load(&task->interrupted))
+        return;
+
+    input_item_t *item = task->item;
+    vlc_mutex_lock(&item->lock);
+    vlc_audio_replay_gain_SetMetaFromLoudness(item->p_meta, &task->loudness);
+    vlc_mutex_unlock(&item->lock);
+}
+
 static void
 Fetch(struct task *task)
 {
@@ -268,6 +365,11 @@ RunnableRun(void *userdata)
 
     Parse(task, deadline);
 
+    if (atomic_load(&task->interrupted))
+        goto end;
+
+    AnalyseLoudness(task);
+
     if (atomic_load(&task->interrupted))
         goto end;
 
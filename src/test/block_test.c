@@ -86,11 +86,73 @@ static void test_block (void)
     //assert (block == NULL);
 }
 
+static void test_block_Share (void)
+{
+    block_t *block = block_Alloc (sizeof (text));
+    assert (block != NULL);
+    memcpy (block->p_buffer, text, sizeof (text));
+    block->i_pts = 42;
+
+    block_t *copy = block_Share (&block);
+    assert (copy != NULL);
+    assert (copy->p_buffer == block->p_buffer);
+    assert (copy->i_buffer == sizeof (text));
+    assert (copy->i_pts == 42);
+
+    block_t *other = block_Share (&copy);
+    assert (other != NULL);
+    assert (other->p_buffer == block->p_buffer);
+
+    /* One block may prepend in place, the others get a copy */
+    block = block_Realloc (block, 4, sizeof (text) + 4);
+    assert (block != NULL);
+    memset (block->p_buffer, 'A', 4);
+    copy = block_Realloc (copy, 4, sizeof (text) + 4);
+    assert (copy != NULL);
+    assert (copy->p_buffer != block->p_buffer);
+    memset (copy->p_buffer, 'B', 4);
+    assert (!memcmp (block->p_buffer, "AAAA", 4));
+    assert (!memcmp (block->p_buffer + 4, text, sizeof (text)));
+    assert (!memcmp (copy->p_buffer + 4, text, sizeof (text)));
+
+    /* Expanding the tail must not overwrite the shared payload */
+    block = block_Realloc (block, -4, sizeof (text) - 1);
+    assert (block != NULL);
+    block = block_Realloc (block, 0, sizeof (text));
+    assert (block != NULL);
+    block->p_buffer[sizeof (text) - 1] = 'C';
+    assert (other->p_buffer[sizeof (text) - 1] == '\0');
+
+    /* A payload still shared is copied, the last view gets it back as is */
+    block_t *view = block_Share (&other);
+    assert (view != NULL);
+    view = block_Unshare (view);
+    assert (view != NULL);
+    assert (view->p_buffer != other->p_buffer);
+    assert (view->i_pts == 42);
+    block_Release (view);
+
+    const uint8_t *payload = other->p_buffer;
+    other = block_Unshare (other);
+    assert (other != NULL);
+    assert (other->p_buffer == payload);
+    assert (other->i_buffer == sizeof (text));
+    assert (other->i_pts == 42);
+    other->p_buffer[0] = 'D';
+    assert (!memcmp (copy->p_buffer + 4, text, sizeof (text)));
+    assert (!memcmp (other->p_buffer + 1, text + 1, sizeof (text) - 1));
+
+    block_Release (copy);
+    block_Release (block);
+    block_Release (other);
+}
+
 int main (void)
 {
     test_block_File(false);
     test_block_File(true);
     test_block ();
+    test_block_Share ();
     return 0;
 }
 
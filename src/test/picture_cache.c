@@ -0,0 +1,125 @@
+/*****************************************************************************
+ * picture_cache.c: test cases for the picture buffer cache
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_picture.h>
+#include "../misc/picture.h"
+
+const char vlc_module_name[] = "test_picture_cache";
+
+/* Replace the system allocator to count the buffers */
+static unsigned allocated, deallocated;
+static void *last_freed;
+
+void *picture_Allocate(int *restrict fdp, size_t size)
+{
+    allocated++;
+    *fdp = -1;
+    return aligned_alloc(64, size);
+}
+
+void picture_Deallocate(int fd, void *base, size_t size)
+{
+    assert(fd == -1);
+    (void) size;
+    deallocated++;
+    last_freed = base;
+    free(base);
+}
+
+static video_format_t fmt, fmt_big;
+
+static size_t BufferSize(const video_format_t *f)
+{
+    picture_t *pic = picture_NewFromFormat(f);
+    assert(pic != NULL);
+    size_t size = ((picture_buffer_t *)pic->p_sys)->size;
+    picture_Release(pic);
+    return size;
+}
+
+int main(void)
+{
+    video_format_Setup(&fmt, VLC_CODEC_I420, 320, 200, 320, 200, 1, 1);
+    video_format_Setup(&fmt_big, VLC_CODEC_I420, 640, 400, 640, 400, 1, 1);
+
+    /* Without any holder, the buffers are freed at once */
+    size_t size = BufferSize(&fmt);
+    assert(allocated == 1 && deallocated == 1);
+
+    /* Reuse of a released buffer of the same size */
+    picture_cache_Hold(2 * size + size / 2);
+
+    picture_t *pic = picture_NewFromFormat(&fmt);
+    assert(pic != NULL);
+    void *base = pic->p[0].p_pixels;
+    picture_Release(pic);
+    assert(allocated == 2 && deallocated == 1);
+
+    pic = picture_NewFromFormat(&fmt);
+    assert(pic != NULL);
+    assert(pic->p[0].p_pixels == base);
+    assert(allocated == 2);
+    picture_Release(pic);
+
+    /* A different size does not match */
+    pic = picture_NewFromFormat(&fmt_big);
+    assert(pic != NULL);
+    assert(allocated == 3);
+    picture_Release(pic); /* larger than the budget: freed */
+    assert(deallocated == 2);
+
+    /* Eviction of the least recently released buffer */
+    picture_t *pics[3];
+    for (unsigned i = 0; i < 3; i++)
+    {
+        pics[i] = picture_NewFromFormat(&fmt);
+        assert(pics[i] != NULL);
+    }
+    assert(allocated == 5); /* one from the cache */
+
+    void *oldest = pics[0]->p[0].p_pixels;
+    for (unsigned i = 0; i < 3; i++)
+        picture_Release(pics[i]);
+    assert(deallocated == 3);
+    assert(last_freed == oldest);
+
+    /* The last holder empties the cache */
+    picture_cache_Hold(0);
+    picture_cache_Release();
+    assert(deallocated == 3);
+    picture_cache_Release();
+    assert(deallocated == 5);
+    assert(allocated == deallocated);
+
+    /* Disabled again */
+    BufferSize(&fmt);
+    assert(allocated == 6 && deallocated == 6);
+
+    return 0;
+}
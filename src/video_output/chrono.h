@@ -64,7 +64,7 @@ static inline vlc_tick_t vout_chrono_GetLow(vout_chrono_t *chrono)
     return __MAX(chrono->avg - 2 * chrono->var, 0);
 }
 
-static inline void vout_chrono_Stop(vout_chrono_t *chrono)
+static inline vlc_tick_t vout_chrono_Stop(vout_chrono_t *chrono)
 {
     assert(chrono->start != VLC_TICK_INVALID);
 
@@ -80,6 +80,7 @@ static inline void vout_chrono_Stop(vout_chrono_t *chrono)
 
     /* For assert */
     chrono->start = VLC_TICK_INVALID;
+    return duration;
 }
 static inline void vout_chrono_Reset(vout_chrono_t *chrono)
 {
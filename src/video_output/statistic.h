@@ -31,6 +31,9 @@ typedef struct {
     atomic_uint displayed;
     atomic_uint lost;
     atomic_uint late;
+    atomic_int_least64_t render_time; /* total time spent rendering */
+    atomic_int_least64_t slack; /* total margin left before the deadlines */
+    atomic_uint scheduled; /* displayed pictures with a deadline */
 } vout_statistic_t;
 
 static inline void vout_statistic_Init(vout_statistic_t *stat)
@@ -38,6 +41,9 @@ static inline void vout_statistic_Init(vout_statistic_t *stat)
     atomic_init(&stat->displayed, 0);
     atomic_init(&stat->lost, 0);
     atomic_init(&stat->late, 0);
+    atomic_init(&stat->render_time, 0);
+    atomic_init(&stat->slack, 0);
+    atomic_init(&stat->scheduled, 0);
 }
 
 static inline void vout_statistic_Clean(vout_statistic_t *stat)
@@ -48,12 +54,20 @@ static inline void vout_statistic_Clean(vout_statistic_t *stat)
 static inline void vout_statistic_GetReset(vout_statistic_t *stat,
                                            unsigned *restrict displayed,
                                            unsigned *restrict lost,
-                                           unsigned *restrict late)
+                                           unsigned *restrict late,
+                                           vlc_tick_t *restrict render_time,
+                                           vlc_tick_t *restrict slack,
+                                           unsigned *restrict scheduled)
 {
     *displayed = atomic_exchange_explicit(&stat->displayed, 0,
                                           memory_order_relaxed);
     *lost = atomic_exchange_explicit(&stat->lost, 0, memory_order_relaxed);
     *late = atomic_exchange_explicit(&stat->late, 0, memory_order_relaxed);
+    *render_time = atomic_exchange_explicit(&stat->render_time, 0,
+                                            memory_order_relaxed);
+    *slack = atomic_exchange_explicit(&stat->slack, 0, memory_order_relaxed);
+    *scheduled = atomic_exchange_explicit(&stat->scheduled, 0,
+                                          memory_order_relaxed);
 }
 
 static inline void vout_statistic_AddDisplayed(vout_statistic_t *stat,
@@ -73,4 +87,21 @@ static inline void vout_statistic_AddLate(vout_statistic_t *stat, int late)
     atomic_fetch_add_explicit(&stat->late, late, memory_order_relaxed);
 }
 
+/* Accounts for the rendering duration of a displayed picture */
+static inline void vout_statistic_AddRenderTime(vout_statistic_t *stat,
+                                                vlc_tick_t render_time)
+{
+    atomic_fetch_add_explicit(&stat->render_time, render_time,
+                              memory_order_relaxed);
+}
+
+/* Accounts for the time left before the display deadline of a picture once
+ * rendered (negative if late), for the pictures which have one */
+static inline void vout_statistic_AddSlack(vout_statistic_t *stat,
+                                           vlc_tick_t slack)
+{
+    atomic_fetch_add_explicit(&stat->slack, slack, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat->scheduled, 1, memory_order_relaxed);
+}
+
 #endif
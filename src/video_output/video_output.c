@@ -328,11 +328,15 @@ static void vout_UpdateWindowSizeLocked(vout_thread_sys_t *vout)
 
 /* */
 void vout_GetResetStatistic(vout_thread_t *vout, unsigned *restrict displayed,
-                            unsigned *restrict lost, unsigned *restrict late)
+                            unsigned *restrict lost, unsigned *restrict late,
+                            vlc_tick_t *restrict render_time,
+                            vlc_tick_t *restrict slack,
+                            unsigned *restrict scheduled)
 {
     vout_thread_sys_t *sys = VOUT_THREAD_TO_SYS(vout);
     assert(!sys->dummy);
-    vout_statistic_GetReset( &sys->statistic, displayed, lost, late );
+    vout_statistic_GetReset( &sys->statistic, displayed, lost, late,
+                             render_time, slack, scheduled );
 }
 
 bool vout_IsEmpty(vout_thread_t *vout)
@@ -1289,7 +1293,7 @@ static int ThreadDisplayRenderPicture(vout_thread_sys_t *vout, bool render_now)
     if (vd->ops->prepare != NULL)
         vd->ops->prepare(vd, todisplay, do_dr_spu ? subpic : NULL, system_pts);
 
-    vout_chrono_Stop(&sys->render);
+    const vlc_tick_t render_time = vout_chrono_Stop(&sys->render);
 #if 0
         {
         static int i = 0;
@@ -1303,6 +1307,7 @@ static int ThreadDisplayRenderPicture(vout_thread_sys_t *vout, bool render_now)
     if (!render_now)
     {
         const vlc_tick_t late = system_now - system_pts;
+        vout_statistic_AddSlack(&sys->statistic, -late);
         if (unlikely(late > 0))
         {
             msg_Dbg(vd, "picture displayed late (missing %"PRId64" ms)", MS_FROM_VLC_TICK(late));
@@ -1340,6 +1345,7 @@ static int ThreadDisplayRenderPicture(vout_thread_sys_t *vout, bool render_now)
         subpicture_Delete(subpic);
 
     vout_statistic_AddDisplayed(&sys->statistic, 1);
+    vout_statistic_AddRenderTime(&sys->statistic, render_time);
 
     return VLC_SUCCESS;
 }
@@ -217,9 +217,15 @@ void vout_MouseState(vout_thread_t *, const vlc_mouse_t *);
 
 /**
  * This function will return and reset internal statistics.
+ *
+ * The render time is the total time spent rendering the displayed pictures,
+ * the slack is the total time that was left before the display deadlines of
+ * the pi_scheduled ones which had one.
  */
 void vout_GetResetStatistic( vout_thread_t *p_vout, unsigned *pi_displayed,
-                             unsigned *pi_lost, unsigned *pi_late );
+                             unsigned *pi_lost, unsigned *pi_late,
+                             vlc_tick_t *pi_render_time, vlc_tick_t *pi_slack,
+                             unsigned *pi_scheduled );
 
 /**
  * This function will force to display the next picture while paused
@@ -0,0 +1,311 @@
+/*****************************************************************************
+ * effects.c: equalizer, spatializer and scaletempo checks and benchmark
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Checks the response of the equalizer to a tone, that the spatializer adds a
+ * reverberation tail, that scaletempo keeps a tone clean at every search
+ * quality, and reports the throughput of the filters on a stereo stream. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <math.h>
+
+#include <vlc_common.h>
+#include <vlc_aout.h>
+#include <vlc_block.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+
+#define RATE 48000
+#define CHANNELS 2
+#define BLOCK_FRAMES 1024
+#define BENCH_SECONDS 10
+#define SINAD_WINDOW 4800
+
+static filter_t *CreateFilter(vlc_object_t *parent, const char *name)
+{
+    filter_t *filter = vlc_object_create(parent, sizeof (*filter));
+    assert(filter != NULL);
+
+    es_format_Init(&filter->fmt_in, AUDIO_ES, VLC_CODEC_FL32);
+    filter->fmt_in.audio.i_format = VLC_CODEC_FL32;
+    filter->fmt_in.audio.i_rate = RATE;
+    filter->fmt_in.audio.i_physical_channels = AOUT_CHAN_LEFT | AOUT_CHAN_RIGHT;
+    filter->fmt_in.audio.i_channels = CHANNELS;
+    aout_FormatPrepare(&filter->fmt_in.audio);
+    es_format_Copy(&filter->fmt_out, &filter->fmt_in);
+
+    filter->p_module = module_need(filter, "audio filter", name, true);
+    assert(filter->p_module != NULL);
+    return filter;
+}
+
+static void DeleteFilter(filter_t *filter)
+{
+    filter_Close(filter);
+    module_unneed(filter, filter->p_module);
+    es_format_Clean(&filter->fmt_in);
+    es_format_Clean(&filter->fmt_out);
+    vlc_object_delete(filter);
+}
+
+static block_t *MakeTone(double freq, size_t offset)
+{
+    block_t *block = block_Alloc(BLOCK_FRAMES * CHANNELS * sizeof (float));
+    assert(block != NULL);
+
+    float *p = (float *)block->p_buffer;
+    for (size_t i = 0; i < BLOCK_FRAMES; i++)
+    {
+        const float v = freq > 0.
+            ? .1 * sin(2. * M_PI * freq * (offset + i) / RATE)
+            : (offset + i == 0); /* impulse */
+        for (unsigned c = 0; c < CHANNELS; c++)
+            *(p++) = v;
+    }
+    block->i_nb_samples = BLOCK_FRAMES;
+    block->i_pts = VLC_TICK_0 + vlc_tick_from_samples(offset, RATE);
+    block->i_length = vlc_tick_from_samples(BLOCK_FRAMES, RATE);
+    return block;
+}
+
+/** Ratio of the output to the input RMS levels, over the second half of a
+ * one second tone */
+static double Gain(filter_t *filter, double freq)
+{
+    double in = 0., out = 0.;
+
+    for (size_t offset = 0; offset < RATE; offset += BLOCK_FRAMES)
+    {
+        block_t *block = MakeTone(freq, offset);
+        const bool measure = offset >= RATE / 2;
+
+        if (measure)
+            for (size_t i = 0; i < BLOCK_FRAMES * CHANNELS; i++)
+                in += pow(((float *)block->p_buffer)[i], 2.);
+
+        block = filter->ops->filter_audio(filter, block);
+        assert(block != NULL);
+
+        if (measure)
+            for (size_t i = 0; i < BLOCK_FRAMES * CHANNELS; i++)
+            {
+                const float v = ((float *)block->p_buffer)[i];
+                assert(isfinite(v));
+                out += v * v;
+            }
+        block_Release(block);
+    }
+    return sqrt(out / in);
+}
+
+/** Accumulates the energy of the least squares fit of a sinusoid, and of
+ * the residual */
+static void FitTone(const float *out, size_t n, double freq,
+                    double *signal, double *noise)
+{
+    double ss = 0., sc = 0., cc = 0., ys = 0., yc = 0.;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const double w = 2. * M_PI * freq * i / RATE;
+        const double s = sin(w), c = cos(w);
+
+        ss += s * s; sc += s * c; cc += c * c;
+        ys += out[i] * s; yc += out[i] * c;
+    }
+
+    const double det = ss * cc - sc * sc;
+    const double a = (ys * cc - yc * sc) / det;
+    const double b = (yc * ss - ys * sc) / det;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const double w = 2. * M_PI * freq * i / RATE;
+        const double fit = a * sin(w) + b * cos(w);
+
+        *signal += fit * fit;
+        *noise += (out[i] - fit) * (out[i] - fit);
+    }
+}
+
+/** Signal to noise and distortion ratio of a tone, in dB. The sinusoid is
+ * fitted on each window separately, so that slow phase drifts are not
+ * counted as noise. */
+static double Sinad(const float *out, size_t n, double freq)
+{
+    double signal = 0., noise = 0.;
+
+    for (size_t i = 0; i + SINAD_WINDOW <= n; i += SINAD_WINDOW)
+        FitTone(out + i, SINAD_WINDOW, freq, &signal, &noise);
+    return noise > 0. ? 10. * log10(signal / noise) : INFINITY;
+}
+
+static void Bench(filter_t *filter, const char *name)
+{
+    /* Synthesize the input first, so that only the filter is timed */
+    const size_t count = BENCH_SECONDS * RATE / BLOCK_FRAMES;
+    block_t **blocks = malloc(count * sizeof (*blocks));
+    assert(blocks != NULL);
+    for (size_t i = 0; i < count; i++)
+        blocks[i] = MakeTone(997., i * BLOCK_FRAMES);
+
+    vlc_tick_t start = vlc_tick_now();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        block_t *block = filter->ops->filter_audio(filter, blocks[i]);
+        if (block != NULL)
+            block_Release(block);
+    }
+
+    vlc_tick_t elapsed = vlc_tick_now() - start;
+    free(blocks);
+
+    const double seconds = (double)count * BLOCK_FRAMES / RATE;
+    printf("%-20s %7.2f Mframes/s (%5.1fx real time)\n", name,
+           seconds * RATE / (1e6 * secf_from_vlc_tick(elapsed)),
+           seconds / secf_from_vlc_tick(elapsed));
+    fflush(stdout);
+}
+
+static void TestEqualizer(vlc_object_t *obj)
+{
+    var_Create(obj, "equalizer-bands", VLC_VAR_STRING);
+    var_Create(obj, "equalizer-preamp", VLC_VAR_FLOAT);
+    var_Create(obj, "equalizer-2pass", VLC_VAR_BOOL);
+    var_SetFloat(obj, "equalizer-preamp", 0.f);
+
+    /* Flat: the dry signal scaled by EQZ_IN_FACTOR */
+    var_SetString(obj, "equalizer-bands", "0 0 0 0 0 0 0 0 0 0");
+    filter_t *filter = CreateFilter(obj, "equalizer");
+    double gain = Gain(filter, 997.);
+    printf("equalizer flat:  %.4f\n", gain);
+    assert(fabs(gain - .25) < 1e-4);
+
+    /* Boost of the 1 kHz band only */
+    var_SetString(obj, "equalizer-bands", "0 0 0 0 12 0 0 0 0 0");
+    const double boost = Gain(filter, 997.);
+    const double other = Gain(filter, 12000.);
+    printf("equalizer 1 kHz: %.4f, 12 kHz: %.4f\n", boost, other);
+    assert(boost > 3. * .25 && fabs(other - .25) < .25 / 10.);
+    DeleteFilter(filter);
+
+    var_SetString(obj, "equalizer-bands", "4 2 0 -2 -4 -2 0 2 4 6");
+    var_SetFloat(obj, "equalizer-preamp", 12.f);
+    filter = CreateFilter(obj, "equalizer");
+    Bench(filter, "equalizer");
+    var_SetBool(obj, "equalizer-2pass", true);
+    Bench(filter, "equalizer (2 pass)");
+    DeleteFilter(filter);
+}
+
+static void TestSpatializer(vlc_object_t *obj)
+{
+    filter_t *filter = CreateFilter(obj, "spatializer");
+
+    /* The impulse response must keep ringing long after the impulse */
+    double tail = 0.;
+    for (size_t offset = 0; offset < RATE / 2; offset += BLOCK_FRAMES)
+    {
+        block_t *block = filter->ops->filter_audio(filter, MakeTone(0., offset));
+        assert(block != NULL);
+
+        for (size_t i = 0; i < BLOCK_FRAMES * CHANNELS; i++)
+        {
+            const float v = ((float *)block->p_buffer)[i];
+            assert(isfinite(v));
+            if (offset >= RATE / 4)
+                tail += v * v;
+        }
+        block_Release(block);
+    }
+    printf("spatializer tail energy: %g\n", tail);
+    assert(tail > 0.);
+
+    Bench(filter, "spatializer");
+    DeleteFilter(filter);
+}
+
+static void TestScaletempo(vlc_object_t *obj)
+{
+    static const char *const names[] = { "fast", "normal", "best" };
+    const size_t max = RATE;
+    float *out = malloc(max * sizeof (*out));
+    assert(out != NULL);
+
+    var_Create(obj, "scaletempo-quality", VLC_VAR_INTEGER);
+
+    for (unsigned quality = 0; quality < ARRAY_SIZE(names); quality++)
+    {
+        var_SetInteger(obj, "scaletempo-quality", quality);
+        filter_t *filter = CreateFilter(obj, "scaletempo");
+
+        /* The audio output signals the playback rate through the input rate */
+        filter->fmt_in.audio.i_rate = 2 * RATE;
+
+        size_t n = 0;
+        for (size_t offset = 0; offset < 2 * RATE; offset += BLOCK_FRAMES)
+        {
+            block_t *block = filter->ops->filter_audio(filter,
+                                                       MakeTone(441., offset));
+            if (block == NULL)
+                continue;
+
+            const float *p = (const float *)block->p_buffer;
+            for (size_t i = 0; i < block->i_nb_samples && n < max; i++)
+                out[n++] = p[i * CHANNELS];
+            block_Release(block);
+        }
+
+        /* Twice the tempo: about half of the frames, at the same pitch */
+        const double sinad = Sinad(out, n, 441.);
+        printf("scaletempo %-6s   %zu frames, %.1f dB\n", names[quality], n,
+               sinad);
+        fflush(stdout);
+        assert(n > RATE * 9 / 10 && sinad > 20.);
+
+        char name[32];
+        snprintf(name, sizeof (name), "scaletempo x2 %s", names[quality]);
+        Bench(filter, name);
+        filter->fmt_in.audio.i_rate = 4 * RATE;
+        snprintf(name, sizeof (name), "scaletempo x4 %s", names[quality]);
+        Bench(filter, name);
+        DeleteFilter(filter);
+    }
+    free(out);
+}
+
+int main(void)
+{
+    test_init();
+
+    const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    TestEqualizer(obj);
+    TestSpatializer(obj);
+    TestScaletempo(obj);
+
+    libvlc_release(vlc);
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*****************************************************************************
+ * resampler.c: audio resamplers accuracy and throughput benchmark
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Resamples pure tones with every available "audio resampler" module and
+ * reports the signal to noise and distortion ratio of the output, and the
+ * throughput. The noise is what remains after a least squares fit of a
+ * sinusoid at the expected frequency, so the filter delay does not matter.
+ * Only the polyphase resampler is required, and checked. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <math.h>
+
+#include <vlc_common.h>
+#include <vlc_aout.h>
+#include <vlc_block.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+
+#define CHANNELS 2
+#define BLOCK_FRAMES 1024
+#define TONE_SECONDS 1
+#define BENCH_SECONDS 4
+
+static const char *const modules[] = {
+    "polyphase", "bandlimited", "ugly", "speex", "samplerate", "soxr",
+};
+
+static const struct
+{
+    unsigned in;
+    unsigned out;
+} ratios[] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 48000, 96000 },
+};
+
+static const double tones[] = { 997., 10000. };
+
+static filter_t *CreateResampler(vlc_object_t *parent, const char *name,
+                                 unsigned in_rate, unsigned out_rate)
+{
+    filter_t *filter = vlc_object_create(parent, sizeof (*filter));
+    assert(filter != NULL);
+
+    es_format_Init(&filter->fmt_in, AUDIO_ES, VLC_CODEC_FL32);
+    filter->fmt_in.audio.i_format = VLC_CODEC_FL32;
+    filter->fmt_in.audio.i_rate = in_rate;
+    filter->fmt_in.audio.i_physical_channels = AOUT_CHAN_LEFT | AOUT_CHAN_RIGHT;
+    filter->fmt_in.audio.i_channels = CHANNELS;
+    aout_FormatPrepare(&filter->fmt_in.audio);
+    es_format_Copy(&filter->fmt_out, &filter->fmt_in);
+    filter->fmt_out.audio.i_rate = out_rate;
+
+    filter->p_module = module_need(filter, "audio resampler", name, true);
+    if (filter->p_module == NULL)
+    {
+        vlc_object_delete(filter);
+        return NULL;
+    }
+    assert(filter->ops != NULL && filter->ops->filter_audio != NULL);
+    return filter;
+}
+
+static void DeleteResampler(filter_t *filter)
+{
+    filter_Close(filter);
+    module_unneed(filter, filter->p_module);
+    es_format_Clean(&filter->fmt_in);
+    es_format_Clean(&filter->fmt_out);
+    vlc_object_delete(filter);
+}
+
+static block_t *MakeTone(double freq, unsigned rate, size_t offset,
+                         size_t frames)
+{
+    block_t *block = block_Alloc(frames * CHANNELS * sizeof (float));
+    assert(block != NULL);
+
+    float *p = (float *)block->p_buffer;
+    for (size_t i = 0; i < frames; i++)
+    {
+        const float v = .5 * sin(2. * M_PI * freq * (offset + i) / rate);
+        for (unsigned c = 0; c < CHANNELS; c++)
+            *(p++) = v;
+    }
+    block->i_nb_samples = frames;
+    block->i_pts = VLC_TICK_0 + vlc_tick_from_samples(offset, rate);
+    block->i_length = vlc_tick_from_samples(frames, rate);
+    return block;
+}
+
+/** Runs the resampler over frames input frames, optionally collecting the
+ * first channel of the output. Returns the number of output frames. */
+static size_t Run(filter_t *filter, double freq, size_t frames,
+                  float *out, size_t out_max)
+{
+    const unsigned rate = filter->fmt_in.audio.i_rate;
+    size_t done = 0;
+
+    for (size_t offset = 0; offset < frames + BLOCK_FRAMES;
+         offset += BLOCK_FRAMES)
+    {
+        block_t *block;
+
+        if (offset < frames)
+        {
+            const size_t n = frames - offset < BLOCK_FRAMES
+                           ? frames - offset : BLOCK_FRAMES;
+            block = MakeTone(freq, rate, offset, n);
+            block = filter->ops->filter_audio(filter, block);
+        }
+        else
+            block = filter_DrainAudio(filter);
+        if (block == NULL)
+            continue;
+
+        const float *p = (const float *)block->p_buffer;
+        for (size_t i = 0; i < block->i_nb_samples; i++, done++)
+            if (done < out_max)
+                out[done] = p[i * CHANNELS];
+        block_Release(block);
+    }
+    return done;
+}
+
+/** Signal to noise and distortion ratio of a tone, in dB */
+static double Sinad(const float *out, size_t n, double freq, unsigned rate)
+{
+    double ss = 0., sc = 0., cc = 0., ys = 0., yc = 0.;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const double w = 2. * M_PI * freq * i / rate;
+        const double s = sin(w), c = cos(w);
+
+        ss += s * s; sc += s * c; cc += c * c;
+        ys += out[i] * s; yc += out[i] * c;
+    }
+
+    const double det = ss * cc - sc * sc;
+    const double a = (ys * cc - yc * sc) / det;
+    const double b = (yc * ss - ys * sc) / det;
+    double signal = 0., noise = 0.;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const double w = 2. * M_PI * freq * i / rate;
+        const double fit = a * sin(w) + b * cos(w);
+
+        signal += fit * fit;
+        noise += (out[i] - fit) * (out[i] - fit);
+    }
+    return noise > 0. ? 10. * log10(signal / noise) : INFINITY;
+}
+
+static void Bench(vlc_object_t *obj, const char *name,
+                  unsigned in_rate, unsigned out_rate)
+{
+    const size_t frames = TONE_SECONDS * in_rate;
+    const size_t out_max = (size_t)TONE_SECONDS * out_rate + BLOCK_FRAMES;
+    float *out = malloc(out_max * sizeof (*out));
+    assert(out != NULL);
+
+    printf("%-11s %5u -> %5u:", name, in_rate, out_rate);
+
+    for (size_t i = 0; i < ARRAY_SIZE(tones); i++)
+    {
+        filter_t *filter = CreateResampler(obj, name, in_rate, out_rate);
+        if (filter == NULL)
+        {
+            printf(" not available\n");
+            free(out);
+            return;
+        }
+
+        size_t n = Run(filter, tones[i], frames, out, out_max);
+        DeleteResampler(filter);
+
+        /* Leave the start-up and drain transients out */
+        const size_t margin = out_rate / 100;
+        assert(n > 2 * margin && n <= out_max);
+        const double sinad = Sinad(out + margin, n - 2 * margin,
+                                   tones[i], out_rate);
+        printf(" %5.0f Hz %6.1f dB,", tones[i], sinad);
+
+        if (strcmp(name, "polyphase") == 0)
+        {
+            /* All input frames must come out, within rounding */
+            const size_t expected = (uint64_t)frames * out_rate / in_rate;
+            assert(n + 1 >= expected && n <= expected + 1);
+            assert(sinad > 70.);
+        }
+    }
+
+    filter_t *filter = CreateResampler(obj, name, in_rate, out_rate);
+    assert(filter != NULL);
+
+    vlc_tick_t start = vlc_tick_now();
+    Run(filter, tones[0], (size_t)BENCH_SECONDS * in_rate, NULL, 0);
+    vlc_tick_t elapsed = vlc_tick_now() - start;
+    DeleteResampler(filter);
+
+    printf(" %7.1f Mframes/s\n", BENCH_SECONDS * in_rate
+           / (1e6 * secf_from_vlc_tick(elapsed > 0 ? elapsed : 1)));
+    fflush(stdout);
+    free(out);
+}
+
+/* The audio output adjusts the input rate of its resampler to compensate the
+ * clock drift, then restores it: the polyphase resampler must follow, then
+ * pass the samples through again without losing any */
+static void TestDrift(vlc_object_t *obj)
+{
+    const unsigned rate = 48000, adjust = 48;
+    filter_t *filter = CreateResampler(obj, "polyphase", rate, rate);
+    assert(filter != NULL);
+
+    size_t in = 0, out = 0;
+    double expected = 0.;
+
+    for (unsigned i = 0; i < 64; i++)
+    {
+        const bool drift = i >= 16 && i < 48;
+
+        filter->fmt_in.audio.i_rate = rate + (drift ? adjust : 0);
+        block_t *block = MakeTone(tones[0], rate, in, BLOCK_FRAMES);
+        block = filter->ops->filter_audio(filter, block);
+        assert(block != NULL);
+
+        in += BLOCK_FRAMES;
+        expected += BLOCK_FRAMES * (double)rate / filter->fmt_in.audio.i_rate;
+        out += block->i_nb_samples;
+
+        if (i >= 49)
+            /* Pass-through once the pending samples are flushed */
+            assert(block->i_nb_samples == BLOCK_FRAMES);
+        block_Release(block);
+    }
+    DeleteResampler(filter);
+
+    printf("drift: %zu frames in, %zu out, %.1f expected\n", in, out, expected);
+    assert(fabs(out - expected) <= 1.);
+}
+
+int main(void)
+{
+    test_init();
+
+    const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    for (size_t i = 0; i < ARRAY_SIZE(ratios); i++)
+        for (size_t j = 0; j < ARRAY_SIZE(modules); j++)
+            Bench(obj, modules[j], ratios[i].in, ratios[i].out);
+
+    TestDrift(obj);
+
+    libvlc_release(vlc);
+    return 0;
+}
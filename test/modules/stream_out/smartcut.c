@@ -0,0 +1,319 @@
+/*****************************************************************************
+ * smartcut.c: transcode smart cut checks
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Encodes H.264 and HEVC samples from the mock demuxer in TS and MP4, cuts a
+ * clip starting and stopping between keyframes with the smart cut mode of the
+ * transcode stream output, and decodes the clip. The mock demuxer fills each
+ * picture with a level following its timestamp, so that the decoded pictures
+ * tell which source pictures were kept, and in which order. Each combination
+ * is skipped if its encoder, muxer, demuxer or decoder is missing. */
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_fs.h>
+#include <vlc_modules.h>
+#include <vlc_url.h>
+
+#define SAMPLE_WIDTH 320
+#define SAMPLE_HEIGHT 240
+#define SAMPLE_RATE 25 /* pictures per second */
+#define SAMPLE_LENGTH VLC_TICK_FROM_SEC(3)
+
+/* Between the keyframes of the samples with one every second */
+#define CUT_START "1.2"
+#define CUT_STOP "2.4"
+#define CUT_START_MS 1200
+#define CUT_STOP_MS 2400
+#define CUT_PICTURES ((CUT_STOP_MS - CUT_START_MS) * SAMPLE_RATE / 1000)
+
+/* The mock demuxer fills a picture with its timestamp in 10 ms units */
+#define LEVEL(ms) (((ms) / 10) % 255)
+#define LEVEL_STEP LEVEL(1000 / SAMPLE_RATE)
+#define LEVEL_TOLERANCE 2
+
+static const struct
+{
+    const char *name;
+    const char *encoder_module;
+    const char *encoder;
+} codecs[] = {
+    { "h264", "x264", "x264{keyint=25,min-keyint=25,scenecut=0}" },
+    { "hevc", "x265", "x265" },
+    /* With open GOPs, whose leading pictures precede the keyframes */
+    { "hevc", "x265", "x265{keyint=25,min-keyint=25,scenecut=0}" },
+};
+
+static const struct
+{
+    const char *name;
+    const char *mux_module;
+    const char *demux_module;
+} muxes[] = {
+    { "ts", "mux_ts", "ts" },
+    { "mp4", "mux_mp4", "mp4" },
+};
+
+struct playback
+{
+    vlc_sem_t done;
+    bool error;
+};
+
+struct decoded
+{
+    uint8_t *buffer;
+    unsigned width;
+    unsigned height;
+    unsigned count;
+    uint8_t levels[4 * CUT_PICTURES];
+};
+
+static void OnEvent(const libvlc_event_t *event, void *data)
+{
+    struct playback *playback = data;
+
+    playback->error = event->type == libvlc_MediaPlayerEncounteredError;
+    vlc_sem_post(&playback->done);
+}
+
+static unsigned SetupVideo(void **opaque, char *chroma, unsigned *width,
+                           unsigned *height, unsigned *pitches,
+                           unsigned *lines)
+{
+    struct decoded *decoded = *opaque;
+
+    memcpy(chroma, "I420", 4);
+    decoded->width = *width;
+    decoded->height = *height;
+    pitches[0] = *width;
+    pitches[1] = pitches[2] = (*width + 1) / 2;
+    lines[0] = *height;
+    lines[1] = lines[2] = (*height + 1) / 2;
+
+    decoded->buffer = malloc(pitches[0] * lines[0]
+                             + 2 * pitches[1] * lines[1]);
+    assert(decoded->buffer != NULL);
+    return 1;
+}
+
+static void CleanupVideo(void *opaque)
+{
+    struct decoded *decoded = opaque;
+
+    free(decoded->buffer);
+    decoded->buffer = NULL;
+}
+
+static void *LockVideo(void *opaque, void **planes)
+{
+    struct decoded *decoded = opaque;
+    const size_t luma = decoded->width * decoded->height;
+    const size_t chroma = ((decoded->width + 1) / 2)
+                        * ((decoded->height + 1) / 2);
+
+    planes[0] = decoded->buffer;
+    planes[1] = decoded->buffer + luma;
+    planes[2] = decoded->buffer + luma + chroma;
+    return NULL;
+}
+
+static void DisplayVideo(void *opaque, void *picture)
+{
+    struct decoded *decoded = opaque;
+    const unsigned center = decoded->height / 2 * decoded->width
+                          + decoded->width / 2;
+
+    assert(decoded->count < ARRAY_SIZE(decoded->levels));
+    decoded->levels[decoded->count++] = decoded->buffer[center];
+    (void) picture;
+}
+
+/* Plays the media to its end, through the video callbacks if decoded is
+ * not NULL */
+static void Play(libvlc_instance_t *vlc, const char *mrl,
+                 const char *demux, const char *sout,
+                 struct decoded *decoded)
+{
+    libvlc_media_t *md = libvlc_media_new_location(vlc, mrl);
+    assert(md != NULL);
+
+    char *option;
+    if (demux != NULL)
+    {
+        assert(asprintf(&option, ":demux=%s", demux) != -1);
+        libvlc_media_add_option(md, option);
+        free(option);
+    }
+    if (sout != NULL)
+    {
+        assert(asprintf(&option, ":sout=%s", sout) != -1);
+        libvlc_media_add_option(md, option);
+        free(option);
+    }
+
+    libvlc_media_player_t *mp = libvlc_media_player_new_from_media(md);
+    assert(mp != NULL);
+    libvlc_media_release(md);
+
+    if (decoded != NULL)
+    {
+        libvlc_video_set_callbacks(mp, LockVideo, NULL, DisplayVideo,
+                                   decoded);
+        libvlc_video_set_format_callbacks(mp, SetupVideo, CleanupVideo);
+    }
+
+    struct playback playback = { .error = false };
+    vlc_sem_init(&playback.done, 0);
+
+    libvlc_event_manager_t *em = libvlc_media_player_event_manager(mp);
+    int ret = libvlc_event_attach(em, libvlc_MediaPlayerEndReached,
+                                  OnEvent, &playback);
+    assert(ret == 0);
+    ret = libvlc_event_attach(em, libvlc_MediaPlayerEncounteredError,
+                              OnEvent, &playback);
+    assert(ret == 0);
+
+    ret = libvlc_media_player_play(mp);
+    assert(ret == 0);
+    vlc_sem_wait(&playback.done);
+    assert(!playback.error);
+
+    libvlc_media_player_stop_async(mp);
+    libvlc_media_player_release(mp);
+}
+
+static char *CreateTempFile(void)
+{
+    char path[] = "/tmp/vlc_smartcut_XXXXXX";
+    int fd = vlc_mkstemp(path);
+    assert(fd != -1);
+    close(fd);
+    return strdup(path);
+}
+
+static void CheckClip(const struct decoded *decoded)
+{
+    test_log("%u pictures, levels %u to %u\n", decoded->count,
+             decoded->count ? decoded->levels[0] : 0,
+             decoded->count ? decoded->levels[decoded->count - 1] : 0);
+
+    /* All the pictures from the start to the stop, and only them */
+    assert(decoded->count + 1 >= CUT_PICTURES
+        && decoded->count <= CUT_PICTURES + 1);
+
+    /* The clip origin is the first DTS: the first kept picture may precede
+     * the start by the reordering delay of the encoder */
+    const int first = decoded->levels[0];
+    assert(first >= LEVEL(CUT_START_MS) - 4 * LEVEL_STEP - LEVEL_TOLERANCE
+        && first <= LEVEL(CUT_START_MS) + LEVEL_STEP + LEVEL_TOLERANCE);
+
+    /* In order, without any gap nor duplicate, across the re-encoded head
+     * and tail and the copied middle */
+    for (unsigned i = 1; i < decoded->count; i++)
+    {
+        const int step = decoded->levels[i] - decoded->levels[i - 1];
+        if (abs(step - LEVEL_STEP) > LEVEL_TOLERANCE)
+        {
+            fprintf(stderr, "picture %u: level %u after %u\n", i,
+                    decoded->levels[i], decoded->levels[i - 1]);
+            abort();
+        }
+    }
+}
+
+static bool Test(libvlc_instance_t *vlc, size_t codec, size_t mux)
+{
+    if (!module_exists(codecs[codec].encoder_module)
+     || !module_exists(muxes[mux].mux_module)
+     || !module_exists(muxes[mux].demux_module)
+     || !module_exists("avcodec") || !module_exists("vmem"))
+    {
+        test_log("%s in %s skipped\n", codecs[codec].encoder,
+                 muxes[mux].name);
+        return false;
+    }
+
+    test_log("%s in %s\n", codecs[codec].encoder, muxes[mux].name);
+
+    char *sample = CreateTempFile();
+    char *clip = CreateTempFile();
+    char *mrl, *sout;
+
+    assert(asprintf(&mrl, "mock://video_track_count=1;length=%" PRId64
+                    ";video_width=%u;video_height=%u;video_frame_rate=%u",
+                    SAMPLE_LENGTH, SAMPLE_WIDTH, SAMPLE_HEIGHT,
+                    SAMPLE_RATE) != -1);
+    assert(asprintf(&sout, "#transcode{vcodec=%s,venc=%s}"
+                    ":std{access=file,mux=%s,dst=%s}", codecs[codec].name,
+                    codecs[codec].encoder, muxes[mux].name, sample) != -1);
+    Play(vlc, mrl, NULL, sout, NULL);
+    free(sout);
+    free(mrl);
+
+    /* Same encoder as the sample for the re-encoded head and tail */
+    mrl = vlc_path2uri(sample, NULL);
+    assert(mrl != NULL);
+    assert(asprintf(&sout, "#transcode{smartcut,smartcut-start=" CUT_START
+                    ",smartcut-stop=" CUT_STOP ",venc=%s}"
+                    ":std{access=file,mux=%s,dst=%s}", codecs[codec].encoder,
+                    muxes[mux].name, clip) != -1);
+    Play(vlc, mrl, muxes[mux].demux_module, sout, NULL);
+    free(sout);
+    free(mrl);
+
+    struct decoded decoded = { .count = 0 };
+    mrl = vlc_path2uri(clip, NULL);
+    assert(mrl != NULL);
+    Play(vlc, mrl, muxes[mux].demux_module, NULL, &decoded);
+    free(mrl);
+
+    CheckClip(&decoded);
+
+    unlink(clip);
+    unlink(sample);
+    free(clip);
+    free(sample);
+    return true;
+}
+
+int main(void)
+{
+    /* The clips are decoded in real time */
+    setenv("VLC_TEST_TIMEOUT", "60", 0);
+    test_init();
+
+    /* Decode every picture, even late */
+    const char *argv[] = {
+        "-v", "--ignore-config", "--no-audio", "--no-drop-late-frames",
+        "--no-skip-frames", "--file-caching=100",
+    };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    unsigned tested = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(codecs); i++)
+        for (size_t j = 0; j < ARRAY_SIZE(muxes); j++)
+            if (Test(vlc, i, j))
+                tested++;
+
+    libvlc_release(vlc);
+    return tested > 0 ? 0 : 77;
+}
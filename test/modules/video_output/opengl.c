@@ -0,0 +1,301 @@
+/*****************************************************************************
+ * opengl.c: OpenGL rendering pipeline benchmark
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Pushes synthetic pictures through the OpenGL vout helper (interop upload,
+ * sampler, filters, renderer and subpicture renderer) in an offscreen EGL
+ * context, and reports the texture upload bandwidth and the frame time for
+ * each chroma and size. Each configuration is also checked by rendering solid
+ * pictures and comparing the read-back pixels with the expected colours. The
+ * test is skipped if no offscreen OpenGL context can be created. The frame
+ * count is kept low to fit the "make check" timeout with software rasterizers:
+ * raise BENCH_FRAMES (and VLC_TEST_TIMEOUT) for more stable figures. */
+
+#include "../../libvlc/test.h"
+#include "../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_opengl.h>
+#include <vlc_picture.h>
+#include <vlc_subpicture.h>
+#include <vlc_tick.h>
+
+#include "../../../modules/video_output/opengl/gl_api.h"
+#include "../../../modules/video_output/opengl/vout_helper.h"
+
+#define BENCH_FRAMES 4
+#define CHECK_TOLERANCE 3
+
+/* Required by the messages of the statically linked OpenGL helpers */
+const char vlc_module_name[] = "test_opengl";
+
+static const vlc_fourcc_t bench_chromas[] = {
+    VLC_CODEC_I420, VLC_CODEC_NV12, VLC_CODEC_RGBA, VLC_CODEC_I420_10L,
+};
+
+static const struct
+{
+    unsigned width;
+    unsigned height;
+} bench_sizes[] = {
+    { 640, 360 },
+    { 1920, 1080 },
+};
+
+static picture_t *(*offscreen_swap)(vlc_gl_t *);
+
+/* Position of the probed pixel in the rendered picture, and its value as
+ * read back by the last swap */
+static unsigned probe_x, probe_y;
+static uint8_t probe_rgba[4];
+
+/* The vout helper swaps as if the context was on-screen: read the rendered
+ * picture back and drop it, as an offscreen consumer would */
+static void SwapOffscreen(vlc_gl_t *gl)
+{
+    picture_t *pic = offscreen_swap(gl);
+    if (pic != NULL)
+    {
+        const plane_t *p = &pic->p[0];
+        assert((int)probe_y < p->i_lines);
+        memcpy(probe_rgba, &p->p_pixels[probe_y * p->i_pitch + probe_x * 4],
+               sizeof (probe_rgba));
+        picture_Release(pic);
+    }
+}
+
+static void FillPicture(picture_t *pic, unsigned frame)
+{
+    for (int i = 0; i < pic->i_planes; i++)
+    {
+        plane_t *p = &pic->p[i];
+        for (int y = 0; y < p->i_visible_lines; y++)
+            memset(&p->p_pixels[y * p->i_pitch], (frame * 7 + y + i * 64) & 0xff,
+                   p->i_visible_pitch);
+    }
+}
+
+/* Fills the picture with a grey level, neutral chroma and opaque alpha, and
+ * returns the 8-bit level it is expected to be rendered with */
+static int FillSolid(picture_t *pic, uint8_t level)
+{
+    const vlc_chroma_description_t *desc =
+        vlc_fourcc_GetChromaDescription(pic->format.i_chroma);
+    assert(desc != NULL);
+
+    if (pic->format.i_chroma == VLC_CODEC_RGBA)
+    {
+        plane_t *p = &pic->p[0];
+        for (int y = 0; y < p->i_visible_lines; y++)
+            for (int x = 0; x < p->i_visible_pitch; x += 4)
+            {
+                uint8_t *px = &p->p_pixels[y * p->i_pitch + x];
+                px[0] = px[1] = px[2] = level;
+                px[3] = 0xff;
+            }
+        return level;
+    }
+
+    for (int i = 0; i < pic->i_planes; i++)
+    {
+        plane_t *p = &pic->p[i];
+        const unsigned value = i == 0 ? level : 0x80;
+        for (int y = 0; y < p->i_visible_lines; y++)
+        {
+            uint8_t *line = &p->p_pixels[y * p->i_pitch];
+            if (desc->pixel_size == 2)
+            {
+                const unsigned shift = desc->pixel_bits - 8;
+                for (int x = 0; x < p->i_visible_pitch; x += 2)
+                    SetWLE(&line[x], value << shift);
+            }
+            else
+                memset(line, value, p->i_visible_pitch);
+        }
+    }
+    /* YUV is always sampled as limited range */
+    return (level - 16) * 255 / 219;
+}
+
+static double PictureSize(const picture_t *pic)
+{
+    double size = 0.;
+    for (int i = 0; i < pic->i_planes; i++)
+        size += (double)pic->p[i].i_visible_pitch * pic->p[i].i_visible_lines;
+    return size;
+}
+
+static subpicture_t *CreateSubpicture(void)
+{
+    video_format_t fmt;
+    video_format_Init(&fmt, VLC_CODEC_RGBA);
+    video_format_Setup(&fmt, VLC_CODEC_RGBA, 512, 64, 512, 64, 1, 1);
+
+    subpicture_t *subpic = subpicture_New(NULL);
+    if (subpic == NULL)
+        return NULL;
+
+    subpicture_region_t *region = subpicture_region_New(&fmt);
+    if (region == NULL)
+    {
+        subpicture_Delete(subpic);
+        return NULL;
+    }
+    FillPicture(region->p_picture, 0);
+    region->i_x = region->i_y = 16;
+    subpic->p_region = region;
+    subpic->b_absolute = true;
+    subpic->i_original_picture_width = fmt.i_width;
+    subpic->i_original_picture_height = fmt.i_height;
+    return subpic;
+}
+
+static void Bench(vlc_gl_t *gl, const struct vlc_gl_api *api,
+                  vlc_fourcc_t chroma, unsigned width, unsigned height)
+{
+    const opengl_vtable_t *vt = &api->vt;
+    video_format_t fmt;
+
+    video_format_Init(&fmt, chroma);
+    video_format_Setup(&fmt, chroma, width, height, width, height, 1, 1);
+
+    vout_display_opengl_t *vgl =
+        vout_display_opengl_New(&fmt, NULL, gl, NULL, NULL);
+    if (vgl == NULL)
+    {
+        printf("%4.4s %4ux%-4u: not supported\n", (const char *)&chroma,
+               width, height);
+        video_format_Clean(&fmt);
+        return;
+    }
+    vout_display_opengl_Viewport(vgl, 0, 0, width, height);
+
+    /* The interop may have changed the input format */
+    picture_t *pic = picture_NewFromFormat(&fmt);
+    subpicture_t *subpic = CreateSubpicture();
+    assert(pic != NULL && subpic != NULL);
+
+    /* Check the rendered colours before measuring anything */
+    probe_x = width / 2;
+    probe_y = height / 2;
+    static const uint8_t levels[] = { 0x40, 0xc0 };
+    for (size_t i = 0; i < ARRAY_SIZE(levels); i++)
+    {
+        const int expected = FillSolid(pic, levels[i]);
+
+        memset(probe_rgba, 0, sizeof (probe_rgba));
+        int ret = vout_display_opengl_Prepare(vgl, pic, NULL);
+        assert(ret == VLC_SUCCESS);
+        ret = vout_display_opengl_Display(vgl);
+        assert(ret == VLC_SUCCESS);
+
+        for (int c = 0; c < 3; c++)
+        {
+            if (abs(probe_rgba[c] - expected) > CHECK_TOLERANCE)
+            {
+                fprintf(stderr, "%4.4s %ux%u: level %u rendered as "
+                        "%u,%u,%u, expected %d\n", (const char *)&chroma,
+                        width, height, levels[i], probe_rgba[0],
+                        probe_rgba[1], probe_rgba[2], expected);
+                abort();
+            }
+        }
+    }
+
+    vlc_tick_t upload = 0, frame = 0;
+
+    /* The first frame is not measured (allocations, shader compilation) */
+    for (unsigned i = 0; i <= BENCH_FRAMES; i++)
+    {
+        FillPicture(pic, i);
+
+        vlc_tick_t start = vlc_tick_now();
+        int ret = vout_display_opengl_Prepare(vgl, pic, subpic);
+        assert(ret == VLC_SUCCESS);
+        vt->Finish();
+        vlc_tick_t uploaded = vlc_tick_now();
+
+        ret = vout_display_opengl_Display(vgl);
+        assert(ret == VLC_SUCCESS);
+        vt->Finish();
+        vlc_tick_t end = vlc_tick_now();
+
+        if (i > 0)
+        {
+            upload += uploaded - start;
+            frame += end - start;
+        }
+    }
+
+    const double bytes = PictureSize(pic) * BENCH_FRAMES;
+    printf("%4.4s %4ux%-4u: upload %8.1f MiB/s, frame %7.2f ms\n",
+           (const char *)&chroma, width, height,
+           upload > 0 ? bytes / (1 << 20) / secf_from_vlc_tick(upload) : 0.,
+           MS_FROM_VLC_TICK(frame) / (double)BENCH_FRAMES);
+    fflush(stdout);
+
+    subpicture_Delete(subpic);
+    picture_Release(pic);
+    vout_display_opengl_Delete(vgl);
+    video_format_Clean(&fmt);
+}
+
+int main(void)
+{
+    test_init();
+
+    const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    const unsigned max_width = bench_sizes[ARRAY_SIZE(bench_sizes) - 1].width;
+    const unsigned max_height = bench_sizes[ARRAY_SIZE(bench_sizes) - 1].height;
+
+    vlc_gl_t *gl = vlc_gl_CreateOffscreen(VLC_OBJECT(vlc->p_libvlc_int), NULL,
+                                          max_width, max_height, VLC_OPENGL,
+                                          NULL);
+    if (gl == NULL)
+    {
+        fprintf(stderr, "no offscreen OpenGL implementation, skipping\n");
+        libvlc_release(vlc);
+        return 77;
+    }
+
+    offscreen_swap = gl->swap_offscreen;
+    gl->swap = SwapOffscreen;
+
+    int ret = vlc_gl_MakeCurrent(gl);
+    assert(ret == VLC_SUCCESS);
+
+    struct vlc_gl_api api;
+    ret = vlc_gl_api_Init(&api, gl);
+    assert(ret == VLC_SUCCESS);
+
+    printf("%s\n", (const char *)api.vt.GetString(GL_RENDERER));
+
+    for (size_t i = 0; i < ARRAY_SIZE(bench_chromas); i++)
+        for (size_t j = 0; j < ARRAY_SIZE(bench_sizes); j++)
+            Bench(gl, &api, bench_chromas[i],
+                  bench_sizes[j].width, bench_sizes[j].height);
+
+    vlc_gl_ReleaseCurrent(gl);
+    vlc_gl_Release(gl);
+    libvlc_release(vlc);
+    return 0;
+}
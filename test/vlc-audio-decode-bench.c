@@ -0,0 +1,461 @@
+/*****************************************************************************
+ * vlc-audio-decode-bench.c: audio decoder throughput benchmark
+ *****************************************************************************
+ * Copyright (C) 2021 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/* Demuxes and packetizes the audio track of a file with the most blocks into
+ * memory, then decodes it several times, timing only the decoder (and
+ * optionally the conversion of its output to FL32). Reports the throughput in
+ * samples per second and percentiles of the time spent decoding each block. */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vlc_common.h>
+#include <vlc_access.h>
+#include <vlc_aout.h>
+#include <vlc_block.h>
+#include <vlc_codec.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_filter.h>
+#include <vlc_modules.h>
+#include <vlc_url.h>
+#include "../lib/libvlc_internal.h"
+
+#include "src/input/common.h"
+
+struct es_out_id_t
+{
+    struct es_out_id_t *next;
+    decoder_t *packetizer;
+    es_format_t fmt; /* Format of the packetized blocks */
+    block_t *blocks;
+    block_t **last;
+    size_t count;
+};
+
+struct bench_es_out
+{
+    es_out_t out;
+    vlc_object_t *parent;
+    es_out_id_t *ids;
+};
+
+static void EsOutStore(es_out_id_t *id, block_t *chain)
+{
+    for (block_t *block = chain; block != NULL; block = block->p_next)
+        id->count++;
+    block_ChainLastAppend(&id->last, chain);
+}
+
+static es_out_id_t *EsOutAdd(es_out_t *out, input_source_t *in,
+                             const es_format_t *fmt)
+{
+    struct bench_es_out *ctx = container_of(out, struct bench_es_out, out);
+    (void) in;
+
+    es_out_id_t *id = calloc(1, sizeof (*id));
+    if (unlikely(id == NULL))
+        return NULL;
+
+    id->last = &id->blocks;
+    es_format_Init(&id->fmt, fmt->i_cat, fmt->i_codec);
+    id->next = ctx->ids;
+    ctx->ids = id;
+
+    if (fmt->i_cat != AUDIO_ES)
+        return id;
+
+    decoder_t *packetizer = vlc_object_create(ctx->parent,
+                                              sizeof (*packetizer));
+    if (unlikely(packetizer == NULL))
+        return id;
+
+    decoder_Init(packetizer, fmt);
+    packetizer->p_module = module_need(packetizer, "packetizer", NULL, false);
+    if (packetizer->p_module == NULL)
+    {
+        decoder_Clean(packetizer);
+        vlc_object_delete(packetizer);
+        return id;
+    }
+    id->packetizer = packetizer;
+    return id;
+}
+
+static int EsOutSend(es_out_t *out, es_out_id_t *id, block_t *block)
+{
+    (void) out;
+
+    if (id->packetizer == NULL)
+    {
+        block_Release(block);
+        return VLC_SUCCESS;
+    }
+
+    block_t *chain;
+    while ((chain = id->packetizer->pf_packetize(id->packetizer, &block)))
+        EsOutStore(id, chain);
+    return VLC_SUCCESS;
+}
+
+static void EsOutFinish(es_out_id_t *id)
+{
+    decoder_t *packetizer = id->packetizer;
+
+    if (packetizer == NULL)
+        return;
+
+    block_t *chain;
+    while ((chain = packetizer->pf_packetize(packetizer, NULL)))
+        EsOutStore(id, chain);
+
+    es_format_Clean(&id->fmt);
+    es_format_Copy(&id->fmt, &packetizer->fmt_out);
+    decoder_Destroy(packetizer);
+    id->packetizer = NULL;
+}
+
+static void EsOutDel(es_out_t *out, es_out_id_t *id)
+{
+    (void) out;
+    /* Keep the blocks until the benchmark */
+    EsOutFinish(id);
+}
+
+static int EsOutControl(es_out_t *out, input_source_t *in, int query,
+                        va_list args)
+{
+    (void) out; (void) in;
+
+    switch (query)
+    {
+        case ES_OUT_GET_ES_STATE:
+            va_arg(args, es_out_id_t *);
+            *va_arg(args, bool *) = true;
+            return VLC_SUCCESS;
+        case ES_OUT_GET_EMPTY:
+            *va_arg(args, bool *) = true;
+            return VLC_SUCCESS;
+        case ES_OUT_GET_PCR_SYSTEM:
+        case ES_OUT_MODIFY_PCR_SYSTEM:
+            return VLC_EGENERIC;
+        default:
+            return VLC_SUCCESS;
+    }
+}
+
+static void EsOutDestroy(es_out_t *out)
+{
+    struct bench_es_out *ctx = container_of(out, struct bench_es_out, out);
+    es_out_id_t *id;
+
+    while ((id = ctx->ids) != NULL)
+    {
+        ctx->ids = id->next;
+        EsOutFinish(id);
+        block_ChainRelease(id->blocks);
+        es_format_Clean(&id->fmt);
+        free(id);
+    }
+}
+
+static const struct es_out_callbacks es_out_cbs =
+{
+    .add = EsOutAdd,
+    .send = EsOutSend,
+    .del = EsOutDel,
+    .control = EsOutControl,
+    .destroy = EsOutDestroy,
+};
+
+/** Audio track with the most blocks, once the whole input is demuxed */
+static es_out_id_t *Demux(struct bench_es_out *ctx, const char *url)
+{
+    stream_t *s = vlc_access_NewMRL(ctx->parent, url);
+    if (s == NULL)
+    {
+        fprintf(stderr, "Error: cannot create input stream: %s\n", url);
+        return NULL;
+    }
+
+    demux_t *demux = demux_New(ctx->parent, "any", s, &ctx->out);
+    if (demux == NULL)
+    {
+        vlc_stream_Delete(s);
+        fprintf(stderr, "Error: cannot create demultiplexer\n");
+        return NULL;
+    }
+
+    while (demux_Demux(demux) == VLC_DEMUXER_SUCCESS);
+    demux_Delete(demux);
+
+    es_out_id_t *best = NULL;
+    for (es_out_id_t *id = ctx->ids; id != NULL; id = id->next)
+    {
+        EsOutFinish(id);
+        if (id->fmt.i_cat == AUDIO_ES && id->count > 0
+         && (best == NULL || id->count > best->count))
+            best = id;
+    }
+    return best;
+}
+
+struct bench_decoder
+{
+    decoder_t dec;
+    bool fl32;
+    filter_t *converter;
+    uint64_t samples;
+};
+
+static void ConverterDelete(filter_t *converter)
+{
+    filter_Close(converter);
+    module_unneed(converter, converter->p_module);
+    es_format_Clean(&converter->fmt_in);
+    es_format_Clean(&converter->fmt_out);
+    vlc_object_delete(converter);
+}
+
+static int AudioFormatUpdate(decoder_t *dec)
+{
+    struct bench_decoder *bench = container_of(dec, struct bench_decoder, dec);
+
+    dec->fmt_out.audio.i_format = dec->fmt_out.i_codec;
+    aout_FormatPrepare(&dec->fmt_out.audio);
+
+    if (bench->converter != NULL)
+    {
+        if (AOUT_FMTS_IDENTICAL(&bench->converter->fmt_in.audio,
+                                &dec->fmt_out.audio))
+            return 0;
+        ConverterDelete(bench->converter);
+        bench->converter = NULL;
+    }
+    if (!bench->fl32 || dec->fmt_out.i_codec == VLC_CODEC_FL32)
+        return 0;
+
+    filter_t *converter = vlc_object_create(dec, sizeof (*converter));
+    if (unlikely(converter == NULL))
+        return -1;
+
+    es_format_Init(&converter->fmt_in, AUDIO_ES, dec->fmt_out.i_codec);
+    converter->fmt_in.audio = dec->fmt_out.audio;
+    es_format_Init(&converter->fmt_out, AUDIO_ES, VLC_CODEC_FL32);
+    converter->fmt_out.audio = dec->fmt_out.audio;
+    converter->fmt_out.audio.i_format = VLC_CODEC_FL32;
+    aout_FormatPrepare(&converter->fmt_out.audio);
+
+    converter->p_module = module_need(converter, "audio converter", NULL,
+                                      false);
+    if (converter->p_module == NULL)
+    {
+        fprintf(stderr, "Error: cannot convert %4.4s to FL32\n",
+                (const char *)&dec->fmt_out.i_codec);
+        es_format_Clean(&converter->fmt_in);
+        es_format_Clean(&converter->fmt_out);
+        vlc_object_delete(converter);
+        return -1;
+    }
+    bench->converter = converter;
+    return 0;
+}
+
+static void AudioQueue(decoder_t *dec, block_t *block)
+{
+    struct bench_decoder *bench = container_of(dec, struct bench_decoder, dec);
+
+    bench->samples += block->i_nb_samples;
+    if (bench->converter != NULL)
+        block = bench->converter->ops->filter_audio(bench->converter, block);
+    if (block != NULL)
+        block_Release(block);
+}
+
+static int CompareTicks(const void *a, const void *b)
+{
+    const vlc_tick_t *x = a, *y = b;
+    return (*x > *y) - (*x < *y);
+}
+
+static int Bench(vlc_object_t *parent, const struct vlc_run_args *args,
+                 const es_out_id_t *id, bool fl32, unsigned run)
+{
+    static const struct decoder_owner_callbacks cbs =
+    {
+        .audio = {
+            .format_update = AudioFormatUpdate,
+            .queue = AudioQueue,
+        },
+    };
+
+    /* Copy the input first, so that only the decoder is timed */
+    block_t **blocks = malloc(id->count * sizeof (*blocks));
+    vlc_tick_t *latencies = malloc(id->count * sizeof (*latencies));
+    if (blocks == NULL || latencies == NULL)
+    {
+        free(blocks);
+        free(latencies);
+        return -1;
+    }
+
+    size_t count = 0;
+    for (const block_t *block = id->blocks; block != NULL;
+         block = block->p_next)
+    {
+        blocks[count] = block_Duplicate(block);
+        if (blocks[count] != NULL)
+            count++;
+    }
+    if (count == 0)
+        goto error;
+
+    struct bench_decoder *bench = vlc_object_create(parent, sizeof (*bench));
+    if (unlikely(bench == NULL))
+        goto error;
+
+    decoder_t *dec = &bench->dec;
+    bench->fl32 = fl32;
+    bench->converter = NULL;
+    bench->samples = 0;
+
+    decoder_Init(dec, &id->fmt);
+    dec->cbs = &cbs;
+    dec->p_module = module_need(dec, "audio decoder", args->name,
+                                args->name != NULL);
+    if (dec->p_module == NULL)
+    {
+        fprintf(stderr, "Error: cannot load the %s audio decoder\n",
+                args->name != NULL ? args->name : "any");
+        decoder_Clean(dec);
+        vlc_object_delete(dec);
+        goto error;
+    }
+
+    vlc_tick_t start = vlc_tick_now();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        vlc_tick_t begin = vlc_tick_now();
+        dec->pf_decode(dec, blocks[i]);
+        latencies[i] = vlc_tick_now() - begin;
+    }
+    dec->pf_decode(dec, NULL); /* Drain */
+
+    vlc_tick_t elapsed = vlc_tick_now() - start;
+
+    if (run == 0)
+        printf("decoder %s: %u Hz, %u channels, %zu blocks, %"PRIu64
+               " samples%s\n", module_get_object(dec->p_module),
+               dec->fmt_out.audio.i_rate, dec->fmt_out.audio.i_channels,
+               count, bench->samples, fl32 ? ", converted to FL32" : "");
+
+    qsort(latencies, count, sizeof (*latencies), CompareTicks);
+
+    const double seconds = secf_from_vlc_tick(elapsed > 0 ? elapsed : 1);
+    const double duration = dec->fmt_out.audio.i_rate > 0
+        ? (double)bench->samples / dec->fmt_out.audio.i_rate : 0.;
+    printf("run %u: %8.3f Msamples/s (%7.1fx real time), block latency "
+           "p50 %"PRId64" us, p90 %"PRId64" us, p99 %"PRId64" us, "
+           "max %"PRId64" us\n", run + 1,
+           bench->samples / (1e6 * seconds), duration / seconds,
+           US_FROM_VLC_TICK(latencies[count / 2]),
+           US_FROM_VLC_TICK(latencies[count * 9 / 10]),
+           US_FROM_VLC_TICK(latencies[count * 99 / 100]),
+           US_FROM_VLC_TICK(latencies[count - 1]));
+    fflush(stdout);
+
+    if (bench->converter != NULL)
+        ConverterDelete(bench->converter);
+    decoder_Destroy(dec);
+    free(latencies);
+    free(blocks);
+    return 0;
+
+error:
+    for (size_t i = 0; i < count; i++)
+        block_Release(blocks[i]);
+    free(latencies);
+    free(blocks);
+    return -1;
+}
+
+static int getenv_atoi(const char *name, int def)
+{
+    const char *env = getenv(name);
+    return env != NULL ? atoi(env) : def;
+}
+
+int main(int argc, char *argv[])
+{
+    struct vlc_run_args args;
+    vlc_run_args_init(&args);
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: [VLC_TARGET=decoder] [VLC_BENCH_FL32=1] "
+                "[VLC_BENCH_RUNS=n] %s <filename>\n", argv[0]);
+        return 1;
+    }
+
+    const bool fl32 = getenv_atoi("VLC_BENCH_FL32", 0) != 0;
+    const int runs = getenv_atoi("VLC_BENCH_RUNS", 3);
+
+    char *url = vlc_path2uri(argv[1], NULL);
+    if (url == NULL)
+    {
+        fprintf(stderr, "Error: cannot convert path to URL: %s\n", argv[1]);
+        return 1;
+    }
+
+    libvlc_instance_t *vlc = libvlc_create(&args);
+    if (vlc == NULL)
+    {
+        free(url);
+        return 1;
+    }
+
+    struct bench_es_out ctx = {
+        .out = { .cbs = &es_out_cbs },
+        .parent = VLC_OBJECT(vlc->p_libvlc_int),
+        .ids = NULL,
+    };
+    int ret = 1;
+
+    const es_out_id_t *id = Demux(&ctx, url);
+    if (id == NULL)
+        fprintf(stderr, "Error: no audio track found\n");
+    else
+    {
+        ret = 0;
+        for (int i = 0; i < runs && ret == 0; i++)
+            if (Bench(ctx.parent, &args, id, fl32, i))
+                ret = 1;
+    }
+
+    es_out_Delete(&ctx.out);
+    libvlc_release(vlc);
+    free(url);
+    return ret;
+}